@@ -0,0 +1,104 @@
+// Copyright (C) 2013 Timothy Gale
+// Compaction of a level's significant coefficients (those with magnitude
+// above a threshold) into a list, in two passes either side of a scan of
+// the per-workgroup counts.  Built after scan.cl, which provides
+// exclusiveScan.  WG_SIZE (the workgroup size, a power of two) should be
+// defined externally.
+//
+// Each work item takes one coefficient, numbered through the level slice by
+// slice, then row by row.  The level is a padded ImageBuffer of complex
+// values: start is where the first slice's top-left coefficient is, stride
+// and pitch the distances between rows and slices (all in coefficients).
+
+
+bool isSignificant(__global const float2* input,
+                   unsigned int start, unsigned int stride,
+                   unsigned int pitch,
+                   unsigned int width, unsigned int height,
+                   unsigned int numSlices, float thresholdSq,
+                   uint i, uint* index, uint* slice, float2* value)
+{
+    const uint sliceSize = width * height;
+
+    if (i >= sliceSize * numSlices)
+        return false;
+
+    *slice = i / sliceSize;
+    *index = i - *slice * sliceSize;
+
+    const uint y = *index / width;
+    const uint x = *index - y * width;
+
+    *value = input[start + *slice * pitch + y * stride + x];
+
+    return dot(*value, *value) > thresholdSq;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void countSignificant(__global const float2* input,
+                      unsigned int start, unsigned int stride,
+                      unsigned int pitch,
+                      unsigned int width, unsigned int height,
+                      unsigned int numSlices, float thresholdSq,
+                      __global unsigned int* groupCounts)
+{
+    // How many significant coefficients each workgroup has
+    __local uint buf[WG_SIZE];
+
+    uint index, slice;
+    float2 value;
+    const bool keep = isSignificant(input, start, stride, pitch,
+                                    width, height, numSlices, thresholdSq,
+                                    get_global_id(0),
+                                    &index, &slice, &value);
+
+    uint total;
+    exclusiveScan(keep, buf, &total);
+
+    if (get_local_id(0) == 0)
+        groupCounts[get_group_id(0)] = total;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void scatterSignificant(__global const float2* input,
+                        unsigned int start, unsigned int stride,
+                        unsigned int pitch,
+                        unsigned int width, unsigned int height,
+                        unsigned int numSlices, float thresholdSq,
+                        __global const unsigned int* groupStarts,
+                        unsigned int numGroups,
+                        __global uint4* output,
+                        unsigned int capacity,
+                        __global unsigned int* totals,
+                        unsigned int totalIndex)
+{
+    // Writes each significant coefficient to output as (index within the
+    // slice, slice, real, imaginary), in order, at its workgroup's start
+    // (from scanning countSignificant's counts) plus its rank within the
+    // workgroup.  Anything past capacity is dropped, but the full count
+    // still goes to totals[totalIndex].
+    __local uint buf[WG_SIZE];
+
+    uint index, slice;
+    float2 value;
+    const bool keep = isSignificant(input, start, stride, pitch,
+                                    width, height, numSlices, thresholdSq,
+                                    get_global_id(0),
+                                    &index, &slice, &value);
+
+    uint total;
+    const uint rank = exclusiveScan(keep, buf, &total);
+    const uint pos = groupStarts[get_group_id(0)] + rank;
+
+    if (keep && pos < capacity)
+        output[pos] = (uint4) (index, slice,
+                               as_uint(value.x), as_uint(value.y));
+
+    if (get_global_id(0) == 0)
+        totals[totalIndex] = groupStarts[numGroups];
+}
+
@@ -0,0 +1,10 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef KERNEL_H
+#define KERNEL_H
+
+namespace SparseSubbandsNS {
+    extern const unsigned char kernel_cl[];
+    extern const unsigned int kernel_cl_len;
+}
+
+#endif
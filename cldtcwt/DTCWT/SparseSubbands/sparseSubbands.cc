@@ -0,0 +1,222 @@
+// Copyright (C) 2013 Timothy Gale
+#include "sparseSubbands.h"
+#include "kernel.h"
+#include "MiscKernels/Primitives/scan.h"
+#include "util/clUtil.h"
+
+using namespace SparseSubbandsNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <stdexcept>
+
+
+SparseSubbands::SparseSubbands(cl::Context& context,
+                               const std::vector<cl::Device>& devices)
+   : context_(context),
+     primitives_(context, devices)
+{
+    // Bundle the code up, after the shared workgroup scan
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(
+        reinterpret_cast<const char*>(PrimitivesNS::scan_cl),
+        PrimitivesNS::scan_cl_len));
+    source.push_back(std::make_pair(reinterpret_cast<const char*>(kernel_cl),
+                                    kernel_cl_len));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful parts, i.e. the kernels
+    countKernel_ = cl::Kernel(program, "countSignificant");
+    scatterKernel_ = cl::Kernel(program, "scatterSignificant");
+}
+
+
+
+SparseSubbandsOutput SparseSubbands::createOutputs(const DtcwtOutput& layout,
+                                                   size_t capacity)
+{
+    if (layout.format() != SubbandsComplex)
+        throw std::logic_error("SparseSubbands only takes complex subbands");
+
+    SparseSubbandsOutput output;
+
+    output.startLevel_ = layout.startLevel();
+    output.capacity_ = capacity;
+
+    for (const Subbands& level: layout) {
+        const size_t numCoeffs = level.width() * level.height()
+                               * level.numSlices();
+        const size_t numGroups = roundWGs(numCoeffs, wgSize_) / wgSize_;
+
+        output.lists_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                   std::max<size_t>(capacity, 1)
+                                    * sizeof(SparseCoefficient));
+        output.groupCounts_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                         std::max<size_t>(numGroups, 1)
+                                          * sizeof(cl_uint));
+        output.groupStarts_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                         (numGroups + 1) * sizeof(cl_uint));
+        output.numGroups_.push_back(numGroups);
+    }
+
+    output.totals_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
+                                std::max<size_t>(output.lists_.size(), 1)
+                                 * sizeof(cl_uint));
+
+    return output;
+}
+
+
+
+void SparseSubbands::setLevelArgs_(cl::Kernel& kernel, const Subbands& level,
+                                   float threshold)
+{
+    kernel.setArg(0, level.buffer());
+    kernel.setArg(1, cl_uint(level.start()));
+    kernel.setArg(2, cl_uint(level.stride()));
+    kernel.setArg(3, cl_uint(level.pitch()));
+    kernel.setArg(4, cl_uint(level.width()));
+    kernel.setArg(5, cl_uint(level.height()));
+    kernel.setArg(6, cl_uint(level.numSlices()));
+    kernel.setArg(7, threshold * threshold);
+}
+
+
+
+void SparseSubbands::operator() (cl::CommandQueue& cq,
+                                 const DtcwtOutput& input,
+                                 const std::vector<float>& thresholds,
+                                 SparseSubbandsOutput& output,
+                                 const std::vector<cl::Event>& waitEvents)
+{
+    const size_t numLevels = output.numLevels();
+
+    if (input.format() != SubbandsComplex
+     || input.startLevel() != output.startLevel()
+     || size_t(input.end() - input.begin()) != numLevels)
+        throw std::logic_error("SparseSubbands: output made for different "
+                               "levels");
+
+    if (thresholds.size() != numLevels)
+        throw std::logic_error("SparseSubbands: need a threshold per level");
+
+    output.doneEvents_.resize(numLevels);
+
+    for (size_t n = 0; n < numLevels; ++n) {
+        const Subbands& level = input[n];
+        const size_t numGroups = output.numGroups_[n];
+
+        if (numGroups == 0) {
+            // Nothing to compact, but the total still needs setting
+            const cl_uint zero = 0;
+            cq.enqueueWriteBuffer(output.totals_, CL_TRUE,
+                                  n * sizeof(cl_uint), sizeof(cl_uint),
+                                  &zero, &waitEvents,
+                                  &output.doneEvents_[n]);
+            continue;
+        }
+
+        std::vector<cl::Event> levelWait = waitEvents;
+        for (const cl::Event& e: input.doneEvents(input.startLevel() + n))
+            if (e())
+                levelWait.push_back(e);
+
+        // Count...
+        setLevelArgs_(countKernel_, level, thresholds[n]);
+        countKernel_.setArg(8, output.groupCounts_[n]);
+
+        cl::Event counted;
+        cq.enqueueNDRangeKernel(countKernel_, cl::NullRange,
+                                {numGroups * wgSize_}, {wgSize_},
+                                &levelWait, &counted);
+
+        // ...find where each workgroup's coefficients go (unclamped, so the
+        // last entry is the true total)...
+        std::vector<cl::Event> scanned(1);
+        primitives_.scan(cq, output.groupCounts_[n], numGroups,
+                         output.groupStarts_[n], cl_uint(-1),
+                         {counted}, &scanned[0]);
+
+        // ...and put them there
+        setLevelArgs_(scatterKernel_, level, thresholds[n]);
+        scatterKernel_.setArg(8, output.groupStarts_[n]);
+        scatterKernel_.setArg(9, cl_uint(numGroups));
+        scatterKernel_.setArg(10, output.lists_[n]);
+        scatterKernel_.setArg(11, cl_uint(output.capacity_));
+        scatterKernel_.setArg(12, output.totals_);
+        scatterKernel_.setArg(13, cl_uint(n));
+
+        cq.enqueueNDRangeKernel(scatterKernel_, cl::NullRange,
+                                {numGroups * wgSize_}, {wgSize_},
+                                &scanned, &output.doneEvents_[n]);
+    }
+}
+
+
+
+std::vector<cl_uint> SparseSubbandsOutput::totals(
+    cl::CommandQueue& cq, const std::vector<cl::Event>& waitEvents) const
+{
+    std::vector<cl::Event> events = waitEvents;
+    events.insert(events.end(), doneEvents_.begin(), doneEvents_.end());
+
+    std::vector<cl_uint> result(numLevels());
+    if (!result.empty())
+        cq.enqueueReadBuffer(totals_, CL_TRUE, 0,
+                             result.size() * sizeof(cl_uint), &result[0],
+                             &events);
+    return result;
+}
+
+
+
+void SparseSubbandsOutput::read(
+    cl::CommandQueue& cq,
+    std::vector<std::vector<SparseCoefficient>>& levels,
+    const std::vector<cl::Event>& waitEvents) const
+{
+    const std::vector<cl_uint> counts = totals(cq, waitEvents);
+
+    levels.resize(numLevels());
+
+    // The lists are ready now the totals have been read
+    std::vector<cl::Event> reads;
+    reads.reserve(numLevels());
+    for (size_t n = 0; n < numLevels(); ++n) {
+        levels[n].resize(std::min<size_t>(counts[n], capacity_));
+
+        if (levels[n].empty())
+            continue;
+
+        reads.emplace_back();
+        cq.enqueueReadBuffer(lists_[n], CL_FALSE, 0,
+                             levels[n].size() * sizeof(SparseCoefficient),
+                             &levels[n][0], nullptr, &reads.back());
+    }
+
+    if (!reads.empty())
+        cl::WaitForEvents(reads);
+}
+
+
+
+cl::Buffer SparseSubbandsOutput::list(int levelNum) const
+{
+    return lists_[levelNum - startLevel_];
+}
+
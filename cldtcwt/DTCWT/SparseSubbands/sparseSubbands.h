@@ -0,0 +1,127 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef SPARSESUBBANDS_H
+#define SPARSESUBBANDS_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+
+#include "DTCWT/dtcwt.h"
+#include "MiscKernels/Primitives/primitives.h"
+
+#include <vector>
+
+
+// One significant coefficient, as laid out in the device lists
+struct SparseCoefficient {
+    cl_uint index;              // y * width + x within the level
+    cl_uint orientation;        // Which subband (slice), 0 to 5
+    Complex<cl_float> value;
+};
+
+static_assert(sizeof(SparseCoefficient) == 16,
+              "SparseCoefficient should match the kernel's uint4");
+
+
+class SparseSubbands;
+
+
+class SparseSubbandsOutput {
+    // A list of significant coefficients for each level of a DtcwtOutput,
+    // with the device scratch space needed to produce them
+
+    // Constructed and modified by
+    friend class SparseSubbands;
+
+public:
+
+    SparseSubbandsOutput() = default;
+
+    void read(cl::CommandQueue& cq,
+              std::vector<std::vector<SparseCoefficient>>& levels,
+              const std::vector<cl::Event>& waitEvents
+                = std::vector<cl::Event>()) const;
+    // Reads back the counts, then only as much of each list as is in use.
+    // levels[n] gets the coefficients of level startLevel() + n, in order
+    // of orientation, then row, then column.
+
+    std::vector<cl_uint> totals(cl::CommandQueue& cq,
+                                const std::vector<cl::Event>& waitEvents
+                                    = std::vector<cl::Event>()) const;
+    // How many coefficients each level had over its threshold, which may
+    // be more than its list could hold
+
+    cl::Buffer list(int levelNum) const;
+    // On the device, for further processing: capacity() items
+    cl::Buffer totalsBuffer() const { return totals_; }
+    // numLevels() cl_uints
+
+    size_t capacity() const { return capacity_; }
+    size_t startLevel() const { return startLevel_; }
+    size_t numLevels() const { return lists_.size(); }
+
+    std::vector<cl::Event> doneEvents() const { return doneEvents_; }
+
+private:
+    size_t startLevel_ = 0;
+    size_t capacity_ = 0;
+
+    std::vector<cl::Buffer> lists_;
+    cl::Buffer totals_;
+
+    // Per level: each workgroup's count, then where its items start
+    std::vector<cl::Buffer> groupCounts_, groupStarts_;
+    std::vector<size_t> numGroups_;
+
+    std::vector<cl::Event> doneEvents_;
+};
+
+
+
+class SparseSubbands {
+    // Picks out the coefficients of each DTCWT level whose magnitude is
+    // over that level's threshold, and compacts them into a list on the
+    // device, so that only they need reading back.  Each level takes three
+    // launches: a count per workgroup, a scan of the counts, and a scatter
+    // to the positions the scan gives.
+
+public:
+
+    SparseSubbands() = default;
+    SparseSubbands(const SparseSubbands&) = default;
+    SparseSubbands(cl::Context& context,
+                   const std::vector<cl::Device>& devices);
+
+    SparseSubbandsOutput createOutputs(const DtcwtOutput& layout,
+                                       size_t capacity);
+    // Room for capacity coefficients per level
+
+    void operator() (cl::CommandQueue& cq,
+                     const DtcwtOutput& input,
+                     const std::vector<float>& thresholds,
+                     SparseSubbandsOutput& output,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>());
+    // thresholds holds one magnitude per level, starting at
+    // input.startLevel().  Waits for input's done events as well as
+    // waitEvents; sets output's done events.
+
+private:
+
+    static const size_t wgSize_ = 256;
+
+    cl::Context context_;
+    Primitives primitives_;
+
+    cl::Kernel countKernel_;
+    cl::Kernel scatterKernel_;
+
+    void setLevelArgs_(cl::Kernel& kernel, const Subbands& level,
+                       float threshold);
+};
+
+
+
+#endif
+
@@ -1,6 +1,7 @@
 // Copyright (C) 2013 Timothy Gale
 #include "dtcwt.h"
 #include <cmath>
+#include <stdexcept>
 
 #include "util/clUtil.h"
 
@@ -141,24 +142,48 @@ DtcwtTemps::DtcwtTemps(cl::Context& context,
 
 
 
-DtcwtOutput DtcwtTemps::createOutputs()
+DtcwtOutput DtcwtTemps::createOutputs(SubbandFormat format)
 {
     // Construct an output structure, using the sizes we already know
 
     DtcwtOutput output;
 
+    output.format_ = format;
     output.startLevel_ = startLevel_;
     output.numLevels_ = numLevels_;
 
     for (const auto& levelTemp: levelTemps_)
         if (levelTemp.producesOutputs_) {
 
-            output.levels_.emplace_back(context_, 
-                    CL_MEM_READ_WRITE,
-                    levelTemp.outputWidth_ / 2,
-                    levelTemp.outputHeight_ / 2,
-                    0, 1,
-                    6);
+            const size_t width = levelTemp.outputWidth_ / 2,
+                         height = levelTemp.outputHeight_ / 2;
+
+            switch (format) {
+            case SubbandsComplex:
+                output.levels_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                            width, height, 0, 1, 6);
+                break;
+
+            case SubbandsMagnitude:
+                output.magnitudes_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                                width, height, 0, 1, 6);
+                break;
+
+            case SubbandsPolar:
+                output.polar_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                           width, height, 0, 1, 6);
+                break;
+
+            case SubbandsPlanar:
+                output.planar_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                            width, height, 0, 1);
+                break;
+
+            case SubbandsTiled:
+                output.tiled_.emplace_back(context_, CL_MEM_READ_WRITE,
+                                           width, height);
+                break;
+            }
 
             // Add a three-long vector to the list of wait events
             output.doneEvents_.emplace_back(3);
@@ -174,16 +199,132 @@ DtcwtOutput DtcwtTemps::createOutputs()
 
 Subbands& DtcwtOutput::level(int levelNum)
 {
+    checkFormat(SubbandsComplex);
     return levels_[levelNum-startLevel_];
 }
 
 
 const Subbands& DtcwtOutput::level(int levelNum) const
 {
+    checkFormat(SubbandsComplex);
     return levels_[levelNum-startLevel_];
 }
 
 
+MagnitudeSubbands& DtcwtOutput::magnitudes(int levelNum)
+{
+    checkFormat(SubbandsMagnitude);
+    return magnitudes_[levelNum-startLevel_];
+}
+
+
+const MagnitudeSubbands& DtcwtOutput::magnitudes(int levelNum) const
+{
+    checkFormat(SubbandsMagnitude);
+    return magnitudes_[levelNum-startLevel_];
+}
+
+
+PolarSubbands& DtcwtOutput::polar(int levelNum)
+{
+    checkFormat(SubbandsPolar);
+    return polar_[levelNum-startLevel_];
+}
+
+
+const PolarSubbands& DtcwtOutput::polar(int levelNum) const
+{
+    checkFormat(SubbandsPolar);
+    return polar_[levelNum-startLevel_];
+}
+
+
+PlanarSubbands& DtcwtOutput::planar(int levelNum)
+{
+    checkFormat(SubbandsPlanar);
+    return planar_[levelNum-startLevel_];
+}
+
+
+const PlanarSubbands& DtcwtOutput::planar(int levelNum) const
+{
+    checkFormat(SubbandsPlanar);
+    return planar_[levelNum-startLevel_];
+}
+
+
+TiledSubbands& DtcwtOutput::tiled(int levelNum)
+{
+    checkFormat(SubbandsTiled);
+    return tiled_[levelNum-startLevel_];
+}
+
+
+const TiledSubbands& DtcwtOutput::tiled(int levelNum) const
+{
+    checkFormat(SubbandsTiled);
+    return tiled_[levelNum-startLevel_];
+}
+
+
+template <>
+Subbands& DtcwtOutput::levelAs<Subbands>(int levelNum)
+{
+    return level(levelNum);
+}
+
+
+template <>
+const Subbands& DtcwtOutput::levelAs<Subbands>(int levelNum) const
+{
+    return level(levelNum);
+}
+
+
+template <>
+PlanarSubbands& DtcwtOutput::levelAs<PlanarSubbands>(int levelNum)
+{
+    return planar(levelNum);
+}
+
+
+template <>
+const PlanarSubbands& DtcwtOutput::levelAs<PlanarSubbands>(int levelNum)
+    const
+{
+    return planar(levelNum);
+}
+
+
+template <>
+TiledSubbands& DtcwtOutput::levelAs<TiledSubbands>(int levelNum)
+{
+    return tiled(levelNum);
+}
+
+
+template <>
+const TiledSubbands& DtcwtOutput::levelAs<TiledSubbands>(int levelNum)
+    const
+{
+    return tiled(levelNum);
+}
+
+
+SubbandFormat DtcwtOutput::format() const
+{
+    return format_;
+}
+
+
+void DtcwtOutput::checkFormat(SubbandFormat format) const
+{
+    if (format_ != format)
+        throw std::logic_error("DtcwtOutput: levels asked for in a format "
+                               "the output wasn't created with");
+}
+
+
 std::vector<cl::Event> DtcwtOutput::doneEvents(int levelNum)
 {
     return doneEvents_[levelNum - startLevel_];
@@ -199,36 +340,42 @@ const std::vector<cl::Event> DtcwtOutput::doneEvents(int levelNum) const
 
 Subbands& DtcwtOutput::operator [] (int n)
 {
+    checkFormat(SubbandsComplex);
     return levels_[n];
 }
 
 
 const Subbands& DtcwtOutput::operator [] (int n) const
 {
+    checkFormat(SubbandsComplex);
     return levels_[n];
 }
 
 
 std::vector<Subbands>::iterator DtcwtOutput::begin()
 {
+    checkFormat(SubbandsComplex);
     return levels_.begin();
 }
 
 
 std::vector<Subbands>::const_iterator DtcwtOutput::begin() const
 {
+    checkFormat(SubbandsComplex);
     return levels_.begin();
 }
 
 
 std::vector<Subbands>::iterator DtcwtOutput::end()
 {
+    checkFormat(SubbandsComplex);
     return levels_.end();
 }
 
 
 std::vector<Subbands>::const_iterator DtcwtOutput::end() const
 {
+    checkFormat(SubbandsComplex);
     return levels_.end();
 }
 
@@ -249,7 +396,7 @@ size_t DtcwtOutput::numLevels() const
 
 
 Dtcwt::Dtcwt(cl::Context& context, const std::vector<cl::Device>& devices,
-             float scaleFactor) : 
+             float scaleFactor, SubbandFormat format) : 
 
     context_ {context},
 
@@ -266,7 +413,7 @@ Dtcwt::Dtcwt(cl::Context& context, const std::vector<cl::Device>& devices,
     h1oy {context, devices, h1oCoefs(scaleFactor)},
     h2oy {context, devices, h2oCoefs(scaleFactor)},
 
-    quadToComplex {context, devices},
+    quadToComplex {context, devices, format},
 
     // Decimating
     h0bx {context, devices, h0bCoefs(scaleFactor), false},
@@ -281,7 +428,10 @@ Dtcwt::Dtcwt(cl::Context& context, const std::vector<cl::Device>& devices,
     q2c_h1_h2_h0 {context, devices,
                   h1bCoefs(scaleFactor), true,
                   h2bCoefs(scaleFactor), true,
-                  h0bCoefs(scaleFactor), false}
+                  h0bCoefs(scaleFactor), false,
+                  format},
+
+    format_ {format}
 {}
 
 
@@ -295,6 +445,10 @@ void Dtcwt::operator() (cl::CommandQueue& commandQueue,
                         DtcwtOutput& output,
                         const std::vector<cl::Event>& waitEvents)
 {
+    if (output.format_ != format_)
+        throw std::logic_error("Dtcwt: outputs created for a different "
+                               "subband format");
+
     int outputIdx = 0;
 
     for (int l = 0; l < temps.levelTemps_.size(); ++l) {
@@ -304,11 +458,8 @@ void Dtcwt::operator() (cl::CommandQueue& commandQueue,
             filter(commandQueue, image, waitEvents,
                    temps.levelTemps_[l], 
                    temps.levelTemps_[l].producesOutputs_? 
-                       &output.levels_[0]
-                     : nullptr,
-                   temps.levelTemps_[l].producesOutputs_? 
-                       &output.doneEvents_[0]
-                     : nullptr);
+                       &output : nullptr,
+                   0);
 
         } else {
 
@@ -317,9 +468,8 @@ void Dtcwt::operator() (cl::CommandQueue& commandQueue,
                                {temps.levelTemps_[l-1].loloDone},
                            temps.levelTemps_[l], 
                            temps.levelTemps_[l].producesOutputs_? 
-                               &output.levels_[outputIdx] : nullptr,
-                           temps.levelTemps_[l].producesOutputs_? 
-                               &output.doneEvents_[outputIdx] : nullptr);
+                               &output : nullptr,
+                           outputIdx);
 
         }
         
@@ -337,11 +487,10 @@ void Dtcwt::filter(cl::CommandQueue& commandQueue,
                    ImageBuffer<cl_float>& xx, 
                    const std::vector<cl::Event>& xxEvents,
                    LevelTemps& levelTemps, 
-                   Subbands* subbands,
-                   std::vector<cl::Event>* events)
+                   DtcwtOutput* output, size_t outputIdx)
 {
-    // Events are the events which, when done, signal that the Subband
-    // outputs are complete
+    // The output's done events for the level are set to the events which,
+    // when done, signal that the Subband outputs are complete
 
     // Definitely need to do this padding, whether outputs or not
     cl::Event xxPadded;
@@ -358,7 +507,7 @@ void Dtcwt::filter(cl::CommandQueue& commandQueue,
          {loPadded}, &levelTemps.loloDone);
 
     // If we've been given subbands to output to, we need to do more work:
-    if (subbands) {
+    if (output) {
 
         // Produce both the other vertically-filtered versions
         h1ox(commandQueue, xx, levelTemps.hi,
@@ -383,20 +532,21 @@ void Dtcwt::filter(cl::CommandQueue& commandQueue,
 
         // Create events that, when all done signify everything about this stage
         // is complete
-        *events = std::vector<cl::Event>(3);
+        std::vector<cl::Event>& events = output->doneEvents_[outputIdx];
+        events = std::vector<cl::Event>(3);
 
         // ...and generate subband outputs.
-        quadToComplex(commandQueue, levelTemps.lohi, 
-                      *subbands, 2, 3,
-                      {levelTemps.lohiDone}, &(*events)[0]); 
+        quadToComplex_(commandQueue, levelTemps.lohi, 
+                       *output, outputIdx, 2, 3,
+                       {levelTemps.lohiDone}, &events[0]); 
 
-        quadToComplex(commandQueue, levelTemps.hilo, 
-                      *subbands, 0, 5,
-                      {levelTemps.hiloDone}, &(*events)[1]); 
+        quadToComplex_(commandQueue, levelTemps.hilo, 
+                       *output, outputIdx, 0, 5,
+                       {levelTemps.hiloDone}, &events[1]); 
 
-        quadToComplex(commandQueue, levelTemps.bpbp, 
-                      *subbands, 1, 4,
-                      {levelTemps.bpbpDone}, &(*events)[2]); 
+        quadToComplex_(commandQueue, levelTemps.bpbp, 
+                       *output, outputIdx, 1, 4,
+                       {levelTemps.bpbpDone}, &events[2]); 
  
     }
 }
@@ -406,17 +556,16 @@ void Dtcwt::decimateFilter(cl::CommandQueue& commandQueue,
                            ImageBuffer<cl_float>& xx, 
                            const std::vector<cl::Event>& xxEvents,
                            LevelTemps& levelTemps, 
-                           Subbands* subbands,
-                           std::vector<cl::Event>* events)
+                           DtcwtOutput* output, size_t outputIdx)
 {
-    // Events are the events which, when done, signal that the Subband
-    // outputs are complete
+    // The output's done events for the level are set to the events which,
+    // when done, signal that the Subband outputs are complete
 
     // Definitely need to do this padding, whether outputs or not
     cl::Event xxPadded;
     padX(commandQueue, xx, xxEvents, &xxPadded);
 
-    if (subbands == nullptr) {
+    if (output == nullptr) {
 
         // Apply the non-decimating, low-pass filters both ways
         h0bx(commandQueue, xx, levelTemps.lo, 
@@ -437,7 +586,8 @@ void Dtcwt::decimateFilter(cl::CommandQueue& commandQueue,
 
         // Create events that, when all done signify everything about this stage
         // is complete
-        *events = std::vector<cl::Event>(1);
+        std::vector<cl::Event>& events = output->doneEvents_[outputIdx];
+        events = std::vector<cl::Event>(1);
 
         cl::Event loPadded, hiPadded, bpPadded;
         padY(commandQueue, levelTemps.lo, {levelTemps.loDone}, &loPadded);
@@ -449,15 +599,88 @@ void Dtcwt::decimateFilter(cl::CommandQueue& commandQueue,
              {loPadded}, &levelTemps.loloDone);
 
         // ...and filter in the y direction, generating subband outputs.
-        q2c_h1_h2_h0(commandQueue, levelTemps.lo, *subbands,
-                     {loPadded, bpPadded, hiPadded},
-                     &(*events)[0]);
+        q2cDecimateFilter_(commandQueue, levelTemps.lo, *output, outputIdx,
+                           {loPadded, bpPadded, hiPadded},
+                           &events[0]);
      
     }
 }
 
 
 
+void Dtcwt::quadToComplex_(cl::CommandQueue& commandQueue,
+                           ImageBuffer<cl_float>& input,
+                           DtcwtOutput& output, size_t outputIdx,
+                           size_t idx0, size_t idx1,
+                           const std::vector<cl::Event>& waitEvents,
+                           cl::Event* doneEvent)
+{
+    switch (format_) {
+    case SubbandsComplex:
+        quadToComplex(commandQueue, input, output.levels_[outputIdx],
+                      idx0, idx1, waitEvents, doneEvent);
+        break;
+
+    case SubbandsMagnitude:
+        quadToComplex(commandQueue, input, output.magnitudes_[outputIdx],
+                      idx0, idx1, waitEvents, doneEvent);
+        break;
+
+    case SubbandsPolar:
+        quadToComplex(commandQueue, input, output.polar_[outputIdx],
+                      idx0, idx1, waitEvents, doneEvent);
+        break;
+
+    case SubbandsPlanar:
+        quadToComplex(commandQueue, input, output.planar_[outputIdx],
+                      idx0, idx1, waitEvents, doneEvent);
+        break;
+
+    case SubbandsTiled:
+        quadToComplex(commandQueue, input, output.tiled_[outputIdx],
+                      idx0, idx1, waitEvents, doneEvent);
+        break;
+    }
+}
+
+
+
+void Dtcwt::q2cDecimateFilter_(cl::CommandQueue& commandQueue,
+                               ImageBuffer<cl_float>& input,
+                               DtcwtOutput& output, size_t outputIdx,
+                               const std::vector<cl::Event>& waitEvents,
+                               cl::Event* doneEvent)
+{
+    switch (format_) {
+    case SubbandsComplex:
+        q2c_h1_h2_h0(commandQueue, input, output.levels_[outputIdx],
+                     waitEvents, doneEvent);
+        break;
+
+    case SubbandsMagnitude:
+        q2c_h1_h2_h0(commandQueue, input, output.magnitudes_[outputIdx],
+                     waitEvents, doneEvent);
+        break;
+
+    case SubbandsPolar:
+        q2c_h1_h2_h0(commandQueue, input, output.polar_[outputIdx],
+                     waitEvents, doneEvent);
+        break;
+
+    case SubbandsPlanar:
+        q2c_h1_h2_h0(commandQueue, input, output.planar_[outputIdx],
+                     waitEvents, doneEvent);
+        break;
+
+    case SubbandsTiled:
+        q2c_h1_h2_h0(commandQueue, input, output.tiled_[outputIdx],
+                     waitEvents, doneEvent);
+        break;
+    }
+}
+
+
+
 
 
 
@@ -8,6 +8,7 @@
 #include "CL/cl.hpp"
 
 #include "Filter/imageBuffer.h"
+#include "Filter/subbandFormat.h"
 
 #include "Filter/PadX/padX.h"
 #include "Filter/PadY/padY.h"
@@ -29,6 +30,7 @@
 class Dtcwt;
 class DtcwtTemps;
 class DtcwtOutput;
+class SubbandReplay;
 
 // Temporary images used in the production of an output level
 struct LevelTemps {
@@ -78,7 +80,8 @@ private:
     std::vector<LevelTemps> levelTemps_;
 
 public:
-    DtcwtOutput createOutputs();
+    DtcwtOutput createOutputs(SubbandFormat format = SubbandsComplex);
+    // format must match the Dtcwt that will fill them
 
     DtcwtTemps(cl::Context& context,
                size_t imageWidth, size_t imageHeight, 
@@ -89,28 +92,43 @@ public:
 
 
 typedef ImageBuffer<Complex<cl_float>> Subbands;
+typedef ImageBuffer<cl_float> MagnitudeSubbands;
+typedef ImageBuffer<cl_uint> PolarSubbands;
 
 
 class DtcwtOutput {
 
     // Constructed by
     friend class DtcwtTemps;
+    friend class SubbandReplay;
 
     // Modified by
     friend class Dtcwt;
 
 private:
+    // Only the levels for format_ are allocated
+    SubbandFormat format_ = SubbandsComplex;
     std::vector<Subbands> levels_;
+    std::vector<MagnitudeSubbands> magnitudes_;
+    std::vector<PolarSubbands> polar_;
+    std::vector<PlanarSubbands> planar_;
+    std::vector<TiledSubbands> tiled_;
+
     std::vector<std::vector<cl::Event>> doneEvents_;
 
     size_t startLevel_;
     size_t numLevels_;
 
+    void checkFormat(SubbandFormat format) const;
+    // Throws std::logic_error unless the output is in format
+
 public:
 
 
     // Return the specified level (1 is the first level of the tree,
-    // etc)
+    // etc).  These and the iterators are for SubbandsComplex outputs; in
+    // the other formats there are no complex levels, and they throw
+    // std::logic_error.  Likewise for the accessors below.
     Subbands& level(int levelNum);
     const Subbands& level(int levelNum) const;
 
@@ -127,6 +145,29 @@ public:
     std::vector<Subbands>::const_iterator end() const;
 
 
+    // The specified level in the other formats: SubbandsMagnitude and
+    // SubbandsPolar respectively
+    MagnitudeSubbands& magnitudes(int levelNum);
+    const MagnitudeSubbands& magnitudes(int levelNum) const;
+    PolarSubbands& polar(int levelNum);
+    const PolarSubbands& polar(int levelNum) const;
+
+    // ...and SubbandsPlanar and SubbandsTiled
+    PlanarSubbands& planar(int levelNum);
+    const PlanarSubbands& planar(int levelNum) const;
+    TiledSubbands& tiled(int levelNum);
+    const TiledSubbands& tiled(int levelNum) const;
+
+    // The specified level as Level, one of Subbands, PlanarSubbands or
+    // TiledSubbands, so that code templated on the layout (see
+    // SubbandLayout) can work with any
+    template <typename Level>
+    Level& levelAs(int levelNum);
+    template <typename Level>
+    const Level& levelAs(int levelNum) const;
+
+    SubbandFormat format() const;
+
     std::vector<cl::Event> doneEvents(int levelNum);
     const std::vector<cl::Event> doneEvents(int levelNum) const;
 
@@ -136,6 +177,22 @@ public:
 };
 
 
+template <>
+Subbands& DtcwtOutput::levelAs<Subbands>(int levelNum);
+template <>
+const Subbands& DtcwtOutput::levelAs<Subbands>(int levelNum) const;
+template <>
+PlanarSubbands& DtcwtOutput::levelAs<PlanarSubbands>(int levelNum);
+template <>
+const PlanarSubbands& DtcwtOutput::levelAs<PlanarSubbands>(int levelNum)
+    const;
+template <>
+TiledSubbands& DtcwtOutput::levelAs<TiledSubbands>(int levelNum);
+template <>
+const TiledSubbands& DtcwtOutput::levelAs<TiledSubbands>(int levelNum)
+    const;
+
+
 
 
 
@@ -162,21 +219,36 @@ private:
     const size_t padding_ = 16;
     const size_t alignment_ = 32;
 
+    SubbandFormat format_ = SubbandsComplex;
+
+    // Complex conversion into whichever of output's levels format_ uses
+    void quadToComplex_(cl::CommandQueue& commandQueue,
+                        ImageBuffer<cl_float>& input,
+                        DtcwtOutput& output, size_t outputIdx,
+                        size_t idx0, size_t idx1,
+                        const std::vector<cl::Event>& waitEvents,
+                        cl::Event* doneEvent);
+
+    void q2cDecimateFilter_(cl::CommandQueue& commandQueue,
+                            ImageBuffer<cl_float>& input,
+                            DtcwtOutput& output, size_t outputIdx,
+                            const std::vector<cl::Event>& waitEvents,
+                            cl::Event* doneEvent);
+
 // Debug:
 public:
     void filter(cl::CommandQueue& commandQueue,
                 ImageBuffer<cl_float>& xx, 
                 const std::vector<cl::Event>& xxEvents,
                 LevelTemps& levelTemps, 
-                Subbands* subbands,
-                std::vector<cl::Event>* events);
+                DtcwtOutput* output, size_t outputIdx);
 
     void decimateFilter(cl::CommandQueue& commandQueue,
                         ImageBuffer<cl_float>& xx, 
                         const std::vector<cl::Event>& xxEvents,
                         LevelTemps& levelTemps, 
-                        Subbands* subbands,
-                        std::vector<cl::Event>* events);
+                        DtcwtOutput* output, size_t outputIdx);
+    // output is null if the level produces no outputs
 
 public:
 
@@ -184,10 +256,22 @@ public:
     Dtcwt(const Dtcwt&) = default;
 
     Dtcwt(cl::Context& context, const std::vector<cl::Device>& devices,
-          float scaleFactor = 1.f);
+          float scaleFactor = 1.f,
+          SubbandFormat format = SubbandsComplex);
     // Scale factor selects how much to multiply each level by,
     // cumulatively.  0.5 is useful in quite a few cases, because otherwise
     // the coarser scales have much greater magnitudes.
+    //
+    // format selects what the subbands hold.  Magnitudes, or magnitudes
+    // with quantised phases packed in, are produced by the same kernels
+    // that form the complex coefficients, rather than by a separate pass,
+    // and take half the memory.  Planar keeps the complex coefficients but
+    // splits their parts into separate slices, for consumers that would
+    // rather not deinterleave them, and tiled keeps them interleaved but
+    // in small square tiles, for consumers that sample scattered
+    // neighbourhoods.  Outputs must be created with the same format.
+
+    SubbandFormat format() const { return format_; }
 
     void operator() (cl::CommandQueue& commandQueue,
                      ImageBuffer<cl_float>& image, 
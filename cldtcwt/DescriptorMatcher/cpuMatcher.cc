@@ -0,0 +1,144 @@
+// Copyright (C) 2013 Timothy Gale
+#include "cpuMatcher.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+
+static float squaredDistance(const float* a, const float* b)
+{
+#ifdef __SSE__
+    // Two accumulators to keep the adds independent
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+
+    static_assert(descriptorLength % 8 == 0,
+                  "Descriptor length must be a multiple of 8");
+
+    for (size_t n = 0; n < descriptorLength; n += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + n), _mm_loadu_ps(b + n));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + n + 4),
+                               _mm_loadu_ps(b + n + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+
+    float parts[4];
+    _mm_storeu_ps(parts, _mm_add_ps(acc0, acc1));
+    return (parts[0] + parts[1]) + (parts[2] + parts[3]);
+#else
+    float acc = 0.f;
+    for (size_t n = 0; n < descriptorLength; ++n) {
+        float d = a[n] - b[n];
+        acc += d * d;
+    }
+    return acc;
+#endif
+}
+
+
+
+KnnMatches CPUMatcher::operator() (const float* query, size_t numQuery,
+                                   const float* train, size_t numTrain,
+                                   const MatchSettings& settings)
+{
+    checkMatchSettings(settings);
+
+    // A half turn is the same whichever way it is reached
+    const int minRotation = (settings.maxRotation == maxRotationSteps)?
+                                1 - settings.maxRotation
+                              : -settings.maxRotation;
+    const size_t numRotations = settings.maxRotation - minRotation + 1;
+
+    const size_t k = settings.k;
+
+    KnnMatches results;
+    results.k = k;
+    results.indices.assign(numQuery * k, -1);
+    results.distances.assign(numQuery * k,
+                             std::numeric_limits<float>::infinity());
+    results.rotations.assign(numQuery * k, 0);
+
+    rotated_.resize(queryBlock_ * numRotations * descriptorLength);
+
+    for (size_t q0 = 0; q0 < numQuery; q0 += queryBlock_) {
+
+        const size_t qEnd = std::min(q0 + queryBlock_, numQuery);
+
+        // Every rotation of each query in the block
+        for (size_t q = q0; q < qEnd; ++q)
+            for (size_t r = 0; r < numRotations; ++r)
+                rotateDescriptor(&query[q * descriptorLength],
+                                 minRotation + int(r),
+                                 &rotated_[((q - q0) * numRotations + r)
+                                            * descriptorLength]);
+
+        for (size_t t0 = 0; t0 < numTrain; t0 += trainBlock_) {
+
+            const size_t tEnd = std::min(t0 + trainBlock_, numTrain);
+
+            for (size_t q = q0; q < qEnd; ++q) {
+
+                int* bestIdx = &results.indices[q * k];
+                float* bestDist = &results.distances[q * k];
+                int* bestRot = &results.rotations[q * k];
+
+                const float* rotations
+                    = &rotated_[(q - q0) * numRotations * descriptorLength];
+
+                for (size_t t = t0; t < tEnd; ++t) {
+
+                    const float* b = &train[t * descriptorLength];
+
+                    float dist = std::numeric_limits<float>::infinity();
+                    int rot = 0;
+                    for (size_t r = 0; r < numRotations; ++r) {
+                        float d = squaredDistance(
+                                    &rotations[r * descriptorLength], b);
+                        if (d < dist) {
+                            dist = d;
+                            rot = minRotation + int(r);
+                        }
+                    }
+
+                    // Insert into the sorted list of the best so far
+                    if (dist < bestDist[k - 1]) {
+                        size_t pos = k - 1;
+                        while (pos > 0 && dist < bestDist[pos - 1]) {
+                            bestIdx[pos] = bestIdx[pos - 1];
+                            bestDist[pos] = bestDist[pos - 1];
+                            bestRot[pos] = bestRot[pos - 1];
+                            --pos;
+                        }
+                        bestIdx[pos] = int(t);
+                        bestDist[pos] = dist;
+                        bestRot[pos] = rot;
+                    }
+                }
+            }
+        }
+    }
+
+    return results;
+}
+
+
+
+KnnMatches CPUMatcher::operator() (const std::vector<float>& query,
+                                   const std::vector<float>& train,
+                                   const MatchSettings& settings)
+{
+    if (query.size() % descriptorLength != 0
+     || train.size() % descriptorLength != 0)
+        throw std::logic_error("CPUMatcher: input not a whole number of "
+                               "descriptors");
+
+    return (*this)(query.data(), query.size() / descriptorLength,
+                   train.data(), train.size() / descriptorLength,
+                   settings);
+}
+
@@ -0,0 +1,41 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef CPUMATCHER_H
+#define CPUMATCHER_H
+
+#include <vector>
+#include <cstddef>
+
+#include "matches.h"
+
+
+
+class CPUMatcher {
+// Brute-force k-nearest-neighbour matching of descriptors on the host,
+// giving the same results as DescriptorMatcher (up to rounding).  Distances
+// use SSE where the compiler has it.  Each query is rotated once for each
+// rotation tried, so that every distance is between two contiguous
+// descriptors; the work goes through blocks of queries and train
+// descriptors small enough to stay in cache.
+
+public:
+
+    KnnMatches operator() (const float* query, size_t numQuery,
+                           const float* train, size_t numTrain,
+                           const MatchSettings& settings);
+    // query and train hold descriptors of descriptorLength floats each
+
+    KnnMatches operator() (const std::vector<float>& query,
+                           const std::vector<float>& train,
+                           const MatchSettings& settings);
+
+private:
+    std::vector<float> rotated_;
+
+    static const size_t queryBlock_ = 16;
+    static const size_t trainBlock_ = 64;
+};
+
+
+
+#endif
+
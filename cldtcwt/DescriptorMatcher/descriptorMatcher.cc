@@ -0,0 +1,121 @@
+// Copyright (C) 2013 Timothy Gale
+#include "descriptorMatcher.h"
+#include "util/clUtil.h"
+#include "kernel.h"
+
+using namespace DescriptorMatcherNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <stdexcept>
+
+
+DescriptorMatcher::DescriptorMatcher(cl::Context& context,
+                                     const std::vector<cl::Device>& devices)
+   : context_(context)
+{
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (kernel_cl);
+    size_t fileTextLength = kernel_cl_len;
+
+    // Bundle the code up
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(fileText, fileTextLength));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_
+                        << " -D TRAIN_TILE=" << trainTile_
+                        << " -D MAX_K=" << maxMatchK;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful part, viz the kernel
+    kernel_ = cl::Kernel(program, "matchKnn");
+}
+
+
+
+
+void DescriptorMatcher::operator()
+      (cl::CommandQueue& commandQueue,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       const MatchSettings& settings,
+       cl::Buffer& indices, cl::Buffer& distances, cl::Buffer& rotations,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    checkMatchSettings(settings);
+
+    // No queries, no matches; just keep the events in order
+    if (numQuery == 0) {
+        if (!waitEvents.empty())
+            commandQueue.enqueueWaitForEvents(waitEvents);
+        if (doneEvent != nullptr)
+            commandQueue.enqueueMarker(doneEvent);
+        return;
+    }
+
+    kernel_.setArg(0, query);
+    kernel_.setArg(1, cl_uint(numQuery));
+    kernel_.setArg(2, train);
+    kernel_.setArg(3, cl_uint(numTrain));
+    kernel_.setArg(4, cl_uint(settings.k));
+    kernel_.setArg(5, cl_int(settings.maxRotation));
+    kernel_.setArg(6, indices);
+    kernel_.setArg(7, distances);
+    kernel_.setArg(8, rotations);
+
+    const size_t globalSize = roundWGs(numQuery, wgSize_);
+
+    commandQueue.enqueueNDRangeKernel(kernel_, cl::NullRange,
+                                      {globalSize}, {wgSize_},
+                                      &waitEvents, doneEvent);
+}
+
+
+
+KnnMatches DescriptorMatcher::operator()
+      (cl::CommandQueue& commandQueue,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       const MatchSettings& settings,
+       const std::vector<cl::Event>& waitEvents)
+{
+    KnnMatches results;
+    results.k = settings.k;
+
+    checkMatchSettings(settings);
+
+    if (numQuery == 0)
+        return results;
+
+    const size_t numResults = numQuery * settings.k;
+
+    cl::Buffer indices(context_, CL_MEM_READ_WRITE,
+                       numResults * sizeof(cl_int)),
+               distances(context_, CL_MEM_READ_WRITE,
+                         numResults * sizeof(cl_float)),
+               rotations(context_, CL_MEM_READ_WRITE,
+                         numResults * sizeof(cl_int));
+
+    (*this)(commandQueue, query, numQuery, train, numTrain, settings,
+            indices, distances, rotations, waitEvents);
+
+    results.indices = readBuffer<int>(commandQueue, indices);
+    results.distances = readBuffer<float>(commandQueue, distances);
+    results.rotations = readBuffer<int>(commandQueue, rotations);
+
+    return results;
+}
+
@@ -0,0 +1,59 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef DESCRIPTORMATCHER_H
+#define DESCRIPTORMATCHER_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+#include "matches.h"
+
+
+
+class DescriptorMatcher {
+// Brute-force k-nearest-neighbour matching of descriptors on the device,
+// optionally searching over rotations of the query (cyclic shifts of the
+// ring, with the subbands shifted to match).  Each work item takes one
+// query; the train descriptors are worked through in tiles held in local
+// memory, shared by the workgroup.
+
+public:
+
+    DescriptorMatcher() = default;
+    DescriptorMatcher(const DescriptorMatcher&) = default;
+    DescriptorMatcher(cl::Context& context,
+                      const std::vector<cl::Device>& devices);
+
+    void operator() (cl::CommandQueue& commandQueue,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       const MatchSettings& settings,
+       cl::Buffer& indices, cl::Buffer& distances, cl::Buffer& rotations,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // query and train hold descriptors of descriptorLength floats each.
+    // indices and rotations (ints) and distances (floats) need room for
+    // numQuery * settings.k each, laid out as in KnnMatches.  numQuery may
+    // be zero, when nothing is written.
+
+    KnnMatches operator() (cl::CommandQueue& commandQueue,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       const MatchSettings& settings,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>());
+    // As above, but waits for and reads back the results
+
+private:
+    cl::Context context_;
+    cl::Kernel kernel_;
+
+    static const size_t wgSize_ = 64;
+    static const size_t trainTile_ = 16;
+};
+
+
+
+#endif
+
@@ -0,0 +1,146 @@
+// Copyright (C) 2013 Timothy Gale
+// Brute-force k-nearest-neighbour matching of polar descriptors, with a
+// search over rotations.  WG_SIZE, TRAIN_TILE (train descriptors held in
+// local memory at once) and MAX_K should be defined externally.
+//
+// A descriptor is NUM_SAMPLES x NUM_SUBBANDS complex values, sample-major:
+// sample 0 the centre, 1 to 12 a ring at 30 degree steps, and 13 the centre
+// at the coarser level.  Rotating by one step moves each ring sample on by
+// one and each subband back by one, the subband conjugated when it wraps
+// round (the wavelet turned by 180 degrees being the conjugate one).
+
+#define NUM_SAMPLES 14
+#define NUM_SUBBANDS 6
+#define RING_LENGTH 12
+#define DESC_LEN (NUM_SAMPLES * NUM_SUBBANDS)
+#define MAX_ROTATIONS (RING_LENGTH + 1)
+
+#define CONJ_FLAG 0x8000
+
+
+ushort rotatedIndex(int e, int r)
+{
+    // Where element e of a descriptor ends up when rotated by r steps, with
+    // CONJ_FLAG set if it should be conjugated
+    const int s = e / NUM_SUBBANDS, k = e % NUM_SUBBANDS;
+
+    const int sOut = (s == 0 || s == NUM_SAMPLES - 1)?
+                        s : 1 + (s - 1 + r + 2 * RING_LENGTH) % RING_LENGTH;
+
+    const int kShifted = k - r + 2 * NUM_SUBBANDS;
+    const int kOut = kShifted % NUM_SUBBANDS;
+    const bool conj = ((kShifted / NUM_SUBBANDS) & 1) == 1;
+
+    return (ushort) (sOut * NUM_SUBBANDS + kOut) | (conj? CONJ_FLAG : 0);
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void matchKnn(__global const float2* query,
+              unsigned int numQuery,
+              __global const float2* train,
+              unsigned int numTrain,
+              unsigned int k,
+              int maxRotation,
+              __global int* knnIndices,
+              __global float* knnDistances,
+              __global int* knnRotations)
+{
+    // Each work item finds the k nearest train descriptors to one query,
+    // by squared Euclidean distance, minimised over rotations from
+    // -maxRotation to maxRotation steps (0 to 6).  Rotation r means the
+    // query turned by r steps matches the train descriptor.  Results are in
+    // order of distance, with -1 indices for any not found.  Ties go to the
+    // lower train index, then the rotation nearest -maxRotation.
+    __local float2 tile[TRAIN_TILE * DESC_LEN];
+    __local ushort rotMap[MAX_ROTATIONS * DESC_LEN];
+
+    const uint q = get_global_id(0), l = get_local_id(0);
+    const bool valid = q < numQuery;
+
+    // A half turn is the same whichever way it is reached
+    const int minRotation = (maxRotation == RING_LENGTH / 2)?
+                                1 - maxRotation : -maxRotation;
+    const int numRotations = maxRotation - minRotation + 1;
+
+    for (int i = l; i < numRotations * DESC_LEN; i += WG_SIZE)
+        rotMap[i] = rotatedIndex(i % DESC_LEN, minRotation + i / DESC_LEN);
+
+    float2 desc[DESC_LEN];
+    if (valid)
+        for (int e = 0; e < DESC_LEN; ++e)
+            desc[e] = query[q * DESC_LEN + e];
+
+    int bestIdx[MAX_K];
+    float bestDist[MAX_K];
+    int bestRot[MAX_K];
+    for (int n = 0; n < MAX_K; ++n) {
+        bestIdx[n] = -1;
+        bestDist[n] = INFINITY;
+        bestRot[n] = 0;
+    }
+
+    for (uint base = 0; base < numTrain; base += TRAIN_TILE) {
+
+        const uint n = min((uint) TRAIN_TILE, numTrain - base);
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (uint i = l; i < n * DESC_LEN; i += WG_SIZE)
+            tile[i] = train[base * DESC_LEN + i];
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (!valid)
+            continue;
+
+        for (uint t = 0; t < n; ++t) {
+
+            __local const float2* b = &tile[t * DESC_LEN];
+
+            float dist = INFINITY;
+            int rot = 0;
+
+            for (int ri = 0; ri < numRotations; ++ri) {
+
+                __local const ushort* map = &rotMap[ri * DESC_LEN];
+
+                float d = 0.f;
+                for (int e = 0; e < DESC_LEN; ++e) {
+                    ushort m = map[e];
+                    float2 a = desc[e];
+                    if (m & CONJ_FLAG)
+                        a.y = -a.y;
+                    float2 diff = a - b[m & ~CONJ_FLAG];
+                    d += dot(diff, diff);
+                }
+
+                if (d < dist) {
+                    dist = d;
+                    rot = minRotation + ri;
+                }
+            }
+
+            // Insert into the sorted list of the best so far
+            if (dist < bestDist[k - 1]) {
+                int pos = k - 1;
+                while (pos > 0 && dist < bestDist[pos - 1]) {
+                    bestIdx[pos] = bestIdx[pos - 1];
+                    bestDist[pos] = bestDist[pos - 1];
+                    bestRot[pos] = bestRot[pos - 1];
+                    --pos;
+                }
+                bestIdx[pos] = base + t;
+                bestDist[pos] = dist;
+                bestRot[pos] = rot;
+            }
+        }
+    }
+
+    if (valid)
+        for (uint n = 0; n < k; ++n) {
+            knnIndices[q * k + n] = bestIdx[n];
+            knnDistances[q * k + n] = bestDist[n];
+            knnRotations[q * k + n] = bestRot[n];
+        }
+}
+
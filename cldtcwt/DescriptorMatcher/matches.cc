@@ -0,0 +1,90 @@
+// Copyright (C) 2013 Timothy Gale
+#include "matches.h"
+
+#include <stdexcept>
+
+
+std::vector<Match> selectMatches(const KnnMatches& forward,
+                                 float maxRatio,
+                                 const KnnMatches* backward)
+{
+    if (forward.k == 0)
+        throw std::logic_error("selectMatches: no neighbours");
+
+    if (maxRatio < 1.f && forward.k < 2)
+        throw std::logic_error("selectMatches: ratio test needs at least "
+                               "two neighbours");
+
+    // The distances are squared
+    const float maxRatioSq = maxRatio * maxRatio;
+
+    std::vector<Match> matches;
+
+    for (size_t q = 0; q < forward.numQueries(); ++q) {
+
+        const size_t first = q * forward.k;
+        const int t = forward.indices[first];
+        if (t < 0)
+            continue;
+
+        if (maxRatio < 1.f && forward.indices[first + 1] >= 0
+         && !(forward.distances[first]
+               < maxRatioSq * forward.distances[first + 1]))
+            continue;
+
+        if (backward != nullptr) {
+            if (size_t(t) >= backward->numQueries()
+             || backward->indices[t * backward->k] != int(q))
+                continue;
+        }
+
+        Match match = {int(q), t, forward.distances[first],
+                       forward.rotations[first]};
+        matches.push_back(match);
+    }
+
+    return matches;
+}
+
+
+
+void rotateDescriptor(const float* in, int steps, float* out)
+{
+    const int numSubbands = descriptorNumSubbands,
+              ringLength = descriptorRingLength;
+
+    for (int s = 0; s < int(descriptorNumSamples); ++s) {
+
+        const int sOut = (s == 0 || s == int(descriptorNumSamples) - 1)?
+                           s : 1 + ((s - 1 + steps) % ringLength
+                                     + ringLength) % ringLength;
+
+        for (int k = 0; k < numSubbands; ++k) {
+
+            // Floor division, to count the wraps
+            int kShifted = k - steps;
+            int wraps = (kShifted >= 0)? kShifted / numSubbands
+                                       : -((numSubbands - 1 - kShifted)
+                                            / numSubbands);
+            int kOut = kShifted - wraps * numSubbands;
+            bool conj = (wraps % 2) != 0;
+
+            const float* src = &in[2 * (s * numSubbands + k)];
+            float* dst = &out[2 * (sOut * numSubbands + kOut)];
+            dst[0] = src[0];
+            dst[1] = conj? -src[1] : src[1];
+        }
+    }
+}
+
+
+
+void checkMatchSettings(const MatchSettings& settings)
+{
+    if (settings.k < 1 || settings.k > maxMatchK)
+        throw std::logic_error("Matcher: k out of range");
+
+    if (settings.maxRotation < 0 || settings.maxRotation > maxRotationSteps)
+        throw std::logic_error("Matcher: maxRotation out of range");
+}
+
@@ -0,0 +1,75 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef MATCHES_H
+#define MATCHES_H
+
+#include <vector>
+#include <cstddef>
+
+// Things shared by the OpenCL and CPU descriptor matchers.  Descriptors are
+// as DescriptorExtracter produces them: 14 samples of 6 subbands, each a
+// complex number stored as two floats.  Sample 0 is the centre, 1 to 12 a
+// ring at 30 degree steps, and 13 the centre at the next level down.
+
+
+const size_t descriptorNumSamples = 14;
+const size_t descriptorNumSubbands = 6;
+const size_t descriptorRingLength = 12;
+const size_t descriptorLength = 2 * descriptorNumSamples
+                                  * descriptorNumSubbands;
+
+const size_t maxMatchK = 8;
+const int maxRotationSteps = descriptorRingLength / 2;
+
+
+struct MatchSettings {
+    size_t k;               // Nearest neighbours to find, 1 to maxMatchK
+    int maxRotation;        // Try rotating the query by -maxRotation to
+                            // maxRotation steps of 30 degrees, 0 to
+                            // maxRotationSteps
+};
+
+
+struct KnnMatches {
+    // The k nearest train descriptors of each query, nearest first, query
+    // q's at [q * k] onwards.  Distances are squared Euclidean, after the
+    // query is rotated by rotations[n] steps.  Indices are -1 where there
+    // weren't k train descriptors.
+    size_t k;
+    std::vector<int> indices;
+    std::vector<float> distances;
+    std::vector<int> rotations;
+
+    size_t numQueries() const { return k? indices.size() / k : 0; }
+};
+
+
+struct Match {
+    int queryIdx;
+    int trainIdx;
+    float distance;         // Squared Euclidean
+    int rotation;           // Steps of 30 degrees
+};
+
+
+std::vector<Match> selectMatches(const KnnMatches& forward,
+                                 float maxRatio = 1.f,
+                                 const KnnMatches* backward = nullptr);
+// The nearest match of each query, keeping only those that pass the ratio
+// test (distance less than maxRatio times that of the second nearest, so
+// needs k >= 2 when maxRatio < 1) and, if backward (the results of matching
+// train against query) is given, the mutual check (the query is the train
+// descriptor's nearest too).
+
+void rotateDescriptor(const float* in, int steps, float* out);
+// Writes to out the descriptor in turned by steps of 30 degrees (positive
+// in the direction the ring samples are numbered): each ring sample moves on
+// by steps, and each subband back by steps, conjugated each time it wraps
+// round.  in and out must not overlap.
+
+void checkMatchSettings(const MatchSettings& settings);
+// Throws std::logic_error if out of range
+
+
+
+#endif
+
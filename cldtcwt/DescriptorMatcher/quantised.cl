@@ -0,0 +1,188 @@
+// Copyright (C) 2013 Timothy Gale
+// Brute-force k-nearest-neighbour matching of quantised descriptors (as
+// from DescriptorQuantiser).  WG_SIZE, TRAIN_TILE (train codes held in
+// local memory at once), MAX_K and DESC_LEN (elements per descriptor, a
+// multiple of four) should be defined externally.
+//
+// As matchKnn, each work item takes one query, and the results are in order
+// of distance, with -1 indices for any not found and ties going to the lower
+// train index.  No rotations are tried, so the rotations are all zero.
+
+#define CODE_WORDS ((DESC_LEN + 31) / 32)
+#define CODE_CHAR4S (DESC_LEN / 4)
+
+
+uint popCount(uint x)
+{
+    // Bits set (popcount itself only arrived with OpenCL 1.2)
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+    return (x * 0x01010101u) >> 24;
+}
+
+
+void insertBest(float dist, int idx, uint k,
+                int* bestIdx, float* bestDist)
+{
+    if (dist < bestDist[k - 1]) {
+        int pos = k - 1;
+        while (pos > 0 && dist < bestDist[pos - 1]) {
+            bestIdx[pos] = bestIdx[pos - 1];
+            bestDist[pos] = bestDist[pos - 1];
+            --pos;
+        }
+        bestIdx[pos] = idx;
+        bestDist[pos] = dist;
+    }
+}
+
+
+void writeBest(uint q, uint k, const int* bestIdx, const float* bestDist,
+               __global int* knnIndices,
+               __global float* knnDistances,
+               __global int* knnRotations)
+{
+    for (uint n = 0; n < k; ++n) {
+        knnIndices[q * k + n] = bestIdx[n];
+        knnDistances[q * k + n] = bestDist[n];
+        knnRotations[q * k + n] = 0;
+    }
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void matchKnnBinary(__global const uint* query,
+                    unsigned int numQuery,
+                    __global const uint* train,
+                    unsigned int numTrain,
+                    unsigned int k,
+                    __global int* knnIndices,
+                    __global float* knnDistances,
+                    __global int* knnRotations)
+{
+    // Distances are the number of bits that differ
+    __local uint tile[TRAIN_TILE * CODE_WORDS];
+
+    const uint q = get_global_id(0), l = get_local_id(0);
+    const bool valid = q < numQuery;
+
+    uint code[CODE_WORDS];
+    if (valid)
+        for (int w = 0; w < CODE_WORDS; ++w)
+            code[w] = query[q * CODE_WORDS + w];
+
+    int bestIdx[MAX_K];
+    float bestDist[MAX_K];
+    for (int n = 0; n < MAX_K; ++n) {
+        bestIdx[n] = -1;
+        bestDist[n] = INFINITY;
+    }
+
+    for (uint base = 0; base < numTrain; base += TRAIN_TILE) {
+
+        const uint n = min((uint) TRAIN_TILE, numTrain - base);
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (uint i = l; i < n * CODE_WORDS; i += WG_SIZE)
+            tile[i] = train[base * CODE_WORDS + i];
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (!valid)
+            continue;
+
+        for (uint t = 0; t < n; ++t) {
+            uint d = 0;
+            for (int w = 0; w < CODE_WORDS; ++w)
+                d += popCount(code[w] ^ tile[t * CODE_WORDS + w]);
+
+            insertBest((float) d, base + t, k, bestIdx, bestDist);
+        }
+    }
+
+    if (valid)
+        writeBest(q, k, bestIdx, bestDist,
+                  knnIndices, knnDistances, knnRotations);
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void matchKnnInt8(__global const char4* query,
+                  unsigned int numQuery,
+                  __global const char4* train,
+                  unsigned int numTrain,
+                  unsigned int k,
+                  __global int* knnIndices,
+                  __global float* knnDistances,
+                  __global int* knnRotations)
+{
+    // Distances are one minus the cosine of the angle between the codes,
+    // from integer dot products
+    __local char4 tile[TRAIN_TILE * CODE_CHAR4S];
+    __local int tileNormSq[TRAIN_TILE];
+
+    const uint q = get_global_id(0), l = get_local_id(0);
+    const bool valid = q < numQuery;
+
+    int4 code[CODE_CHAR4S];
+    int queryNormSq = 0;
+    if (valid)
+        for (int c = 0; c < CODE_CHAR4S; ++c) {
+            code[c] = convert_int4(query[q * CODE_CHAR4S + c]);
+            int4 sq = code[c] * code[c];
+            queryNormSq += sq.x + sq.y + sq.z + sq.w;
+        }
+
+    int bestIdx[MAX_K];
+    float bestDist[MAX_K];
+    for (int n = 0; n < MAX_K; ++n) {
+        bestIdx[n] = -1;
+        bestDist[n] = INFINITY;
+    }
+
+    for (uint base = 0; base < numTrain; base += TRAIN_TILE) {
+
+        const uint n = min((uint) TRAIN_TILE, numTrain - base);
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (uint i = l; i < n * CODE_CHAR4S; i += WG_SIZE)
+            tile[i] = train[base * CODE_CHAR4S + i];
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Each train code's norm, once for the whole workgroup
+        for (uint t = l; t < n; t += WG_SIZE) {
+            int normSq = 0;
+            for (int c = 0; c < CODE_CHAR4S; ++c) {
+                int4 v = convert_int4(tile[t * CODE_CHAR4S + c]);
+                int4 sq = v * v;
+                normSq += sq.x + sq.y + sq.z + sq.w;
+            }
+            tileNormSq[t] = normSq;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (!valid)
+            continue;
+
+        for (uint t = 0; t < n; ++t) {
+            int dot = 0;
+            for (int c = 0; c < CODE_CHAR4S; ++c) {
+                int4 p = code[c] * convert_int4(tile[t * CODE_CHAR4S + c]);
+                dot += p.x + p.y + p.z + p.w;
+            }
+
+            const float norms = sqrt((float) queryNormSq
+                                     * (float) tileNormSq[t]);
+            const float d = (norms > 0.f)? 1.f - dot / norms : 1.f;
+
+            insertBest(d, base + t, k, bestIdx, bestDist);
+        }
+    }
+
+    if (valid)
+        writeBest(q, k, bestIdx, bestDist,
+                  knnIndices, knnDistances, knnRotations);
+}
+
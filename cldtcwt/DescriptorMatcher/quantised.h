@@ -0,0 +1,13 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef QUANTISED_H
+#define QUANTISED_H
+
+// The kernels for matching quantised descriptors (see quantised.cl).  The
+// kernel.h headers share an include guard, hence this is kept separate.
+
+namespace DescriptorMatcherNS {
+    extern const unsigned char quantised_cl[];
+    extern const unsigned int quantised_cl_len;
+}
+
+#endif
@@ -0,0 +1,165 @@
+// Copyright (C) 2013 Timothy Gale
+#include "quantisedMatcher.h"
+#include "util/clUtil.h"
+#include "quantised.h"
+
+using namespace DescriptorMatcherNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+
+#include <stdexcept>
+
+
+QuantisedMatcher::QuantisedMatcher(cl::Context& context,
+                                   const std::vector<cl::Device>& devices)
+   : context_(context)
+{
+    static_assert(descriptorLength % 4 == 0,
+                  "Int8 codes are read four bytes at a time");
+
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (quantised_cl);
+    size_t fileTextLength = quantised_cl_len;
+
+    // Bundle the code up
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(fileText, fileTextLength));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_
+                        << " -D TRAIN_TILE=" << trainTile_
+                        << " -D MAX_K=" << maxMatchK
+                        << " -D DESC_LEN=" << descriptorLength;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful parts, viz the kernels
+    int8Kernel_ = cl::Kernel(program, "matchKnnInt8");
+    binaryKernel_ = cl::Kernel(program, "matchKnnBinary");
+}
+
+
+
+
+void QuantisedMatcher::operator()
+      (cl::CommandQueue& commandQueue,
+       DescriptorQuantiser::Format format,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       size_t k,
+       cl::Buffer& indices, cl::Buffer& distances, cl::Buffer& rotations,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    checkMatchSettings(MatchSettings {k, 0});
+
+    // No queries, no matches; just keep the events in order
+    if (numQuery == 0) {
+        if (!waitEvents.empty())
+            commandQueue.enqueueWaitForEvents(waitEvents);
+        if (doneEvent != nullptr)
+            commandQueue.enqueueMarker(doneEvent);
+        return;
+    }
+
+    cl::Kernel& kernel = (format == DescriptorQuantiser::Int8)?
+                            int8Kernel_ : binaryKernel_;
+
+    kernel.setArg(0, query);
+    kernel.setArg(1, cl_uint(numQuery));
+    kernel.setArg(2, train);
+    kernel.setArg(3, cl_uint(numTrain));
+    kernel.setArg(4, cl_uint(k));
+    kernel.setArg(5, indices);
+    kernel.setArg(6, distances);
+    kernel.setArg(7, rotations);
+
+    const size_t globalSize = roundWGs(numQuery, wgSize_);
+
+    commandQueue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                      {globalSize}, {wgSize_},
+                                      &waitEvents, doneEvent);
+}
+
+
+
+KnnMatches QuantisedMatcher::operator()
+      (cl::CommandQueue& commandQueue,
+       DescriptorQuantiser::Format format,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       size_t k,
+       const std::vector<cl::Event>& waitEvents)
+{
+    KnnMatches results;
+    results.k = k;
+
+    checkMatchSettings(MatchSettings {k, 0});
+
+    if (numQuery == 0)
+        return results;
+
+    const size_t numResults = numQuery * k;
+
+    cl::Buffer indices(context_, CL_MEM_READ_WRITE,
+                       numResults * sizeof(cl_int)),
+               distances(context_, CL_MEM_READ_WRITE,
+                         numResults * sizeof(cl_float)),
+               rotations(context_, CL_MEM_READ_WRITE,
+                         numResults * sizeof(cl_int));
+
+    (*this)(commandQueue, format, query, numQuery, train, numTrain, k,
+            indices, distances, rotations, waitEvents);
+
+    results.indices = readBuffer<int>(commandQueue, indices);
+    results.distances = readBuffer<float>(commandQueue, distances);
+    results.rotations = readBuffer<int>(commandQueue, rotations);
+
+    return results;
+}
+
+
+
+float QuantisedMatcher::distance(DescriptorQuantiser::Format format,
+                                 const void* a, const void* b)
+{
+    if (format == DescriptorQuantiser::Int8) {
+
+        const int8_t* ca = static_cast<const int8_t*> (a);
+        const int8_t* cb = static_cast<const int8_t*> (b);
+
+        int dot = 0, normSqA = 0, normSqB = 0;
+        for (size_t i = 0; i < descriptorLength; ++i) {
+            dot += ca[i] * cb[i];
+            normSqA += ca[i] * ca[i];
+            normSqB += cb[i] * cb[i];
+        }
+
+        const float norms = std::sqrt(float(normSqA) * float(normSqB));
+        return (norms > 0.f)? 1.f - dot / norms : 1.f;
+
+    } else {
+
+        const uint32_t* wa = static_cast<const uint32_t*> (a);
+        const uint32_t* wb = static_cast<const uint32_t*> (b);
+
+        int d = 0;
+        for (size_t w = 0; w < (descriptorLength + 31) / 32; ++w)
+            d += __builtin_popcount(wa[w] ^ wb[w]);
+
+        return float(d);
+    }
+}
+
@@ -0,0 +1,70 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef QUANTISEDMATCHER_H
+#define QUANTISEDMATCHER_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+#include "matches.h"
+#include "KeypointDescriptor/Quantise/descriptorQuantiser.h"
+
+
+
+class QuantisedMatcher {
+// Brute-force k-nearest-neighbour matching of quantised descriptors on the
+// device, as DescriptorMatcher but without the rotation search.  Binary
+// codes are compared by Hamming distance (bits differing); Int8 codes by
+// one minus the cosine of the angle between them, from integer dot
+// products.  Results come back as for DescriptorMatcher, so selectMatches
+// works on them too: cosine distances scale like squared Euclidean ones,
+// as its ratio test expects, but for Hamming distances maxRatio applies to
+// their square roots.
+
+public:
+
+    QuantisedMatcher() = default;
+    QuantisedMatcher(const QuantisedMatcher&) = default;
+    QuantisedMatcher(cl::Context& context,
+                     const std::vector<cl::Device>& devices);
+    // For descriptors of descriptorLength floats
+
+    void operator() (cl::CommandQueue& commandQueue,
+       DescriptorQuantiser::Format format,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       size_t k,
+       cl::Buffer& indices, cl::Buffer& distances, cl::Buffer& rotations,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // query and train hold codes as DescriptorQuantiser makes them.  indices
+    // and rotations (ints) and distances (floats) need room for numQuery * k
+    // each, laid out as in KnnMatches.  numQuery may be zero, when nothing
+    // is written.
+
+    KnnMatches operator() (cl::CommandQueue& commandQueue,
+       DescriptorQuantiser::Format format,
+       const cl::Buffer& query, size_t numQuery,
+       const cl::Buffer& train, size_t numTrain,
+       size_t k,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>());
+    // As above, but waits for and reads back the results
+
+    static float distance(DescriptorQuantiser::Format format,
+                          const void* a, const void* b);
+    // The same distance between two codes, on the host
+
+private:
+    cl::Context context_;
+    cl::Kernel int8Kernel_, binaryKernel_;
+
+    static const size_t wgSize_ = 64;
+    static const size_t trainTile_ = 16;
+};
+
+
+
+#endif
+
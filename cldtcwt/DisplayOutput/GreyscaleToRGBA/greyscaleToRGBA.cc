@@ -31,6 +31,7 @@ GreyscaleToRGBA::GreyscaleToRGBA(cl::Context& context,
         
     // ...and extract the useful part, viz the kernel
     kernel_ = cl::Kernel(program, "greyscaleToRGBA");
+    bufferKernel_ = cl::Kernel(program, "imageBufferToRGBA");
 }
 
 
@@ -64,3 +65,34 @@ void GreyscaleToRGBA::operator() (cl::CommandQueue& cq, cl::Image& input,
 }
 
 
+
+void GreyscaleToRGBA::operator() (cl::CommandQueue& cq, 
+                                  ImageBuffer<cl_float>& input,
+                                  cl::Image& output,
+                                  float gain,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    const int wgSize = 16;
+
+    cl::NDRange workgroupSize = {wgSize, wgSize};
+
+    cl::NDRange globalSize = {
+        roundWGs(output.getImageInfo<CL_IMAGE_WIDTH>(), wgSize), 
+        roundWGs(output.getImageInfo<CL_IMAGE_HEIGHT>(), wgSize)
+    }; 
+
+    // Set all the arguments
+    bufferKernel_.setArg(0, input.buffer());
+    bufferKernel_.setArg(1, cl_uint(input.start()));
+    bufferKernel_.setArg(2, cl_uint(input.stride()));
+    bufferKernel_.setArg(3, sizeof(output), &output);
+    bufferKernel_.setArg(4, float(gain));
+
+    // Execute
+    cq.enqueueNDRangeKernel(bufferKernel_, cl::NullRange,
+                            globalSize, workgroupSize,
+                            &waitEvents, doneEvent);
+}
+
+
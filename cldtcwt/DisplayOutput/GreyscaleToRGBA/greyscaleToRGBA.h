@@ -8,6 +8,8 @@
 #endif
 #include "CL/cl.hpp"
 
+#include "Filter/imageBuffer.h"
+
 
 class GreyscaleToRGBA {
     // Kernel that takes a single-component image, and puts out an
@@ -27,10 +29,18 @@ public:
                         = std::vector<cl::Event>(),
                      cl::Event* doneEvent = nullptr);
 
+    void operator() (cl::CommandQueue& cq, ImageBuffer<cl_float>& input,
+                                           cl::Image& output,
+                                           float gain,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // As above, but from a buffer of the same size as the output image
+
 private:
 
     cl::Context context_;
-    cl::Kernel kernel_;
+    cl::Kernel kernel_, bufferKernel_;
 
 };
 
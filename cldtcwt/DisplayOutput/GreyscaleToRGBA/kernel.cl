@@ -17,3 +17,22 @@ void greyscaleToRGBA(__read_only image2d_t input,
     }
 }
 
+
+
+__kernel
+void imageBufferToRGBA(__global const float* input,
+                       unsigned int inputStart,
+                       unsigned int inputStride,
+                       __write_only image2d_t output,
+                       float gain)
+{
+    int2 pos = (int2) (get_global_id(0), get_global_id(1));
+
+    // Make sure we're within the valid region
+    if (all(pos < get_image_dim(output))) {
+
+        float v = gain * input[inputStart + pos.y * inputStride + pos.x];
+        write_imagef(output, pos, (float4) (v, v, v, 1.0f));
+
+    }
+}
@@ -1,6 +1,8 @@
 // Copyright (C) 2013 Timothy Gale
 #include "calculator.h"
 #include "util/clUtil.h"
+#include <algorithm>
+#include <stdexcept>
 
 
 Calculator::Calculator(cl::Context& context,
@@ -13,7 +15,14 @@ Calculator::Calculator(cl::Context& context,
     energyMap(context, {device}),
     peakDetector(context, {device}),
     descriptorExtracter_(context, {device}, peakDetector.getPosLength()),
-    maxNumKeypoints_(maxNumKeypoints)
+    descriptorQuantiser_(context, {device},
+                         descriptorExtracter_.getNumFloatsInDescriptor()),
+    quantising_(false),
+    quantisationFormat_(DescriptorQuantiser::Int8),
+    maxNumKeypoints_(maxNumKeypoints),
+    peakThreshold_(0.04f),
+    fusedDetection_(true),
+    keypointLimit_(maxNumKeypoints)
 {
     const int numLevels = 4;
     const int startLevel = 2;
@@ -35,18 +44,28 @@ Calculator::Calculator(cl::Context& context,
         energyMapsDone.emplace_back();
     }
 
+    numDetectionLevels_ = energyMaps.size();
+
 
     descriptors_ = cl::Buffer(context, CL_MEM_READ_WRITE,
             maxNumKeypoints * 
               descriptorExtracter_.getNumFloatsInDescriptor() * sizeof(float));
 
+    // Room for codes in either format
+    descriptorCodes_ = cl::Buffer(context, CL_MEM_READ_WRITE,
+            maxNumKeypoints * std::max(
+              descriptorQuantiser_.codeBytes(DescriptorQuantiser::Int8),
+              descriptorQuantiser_.codeBytes(DescriptorQuantiser::Binary)));
+
 
     // Create the temporaries and results for peak detection
     peakDetectorResults = peakDetector.createResultsStructure
-        (std::vector<size_t>(energyMaps.size(), maxNumKeypoints), 
+        (std::vector<size_t>(energyMaps.size(), 4 * maxNumKeypoints), 
          maxNumKeypoints);
     // i.e. allow the maximum number to appear in any given level, but
-    // cap overall too to prevent getting more than we can store.
+    // cap overall too to prevent getting more than we can store.  Each
+    // level has room for several times that as candidates, so that the
+    // weakest are dropped rather than whichever happened to come last.
     
     descriptorsDone_ = std::vector<cl::Event>(energyMaps.size() * 2);
     // Enough for coarse and fine parts of descriptors being done
@@ -70,31 +89,54 @@ void Calculator::operator() (ImageBuffer<cl_float>& input,
     // Transform
     dtcwt(commandQueue, input, dtcwtTemps, dtcwtOut, waitEvents);
 
-    // Calculate energy
-    for (int l = 0; l < energyMaps.size(); ++l)
-        energyMap(commandQueue, 
-                  dtcwtOut.level(dtcwtOut.startLevel() + l), 
-                  energyMaps[l], 
-                  dtcwtOut.doneEvents(dtcwtOut.startLevel() + l), 
-                  &energyMapsDone[l]);
-
-    // Adapt to input format of peakDetector, which takes a list of pointers
-    std::vector<cl::Image*> emPointers;
-    for (auto& e: energyMaps)
-        emPointers.push_back(&e);
-
-    // Look for peaks
-    peakDetector(commandQueue, emPointers, scales, 0.04, 0.f,
+    peakDetectorResults.setListLengthLimit(keypointLimit_);
+
+    if (fusedDetection_) {
+
+        // Look for peaks, working out the energy on the way
+        std::vector<const Subbands*> levels;
+        std::vector<cl::Event> levelsDone;
+        for (size_t l = 0; l < numDetectionLevels_; ++l) {
+            levels.push_back(&dtcwtOut.level(dtcwtOut.startLevel() + l));
+
+            const std::vector<cl::Event>& done
+                = dtcwtOut.doneEvents(dtcwtOut.startLevel() + l);
+            levelsDone.insert(levelsDone.end(), done.begin(), done.end());
+        }
+
+        peakDetector(commandQueue, levels, scales, peakThreshold_,
+                                   peakDetectorResults, levelsDone);
+
+    } else {
+
+        // Calculate energy
+        for (int l = 0; l < numDetectionLevels_; ++l)
+            energyMap(commandQueue, 
+                      dtcwtOut.level(dtcwtOut.startLevel() + l), 
+                      energyMaps[l], 
+                      dtcwtOut.doneEvents(dtcwtOut.startLevel() + l), 
+                      &energyMapsDone[l]);
+
+        // Adapt to input format of peakDetector, which takes a list of
+        // pointers
+        std::vector<cl::Image*> emPointers;
+        for (size_t l = 0; l < numDetectionLevels_; ++l)
+            emPointers.push_back(&energyMaps[l]);
+
+        // Look for peaks
+        peakDetector(commandQueue, emPointers, scales, peakThreshold_, 0.f,
                                peakDetectorResults,
-                               energyMapsDone);
+                               std::vector<cl::Event>(energyMapsDone.begin(),
+                                energyMapsDone.begin() + numDetectionLevels_));
+    }
 
     // Extract the descriptors
-    for (size_t l = 0; l < energyMaps.size(); ++l) {
+    for (size_t l = 0; l < numDetectionLevels_; ++l) {
         descriptorExtracter_(commandQueue, 
                 dtcwtOut[l], scales[l],      // Subband
                 dtcwtOut[l+1], scales[l+1],  // Parent subband
                 peakDetectorResults.list(),         // Locations of keypoints
-                peakDetectorResults.cumCounts(), l, maxNumKeypoints_, 
+                peakDetectorResults.cumCounts(), l, keypointLimit_, 
                         // Start indices within list of the different 
                         // levels; which level to extract; what the maximum
                         // number of keypoints we could be asking for is.
@@ -106,6 +148,16 @@ void Calculator::operator() (ImageBuffer<cl_float>& input,
                         // Wait for both coarse and fine to be done
                 );
     }
+
+    // Quantise however many there turned out to be
+    if (quantising_)
+        descriptorQuantiser_(commandQueue, quantisationFormat_,
+                             descriptors_,
+                             peakDetectorResults.cumCounts(),
+                             energyMaps.size(), maxNumKeypoints_,
+                             descriptorCodes_,
+                             keypointDescriptorEvents(),
+                             &descriptorCodesDone_);
     
 
 
@@ -209,5 +261,160 @@ std::vector<cl::Event> Calculator::keypointLocationEvents(void)
 }
 
 
+std::vector<cl::Event> Calculator::keypointDescriptorEvents(void)
+{
+    // Only the levels in use have up-to-date events (coarse and fine
+    // parts)
+    std::vector<cl::Event> events;
+
+    for (size_t l = 0; l < numDetectionLevels_; ++l) {
+        events.push_back(descriptorsDone_[l]);
+        events.push_back(descriptorsDone_[l + energyMaps.size()]);
+    }
+
+    return events;
+}
+
+
+
+void Calculator::setDescriptorQuantisation
+        (DescriptorQuantiser::Format format)
+{
+    quantising_ = true;
+    quantisationFormat_ = format;
+}
+
+
+void Calculator::clearDescriptorQuantisation(void)
+{
+    quantising_ = false;
+}
+
+
+bool Calculator::descriptorQuantisation(void) const
+{
+    return quantising_;
+}
+
+
+cl::Buffer Calculator::keypointDescriptorCodes(void)
+{
+    return descriptorCodes_;
+}
+
+
+size_t Calculator::numBytesPerDescriptorCode(void) const
+{
+    return descriptorQuantiser_.codeBytes(quantisationFormat_);
+}
+
+
+std::vector<cl::Event> Calculator::keypointDescriptorCodeEvents(void)
+{
+    if (!quantising_)
+        throw std::logic_error("Calculator: descriptors aren't being "
+                               "quantised");
+
+    return {descriptorCodesDone_};
+}
+
+
+
+void Calculator::setPeakThreshold(float threshold)
+{
+    peakThreshold_ = threshold;
+}
+
+
+float Calculator::peakThreshold(void) const
+{
+    return peakThreshold_;
+}
+
+
+void Calculator::setAdaptiveThreshold
+        (const AdaptiveThreshold::Settings& settings)
+{
+    peakDetectorResults.setAdaptiveThreshold(settings);
+}
+
+
+void Calculator::clearAdaptiveThreshold(void)
+{
+    peakDetectorResults.clearAdaptiveThreshold();
+}
+
+
+void Calculator::setNumDetectionLevels(size_t numLevels)
+{
+    if (numLevels < 1 || numLevels > energyMaps.size())
+        throw std::logic_error("Calculator: invalid number of "
+                               "detection levels");
+
+    numDetectionLevels_ = numLevels;
+}
+
+
+size_t Calculator::numDetectionLevels(void) const
+{
+    return numDetectionLevels_;
+}
+
+
+size_t Calculator::maxNumDetectionLevels(void) const
+{
+    return energyMaps.size();
+}
+
+
+void Calculator::setKeypointLimit(size_t limit)
+{
+    keypointLimit_ = std::min(limit, maxNumKeypoints_);
+}
+
+
+size_t Calculator::keypointLimit(void) const
+{
+    return keypointLimit_;
+}
+
+
+void Calculator::setGridSelection(const GridSelect::Settings& settings)
+{
+    peakDetectorResults.setGridSelection(settings);
+}
+
+
+void Calculator::clearGridSelection(void)
+{
+    peakDetectorResults.clearGridSelection();
+}
+
+
+void Calculator::setKeypointOrder(SortKeypoints::Order order)
+{
+    peakDetectorResults.setSortOrder(order);
+}
+
+
+void Calculator::clearKeypointOrder(void)
+{
+    peakDetectorResults.clearSortOrder();
+}
+
+
+
+void Calculator::setFusedDetection(bool fused)
+{
+    fusedDetection_ = fused;
+}
+
+
+bool Calculator::fusedDetection(void) const
+{
+    return fusedDetection_;
+}
+
+
 
 
@@ -17,6 +17,7 @@
 #include "KeypointDetector/EnergyMaps/InterpMap/interpMap.h"
 #include "KeypointDetector/EnergyMaps/InterpPhaseMap/interpPhaseMap.h"
 #include "KeypointDescriptor/extractDescriptors.h"
+#include "KeypointDescriptor/Quantise/descriptorQuantiser.h"
 
 
 class Calculator {
@@ -46,6 +47,12 @@ private:
 
     size_t maxNumKeypoints_;
 
+    // Run-time settings, which can trade quality for speed
+    float peakThreshold_;
+    bool fusedDetection_;
+    size_t numDetectionLevels_;
+    size_t keypointLimit_;
+
     PeakDetectorResults peakDetectorResults;
     std::vector<float> scales; // List of the scale of each energy map, i.e. 
                                // how many pixels in the original image each
@@ -57,6 +64,13 @@ private:
 
     DescriptorExtracter descriptorExtracter_;
 
+    // Optional quantised copy of the descriptors
+    DescriptorQuantiser descriptorQuantiser_;
+    bool quantising_;
+    DescriptorQuantiser::Format quantisationFormat_;
+    cl::Buffer descriptorCodes_;
+    cl::Event descriptorCodesDone_;
+
 public:
 
     Calculator(const Calculator&) = default;
@@ -79,6 +93,59 @@ public:
     size_t numFloatsPerKPLocation(void);
     cl::Buffer keypointCumCounts(void);
     std::vector<cl::Event> keypointLocationEvents(void);
+    std::vector<cl::Event> keypointDescriptorEvents(void);
+
+    void setDescriptorQuantisation(DescriptorQuantiser::Format format);
+    void clearDescriptorQuantisation(void);
+    bool descriptorQuantisation(void) const;
+    // Also quantise the descriptors to compact codes each frame (see
+    // DescriptorQuantiser), so that only those need reading back.  Off by
+    // default.
+
+    cl::Buffer keypointDescriptorCodes(void);
+    size_t numBytesPerDescriptorCode(void) const;
+    std::vector<cl::Event> keypointDescriptorCodeEvents(void);
+    // The quantised descriptors, in the same order as the others
+
+    void setPeakThreshold(float threshold);
+    float peakThreshold(void) const;
+    // Minimum energy for a peak to be a keypoint
+
+    void setAdaptiveThreshold(const AdaptiveThreshold::Settings& settings);
+    void clearAdaptiveThreshold(void);
+    // Adjust the threshold from frame to frame, on the device, to find
+    // about settings.target peaks, starting from peakThreshold.  Best with
+    // the target a little above keypointLimit, so the strongest can still
+    // be chosen.  Off by default.
+
+    void setNumDetectionLevels(size_t numLevels);
+    size_t numDetectionLevels(void) const;
+    size_t maxNumDetectionLevels(void) const;
+    // How many levels, from the finest, keypoints are looked for in.
+    // Dropping the coarser levels saves their energy maps, peak detection
+    // and descriptors.
+
+    void setKeypointLimit(size_t limit);
+    size_t keypointLimit(void) const;
+    // Cap on keypoints per frame, up to the maxNumKeypoints given at
+    // construction
+
+    void setGridSelection(const GridSelect::Settings& settings);
+    void clearGridSelection(void);
+    // Spread keypoints over the frame: see PeakDetectorResults.  Off by
+    // default.
+
+    void setKeypointOrder(SortKeypoints::Order order);
+    void clearKeypointOrder(void);
+    // Sort each level's keypoints by position, so the output (descriptors
+    // included) is the same from run to run: see PeakDetectorResults.  Off
+    // by default.
+
+    void setFusedDetection(bool fused);
+    bool fusedDetection(void) const;
+    // Whether to find peaks straight from the subbands, without writing
+    // out the energy maps.  On by default; turn it off if the energy maps
+    // themselves are wanted (getEnergyMapLevel2).
 
 };
 
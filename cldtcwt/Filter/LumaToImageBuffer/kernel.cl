@@ -0,0 +1,119 @@
+// Copyright (C) 2013 Timothy Gale
+// INPUT_TYPE (uchar or ushort), WG_W and WG_H (width and height of the
+// workgroup) should have been defined externally.  The global size should
+// cover the image plus its padding on all sides.
+//
+// DEINTERLACE selects how interlaced input is handled: 0 for not at all,
+// 1 to replace the odd lines by interpolating the even ones (line
+// doubling), and 2 to blend between the odd lines as they are and the
+// interpolated version according to how much they have changed since the
+// previous frame (motion adaptive).
+
+#ifndef DEINTERLACE
+#define DEINTERLACE 0
+#endif
+
+
+int symmetric(int n, int width)
+{
+    // Symmetric extension of an index, which may be negative or
+    // beyond the end
+    if (n < 0)
+        n = -1 - n;
+
+    if (n < width)
+        return n;
+    else {
+        int tmp = n % (2*width);
+        return min(tmp, 2*width - 1 - tmp);
+    }
+}
+
+
+float readSample(__global const INPUT_TYPE* input,
+                 unsigned int inputStart, unsigned int inputStride,
+                 int x, int y)
+{
+    return convert_float(input[inputStart + y * inputStride + x]);
+}
+
+
+float interpolateLine(__global const INPUT_TYPE* input,
+                      unsigned int inputStart, unsigned int inputStride,
+                      int x, int y, int height)
+{
+    // Average of the (even) lines above and below y, which is odd; at the
+    // bottom there may only be the one above
+    float above = readSample(input, inputStart, inputStride, x, y - 1);
+
+    if (y + 1 < height)
+        return 0.5f * (above
+                       + readSample(input, inputStart, inputStride, x, y + 1));
+    else
+        return above;
+}
+
+
+__attribute__((reqd_work_group_size(WG_W, WG_H, 1)))
+__kernel void lumaToImageBuffer(__global const INPUT_TYPE* input,
+                                __global const INPUT_TYPE* previous,
+                                unsigned int inputStart,
+                                unsigned int inputStride,
+                                float scale,
+                                float motionLow,
+                                float motionHigh,
+                                __global float* output,
+                                unsigned int outputStart,
+                                unsigned int outputStride,
+                                unsigned int width,
+                                unsigned int height,
+                                unsigned int padding)
+{
+    // Position within the output, relative to the upper left of the image
+    // (so negative within the padding)
+    const int2 pos = (int2) (get_global_id(0), get_global_id(1))
+                   - (int2) (padding, padding);
+
+    if (pos.x >= (int) (width + padding) || pos.y >= (int) (height + padding))
+        return;
+
+    // Where to read from, reflecting back into the image if in the padding
+    const int2 src = (int2) (symmetric(pos.x, width),
+                             symmetric(pos.y, height));
+
+    float v = readSample(input, inputStart, inputStride, src.x, src.y);
+
+#if DEINTERLACE != 0
+    // Only the odd field gets replaced
+    if (src.y & 1) {
+
+        float interp = interpolateLine(input, inputStart, inputStride,
+                                       src.x, src.y, height);
+
+#if DEINTERLACE == 1
+        v = interp;
+#else
+        // Motion is judged from the pixel itself and the one above it in
+        // the other field, to catch movement that one field alone misses
+        float prev = readSample(previous, inputStart, inputStride,
+                                src.x, src.y);
+        float prevAbove = readSample(previous, inputStart, inputStride,
+                                     src.x, src.y - 1);
+        float above = readSample(input, inputStart, inputStride,
+                                 src.x, src.y - 1);
+
+        float motion = scale * fmax(fabs(v - prev), fabs(above - prevAbove));
+
+        // Still: keep the line (full resolution); moving: interpolate
+        // (no combing)
+        float alpha = clamp((motion - motionLow) / (motionHigh - motionLow),
+                            0.0f, 1.0f);
+        v = mix(v, interp, alpha);
+#endif
+    }
+#endif
+
+    output[(int) outputStart + pos.y * (int) outputStride + pos.x]
+        = scale * v;
+}
+
@@ -0,0 +1,130 @@
+// Copyright (C) 2013 Timothy Gale
+#include "lumaToImageBuffer.h"
+#include "util/clUtil.h"
+#include <sstream>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include "kernel.h"
+
+using namespace LumaToImageBufferNS;
+
+LumaToImageBuffer::LumaToImageBuffer(cl::Context& context,
+                 const std::vector<cl::Device>& devices,
+                 int bitDepth,
+                 Deinterlace deinterlace)
+ : context_(context), bitDepth_(bitDepth), deinterlace_(deinterlace)
+{
+    if (bitDepth < 1 || bitDepth > 16)
+        throw std::logic_error("Luma bit depth must be between 1 and 16");
+
+    // Bundle the code up
+    cl::Program::Sources source;
+    source.push_back(
+        std::make_pair(reinterpret_cast<const char*>(kernel_cl),
+                       kernel_cl_len)
+    );
+
+    std::ostringstream compilerOptions;
+    compilerOptions << "-D WG_W=" << workgroupSize_ << " "
+                    << "-D WG_H=" << workgroupSize_ << " "
+                    << "-D INPUT_TYPE="
+                        << (bytesPerSample() == 1? "uchar" : "ushort") << " "
+                    << "-D DEINTERLACE=" << int(deinterlace_);
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful part, viz the kernel
+    kernel_ = cl::Kernel(program, "lumaToImageBuffer");
+}
+
+
+
+int LumaToImageBuffer::bitDepth() const
+{
+    return bitDepth_;
+}
+
+
+size_t LumaToImageBuffer::bytesPerSample() const
+{
+    return bitDepth_ > 8? 2 : 1;
+}
+
+
+LumaToImageBuffer::Deinterlace LumaToImageBuffer::deinterlace() const
+{
+    return deinterlace_;
+}
+
+
+
+void LumaToImageBuffer::operator() (cl::CommandQueue& cq,
+                 const cl::Buffer& input,
+                 size_t inputStride,
+                 ImageBuffer<cl_float>& output,
+                 float gain,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    // Comparing against itself, nothing moves
+    (*this)(cq, input, input, inputStride, output, gain,
+            waitEvents, doneEvent);
+}
+
+
+
+void LumaToImageBuffer::operator() (cl::CommandQueue& cq,
+                 const cl::Buffer& input,
+                 const cl::Buffer& previousInput,
+                 size_t inputStride,
+                 ImageBuffer<cl_float>& output,
+                 float gain,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    cl::NDRange workgroupSize = {workgroupSize_, workgroupSize_};
+
+    // Cover the padding too
+    cl::NDRange globalSize = {
+        roundWGs(output.width() + 2 * output.padding(), workgroupSize[0]),
+        roundWGs(output.height() + 2 * output.padding(), workgroupSize[1])
+    };
+
+    // Full scale of the input maps to gain
+    const float scale = gain / float((1 << bitDepth_) - 1);
+
+    // Set all the arguments
+    kernel_.setArg(0, input);
+    kernel_.setArg(1, previousInput);
+    kernel_.setArg(2, cl_uint(0));
+    kernel_.setArg(3, cl_uint(inputStride));
+    kernel_.setArg(4, scale);
+    kernel_.setArg(5, gain * motionLow_);
+    kernel_.setArg(6, gain * motionHigh_);
+
+    // Output buffer
+    kernel_.setArg(7, output.buffer());
+    kernel_.setArg(8, cl_uint(output.start()));
+    kernel_.setArg(9, cl_uint(output.stride()));
+    kernel_.setArg(10, cl_uint(output.width()));
+    kernel_.setArg(11, cl_uint(output.height()));
+    kernel_.setArg(12, cl_uint(output.padding()));
+
+    // Execute
+    cq.enqueueNDRangeKernel(kernel_, cl::NullRange,
+                            globalSize, workgroupSize,
+                            &waitEvents, doneEvent);
+}
+
+
@@ -0,0 +1,89 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef LUMA_TO_IMAGE_BUFFER_H
+#define LUMA_TO_IMAGE_BUFFER_H
+
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+
+
+#include "../imageBuffer.h"
+
+
+class LumaToImageBuffer {
+    // Takes a raw luma plane, as produced by a video decoder, from a
+    // buffer and converts it to a float ImageBuffer in one pass.  The
+    // samples are 8-bit, or stored in 16 bits for higher depths, and rows
+    // can have any stride.  Values are scaled so that full scale becomes
+    // gain.  The output's padding is filled by symmetric extension on all
+    // sides, ready for the first level of the DTCWT.
+    //
+    // Interlaced input can be deinterlaced on the way, keeping the even
+    // (top) field.  LineDouble replaces the odd lines by interpolating
+    // the even ones; MotionAdaptive does so only where the picture has
+    // changed since the previous frame, keeping full resolution in still
+    // areas.
+
+public:
+
+    enum Deinterlace { None = 0, LineDouble = 1, MotionAdaptive = 2 };
+
+    LumaToImageBuffer() = default;
+    LumaToImageBuffer(const LumaToImageBuffer&) = default;
+    LumaToImageBuffer(cl::Context& context,
+            const std::vector<cl::Device>& devices,
+            int bitDepth = 8,
+            Deinterlace deinterlace = None);
+    // bitDepth of up to 8 means one byte per sample, up to 16 two bytes
+
+    void operator() (cl::CommandQueue& cq,
+                     const cl::Buffer& input,
+                     size_t inputStride,
+                     ImageBuffer<cl_float>& output,
+                     float gain = 1.0f,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // inputStride is in samples.  The input has the same width and height
+    // as output, and starts at the beginning of the buffer.  With
+    // MotionAdaptive, every pixel is treated as still.
+
+    void operator() (cl::CommandQueue& cq,
+                     const cl::Buffer& input,
+                     const cl::Buffer& previousInput,
+                     size_t inputStride,
+                     ImageBuffer<cl_float>& output,
+                     float gain = 1.0f,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // As above, with the previous frame (in the same format) for
+    // MotionAdaptive deinterlacing to compare against
+
+    int bitDepth() const;
+    size_t bytesPerSample() const;
+    Deinterlace deinterlace() const;
+
+private:
+
+    cl::Context context_;
+    cl::Kernel kernel_;
+
+    int bitDepth_ = 0;
+    Deinterlace deinterlace_ = None;
+
+    // Changes (as a fraction of full scale) between which MotionAdaptive
+    // goes from keeping lines to interpolating them
+    static constexpr float motionLow_ = 0.02f,
+                           motionHigh_ = 0.08f;
+
+    static const size_t workgroupSize_ = 16;
+
+};
+
+
+
+#endif
+
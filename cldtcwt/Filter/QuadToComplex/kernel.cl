@@ -1,13 +1,15 @@
 // Copyright (C) 2013 Timothy Gale
 // WG_W and WG_H  should have been defined externally (width and height of 
-// the workgroup respectively)
+// the workgroup respectively).  Subband and storeSubband come from
+// polar.cl, and subbandOffset from subbandLayout.cl, built in ahead of this.
 __attribute__((reqd_work_group_size(WG_W, WG_H, 1)))
 __kernel void quadToComplex(__global const float* input,
                             unsigned int inputStart,
                             unsigned int inputStride,
-                            __global float2* output,
+                            __global Subband* output,
                             unsigned int outputStart0,
                             unsigned int outputStart1,
+                            unsigned int outputPitch,
                             unsigned int outputStride,
                             unsigned int outWidth,
                             unsigned int outHeight)
@@ -38,9 +40,11 @@ __kernel void quadToComplex(__global const float* input,
         const float factor = 1.0f / sqrt(2.0f);
 
         // Combine into complex pairs
-        const size_t loc = outPos.y * outputStride + outPos.x;
-        output[loc + outputStart0] = factor * (float2) (ul - lr, ur + ll);
-        output[loc + outputStart1] = factor * (float2) (ul + lr, ur - ll);
+        const size_t loc = subbandOffset(outPos.x, outPos.y, outputStride);
+        storeSubband(output, loc + outputStart0, outputPitch,
+                     factor * (float2) (ul - lr, ur + ll));
+        storeSubband(output, loc + outputStart1, outputPitch,
+                     factor * (float2) (ul + lr, ur - ll));
 
     }
 
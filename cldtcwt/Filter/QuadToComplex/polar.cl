@@ -0,0 +1,70 @@
+// Copyright (C) 2013 Timothy Gale
+// The subband output format, for building into the quad-to-complex programs
+// ahead of their own source.  SUBBAND_FORMAT may be defined externally as
+// one of the values below (see SubbandFormat in subbandFormat.h); complex is
+// the default.  Kernels write a coefficient with storeSubband, idx being in
+// Subband elements from the start of the buffer, and pitch the distance
+// between slices.  Tiled output defines TILED_SUBBANDS, so subbandLayout.cl
+// must be built in after this; kernels then find positions within an
+// orientation with its subbandOffset.
+
+#define SUBBANDS_COMPLEX 0
+#define SUBBANDS_MAGNITUDE 1
+#define SUBBANDS_POLAR 2
+#define SUBBANDS_PLANAR 3
+#define SUBBANDS_TILED 4
+
+#ifndef SUBBAND_FORMAT
+    #define SUBBAND_FORMAT SUBBANDS_COMPLEX
+#endif
+
+#if SUBBAND_FORMAT == SUBBANDS_MAGNITUDE
+    typedef float Subband;
+#elif SUBBAND_FORMAT == SUBBANDS_POLAR
+    typedef uint Subband;
+#elif SUBBAND_FORMAT == SUBBANDS_PLANAR
+    typedef float Subband;
+#elif SUBBAND_FORMAT == SUBBANDS_TILED
+    // Complex coefficients, only stored in a different order
+    #define TILED_SUBBANDS
+    typedef float2 Subband;
+#else
+    typedef float2 Subband;
+#endif
+
+
+inline Subband toSubband(float2 z)
+{
+    // Converts a coefficient to the output format.  Polar coefficients
+    // keep the top 24 bits of the magnitude, and put the phase, quantised
+    // to 256 steps of a turn from -pi, in the bottom 8.
+#if SUBBAND_FORMAT == SUBBANDS_MAGNITUDE
+    return length(z);
+#elif SUBBAND_FORMAT == SUBBANDS_POLAR
+    const float turn = (atan2(z.y, z.x) + M_PI_F) * (0.5f / M_PI_F);
+    const uint step = convert_uint_rte(turn * 256.f) & 0xFF;
+
+    return (as_uint(length(z)) & ~0xFFu) | step;
+#elif SUBBAND_FORMAT == SUBBANDS_COMPLEX \
+   || SUBBAND_FORMAT == SUBBANDS_TILED
+    return z;
+#endif
+}
+
+
+#if SUBBAND_FORMAT == SUBBANDS_PLANAR
+inline void storeSubband(__global Subband* output, size_t idx, uint pitch,
+                         float2 z)
+{
+    // Real part at idx, imaginary in the next slice
+    output[idx] = z.x;
+    output[idx + pitch] = z.y;
+}
+#else
+inline void storeSubband(__global Subband* output, size_t idx, uint pitch,
+                         float2 z)
+{
+    output[idx] = toSubband(z);
+}
+#endif
+
@@ -0,0 +1,14 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef POLAR_H
+#define POLAR_H
+
+// The subband output format conversion on its own (see polar.cl), for the
+// quad-to-complex programs to build in ahead of their own source.  Their
+// kernel.h headers share an include guard, hence this is kept separate.
+
+namespace QuadToComplexNS {
+    extern const unsigned char polar_cl[];
+    extern const unsigned int polar_cl_len;
+}
+
+#endif
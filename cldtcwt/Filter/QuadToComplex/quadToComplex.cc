@@ -5,16 +5,31 @@
 #include <string>
 #include <iostream>
 #include <cassert>
+#include <stdexcept>
 
 #include "kernel.h"
+#include "polar.h"
+#include "../subbandLayout.h"
 
 using namespace QuadToComplexNS;
 
 QuadToComplex::QuadToComplex(cl::Context& context, 
-                 const std::vector<cl::Device>& devices)
+                 const std::vector<cl::Device>& devices,
+                 SubbandFormat format)
+    : format_(format)
 {
-    // Bundle the code up
+    // Bundle the code up, after the output format conversion and
+    // addressing
     cl::Program::Sources source;
+    source.push_back(
+        std::make_pair(reinterpret_cast<const char*>(polar_cl), 
+                       polar_cl_len)
+    );
+    source.push_back(
+        std::make_pair(reinterpret_cast<const char*>(
+                            SubbandLayoutNS::subbandLayout_cl), 
+                       SubbandLayoutNS::subbandLayout_cl_len)
+    );
     source.push_back(
         std::make_pair(reinterpret_cast<const char*>(kernel_cl), 
                        kernel_cl_len)
@@ -22,7 +37,8 @@ QuadToComplex::QuadToComplex(cl::Context& context,
 
     std::ostringstream compilerOptions;
     compilerOptions << "-D WG_W=" << workgroupSize_ << " "
-                    << "-D WG_H=" << workgroupSize_;
+                    << "-D WG_H=" << workgroupSize_ << " "
+                    << "-D SUBBAND_FORMAT=" << int(format_);
 
     // Compile it...
     cl::Program program(context, source);
@@ -49,6 +65,78 @@ void QuadToComplex::operator() (cl::CommandQueue& cq,
                  const std::vector<cl::Event>& waitEvents,
                  cl::Event* doneEvent)
 {
+    enqueue_(cq, input, output, SubbandsComplex, idx0, idx1,
+             waitEvents, doneEvent);
+}
+
+
+
+void QuadToComplex::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 ImageBuffer<cl_float>& magnitudes, 
+                 size_t idx0, size_t idx1,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    enqueue_(cq, input, magnitudes, SubbandsMagnitude, idx0, idx1,
+             waitEvents, doneEvent);
+}
+
+
+
+void QuadToComplex::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 ImageBuffer<cl_uint>& polar, 
+                 size_t idx0, size_t idx1,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    enqueue_(cq, input, polar, SubbandsPolar, idx0, idx1,
+             waitEvents, doneEvent);
+}
+
+
+
+void QuadToComplex::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 PlanarSubbands& planar, 
+                 size_t idx0, size_t idx1,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    // Each orientation starts with its real parts
+    enqueue_(cq, input, planar, SubbandsPlanar, 2 * idx0, 2 * idx1,
+             waitEvents, doneEvent);
+}
+
+
+
+void QuadToComplex::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 TiledSubbands& tiled, 
+                 size_t idx0, size_t idx1,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    enqueue_(cq, input, tiled, SubbandsTiled, idx0, idx1,
+             waitEvents, doneEvent);
+}
+
+
+
+template <typename Output>
+void QuadToComplex::enqueue_(cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 Output& output, 
+                 SubbandFormat format,
+                 size_t slice0, size_t slice1,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    if (format != format_)
+        throw std::logic_error("QuadToComplex: output doesn't match the "
+                               "format the kernel was built for");
+
     // Padding etc.
     cl::NDRange workgroupSize = {workgroupSize_, workgroupSize_};
 
@@ -67,12 +155,13 @@ void QuadToComplex::operator() (cl::CommandQueue& cq,
     kernel_.setArg(2, cl_uint(input.stride()));
 
     kernel_.setArg(3, output.buffer());
-    kernel_.setArg(4, cl_uint(output.start(idx0)));
-    kernel_.setArg(5, cl_uint(output.start(idx1)));
-    kernel_.setArg(6, cl_uint(output.stride()));
+    kernel_.setArg(4, cl_uint(output.start(slice0)));
+    kernel_.setArg(5, cl_uint(output.start(slice1)));
+    kernel_.setArg(6, cl_uint(output.pitch()));
+    kernel_.setArg(7, cl_uint(output.stride()));
 
-    kernel_.setArg(7, cl_uint(output.width()));
-    kernel_.setArg(8, cl_uint(output.height()));
+    kernel_.setArg(8, cl_uint(output.width()));
+    kernel_.setArg(9, cl_uint(output.height()));
 
     // Execute
     cq.enqueueNDRangeKernel(kernel_, {0, 0},
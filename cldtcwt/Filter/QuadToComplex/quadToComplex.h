@@ -10,6 +10,7 @@
 
 
 #include "../imageBuffer.h"
+#include "../subbandFormat.h"
 
 
 class QuadToComplex {
@@ -21,7 +22,10 @@ public:
     QuadToComplex() = default;
     QuadToComplex(const QuadToComplex&) = default;
     QuadToComplex(cl::Context& context, 
-            const std::vector<cl::Device>& devices);
+            const std::vector<cl::Device>& devices,
+            SubbandFormat format = SubbandsComplex);
+    // format picks what gets written for each coefficient; the output
+    // passed in must have the matching element type.
 
     void operator() (cl::CommandQueue& cq, 
                      ImageBuffer<cl_float>& input,
@@ -31,10 +35,58 @@ public:
                         = std::vector<cl::Event>(),
                      cl::Event* doneEvent = nullptr);
 
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     ImageBuffer<cl_float>& magnitudes, 
+                     size_t idx0, size_t idx1,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsMagnitude
+
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     ImageBuffer<cl_uint>& polar, 
+                     size_t idx0, size_t idx1,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsPolar
+
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     PlanarSubbands& planar, 
+                     size_t idx0, size_t idx1,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsPlanar; idx0 and idx1 are orientations, not slices
+
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     TiledSubbands& tiled, 
+                     size_t idx0, size_t idx1,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsTiled
+
+    SubbandFormat format() const { return format_; }
+
 private:
 
     cl::Context context_;
     cl::Kernel kernel_;
+    SubbandFormat format_ = SubbandsComplex;
+
+    template <typename Output>
+    void enqueue_(cl::CommandQueue& cq, 
+                  ImageBuffer<cl_float>& input,
+                  Output& output, 
+                  SubbandFormat format,
+                  size_t slice0, size_t slice1,
+                  const std::vector<cl::Event>& waitEvents,
+                  cl::Event* doneEvent);
 
     static const size_t padding_ = 16,
                         workgroupSize_ = 16;
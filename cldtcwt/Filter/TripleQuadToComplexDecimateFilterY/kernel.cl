@@ -3,7 +3,8 @@
 // the length of the filter is FILTER_LENGTH.  
 
 // Choosing to swap the outputs of the two trees is selected by defining
-// SWAP_TREE_1
+// SWAP_TREE_1.  Subband and storeSubband come from polar.cl, and
+// subbandOffset from subbandLayout.cl, built in ahead of this.
 
 #ifndef SWAP_TREE_0 
     #define SWAP_TREE_0 0
@@ -91,7 +92,7 @@ void decimateFilterY(__global const float* input,
                      unsigned int inputStart,
                      unsigned int inputPitch,
                      unsigned int inputStride,
-                     __global float* output,
+                     __global Subband* output,
                      unsigned int outputStart,
                      unsigned int outputPitch,
                      unsigned int outputStride,
@@ -192,6 +193,22 @@ void decimateFilterY(__global const float* input,
         // Version which avoids branches:
         int y = l.y & ~1;
 
+        // Select the right subband for output.  The second output is in the 
+        // opposite subband
+        unsigned int subband = 
+            select(get_group_id(2), (size_t)(5lu - get_group_id(2)), (size_t)(l.y & 1ul));
+
+#if SUBBAND_FORMAT == SUBBANDS_PLANAR
+        // Each orientation takes two slices, real then imaginary
+        unsigned int start = outputStart + 2 * outputPitch * subband;
+#else
+        unsigned int start = outputStart + outputPitch * subband;
+#endif
+
+        const size_t loc = subbandOffset(outPos.x, outPos.y, outputStride);
+
+#if SUBBAND_FORMAT == SUBBANDS_COMPLEX || SUBBAND_FORMAT == SUBBANDS_PLANAR \
+ || SUBBAND_FORMAT == SUBBANDS_TILED
         // Load upper value (u?) into a, lower (l?) into b
         float a = cache[y][l.x];
         float b = cache[y ^ 1][l.x ^ 1];
@@ -199,16 +216,28 @@ void decimateFilterY(__global const float* input,
         float rplus  = a + b;
         float rminus = a - b;
 
-        // Select the right subband for output.  The second output is in the 
-        // opposite subband
-        unsigned int start = 
-            outputStart + outputPitch 
-                    * select(get_group_id(2), (size_t)(5lu - get_group_id(2)), (size_t)(l.y & 1ul));
-        
         // Add or subtract, and place in appropriate output
-        output[2 * (start + outPos.x + outPos.y*outputStride) 
-               + (l.x & 1)]
-            = factor * (((l.x & 1) ^ (l.y & 1))? rplus : rminus);
+        const float r = factor * (((l.x & 1) ^ (l.y & 1))? rplus : rminus);
+#if SUBBAND_FORMAT == SUBBANDS_PLANAR
+        output[start + (l.x & 1) * outputPitch + loc] = r;
+#else
+        ((__global float*) output)[2 * (start + loc) + (l.x & 1)] = r;
+#endif
+#else
+        // The magnitude and phase need both parts at once, so the even
+        // work item of each pair does the whole coefficient
+        if (!(l.x & 1)) {
+            float2 a = (float2) (cache[y][l.x], cache[y][l.x + 1]);
+            float2 b = (float2) (cache[y ^ 1][l.x + 1], cache[y ^ 1][l.x]);
+
+            // Same as above: add for the odd part of even rows and the
+            // even part of odd rows
+            const float s = (l.y & 1)? 1.f : -1.f;
+
+            storeSubband(output, start + loc, outputPitch,
+                         factor * (a + (float2) (s, -s) * b));
+        }
+#endif
 
     }
 
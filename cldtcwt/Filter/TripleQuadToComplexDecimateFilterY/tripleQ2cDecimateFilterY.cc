@@ -7,8 +7,11 @@
 #include <cassert>
 #include <iterator>
 #include <algorithm>
+#include <stdexcept>
 
 #include "kernel.h"
+#include "Filter/QuadToComplex/polar.h"
+#include "Filter/subbandLayout.h"
 
 using namespace TripleQuadToComplexDecimateFilterYNS;
 
@@ -17,11 +20,23 @@ TripleQuadToComplexDecimateFilterY::TripleQuadToComplexDecimateFilterY(cl::Conte
                  const std::vector<cl::Device>& devices,
                  std::vector<float> filter0, bool swapOutputPair0,
                  std::vector<float> filter1, bool swapOutputPair1,
-                 std::vector<float> filter2, bool swapOutputPair2)
-    : filterLength_(filter0.size())
+                 std::vector<float> filter2, bool swapOutputPair2,
+                 SubbandFormat format)
+    : filterLength_(filter0.size()), format_(format)
 {
-    // Bundle the code up
+    // Bundle the code up, after the output format conversion and
+    // addressing
     cl::Program::Sources source;
+    source.push_back(
+        std::make_pair(
+            reinterpret_cast<const char*>(QuadToComplexNS::polar_cl),
+            QuadToComplexNS::polar_cl_len)
+    );
+    source.push_back(
+        std::make_pair(
+            reinterpret_cast<const char*>(SubbandLayoutNS::subbandLayout_cl),
+            SubbandLayoutNS::subbandLayout_cl_len)
+    );
     source.push_back(
         std::make_pair(reinterpret_cast<const char*>(kernel_cl), 
                        kernel_cl_len)
@@ -30,7 +45,8 @@ TripleQuadToComplexDecimateFilterY::TripleQuadToComplexDecimateFilterY(cl::Conte
     std::ostringstream compilerOptions;
     compilerOptions << "-D WG_W=" << workgroupSize_ << " "
                     << "-D WG_H=" << workgroupSize_ << " "
-                    << "-D FILTER_LENGTH=" << filter0.size() << " ";
+                    << "-D FILTER_LENGTH=" << filter0.size() << " "
+                    << "-D SUBBAND_FORMAT=" << int(format_) << " ";
 
     // Swap tree pairs, if requested
     if (swapOutputPair0)
@@ -103,6 +119,69 @@ void TripleQuadToComplexDecimateFilterY::operator() (cl::CommandQueue& cq,
                  const std::vector<cl::Event>& waitEvents,
                  cl::Event* doneEvent)
 {
+    enqueue_(cq, input, output, SubbandsComplex, waitEvents, doneEvent);
+}
+
+
+
+void TripleQuadToComplexDecimateFilterY::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 ImageBuffer<cl_float>& magnitudes,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    enqueue_(cq, input, magnitudes, SubbandsMagnitude,
+             waitEvents, doneEvent);
+}
+
+
+
+void TripleQuadToComplexDecimateFilterY::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 ImageBuffer<cl_uint>& polar,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    enqueue_(cq, input, polar, SubbandsPolar, waitEvents, doneEvent);
+}
+
+
+
+void TripleQuadToComplexDecimateFilterY::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 PlanarSubbands& planar,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    enqueue_(cq, input, planar, SubbandsPlanar, waitEvents, doneEvent);
+}
+
+
+
+void TripleQuadToComplexDecimateFilterY::operator() (cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 TiledSubbands& tiled,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    enqueue_(cq, input, tiled, SubbandsTiled, waitEvents, doneEvent);
+}
+
+
+
+template <typename Output>
+void TripleQuadToComplexDecimateFilterY::enqueue_(cl::CommandQueue& cq, 
+                 ImageBuffer<cl_float>& input, 
+                 Output& output,
+                 SubbandFormat format,
+                 const std::vector<cl::Event>& waitEvents,
+                 cl::Event* doneEvent)
+{
+    if (format != format_)
+        throw std::logic_error("TripleQuadToComplexDecimateFilterY: output "
+                               "doesn't match the format the kernel was "
+                               "built for");
+
     // Padding etc.
     cl::NDRange workgroupSize = {workgroupSize_, workgroupSize_, 1};
 
@@ -10,6 +10,7 @@
 
 
 #include "../imageBuffer.h"
+#include "../subbandFormat.h"
 
 
 class TripleQuadToComplexDecimateFilterY {
@@ -25,11 +26,14 @@ public:
             const std::vector<cl::Device>& devices,
             std::vector<float> filter0, bool swapPairOrder0,
             std::vector<float> filter1, bool swapPairOrder1,
-            std::vector<float> filter2, bool swapPairOrder2);
+            std::vector<float> filter2, bool swapPairOrder2,
+            SubbandFormat format = SubbandsComplex);
     // filter is the set of coefficients to convolve with the first of
     // the pair of trees forwards, and the second backwards.  The order
     // these trees are interleaved in the output is reversed if
-    // swapPairOrder is true.  filter must be even length.
+    // swapPairOrder is true.  filter must be even length.  format picks
+    // what gets written for each coefficient; the output passed in must
+    // have the matching element type.
 
     void operator() (cl::CommandQueue& cq, 
                      ImageBuffer<cl_float>& input,
@@ -38,13 +42,56 @@ public:
                         = std::vector<cl::Event>(),
                      cl::Event* doneEvent = nullptr);
 
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     ImageBuffer<cl_float>& magnitudes,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsMagnitude
+
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     ImageBuffer<cl_uint>& polar,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsPolar
+
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     PlanarSubbands& planar,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsPlanar
+
+    void operator() (cl::CommandQueue& cq, 
+                     ImageBuffer<cl_float>& input,
+                     TiledSubbands& tiled,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>(),
+                     cl::Event* doneEvent = nullptr);
+    // For SubbandsTiled
+
+    SubbandFormat format() const { return format_; }
+
 private:
 
     cl::Context context_;
     cl::Kernel kernel_;
     cl::Buffer filter_;
 
+    template <typename Output>
+    void enqueue_(cl::CommandQueue& cq, 
+                  ImageBuffer<cl_float>& input,
+                  Output& output,
+                  SubbandFormat format,
+                  const std::vector<cl::Event>& waitEvents,
+                  cl::Event* doneEvent);
+
     size_t filterLength_;
+    SubbandFormat format_ = SubbandsComplex;
 
     static const size_t padding_ = 16,
                         alignment_ = 32,
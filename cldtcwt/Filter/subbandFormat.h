@@ -0,0 +1,212 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef SUBBAND_FORMAT_H
+#define SUBBAND_FORMAT_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+
+#include "imageBuffer.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+
+// What the quad-to-complex kernels write for each subband coefficient.  The
+// values match SUBBANDS_* in QuadToComplex/polar.cl.
+enum SubbandFormat {
+    SubbandsComplex = 0,    // Complex<cl_float>, real then imaginary
+    SubbandsMagnitude = 1,  // cl_float magnitude only
+    SubbandsPolar = 2,      // cl_uint: magnitude with quantised phase packed
+                            // into its low mantissa bits
+    SubbandsPlanar = 3,     // cl_float real and imaginary parts, each in
+                            // its own slice (see PlanarSubbands)
+    SubbandsTiled = 4       // Complex<cl_float> in square tiles (see
+                            // TiledSubbands)
+};
+
+
+class PlanarSubbands : public ImageBuffer<cl_float> {
+    // A level's six orientations with the real and imaginary parts kept
+    // apart: orientation n's real parts are slice 2n and its imaginary parts
+    // slice 2n + 1.  Consumers that work through many coefficients at once
+    // (SIMD on a CPU, or a single part of each) then read contiguous runs
+    // of one part rather than shuffling pairs apart.
+
+public:
+    PlanarSubbands() = default;
+    PlanarSubbands(cl::Context context, cl_mem_flags flags,
+                   size_t width, size_t height,
+                   size_t padding, size_t alignment,
+                   size_t numOrientations = 6)
+     : ImageBuffer<cl_float>(context, flags, width, height,
+                             padding, alignment, 2 * numOrientations)
+    {}
+
+    size_t numOrientations() const { return numSlices() / 2; }
+};
+
+
+class TiledSubbands {
+    // A level's six orientations as interleaved complex values, but stored
+    // in tileSize x tileSize tiles: tile after tile along each row of tiles,
+    // and row by row within each tile.  Each row of a tile is a 64-byte
+    // cache line, so the scattered small neighbourhoods the interpolating
+    // consumers sample touch a couple of lines each rather than one per
+    // row.
+    //
+    // The width and height are rounded up to whole tiles in memory; the
+    // coefficients past the edges are never written, and consumers must not
+    // use them.  stride() is the distance, in elements, from one row of
+    // tiles to the next, and padding() is always zero.
+
+public:
+    static const size_t tileSize = 8;
+    // Must match SUBBAND_TILE in subbandLayout.cl
+
+    TiledSubbands() = default;
+    TiledSubbands(cl::Context context, cl_mem_flags flags,
+                  size_t width, size_t height,
+                  size_t numSlices = 6)
+     : width_(width), height_(height),
+       stride_(tilesAcross(width) * tileSize * tileSize),
+       pitch_(tilesAcross(height) * stride_),
+       numSlices_(numSlices)
+    {
+        buffer_ = cl::Buffer {
+            context, flags,
+            numSlices_ * pitch_ * sizeof(Complex<cl_float>)
+        };
+    }
+
+    cl::Buffer buffer() const { return buffer_; }
+    size_t start(int slice = 0) const { return slice * pitch_; }
+
+    size_t width() const { return width_; }
+    size_t height() const { return height_; }
+    size_t padding() const { return 0; }
+    size_t stride() const { return stride_; }
+    size_t pitch() const { return pitch_; }
+    size_t numSlices() const { return numSlices_; }
+
+    size_t offset(size_t x, size_t y) const
+    {
+        // Of (x, y) from the start of its slice, as subbandOffset
+        return (y / tileSize) * stride_ + (x / tileSize) * tileSize * tileSize
+             + (y % tileSize) * tileSize + x % tileSize;
+    }
+
+private:
+    static size_t tilesAcross(size_t length)
+    {
+        return (length + tileSize - 1) / tileSize;
+    }
+
+    cl::Buffer buffer_;
+
+    size_t width_;
+    size_t height_;
+    size_t stride_;
+    size_t pitch_;
+    size_t numSlices_;
+};
+
+
+// SubbandLayout<Level>
+//
+// For each type a level of complex subbands can be stored as, its element
+// type and the format that produces it, so consumers can be written once
+// for any.  Their kernels are told about planar levels with
+// PLANAR_SUBBANDS, and tiled ones with TILED_SUBBANDS (see
+// subbandLayout.cl).
+
+template <typename Level>
+struct SubbandLayout;
+
+template <>
+struct SubbandLayout<ImageBuffer<Complex<cl_float>>> {
+    typedef Complex<cl_float> Element;
+    static const SubbandFormat format = SubbandsComplex;
+};
+
+template <>
+struct SubbandLayout<PlanarSubbands> {
+    typedef cl_float Element;
+    static const SubbandFormat format = SubbandsPlanar;
+};
+
+template <>
+struct SubbandLayout<TiledSubbands> {
+    typedef Complex<cl_float> Element;
+    static const SubbandFormat format = SubbandsTiled;
+};
+
+
+inline void readComplex(cl::CommandQueue& cq,
+                        const ImageBuffer<Complex<cl_float>>& level,
+                        size_t orientation, Complex<cl_float>* output)
+{
+    // Reads one orientation back, interleaved, whichever the layout
+    level.read(cq, output, {}, orientation);
+}
+
+
+inline void readComplex(cl::CommandQueue& cq,
+                        const PlanarSubbands& level,
+                        size_t orientation, Complex<cl_float>* output)
+{
+    const size_t size = level.width() * level.height();
+    std::vector<cl_float> real(size), imag(size);
+
+    level.read(cq, real.data(), {}, 2 * orientation);
+    level.read(cq, imag.data(), {}, 2 * orientation + 1);
+
+    for (size_t n = 0; n < size; ++n)
+        output[n] = {real[n], imag[n]};
+}
+
+
+inline void readComplex(cl::CommandQueue& cq,
+                        const TiledSubbands& level,
+                        size_t orientation, Complex<cl_float>* output)
+{
+    std::vector<Complex<cl_float>> tiles(level.pitch());
+
+    cq.enqueueReadBuffer(level.buffer(), CL_TRUE,
+                         level.start(orientation) * sizeof(Complex<cl_float>),
+                         tiles.size() * sizeof(Complex<cl_float>),
+                         tiles.data());
+
+    for (size_t y = 0; y < level.height(); ++y)
+        for (size_t x = 0; x < level.width(); ++x)
+            *output++ = tiles[level.offset(x, y)];
+}
+
+
+// Packed polar coefficients keep the top 24 bits of the float magnitude
+// (a relative error under 2^-15) and the phase in the bottom eight, as a
+// fraction of a turn starting at -pi.
+const cl_uint polarPhaseSteps = 256;
+
+
+inline float polarMagnitude(cl_uint packed)
+{
+    const cl_uint bits = packed & ~(polarPhaseSteps - 1);
+
+    float magnitude;
+    std::memcpy(&magnitude, &bits, sizeof(magnitude));
+    return magnitude;
+}
+
+
+inline float polarPhase(cl_uint packed)
+{
+    // In [-pi, pi)
+    return float((packed & (polarPhaseSteps - 1))
+                 * (2 * M_PI / polarPhaseSteps) - M_PI);
+}
+
+
+#endif
@@ -0,0 +1,63 @@
+// Copyright (C) 2013 Timothy Gale
+// Addressing complex subbands in any of their layouts, for building into
+// the programs that use them ahead of their own source.  PLANAR_SUBBANDS
+// should be defined if the levels are PlanarSubbands (the real and
+// imaginary parts of each orientation in consecutive slices), and
+// TILED_SUBBANDS if they are TiledSubbands (see subbandOffset); with
+// neither, they are the interleaved, row-major Subbands.
+//
+// Kernels take the level as const __global SubbandElement*, with the usual
+// start, pitch and stride in elements.
+
+#ifdef PLANAR_SUBBANDS
+    typedef float SubbandElement;
+    #define SUBBAND_SLICES 2
+#else
+    typedef float2 SubbandElement;
+    #define SUBBAND_SLICES 1
+#endif
+
+
+// Side of the square tiles, matching TiledSubbands::tileSize
+#define SUBBAND_TILE 8
+
+
+inline size_t subbandOffset(int x, int y, uint stride)
+{
+    // How far (x, y), which must be within the level, is from the start of
+    // its orientation.  Tiled levels go tile by tile along each row of
+    // tiles, and row by row within a tile, so a small neighbourhood sits
+    // in a few adjacent blocks of memory rather than on as many rows as it
+    // is high.  stride is then the distance from one row of tiles to the
+    // next.
+#ifdef TILED_SUBBANDS
+    const uint ux = x, uy = y;
+
+    return (uy / SUBBAND_TILE) * stride
+         + (ux / SUBBAND_TILE) * (SUBBAND_TILE * SUBBAND_TILE)
+         + (uy % SUBBAND_TILE) * SUBBAND_TILE + ux % SUBBAND_TILE;
+#else
+    return x + y * stride;
+#endif
+}
+
+
+inline size_t orientationStart(uint start, uint pitch, int orientation)
+{
+    // Where an orientation begins (its real parts, if planar)
+    return start + orientation * SUBBAND_SLICES * pitch;
+}
+
+
+inline float2 readSubband(const __global SubbandElement* sb, size_t idx,
+                          uint pitch)
+{
+    // The coefficient at idx, counting from the buffer start, in an
+    // orientation that begins at or before idx
+#ifdef PLANAR_SUBBANDS
+    return (float2) (sb[idx], sb[idx + pitch]);
+#else
+    return sb[idx];
+#endif
+}
+
@@ -0,0 +1,13 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef SUBBAND_LAYOUT_H
+#define SUBBAND_LAYOUT_H
+
+// The functions for reading either subband layout (see subbandLayout.cl),
+// for consumers to build in ahead of their own source
+
+namespace SubbandLayoutNS {
+    extern const unsigned char subbandLayout_cl[];
+    extern const unsigned int subbandLayout_cl_len;
+}
+
+#endif
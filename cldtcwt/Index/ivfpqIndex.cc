@@ -0,0 +1,652 @@
+// Copyright (C) 2013 Timothy Gale
+#include "ivfpqIndex.h"
+#include "util/fileIO.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <limits>
+#include <queue>
+#include <thread>
+#include <stdexcept>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// File layout: a header, the coarse centroids and the subquantiser
+// codebooks, then the segments, each starting on a multiple of
+// segmentAlignment so it can be mapped on its own.  A segment is a header,
+// then numLists + 1 offsets to where each list's entries start, then the
+// ids and the codes, both sorted by list.  The segment header is written
+// last, so a segment cut short (by a crash, say) can be recognised and
+// dropped when the file is next opened.
+
+namespace {
+
+const char fileMagic[8] = {'C', 'L', 'D', 'T', 'I', 'V', 'P', 'Q'};
+const char segmentMagic[8] = {'I', 'V', 'P', 'Q', 'S', 'E', 'G', '1'};
+const uint32_t fileVersion = 1;
+const std::string what = "IVFPQIndex";
+
+const uint64_t segmentAlignment = 1 << 16;  // A multiple of any page size
+const uint64_t segmentHeaderLength = 64;
+const uint64_t centroidsOffset = 64;
+
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t numLists;
+    uint32_t numSubquantisers;
+    uint32_t numCentroids;
+    uint32_t reserved;
+};
+
+
+struct SegmentHeader {
+    char magic[8];
+    uint64_t numEntries;
+    uint64_t length;        // Including the header
+};
+
+
+float squaredDistance(const float* a, const float* b, size_t length)
+{
+    float acc = 0.f;
+    for (size_t n = 0; n < length; ++n) {
+        float d = a[n] - b[n];
+        acc += d * d;
+    }
+    return acc;
+}
+
+
+size_t nearest(const float* v, const float* centroids,
+               size_t numCentroids, size_t dimension)
+{
+    size_t best = 0;
+    float bestDist = std::numeric_limits<float>::infinity();
+
+    for (size_t c = 0; c < numCentroids; ++c) {
+        float d = squaredDistance(v, &centroids[c * dimension], dimension);
+        if (d < bestDist) {
+            bestDist = d;
+            best = c;
+        }
+    }
+
+    return best;
+}
+
+
+void kmeans(const float* data, size_t num, size_t dimension,
+            size_t numCentroids, size_t numIterations,
+            std::mt19937& rng, float* centroids)
+{
+    // Lloyd's algorithm, starting from distinct random points.  Clusters
+    // that empty are restarted at a random point.
+    std::vector<size_t> order(num);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    for (size_t c = 0; c < numCentroids; ++c)
+        std::copy(&data[order[c] * dimension],
+                  &data[(order[c] + 1) * dimension],
+                  &centroids[c * dimension]);
+
+    std::vector<float> sums(numCentroids * dimension);
+    std::vector<size_t> counts(numCentroids);
+    std::uniform_int_distribution<size_t> anyPoint(0, num - 1);
+
+    for (size_t it = 0; it < numIterations; ++it) {
+
+        std::fill(sums.begin(), sums.end(), 0.f);
+        std::fill(counts.begin(), counts.end(), 0);
+
+        for (size_t n = 0; n < num; ++n) {
+            const float* v = &data[n * dimension];
+            size_t c = nearest(v, centroids, numCentroids, dimension);
+            ++counts[c];
+            for (size_t d = 0; d < dimension; ++d)
+                sums[c * dimension + d] += v[d];
+        }
+
+        for (size_t c = 0; c < numCentroids; ++c) {
+            float* centroid = &centroids[c * dimension];
+            if (counts[c] > 0)
+                for (size_t d = 0; d < dimension; ++d)
+                    centroid[d] = sums[c * dimension + d] / counts[c];
+            else {
+                const float* v = &data[anyPoint(rng) * dimension];
+                std::copy(v, v + dimension, centroid);
+            }
+        }
+    }
+}
+
+}
+
+
+
+struct IVFPQIndex::Segment {
+    void* map;
+    size_t mapLength;
+    uint64_t numEntries;
+
+    const uint64_t* listStarts;
+    const uint64_t* ids;
+    const uint8_t* codes;
+
+    ~Segment() { munmap(map, mapLength); }
+};
+
+
+
+IVFPQIndex::IVFPQIndex(const std::string& filename, OpenMode mode)
+{
+    open(filename, false, mode);
+}
+
+
+
+IVFPQIndex::IVFPQIndex(const std::string& filename, const Params& params,
+                       const float* samples, size_t numSamples,
+                       unsigned int seed)
+   : params_(params)
+{
+    if (params.dimension == 0 || params.numLists == 0
+     || params.numSubquantisers == 0
+     || params.dimension % params.numSubquantisers != 0)
+        throw std::logic_error("IVFPQIndex: subquantisers must divide the "
+                               "dimension");
+
+    if (numSamples < std::max(params.numLists, numCentroids))
+        throw std::logic_error("IVFPQIndex: too few samples to train on");
+
+    subDimension_ = params.dimension / params.numSubquantisers;
+
+    train(samples, numSamples, seed);
+    open(filename, true, ReadWrite);
+}
+
+
+
+IVFPQIndex::~IVFPQIndex()
+{
+    try {
+        flush();
+    } catch (std::exception&) {
+        // Nothing to be done about it now
+    }
+
+    segments_.reset();
+
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+
+
+void IVFPQIndex::train(const float* samples, size_t numSamples,
+                       unsigned int seed)
+{
+    std::mt19937 rng(seed);
+
+    const size_t dimension = params_.dimension,
+                 numSubquantisers = params_.numSubquantisers;
+
+    coarse_.resize(params_.numLists * dimension);
+    kmeans(samples, numSamples, dimension, params_.numLists,
+           params_.numIterations, rng, &coarse_[0]);
+
+    // Each subquantiser is trained on its part of the residuals
+    std::vector<float> residuals(numSamples * dimension);
+    for (size_t n = 0; n < numSamples; ++n) {
+        const float* v = &samples[n * dimension];
+        const float* c = &coarse_[nearestList(v) * dimension];
+        for (size_t d = 0; d < dimension; ++d)
+            residuals[n * dimension + d] = v[d] - c[d];
+    }
+
+    codebooks_.resize(numSubquantisers * numCentroids * subDimension_);
+    std::vector<float> part(numSamples * subDimension_);
+
+    for (size_t m = 0; m < numSubquantisers; ++m) {
+
+        for (size_t n = 0; n < numSamples; ++n)
+            std::copy(&residuals[n * dimension + m * subDimension_],
+                      &residuals[n * dimension + (m + 1) * subDimension_],
+                      &part[n * subDimension_]);
+
+        kmeans(&part[0], numSamples, subDimension_, numCentroids,
+               params_.numIterations, rng,
+               &codebooks_[m * numCentroids * subDimension_]);
+    }
+}
+
+
+
+void IVFPQIndex::open(const std::string& filename, bool create,
+                      OpenMode mode)
+{
+    readOnly_ = mode == ReadOnly;
+
+    int flags = readOnly_? O_RDONLY : O_RDWR;
+    if (create)
+        flags |= O_CREAT | O_TRUNC;
+
+    fd_ = ::open(filename.c_str(), flags, 0644);
+    if (fd_ < 0)
+        throwErrno(what, "could not open " + filename);
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        throwErrno(what, "stat failed");
+    const uint64_t fileSize = st.st_size;
+
+    segments_ = std::make_shared<std::vector<std::shared_ptr<Segment>>>();
+
+    FileHeader header;
+
+    if (create) {
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.version = fileVersion;
+        header.dimension = params_.dimension;
+        header.numLists = params_.numLists;
+        header.numSubquantisers = params_.numSubquantisers;
+        header.numCentroids = numCentroids;
+
+        writeAll(fd_, &header, sizeof(header), 0, what);
+        writeAll(fd_, &coarse_[0], coarse_.size() * sizeof(float),
+                 centroidsOffset, what);
+        writeAll(fd_, &codebooks_[0], codebooks_.size() * sizeof(float),
+                 centroidsOffset + coarse_.size() * sizeof(float), what);
+
+    } else {
+
+        if (!readAll(fd_, &header, sizeof(header), 0, what)
+         || std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0)
+            throw std::runtime_error("IVFPQIndex: " + filename
+                                     + " is not an index");
+
+        if (header.version != fileVersion
+         || header.numCentroids != numCentroids
+         || header.dimension == 0 || header.numLists == 0
+         || header.numSubquantisers == 0
+         || header.dimension % header.numSubquantisers != 0)
+            throw std::runtime_error("IVFPQIndex: " + filename
+                                     + " has an unsupported format");
+
+        // Check the size before trusting it to allocate
+        if (fileSize < centroidsOffset
+         || (fileSize - centroidsOffset) / sizeof(float) / header.dimension
+             < uint64_t(header.numLists) + numCentroids)
+            throw std::runtime_error("IVFPQIndex: " + filename
+                                     + " is truncated");
+
+        params_.dimension = header.dimension;
+        params_.numLists = header.numLists;
+        params_.numSubquantisers = header.numSubquantisers;
+        params_.numIterations = 0;
+        subDimension_ = params_.dimension / params_.numSubquantisers;
+
+        coarse_.resize(params_.numLists * params_.dimension);
+        codebooks_.resize(params_.numSubquantisers * numCentroids
+                          * subDimension_);
+
+        if (!readAll(fd_, &coarse_[0], coarse_.size() * sizeof(float),
+                     centroidsOffset, what)
+         || !readAll(fd_, &codebooks_[0], codebooks_.size() * sizeof(float),
+                     centroidsOffset + coarse_.size() * sizeof(float), what))
+            throw std::runtime_error("IVFPQIndex: " + filename
+                                     + " is truncated");
+    }
+
+    pendingIds_.assign(params_.numLists, std::vector<uint64_t>());
+    pendingCodes_.assign(params_.numLists, std::vector<uint8_t>());
+
+    fileEnd_ = alignUp(centroidsOffset
+                        + (coarse_.size() + codebooks_.size())
+                           * sizeof(float),
+                       segmentAlignment);
+
+    if (create)
+        return;
+
+    // Map each complete segment
+    const uint64_t minLength = segmentHeaderLength
+                             + (params_.numLists + 1) * sizeof(uint64_t),
+                   entryLength = sizeof(uint64_t)
+                               + params_.numSubquantisers;
+
+    SegmentHeader segHeader;
+    std::vector<uint64_t> listStarts(params_.numLists + 1);
+
+    while (fileEnd_ + segmentHeaderLength <= fileSize
+        && readAll(fd_, &segHeader, sizeof(segHeader), fileEnd_, what)
+        && std::memcmp(segHeader.magic, segmentMagic,
+                       sizeof(segmentMagic)) == 0
+        && segHeader.length <= fileSize - fileEnd_) {
+
+        // A finished segment holds exactly what its header says, with
+        // lists that run in order through its entries
+        bool whole = segHeader.length >= minLength
+                  && segHeader.numEntries
+                      <= (segHeader.length - minLength) / entryLength
+                  && segHeader.length
+                      == minLength + segHeader.numEntries * entryLength
+                  && readAll(fd_, &listStarts[0],
+                             listStarts.size() * sizeof(uint64_t),
+                             fileEnd_ + segmentHeaderLength, what)
+                  && listStarts.front() == 0
+                  && listStarts.back() == segHeader.numEntries
+                  && std::is_sorted(listStarts.begin(), listStarts.end());
+
+        if (!whole)
+            throw std::runtime_error("IVFPQIndex: " + filename
+                                     + " is corrupt");
+
+        mapSegment(fileEnd_, segHeader.length, segHeader.numEntries);
+        fileEnd_ = alignUp(fileEnd_ + segHeader.length, segmentAlignment);
+    }
+
+    // Anything after is a segment that was never finished.  Leave it alone
+    // if only searching: the file may be being added to elsewhere.
+    if (!readOnly_ && fileSize > fileEnd_ && ftruncate(fd_, fileEnd_) != 0)
+        throwErrno(what, "truncate failed");
+}
+
+
+
+void IVFPQIndex::mapSegment(uint64_t offset, uint64_t length,
+                            uint64_t numEntries)
+{
+    void* map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd_, offset);
+    if (map == MAP_FAILED)
+        throwErrno(what, "mmap failed");
+
+    std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+    segment->map = map;
+    segment->mapLength = length;
+    segment->numEntries = numEntries;
+
+    const char* base = static_cast<const char*> (map);
+    segment->listStarts = reinterpret_cast<const uint64_t*>
+                            (base + segmentHeaderLength);
+    segment->ids = segment->listStarts + params_.numLists + 1;
+    segment->codes = reinterpret_cast<const uint8_t*>
+                        (segment->ids + numEntries);
+
+    std::lock_guard<std::mutex> lock(segmentsMutex_);
+
+    auto segments
+        = std::make_shared<std::vector<std::shared_ptr<Segment>>>(*segments_);
+    segments->push_back(segment);
+    segments_ = segments;
+}
+
+
+
+size_t IVFPQIndex::nearestList(const float* descriptor) const
+{
+    return nearest(descriptor, &coarse_[0], params_.numLists,
+                   params_.dimension);
+}
+
+
+
+void IVFPQIndex::encode(const float* descriptor, size_t list,
+                        uint8_t* code) const
+{
+    const float* c = &coarse_[list * params_.dimension];
+
+    std::vector<float> residual(subDimension_);
+
+    for (size_t m = 0; m < params_.numSubquantisers; ++m) {
+        for (size_t d = 0; d < subDimension_; ++d)
+            residual[d] = descriptor[m * subDimension_ + d]
+                        - c[m * subDimension_ + d];
+
+        code[m] = nearest(&residual[0],
+                          &codebooks_[m * numCentroids * subDimension_],
+                          numCentroids, subDimension_);
+    }
+}
+
+
+
+void IVFPQIndex::add(const float* descriptors, size_t numDescriptors,
+                     uint64_t firstId)
+{
+    if (readOnly_)
+        throw std::logic_error("IVFPQIndex: adding to an index opened read "
+                               "only");
+
+    const size_t numBytes = params_.numSubquantisers;
+
+    // Encoding is the slow part, so do it before taking the lock
+    std::vector<size_t> lists(numDescriptors);
+    std::vector<uint8_t> codes(numDescriptors * numBytes);
+
+    for (size_t n = 0; n < numDescriptors; ++n) {
+        const float* d = &descriptors[n * params_.dimension];
+        lists[n] = nearestList(d);
+        encode(d, lists[n], &codes[n * numBytes]);
+    }
+
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+
+    for (size_t n = 0; n < numDescriptors; ++n) {
+        pendingIds_[lists[n]].push_back(firstId + n);
+        pendingCodes_[lists[n]].insert(pendingCodes_[lists[n]].end(),
+                                       &codes[n * numBytes],
+                                       &codes[(n + 1) * numBytes]);
+    }
+    numPending_ += numDescriptors;
+
+    if (numPending_ >= segmentSize)
+        flushPending();
+}
+
+
+
+void IVFPQIndex::flush()
+{
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    flushPending();
+}
+
+
+
+void IVFPQIndex::flushPending()
+{
+    if (numPending_ == 0)
+        return;
+
+    const size_t numLists = params_.numLists,
+                 numBytes = params_.numSubquantisers;
+
+    const uint64_t idsOffset = segmentHeaderLength
+                             + (numLists + 1) * sizeof(uint64_t),
+                   codesOffset = idsOffset + numPending_ * sizeof(uint64_t),
+                   length = codesOffset + numPending_ * numBytes;
+
+    std::vector<char> body(length - segmentHeaderLength);
+    uint64_t* listStarts = reinterpret_cast<uint64_t*> (&body[0]);
+    uint64_t* ids = reinterpret_cast<uint64_t*>
+                        (&body[idsOffset - segmentHeaderLength]);
+    uint8_t* codes = reinterpret_cast<uint8_t*>
+                        (&body[codesOffset - segmentHeaderLength]);
+
+    uint64_t pos = 0;
+    for (size_t l = 0; l < numLists; ++l) {
+        listStarts[l] = pos;
+        std::copy(pendingIds_[l].begin(), pendingIds_[l].end(), &ids[pos]);
+        std::copy(pendingCodes_[l].begin(), pendingCodes_[l].end(),
+                  &codes[pos * numBytes]);
+        pos += pendingIds_[l].size();
+    }
+    listStarts[numLists] = pos;
+
+    // The body has to be on disk before the header that says it's whole
+    writeAll(fd_, &body[0], body.size(), fileEnd_ + segmentHeaderLength,
+             what);
+    if (fdatasync(fd_) != 0)
+        throwErrno(what, "sync failed");
+
+    SegmentHeader header;
+    std::memcpy(header.magic, segmentMagic, sizeof(segmentMagic));
+    header.numEntries = numPending_;
+    header.length = length;
+    writeAll(fd_, &header, sizeof(header), fileEnd_, what);
+
+    mapSegment(fileEnd_, length, numPending_);
+    fileEnd_ = alignUp(fileEnd_ + length, segmentAlignment);
+
+    for (size_t l = 0; l < numLists; ++l) {
+        pendingIds_[l].clear();
+        pendingCodes_[l].clear();
+    }
+    numPending_ = 0;
+}
+
+
+
+size_t IVFPQIndex::size() const
+{
+    std::lock_guard<std::mutex> lock(segmentsMutex_);
+
+    size_t total = 0;
+    for (auto& segment: *segments_)
+        total += segment->numEntries;
+    return total;
+}
+
+
+
+size_t IVFPQIndex::numSegments() const
+{
+    std::lock_guard<std::mutex> lock(segmentsMutex_);
+    return segments_->size();
+}
+
+
+
+void IVFPQIndex::search(const float* queries, size_t numQueries,
+                        size_t k, size_t numProbes,
+                        int64_t* ids, float* distances,
+                        size_t numThreads) const
+{
+    if (k == 0)
+        throw std::logic_error("IVFPQIndex: k must be at least one");
+
+    numProbes = std::min(std::max(numProbes, size_t(1)), params_.numLists);
+    numThreads = std::min(std::max(numThreads, size_t(1)), numQueries);
+
+    if (numThreads <= 1) {
+        searchRange(queries, 0, numQueries, k, numProbes, ids, distances);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        size_t begin = numQueries * t / numThreads,
+               end = numQueries * (t + 1) / numThreads;
+        threads.push_back(std::thread(&IVFPQIndex::searchRange, this,
+                                      queries, begin, end, k, numProbes,
+                                      ids, distances));
+    }
+
+    for (auto& thread: threads)
+        thread.join();
+}
+
+
+
+void IVFPQIndex::searchRange(const float* queries, size_t begin, size_t end,
+                             size_t k, size_t numProbes,
+                             int64_t* ids, float* distances) const
+{
+    std::shared_ptr<const std::vector<std::shared_ptr<Segment>>> segments;
+    {
+        std::lock_guard<std::mutex> lock(segmentsMutex_);
+        segments = segments_;
+    }
+
+    const size_t dimension = params_.dimension,
+                 numLists = params_.numLists,
+                 numBytes = params_.numSubquantisers;
+
+    std::vector<std::pair<float, size_t>> listDists(numLists);
+    std::vector<float> residual(dimension);
+    std::vector<float> table(numBytes * numCentroids);
+
+    // Largest distance on top, to be replaced
+    std::priority_queue<std::pair<float, int64_t>> best;
+
+    for (size_t q = begin; q < end; ++q) {
+
+        const float* query = &queries[q * dimension];
+
+        for (size_t l = 0; l < numLists; ++l)
+            listDists[l] = std::make_pair(
+                squaredDistance(query, &coarse_[l * dimension], dimension),
+                l);
+        std::partial_sort(listDists.begin(), listDists.begin() + numProbes,
+                          listDists.end());
+
+        for (size_t p = 0; p < numProbes; ++p) {
+
+            const size_t l = listDists[p].second;
+
+            // Distances from the residual to every codebook entry
+            for (size_t d = 0; d < dimension; ++d)
+                residual[d] = query[d] - coarse_[l * dimension + d];
+
+            for (size_t m = 0; m < numBytes; ++m)
+                for (size_t c = 0; c < numCentroids; ++c)
+                    table[m * numCentroids + c] = squaredDistance(
+                        &residual[m * subDimension_],
+                        &codebooks_[(m * numCentroids + c) * subDimension_],
+                        subDimension_);
+
+            for (auto& segment: *segments)
+                for (uint64_t e = segment->listStarts[l];
+                     e < segment->listStarts[l + 1]; ++e) {
+
+                    const uint8_t* code = &segment->codes[e * numBytes];
+
+                    float d = 0.f;
+                    for (size_t m = 0; m < numBytes; ++m)
+                        d += table[m * numCentroids + code[m]];
+
+                    if (best.size() < k)
+                        best.push(std::make_pair(d, segment->ids[e]));
+                    else if (d < best.top().first) {
+                        best.pop();
+                        best.push(std::make_pair(d, segment->ids[e]));
+                    }
+                }
+        }
+
+        // Out nearest first, padding with none found
+        for (size_t n = k; n > 0; --n) {
+            if (n > best.size()) {
+                ids[q * k + n - 1] = -1;
+                distances[q * k + n - 1]
+                    = std::numeric_limits<float>::infinity();
+            } else {
+                ids[q * k + n - 1] = best.top().second;
+                distances[q * k + n - 1] = best.top().first;
+                best.pop();
+            }
+        }
+    }
+}
+
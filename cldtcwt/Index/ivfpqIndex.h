@@ -0,0 +1,126 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef IVFPQINDEX_H
+#define IVFPQINDEX_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+
+
+class IVFPQIndex {
+// Approximate nearest-neighbour search over a large number of stored
+// descriptors: an inverted file with product quantisation.  Each
+// descriptor goes in the list of its nearest coarse centroid, stored as
+// one byte per subquantiser encoding the residual from that centroid.  A
+// search looks at only the lists nearest the query, and gets distances by
+// table lookup from the codes.
+//
+// The index lives in a file, which is memory-mapped to search.  Entries
+// are added in memory, then written out by flush() as a new segment on the
+// end of the file, so the index can be built up a frame at a time and
+// reopened later to carry on.  Segments already flushed never change, so
+// any number of threads can search while another adds.  Searches only see
+// flushed entries.
+//
+// Distances are squared Euclidean, and no search over rotations is made.
+
+public:
+
+    struct Params {
+        size_t dimension;           // Floats per descriptor
+        size_t numLists;            // Coarse centroids
+        size_t numSubquantisers;    // Bytes per entry; must divide dimension
+        size_t numIterations;       // Of k-means, when training
+    };
+
+    static const size_t numCentroids = 256;    // Per subquantiser
+
+    enum OpenMode { ReadWrite, ReadOnly };
+
+    IVFPQIndex(const std::string& filename, OpenMode mode = ReadWrite);
+    // Opens an existing index to add to or search.  Opening it to add drops
+    // any segment left unfinished on the end; opening it read only never
+    // changes the file, just ignores such a segment, and makes add() throw.
+
+    IVFPQIndex(const std::string& filename, const Params& params,
+               const float* samples, size_t numSamples,
+               unsigned int seed = 0);
+    // Creates a new index (replacing any existing file), with the centroids
+    // trained by k-means on the samples given (at least numCentroids of
+    // them, and at least numLists)
+
+    IVFPQIndex(const IVFPQIndex&) = delete;
+    IVFPQIndex& operator= (const IVFPQIndex&) = delete;
+    ~IVFPQIndex();
+
+    void add(const float* descriptors, size_t numDescriptors,
+             uint64_t firstId);
+    // Encodes descriptors, giving them ids firstId onwards.  They are
+    // flushed automatically once segmentSize are waiting.
+
+    void flush();
+    // Writes out anything added since the last flush
+
+    void search(const float* queries, size_t numQueries,
+                size_t k, size_t numProbes,
+                int64_t* ids, float* distances,
+                size_t numThreads = 1) const;
+    // For each query, the approximate k nearest entries from the numProbes
+    // lists nearest it, nearest first.  Query q's are at ids[q * k] and
+    // distances[q * k] onwards, with -1 ids where fewer were found.  The
+    // queries are shared between numThreads threads.
+
+    size_t size() const;
+    // Number of entries flushed (and so searchable)
+
+    size_t numSegments() const;
+
+    const Params& params() const { return params_; }
+
+    static const size_t segmentSize = 1 << 16;
+
+private:
+    struct Segment;
+
+    Params params_;
+    size_t subDimension_;
+
+    std::vector<float> coarse_;     // numLists x dimension
+    std::vector<float> codebooks_;  // numSubquantisers x numCentroids
+                                    // x subDimension
+
+    int fd_ = -1;
+    bool readOnly_ = false;
+    uint64_t fileEnd_;
+
+    // Segments are swapped for a new list when one is added, so searches
+    // can take a copy of the pointer and carry on with it
+    mutable std::mutex segmentsMutex_;
+    std::shared_ptr<const std::vector<std::shared_ptr<Segment>>> segments_;
+
+    // Entries added but not yet flushed, by list
+    std::mutex pendingMutex_;
+    std::vector<std::vector<uint64_t>> pendingIds_;
+    std::vector<std::vector<uint8_t>> pendingCodes_;
+    size_t numPending_ = 0;
+
+    void train(const float* samples, size_t numSamples, unsigned int seed);
+    void open(const std::string& filename, bool create, OpenMode mode);
+    void mapSegment(uint64_t offset, uint64_t length, uint64_t numEntries);
+    void flushPending();
+
+    size_t nearestList(const float* descriptor) const;
+    void encode(const float* descriptor, size_t list, uint8_t* code) const;
+    void searchRange(const float* queries, size_t begin, size_t end,
+                     size_t k, size_t numProbes,
+                     int64_t* ids, float* distances) const;
+};
+
+
+
+#endif
+
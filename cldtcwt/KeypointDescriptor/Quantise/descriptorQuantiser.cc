@@ -0,0 +1,136 @@
+// Copyright (C) 2013 Timothy Gale
+#include "descriptorQuantiser.h"
+#include "util/clUtil.h"
+#include "kernel.h"
+
+using namespace DescriptorQuantiserNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <stdexcept>
+
+
+DescriptorQuantiser::DescriptorQuantiser
+                    (cl::Context& context,
+                     const std::vector<cl::Device>& devices,
+                     size_t descriptorLength)
+   : context_(context), descriptorLength_(descriptorLength)
+{
+    if (descriptorLength == 0)
+        throw std::logic_error("DescriptorQuantiser: empty descriptors");
+
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (kernel_cl);
+    size_t fileTextLength = kernel_cl_len;
+
+    // Bundle the code up
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(fileText, fileTextLength));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_
+                        << " -D DESC_LEN=" << descriptorLength;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful parts, viz the kernels
+    int8Kernel_ = cl::Kernel(program, "quantiseInt8");
+    binaryKernel_ = cl::Kernel(program, "quantiseBinary");
+
+    // Enough workgroups to keep every compute unit busy
+    numWorkgroups_ = groupsPerComputeUnit_
+                * devices[0].getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+}
+
+
+
+size_t DescriptorQuantiser::codeBytes(Format format) const
+{
+    if (format == Int8)
+        return descriptorLength_;
+    else
+        return (descriptorLength_ + 31) / 32 * sizeof(cl_uint);
+}
+
+
+
+void DescriptorQuantiser::operator()
+      (cl::CommandQueue& commandQueue,
+       Format format,
+       const cl::Buffer& descriptors,
+       const cl::Buffer& counts, int countIdx,
+       size_t maxNumDescriptors,
+       cl::Buffer& codes,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    cl::Kernel& kernel = (format == Int8)? int8Kernel_ : binaryKernel_;
+
+    kernel.setArg(0, descriptors);
+    kernel.setArg(1, counts);
+    kernel.setArg(2, cl_int(countIdx));
+    kernel.setArg(3, cl_uint(maxNumDescriptors));
+    kernel.setArg(4, codes);
+
+    // The work items loop over however many descriptors there turn out to
+    // be: a workgroup per descriptor for Int8, and a work item per word for
+    // Binary
+    const size_t numItems = (format == Int8)?
+                               maxNumDescriptors * wgSize_
+                             : maxNumDescriptors * codeBytes(Binary)
+                                                 / sizeof(cl_uint);
+
+    const size_t globalSize
+        = roundWGs(std::max<size_t>(std::min(numItems,
+                                             numWorkgroups_ * wgSize_), 1),
+                   wgSize_);
+
+    commandQueue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                      {globalSize}, {wgSize_},
+                                      &waitEvents, doneEvent);
+}
+
+
+
+void DescriptorQuantiser::quantise(Format format, const float* descriptor,
+                                   size_t descriptorLength, void* code)
+{
+    if (format == Int8) {
+
+        float largest = 0.f;
+        for (size_t i = 0; i < descriptorLength; ++i)
+            largest = std::max(largest, std::fabs(descriptor[i]));
+
+        const float scale = (largest > 0.f)? 127.f / largest : 0.f;
+
+        int8_t* out = static_cast<int8_t*> (code);
+        for (size_t i = 0; i < descriptorLength; ++i)
+            out[i] = std::max(-128.f,
+                              std::min(127.f,
+                                       std::nearbyint(descriptor[i]
+                                                       * scale)));
+
+    } else {
+
+        uint32_t* out = static_cast<uint32_t*> (code);
+        std::fill(out, out + (descriptorLength + 31) / 32, 0);
+
+        for (size_t i = 0; i < descriptorLength; ++i)
+            if (descriptor[i] > 0.f)
+                out[i / 32] |= 1u << (i % 32);
+    }
+}
+
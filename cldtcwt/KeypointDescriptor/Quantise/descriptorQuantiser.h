@@ -0,0 +1,69 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef DESCRIPTORQUANTISER_H
+#define DESCRIPTORQUANTISER_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+
+
+class DescriptorQuantiser {
+// Turns float descriptors into compact codes on the device, so that less
+// has to be read back and stored:
+//
+//   Int8    Each descriptor scaled so its largest element is +-127, then
+//           rounded to one signed byte per element (a quarter the size).
+//           Compare with the cosine distance, which ignores the scaling.
+//   Binary  The sign of each element, one bit each, packed into 32-bit
+//           words (a thirty-second the size, less padding).  Compare by
+//           Hamming distance.
+
+public:
+
+    enum Format { Int8 = 0, Binary = 1 };
+
+    DescriptorQuantiser() = default;
+    DescriptorQuantiser(const DescriptorQuantiser&) = default;
+    DescriptorQuantiser(cl::Context& context,
+                        const std::vector<cl::Device>& devices,
+                        size_t descriptorLength);
+    // descriptorLength is in floats
+
+    void operator() (cl::CommandQueue& commandQueue,
+       Format format,
+       const cl::Buffer& descriptors,
+       const cl::Buffer& counts, int countIdx,
+       size_t maxNumDescriptors,
+       cl::Buffer& codes,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // Quantises the first counts[countIdx] descriptors (a count on the
+    // device, such as the total in a keypoint cumulative count), up to
+    // maxNumDescriptors.  codes needs codeBytes(format) per descriptor.
+
+    size_t codeBytes(Format format) const;
+    // Bytes per descriptor
+
+    static void quantise(Format format, const float* descriptor,
+                         size_t descriptorLength, void* code);
+    // The same on the host, for one descriptor (up to rounding of the
+    // Int8 scaling)
+
+private:
+    cl::Context context_;
+    cl::Kernel int8Kernel_, binaryKernel_;
+
+    size_t descriptorLength_;
+    size_t numWorkgroups_;
+
+    static const size_t wgSize_ = 64;
+    static const size_t groupsPerComputeUnit_ = 16;
+};
+
+
+
+#endif
+
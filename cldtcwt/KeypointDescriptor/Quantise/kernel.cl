@@ -0,0 +1,81 @@
+// Copyright (C) 2013 Timothy Gale
+// Quantising descriptors to compact codes, to cut down what has to be read
+// back and stored.  WG_SIZE (the workgroup size, a power of two) and
+// DESC_LEN (floats per descriptor) should be defined externally.
+//
+// Only the first min(counts[countIdx], maxNum) descriptors are done, so
+// the launch doesn't have to know how many keypoints were found.
+
+#define CODE_WORDS ((DESC_LEN + 31) / 32)
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void quantiseInt8(__global const float* descriptors,
+                  __global const unsigned int* counts,
+                  int countIdx,
+                  unsigned int maxNum,
+                  __global char* codes)
+{
+    // Each descriptor is scaled so its largest element is +-127 and
+    // rounded to DESC_LEN signed bytes.  Each workgroup does one descriptor
+    // at a time, taking every get_num_groups(0)th.
+    __local float largest[WG_SIZE];
+
+    const uint l = get_local_id(0);
+    const uint num = min(counts[countIdx], maxNum);
+
+    for (uint d = get_group_id(0); d < num; d += get_num_groups(0)) {
+
+        __global const float* v = &descriptors[d * DESC_LEN];
+
+        float m = 0.f;
+        for (uint i = l; i < DESC_LEN; i += WG_SIZE)
+            m = max(m, fabs(v[i]));
+        largest[l] = m;
+
+        for (uint n = WG_SIZE / 2; n > 0; n >>= 1) {
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if (l < n)
+                largest[l] = max(largest[l], largest[l + n]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        const float scale = (largest[0] > 0.f)? 127.f / largest[0] : 0.f;
+
+        for (uint i = l; i < DESC_LEN; i += WG_SIZE)
+            codes[d * DESC_LEN + i] = convert_char_sat_rte(v[i] * scale);
+
+        // Everyone has to have read largest[0] before it's reused
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void quantiseBinary(__global const float* descriptors,
+                    __global const unsigned int* counts,
+                    int countIdx,
+                    unsigned int maxNum,
+                    __global unsigned int* codes)
+{
+    // One bit per element, set if it is positive, packed into CODE_WORDS
+    // words per descriptor (element i in bit i % 32 of word i / 32, and any
+    // bits past the end clear).  Each work item does a word at a time.
+    const uint num = min(counts[countIdx], maxNum);
+
+    for (uint g = get_global_id(0); g < num * CODE_WORDS;
+         g += get_global_size(0)) {
+
+        const uint d = g / CODE_WORDS, w = g % CODE_WORDS;
+        __global const float* v = &descriptors[d * DESC_LEN + w * 32];
+        const uint numBits = min(32u, (uint) DESC_LEN - w * 32);
+
+        uint word = 0;
+        for (uint b = 0; b < numBits; ++b)
+            word |= (v[b] > 0.f)? (1u << b) : 0u;
+
+        codes[g] = word;
+    }
+}
+
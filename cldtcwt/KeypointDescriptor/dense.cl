@@ -0,0 +1,118 @@
+// Copyright (C) 2013 Timothy Gale
+// Descriptors on a regular grid over a level, rather than at a list of
+// keypoints.  Grid point g is at (gridOriginX, gridOriginY) + g * GRID_STEP
+// in the level's pixels.  Each workgroup covers WG_W x WG_H grid points,
+// and first loads the whole region they sample from (TILE_W x TILE_H, all
+// six orientations, already derotated) into local memory, so each
+// coefficient is read and derotated once per workgroup however many
+// descriptors use it.
+//
+// DIAMETER is as for extractDescriptor, and TILE_W and TILE_H must be at
+// least ceil((WG - 1) * GRID_STEP) + DIAMETER + 5.  The helpers come from
+// interpolate.cl, built in ahead of this.
+
+__kernel __attribute__((reqd_work_group_size(WG_W, WG_H, 1)))
+void extractDenseDescriptors(float gridOriginX, float gridOriginY,
+                             unsigned int gridWidth,
+                             unsigned int gridHeight,
+                             const __global float2* sampleLocs,
+                             const int numSampleLocs,
+                             int stride, int offset,
+                             __global float2* output,
+                             unsigned int outputRowStride,
+                             const __global SubbandElement* sb,
+                             unsigned int sbStart,
+                             unsigned int sbPitch,
+                             unsigned int sbPadding,
+                             unsigned int sbStride,
+                             unsigned int sbWidth,
+                             unsigned int sbHeight)
+{
+    // As in extractDescriptor
+    const float2 offsets[6] = {
+        (float2) ( 0, 1), (float2) ( 0,-1), (float2) ( 0, 1),
+        (float2) (-1, 0), (float2) ( 1, 0), (float2) (-1, 0)
+    };
+
+    const float2 angularFreq[6] = {
+        (float2) (-1,-3) * M_PI_F / 2.15f,
+        (float2) (-sqrt(5.f), -sqrt(5.f)) * M_PI_F / 2.15f,
+        (float2) (-3, -1) * M_PI_F / 2.15f,
+        (float2) (-3,  1) * M_PI_F / 2.15f,
+        (float2) (-sqrt(5.f), sqrt(5.f)) * M_PI_F / 2.15f,
+        (float2) (-1, 3) * M_PI_F / 2.15f
+    };
+
+    const float2 gridOrigin = (float2) (gridOriginX, gridOriginY);
+
+    const int2 g = (int2) (get_global_id(0), get_global_id(1));
+    const int2 l = (int2) (get_local_id(0), get_local_id(1));
+
+    // The region starts where extractDescriptor's would for the
+    // workgroup's first grid point
+    const int2 firstPoint = (int2) (get_group_id(0) * WG_W,
+                                    get_group_id(1) * WG_H);
+    const int2 tileStart
+        = convert_int2(floor(gridOrigin + convert_float2(firstPoint)
+                                          * GRID_STEP))
+        - (DIAMETER / 2) - 1;
+
+    __local float2 sbVals[6][TILE_H][TILE_W];
+
+    for (int n = 0; n < 6; ++n) {
+
+        const __global SubbandElement* orientation
+            = sb + orientationStart(sbStart, sbPitch, n);
+
+        for (int y = l.y; y < TILE_H; y += WG_H)
+            for (int x = l.x; x < TILE_W; x += WG_W)
+                sbVals[n][y][x]
+                    = readSBAndDerotate(orientation,
+                                        tileStart + (int2) (x, y),
+                                        angularFreq[n], offsets[n],
+                                        sbPadding, sbStride, sbPitch,
+                                        (uint2) (sbWidth, sbHeight));
+
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Work items past the edge of the grid only help with the loading
+    if (all(g < (int2) (gridWidth, gridHeight))) {
+
+        const float2 kpPos = gridOrigin + convert_float2(g) * GRID_STEP;
+
+        float2 kpRemPos;
+        int2 kpIntPos = ifract(kpPos, &kpRemPos);
+
+        // Where extractDescriptor's sbVals would begin, within the tile
+        const int2 base = kpIntPos - (DIAMETER / 2) - 1 - tileStart;
+
+        __global float2* descriptor
+            = output + 6 * ((g.x + g.y * outputRowStride) * stride
+                            + offset);
+
+        for (int s = 0; s < numSampleLocs; ++s) {
+
+            float2 sampleRemPosLocal;
+            int2 sampleIntPosLocal = ifract(1.0 + DIAMETER / 2.0
+                                       + kpRemPos + sampleLocs[s],
+                                       &sampleRemPosLocal);
+
+            float interpCoeffsX[4];
+            cubicCoefficients(sampleRemPosLocal.x, interpCoeffsX);
+            float interpCoeffsY[4];
+            cubicCoefficients(sampleRemPosLocal.y, interpCoeffsY);
+
+            for (int n = 0; n < 6; ++n)
+                descriptor[n + s * 6]
+                  = rerotate(interp(&sbVals[n][0][0], TILE_W,
+                                    base + sampleIntPosLocal - 1,
+                                    interpCoeffsX, interpCoeffsY),
+                             kpPos + sampleLocs[s],
+                             angularFreq[n]);
+
+        }
+
+    }
+}
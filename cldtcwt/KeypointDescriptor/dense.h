@@ -0,0 +1,13 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef DENSE_H
+#define DENSE_H
+
+// The grid descriptor kernel (see dense.cl).  kernel.h headers share an
+// include guard, hence this is kept separate.
+
+namespace ExtractDescriptorsNS {
+    extern const unsigned char dense_cl[];
+    extern const unsigned int dense_cl_len;
+}
+
+#endif
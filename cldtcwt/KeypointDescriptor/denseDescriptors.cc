@@ -0,0 +1,328 @@
+// Copyright (C) 2013 Timothy Gale
+
+#include <sstream>
+
+
+
+#include "denseDescriptors.h"
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "util/clUtil.h"
+
+#include "dense.h"
+#include "interpolate.h"
+#include "Filter/subbandLayout.h"
+using namespace ExtractDescriptorsNS;
+
+
+DenseInterpolator::DenseInterpolator(cl::Context& context,
+                const std::vector<cl::Device>& devices,
+                std::vector<Coord> samplingPattern,
+                int outputStride, int outputOffset,
+                int diameter,
+                float gridStep,
+                SubbandFormat layout)
+ : context_(context), layout_(layout)
+{
+    if (layout != SubbandsComplex && layout != SubbandsPlanar
+     && layout != SubbandsTiled)
+        throw std::logic_error("DenseInterpolator needs complex subbands");
+
+    if (!(gridStep > 0))
+        throw std::logic_error("DenseInterpolator: grid step must be "
+                               "positive");
+
+    // Region a workgroup's grid points sample from, along each side, and
+    // the local memory it takes for all six orientations
+    const size_t tileSize
+        = size_t(std::ceil((workgroupSize_ - 1) * gridStep)) + diameter + 5;
+    const cl_ulong tileBytes = 6 * tileSize * tileSize * 2 * sizeof(float);
+
+    if (tileBytes > devices[0].getInfo<CL_DEVICE_LOCAL_MEM_SIZE>())
+        throw std::logic_error("DenseInterpolator: grid step too large for "
+                               "the device's local memory");
+
+    std::ostringstream kernelInput;
+
+    kernelInput
+        << std::setprecision(9)
+        << "#define DIAMETER (" << diameter << ")\n"
+        << "#define GRID_STEP ((float) " << gridStep << ")\n"
+        << "#define WG_W (" << workgroupSize_ << ")\n"
+        << "#define WG_H (" << workgroupSize_ << ")\n"
+        << "#define TILE_W (" << tileSize << ")\n"
+        << "#define TILE_H (" << tileSize << ")\n";
+
+    if (layout_ == SubbandsPlanar)
+        kernelInput << "#define PLANAR_SUBBANDS\n";
+    else if (layout_ == SubbandsTiled)
+        kernelInput << "#define TILED_SUBBANDS\n";
+
+    // Get input from the source files: the subband reading functions,
+    // the interpolation helpers, then the kernel
+    const char* layoutText = reinterpret_cast<const char*>
+                            (SubbandLayoutNS::subbandLayout_cl);
+    std::copy(layoutText, layoutText + SubbandLayoutNS::subbandLayout_cl_len,
+              std::ostream_iterator<char>(kernelInput));
+
+    const char* interpolateText = reinterpret_cast<const char*>
+                                    (interpolate_cl);
+    std::copy(interpolateText, interpolateText + interpolate_cl_len,
+              std::ostream_iterator<char>(kernelInput));
+
+    const char* fileText = reinterpret_cast<const char*>(dense_cl);
+    std::copy(fileText, fileText + dense_cl_len,
+              std::ostream_iterator<char>(kernelInput));
+
+    const std::string sourceCode = kernelInput.str();
+
+    // Bundle the code up
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(sourceCode.c_str(),
+                                    sourceCode.length()));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        program.build(devices);
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // Upload the sampling pattern
+    samplingPattern_ = cl::Buffer(context_,
+                                  CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                  samplingPattern.size() * 2 * sizeof(float),
+                                  &samplingPattern[0]);
+
+    // ...and extract the useful part, viz the kernel
+    kernel_ = cl::Kernel(program, "extractDenseDescriptors");
+
+    // Set arguments we already know
+    kernel_.setArg(4, samplingPattern_);
+    kernel_.setArg(5, int(samplingPattern.size()));
+    kernel_.setArg(6, int(outputStride));
+    kernel_.setArg(7, int(outputOffset));
+}
+
+
+
+void DenseInterpolator::operator()
+               (cl::CommandQueue& cq,
+                const Subbands& subbands,
+                Coord gridOrigin,
+                size_t gridWidth, size_t gridHeight,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEvent)
+{
+    enqueue_(cq, subbands, gridOrigin, gridWidth, gridHeight,
+             output, outputRowStride, waitEvents, doneEvent);
+}
+
+
+
+void DenseInterpolator::operator()
+               (cl::CommandQueue& cq,
+                const PlanarSubbands& subbands,
+                Coord gridOrigin,
+                size_t gridWidth, size_t gridHeight,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEvent)
+{
+    enqueue_(cq, subbands, gridOrigin, gridWidth, gridHeight,
+             output, outputRowStride, waitEvents, doneEvent);
+}
+
+
+
+void DenseInterpolator::operator()
+               (cl::CommandQueue& cq,
+                const TiledSubbands& subbands,
+                Coord gridOrigin,
+                size_t gridWidth, size_t gridHeight,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEvent)
+{
+    enqueue_(cq, subbands, gridOrigin, gridWidth, gridHeight,
+             output, outputRowStride, waitEvents, doneEvent);
+}
+
+
+
+template <typename Level>
+void DenseInterpolator::enqueue_
+               (cl::CommandQueue& cq,
+                const Level& subbands,
+                Coord gridOrigin,
+                size_t gridWidth, size_t gridHeight,
+                cl::Buffer& output, size_t outputRowStride,
+                const std::vector<cl::Event>& waitEvents,
+                cl::Event* doneEvent)
+{
+    if (SubbandLayout<Level>::format != layout_)
+        throw std::logic_error("DenseInterpolator: subbands not in the "
+                               "layout it was built for");
+
+    // Grid
+    kernel_.setArg(0, cl_float(gridOrigin.x));
+    kernel_.setArg(1, cl_float(gridOrigin.y));
+    kernel_.setArg(2, cl_uint(gridWidth));
+    kernel_.setArg(3, cl_uint(gridHeight));
+
+    // Output
+    kernel_.setArg(8, output);
+    kernel_.setArg(9, cl_uint(outputRowStride));
+
+    // Subbands
+    kernel_.setArg(10, subbands.buffer());
+    kernel_.setArg(11, cl_uint(subbands.start()));
+    kernel_.setArg(12, cl_uint(subbands.pitch()));
+    kernel_.setArg(13, cl_uint(subbands.padding()));
+    kernel_.setArg(14, cl_uint(subbands.stride()));
+    kernel_.setArg(15, cl_uint(subbands.width()));
+    kernel_.setArg(16, cl_uint(subbands.height()));
+
+    // One work item per grid point
+    cl::NDRange workgroupSize = {workgroupSize_, workgroupSize_};
+    cl::NDRange globalSize = {
+        roundWGs(gridWidth, workgroupSize_),
+        roundWGs(gridHeight, workgroupSize_)
+    };
+
+    cq.enqueueNDRangeKernel(kernel_, cl::NullRange,
+                            globalSize, workgroupSize,
+                            &waitEvents, doneEvent);
+}
+
+
+// Grid descriptor extracter class
+
+DenseDescriptorExtracter::DenseDescriptorExtracter
+    (cl::Context& context,
+     const std::vector<cl::Device>& devices,
+     float gridStep,
+     SubbandFormat layout)
+ : gridStep_(gridStep)
+{
+    // Grid sizes are worked out by dividing by it
+    if (!(gridStep > 0))
+        throw std::logic_error("DenseDescriptorExtracter: grid step must "
+                               "be positive");
+
+    std::vector<Coord> coarsePattern = {{0, 0}};
+
+    // The coarser level has half the resolution, so its grid is twice as
+    // dense
+    fineInterpolator_ = DenseInterpolator(context, devices,
+                                          fineSamplingPattern(), 14, 0, 2,
+                                          gridStep, layout);
+    coarseInterpolator_ = DenseInterpolator(context, devices,
+                                            coarsePattern, 14, 13, 0,
+                                            gridStep / 2, layout);
+}
+
+
+void DenseDescriptorExtracter::operator()
+               (cl::CommandQueue& cq,
+                const Subbands& fineSubbands,
+                const Subbands& coarseSubbands,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEventFine, cl::Event* doneEventCoarse)
+{
+    extract_(cq, fineSubbands, coarseSubbands, output, outputRowStride,
+             waitEvents, doneEventFine, doneEventCoarse);
+}
+
+
+void DenseDescriptorExtracter::operator()
+               (cl::CommandQueue& cq,
+                const PlanarSubbands& fineSubbands,
+                const PlanarSubbands& coarseSubbands,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEventFine, cl::Event* doneEventCoarse)
+{
+    extract_(cq, fineSubbands, coarseSubbands, output, outputRowStride,
+             waitEvents, doneEventFine, doneEventCoarse);
+}
+
+
+void DenseDescriptorExtracter::operator()
+               (cl::CommandQueue& cq,
+                const TiledSubbands& fineSubbands,
+                const TiledSubbands& coarseSubbands,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEventFine, cl::Event* doneEventCoarse)
+{
+    extract_(cq, fineSubbands, coarseSubbands, output, outputRowStride,
+             waitEvents, doneEventFine, doneEventCoarse);
+}
+
+
+template <typename Level>
+void DenseDescriptorExtracter::extract_
+               (cl::CommandQueue& cq,
+                const Level& fineSubbands,
+                const Level& coarseSubbands,
+                cl::Buffer& output, size_t outputRowStride,
+                const std::vector<cl::Event>& waitEvents,
+                cl::Event* doneEventFine, cl::Event* doneEventCoarse)
+{
+    const size_t width = gridWidth(fineSubbands.width()),
+                 height = gridHeight(fineSubbands.height());
+
+    if (outputRowStride < width)
+        throw std::logic_error("DenseDescriptorExtracter: output rows "
+                               "shorter than the grid");
+
+    // Grid point (0, 0) is the finer level's upper-left pixel.  Relative
+    // to the centres of the levels, the coarser level's positions are half
+    // the finer's.
+    const Coord coarseOrigin = {
+        0.5f * (coarseSubbands.width() - 1)
+            - 0.25f * (fineSubbands.width() - 1),
+        0.5f * (coarseSubbands.height() - 1)
+            - 0.25f * (fineSubbands.height() - 1)
+    };
+
+    fineInterpolator_(cq, fineSubbands, {0.f, 0.f}, width, height,
+                      output, outputRowStride,
+                      waitEvents, doneEventFine);
+
+    coarseInterpolator_(cq, coarseSubbands, coarseOrigin, width, height,
+                        output, outputRowStride,
+                        waitEvents, doneEventCoarse);
+}
+
+
+size_t DenseDescriptorExtracter::gridWidth(size_t fineWidth) const
+{
+    return size_t((fineWidth - 1) / gridStep_) + 1;
+}
+
+
+size_t DenseDescriptorExtracter::gridHeight(size_t fineHeight) const
+{
+    return size_t((fineHeight - 1) / gridStep_) + 1;
+}
+
+
+size_t DenseDescriptorExtracter::getNumFloatsInDescriptor() const
+{
+    return 14*6*2;
+}
+
@@ -0,0 +1,168 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef DENSE_DESCRIPTORS_H
+#define DENSE_DESCRIPTORS_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+
+#include "DTCWT/dtcwt.h"
+#include "extractDescriptors.h"
+
+
+class DenseInterpolator {
+// As Interpolator, but sampling around every point of a regular grid over
+// the level rather than around a list of keypoints.  Each workgroup loads
+// the part of the level its block of grid points needs into local memory
+// once, and interpolates all of their samples from there.
+
+public:
+
+    DenseInterpolator() = default;
+    DenseInterpolator(const DenseInterpolator&) = default;
+
+    DenseInterpolator(cl::Context& context,
+                      const std::vector<cl::Device>& devices,
+                      std::vector<Coord> samplingPattern,
+                      int outputStride, int outputOffset,
+                      int diameter,
+                      float gridStep,
+                      SubbandFormat layout = SubbandsComplex);
+    // gridStep - the distance between grid points, in this level's pixels,
+    // greater than zero.  The region each workgroup samples grows with it,
+    // and must fit in the device's local memory.  layout is as for
+    // Interpolator.
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const Subbands& subbands,
+                Coord gridOrigin,
+                size_t gridWidth, size_t gridHeight,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEvent = nullptr);
+    // gridOrigin - the position of grid point (0, 0) in this level's
+    // pixels.  The descriptor for grid point (x, y) is number
+    // x + y * outputRowStride in output.
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const PlanarSubbands& subbands,
+                Coord gridOrigin,
+                size_t gridWidth, size_t gridHeight,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEvent = nullptr);
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const TiledSubbands& subbands,
+                Coord gridOrigin,
+                size_t gridWidth, size_t gridHeight,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEvent = nullptr);
+
+
+private:
+
+    cl::Context context_;
+    cl::Kernel kernel_;
+    SubbandFormat layout_ = SubbandsComplex;
+
+    template <typename Level>
+    void enqueue_(cl::CommandQueue& cq,
+                  const Level& subbands,
+                  Coord gridOrigin,
+                  size_t gridWidth, size_t gridHeight,
+                  cl::Buffer& output, size_t outputRowStride,
+                  const std::vector<cl::Event>& waitEvents,
+                  cl::Event* doneEvent);
+
+    cl::Buffer samplingPattern_;
+
+    // Grid points per workgroup along each axis
+    static const size_t workgroupSize_ = 8;
+
+};
+
+
+class DenseDescriptorExtracter {
+// The same descriptors as DescriptorExtracter, from two consecutive
+// levels, but at every point of a regular grid over the finer level rather
+// than at a list of keypoints.  Grid point (x, y) is at (x, y) * gridStep in
+// the finer level's pixels, so there are gridWidth(fine.width()) by
+// gridHeight(fine.height()) of them.
+
+public:
+    DenseDescriptorExtracter() = default;
+    DenseDescriptorExtracter(const DenseDescriptorExtracter&) = default;
+
+    DenseDescriptorExtracter(cl::Context& context,
+                             const std::vector<cl::Device>& devices,
+                             float gridStep,
+                             SubbandFormat layout = SubbandsComplex);
+    // gridStep is in the finer level's pixels, and must be greater than
+    // zero: at level 2, 1 gives a descriptor every 4 image pixels.  layout
+    // is SubbandsComplex, SubbandsPlanar or SubbandsTiled, whichever the
+    // levels will be.
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const Subbands& fineSubbands,
+                const Subbands& coarseSubbands,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEventFine = nullptr,
+                cl::Event* doneEventCoarse = nullptr);
+    // The descriptor for grid point (x, y) is number
+    // x + y * outputRowStride in output, laid out as DescriptorExtracter's.
+    // outputRowStride must be at least gridWidth(fineSubbands.width()).
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const PlanarSubbands& fineSubbands,
+                const PlanarSubbands& coarseSubbands,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEventFine = nullptr,
+                cl::Event* doneEventCoarse = nullptr);
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const TiledSubbands& fineSubbands,
+                const TiledSubbands& coarseSubbands,
+                cl::Buffer& output, size_t outputRowStride,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEventFine = nullptr,
+                cl::Event* doneEventCoarse = nullptr);
+
+    size_t gridWidth(size_t fineWidth) const;
+    size_t gridHeight(size_t fineHeight) const;
+
+    size_t getNumFloatsInDescriptor() const;
+
+private:
+
+    DenseInterpolator fineInterpolator_, coarseInterpolator_;
+    float gridStep_;
+
+    template <typename Level>
+    void extract_(cl::CommandQueue& cq,
+                  const Level& fineSubbands,
+                  const Level& coarseSubbands,
+                  cl::Buffer& output, size_t outputRowStride,
+                  const std::vector<cl::Event>& waitEvents,
+                  cl::Event* doneEventFine,
+                  cl::Event* doneEventCoarse);
+
+};
+
+
+
+
+#endif
+
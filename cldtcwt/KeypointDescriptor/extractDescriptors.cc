@@ -9,9 +9,12 @@
 #include <iterator>
 #include <string>
 #include <algorithm>
+#include <stdexcept>
 
 
 #include "kernel.h"
+#include "interpolate.h"
+#include "Filter/subbandLayout.h"
 using namespace ExtractDescriptorsNS;
 
 
@@ -20,9 +23,14 @@ Interpolator::Interpolator(cl::Context& context,
                 std::vector<Coord> samplingPattern,
                 int outputStride, int outputOffset,
                 int diameter,
-                int numFloatsPerPos)
- : context_(context), diameter_(diameter)
+                int numFloatsPerPos,
+                SubbandFormat layout)
+ : context_(context), layout_(layout), diameter_(diameter)
 {
+    if (layout != SubbandsComplex && layout != SubbandsPlanar
+     && layout != SubbandsTiled)
+        throw std::logic_error("Interpolator needs complex subbands");
+
     // Define the diameter (total width/height of sampling pattern)
     // to begin with
     std::ostringstream kernelInput;
@@ -31,7 +39,23 @@ Interpolator::Interpolator(cl::Context& context,
         << "#define DIAMETER (" << diameter << ")\n"
         << "#define NUM_FLOATS_PER_POS (" << numFloatsPerPos << ")\n";
 
-    // Get input from the source file
+    if (layout_ == SubbandsPlanar)
+        kernelInput << "#define PLANAR_SUBBANDS\n";
+    else if (layout_ == SubbandsTiled)
+        kernelInput << "#define TILED_SUBBANDS\n";
+
+    // Get input from the source files: the subband reading functions,
+    // the interpolation helpers, then the kernel
+    const char* layoutText = reinterpret_cast<const char*>
+                            (SubbandLayoutNS::subbandLayout_cl);
+    std::copy(layoutText, layoutText + SubbandLayoutNS::subbandLayout_cl_len,
+              std::ostream_iterator<char>(kernelInput));
+
+    const char* interpolateText = reinterpret_cast<const char*>
+                                    (interpolate_cl);
+    std::copy(interpolateText, interpolateText + interpolate_cl_len,
+              std::ostream_iterator<char>(kernelInput));
+
     const char* fileText = reinterpret_cast<const char*>
                             (kernel_cl);
     size_t fileTextLength = 
@@ -70,6 +94,10 @@ Interpolator::Interpolator(cl::Context& context,
     // ...and extract the useful part, viz the kernel
     kernel_ = cl::Kernel(program, "extractDescriptor");
 
+    // Enough workgroups to keep every compute unit busy
+    numWorkgroups_ = groupsPerComputeUnit_
+                * devices[0].getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+
     // Set arguments we already know
     kernel_.setArg(4, samplingPattern_);
     kernel_.setArg(5, int(samplingPattern.size()));
@@ -91,6 +119,65 @@ void Interpolator::operator()
                 std::vector<cl::Event> waitEvents,
                 cl::Event* doneEvent)
 {
+    enqueue_(cq, subbands, locations, scale, kpOffsets, kpOffsetsIdx,
+             maxNumKPs, output, waitEvents, doneEvent);
+}
+
+
+
+void Interpolator::operator() 
+               (cl::CommandQueue& cq,
+                const PlanarSubbands& subbands,
+                const cl::Buffer& locations,
+                float scale,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEvent)
+{
+    enqueue_(cq, subbands, locations, scale, kpOffsets, kpOffsetsIdx,
+             maxNumKPs, output, waitEvents, doneEvent);
+}
+
+
+
+void Interpolator::operator() 
+               (cl::CommandQueue& cq,
+                const TiledSubbands& subbands,
+                const cl::Buffer& locations,
+                float scale,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEvent)
+{
+    enqueue_(cq, subbands, locations, scale, kpOffsets, kpOffsetsIdx,
+             maxNumKPs, output, waitEvents, doneEvent);
+}
+
+
+
+template <typename Level>
+void Interpolator::enqueue_
+               (cl::CommandQueue& cq,
+                const Level& subbands,
+                const cl::Buffer& locations,
+                float scale,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                const std::vector<cl::Event>& waitEvents,
+                cl::Event* doneEvent)
+{
+    if (SubbandLayout<Level>::format != layout_)
+        throw std::logic_error("Interpolator: subbands not in the layout "
+                               "it was built for");
+
     // Set subband arguments
     kernel_.setArg(9,  subbands.buffer());
     kernel_.setArg(10, cl_uint(subbands.start()));
@@ -113,9 +200,17 @@ void Interpolator::operator()
     // Set output argument
     kernel_.setArg(8, output);
 
-    // Enqueue the kernel
+    kernel_.setArg(16, cl_int(maxNumKPs));
+
+    // Enqueue the kernel.  The workgroups loop over however many keypoints
+    // there turn out to be, so there only need to be enough of them to
+    // fill the device.
+    const size_t numGroups = std::max(std::min(size_t(maxNumKPs), 
+                                               numWorkgroups_),
+                                      size_t(1));
+
     cl::NDRange workgroupSize = {1, diameter_+4, diameter_+4};
-    cl::NDRange globalSize = {maxNumKPs, diameter_+4, diameter_+4};
+    cl::NDRange globalSize = {numGroups, diameter_+4, diameter_+4};
 
     cq.enqueueNDRangeKernel(kernel_, cl::NullRange,
                             globalSize, workgroupSize,
@@ -123,12 +218,7 @@ void Interpolator::operator()
 }
 
 
-// Keypoint extracter class
-
-DescriptorExtracter::DescriptorExtracter
-    (cl::Context& context, 
-     const std::vector<cl::Device>& devices,
-     int numFloatsPerPos)
+std::vector<Coord> fineSamplingPattern()
 {
     const float pi = 4 * atan(1);
 
@@ -142,13 +232,28 @@ DescriptorExtracter::DescriptorExtracter
                                float(cos(float(9-n) / 12.f * 2.f * pi))});
     }
 
+    return finePattern;
+}
+
+
+// Keypoint extracter class
+
+DescriptorExtracter::DescriptorExtracter
+    (cl::Context& context, 
+     const std::vector<cl::Device>& devices,
+     int numFloatsPerPos,
+     SubbandFormat layout)
+{
+    std::vector<Coord> finePattern = fineSamplingPattern();
     std::vector<Coord> coarsePattern = {{0, 0}};
 
     // Set up the kernels
     fineInterpolator_ = Interpolator(context, devices,
-                                     finePattern, 14, 0, 2, numFloatsPerPos);
+                                     finePattern, 14, 0, 2, numFloatsPerPos,
+                                     layout);
     coarseInterpolator_ = Interpolator(context, devices,
-                                     coarsePattern, 14, 13, 0, numFloatsPerPos);
+                                     coarsePattern, 14, 13, 0, numFloatsPerPos,
+                                     layout);
 }
 
 
@@ -165,6 +270,67 @@ void DescriptorExtracter::operator()
                 cl::Buffer& output,
                 std::vector<cl::Event> waitEvents,
                 cl::Event* doneEventFine, cl::Event* doneEventCoarse)
+{
+    extract_(cq, fineSubbands, fineScale, coarseSubbands, coarseScale,
+             locations, kpOffsets, kpOffsetsIdx, maxNumKPs, output,
+             waitEvents, doneEventFine, doneEventCoarse);
+}
+
+
+void DescriptorExtracter::operator() 
+               (cl::CommandQueue& cq,
+                const PlanarSubbands& fineSubbands,   
+                float fineScale,
+                const PlanarSubbands& coarseSubbands,
+                float coarseScale,
+                const cl::Buffer& locations,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEventFine, cl::Event* doneEventCoarse)
+{
+    extract_(cq, fineSubbands, fineScale, coarseSubbands, coarseScale,
+             locations, kpOffsets, kpOffsetsIdx, maxNumKPs, output,
+             waitEvents, doneEventFine, doneEventCoarse);
+}
+
+
+void DescriptorExtracter::operator() 
+               (cl::CommandQueue& cq,
+                const TiledSubbands& fineSubbands,   
+                float fineScale,
+                const TiledSubbands& coarseSubbands,
+                float coarseScale,
+                const cl::Buffer& locations,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents,
+                cl::Event* doneEventFine, cl::Event* doneEventCoarse)
+{
+    extract_(cq, fineSubbands, fineScale, coarseSubbands, coarseScale,
+             locations, kpOffsets, kpOffsetsIdx, maxNumKPs, output,
+             waitEvents, doneEventFine, doneEventCoarse);
+}
+
+
+template <typename Level>
+void DescriptorExtracter::extract_
+               (cl::CommandQueue& cq,
+                const Level& fineSubbands,   
+                float fineScale,
+                const Level& coarseSubbands,
+                float coarseScale,
+                const cl::Buffer& locations,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                const std::vector<cl::Event>& waitEvents,
+                cl::Event* doneEventFine, cl::Event* doneEventCoarse)
 {
     // Call the fine and coarse levels
     fineInterpolator_(cq, fineSubbands, locations, fineScale,
@@ -29,10 +29,13 @@ public:
                         std::vector<Coord> samplingPattern,
                         int outputStride, int outputOffset,
                         int diameter,
-                        int numFloatsPerPos);
+                        int numFloatsPerPos,
+                        SubbandFormat layout = SubbandsComplex);
     // numFloatsPerPos - The number of floating points taken to describe
     // each position. The first two of these are x and y relative to the
-    // centre of the image at the untransformed image scale.
+    // centre of the image at the untransformed image scale.  layout is
+    // SubbandsComplex, SubbandsPlanar or SubbandsTiled, whichever the
+    // levels will be.
 
     void
     operator() (cl::CommandQueue& cq,
@@ -46,20 +49,67 @@ public:
                 std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
                 cl::Event* doneEvent = nullptr);
     // scale - the number of original image pixels per pixel at this level 
-    // of transform.
+    // of transform.  The cost depends on how many keypoints there actually
+    // are (up to maxNumKPs), not on maxNumKPs.
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const PlanarSubbands& subbands,
+                const cl::Buffer& locations,
+                float scale,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEvent = nullptr);
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const TiledSubbands& subbands,
+                const cl::Buffer& locations,
+                float scale,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEvent = nullptr);
 
 
 private:
 
     cl::Context context_;
     cl::Kernel kernel_;
+    SubbandFormat layout_ = SubbandsComplex;
+
+    template <typename Level>
+    void enqueue_(cl::CommandQueue& cq,
+                  const Level& subbands,
+                  const cl::Buffer& locations,
+                  float scale,
+                  const cl::Buffer& kpOffsets,
+                  int kpOffsetsIdx,
+                  int maxNumKPs,
+                  cl::Buffer& output,
+                  const std::vector<cl::Event>& waitEvents,
+                  cl::Event* doneEvent);
 
     cl::Buffer samplingPattern_;
     int diameter_;
 
+    // Size of the launches: each workgroup handles one keypoint at a time
+    size_t numWorkgroups_;
+    static const size_t groupsPerComputeUnit_ = 16;
+
 };
 
 
+std::vector<Coord> fineSamplingPattern();
+// The centre and ring of twelve points at unit radius that descriptors
+// sample the finer level at
+
+
 class DescriptorExtracter {
 // Extract descriptors from two consecutive levels, the lower one a ring
 // with a central point (unit radius) and the upper one a circle.  The
@@ -71,7 +121,10 @@ public:
 
     DescriptorExtracter(cl::Context& context, 
                         const std::vector<cl::Device>& devices,
-                        int numFloatsPerPos);
+                        int numFloatsPerPos,
+                        SubbandFormat layout = SubbandsComplex);
+    // layout is SubbandsComplex, SubbandsPlanar or SubbandsTiled,
+    // whichever the levels will be
 
     void
     operator() (cl::CommandQueue& cq,
@@ -88,6 +141,36 @@ public:
                 cl::Event* doneEventFine = nullptr,
                 cl::Event* doneEventCoarse = nullptr);
 
+    void
+    operator() (cl::CommandQueue& cq,
+                const PlanarSubbands& fineSubbands,   
+                float fineScale,
+                const PlanarSubbands& coarseSubbands,
+                float coarseScale,
+                const cl::Buffer& locations,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEventFine = nullptr,
+                cl::Event* doneEventCoarse = nullptr);
+
+    void
+    operator() (cl::CommandQueue& cq,
+                const TiledSubbands& fineSubbands,   
+                float fineScale,
+                const TiledSubbands& coarseSubbands,
+                float coarseScale,
+                const cl::Buffer& locations,
+                const cl::Buffer& kpOffsets,
+                int kpOffsetsIdx,
+                int maxNumKPs,
+                cl::Buffer& output,
+                std::vector<cl::Event> waitEvents = std::vector<cl::Event>(),
+                cl::Event* doneEventFine = nullptr,
+                cl::Event* doneEventCoarse = nullptr);
+
     size_t getNumFloatsInDescriptor() const;
 
 private:
@@ -95,6 +178,21 @@ private:
     // Different interpolators for the ring vs. the single point
     Interpolator fineInterpolator_, coarseInterpolator_;
 
+    template <typename Level>
+    void extract_(cl::CommandQueue& cq,
+                  const Level& fineSubbands,   
+                  float fineScale,
+                  const Level& coarseSubbands,
+                  float coarseScale,
+                  const cl::Buffer& locations,
+                  const cl::Buffer& kpOffsets,
+                  int kpOffsetsIdx,
+                  int maxNumKPs,
+                  cl::Buffer& output,
+                  const std::vector<cl::Event>& waitEvents,
+                  cl::Event* doneEventFine,
+                  cl::Event* doneEventCoarse);
+
 };
 
 
@@ -0,0 +1,111 @@
+// Copyright (C) 2013 Timothy Gale
+// Reading, derotating and interpolating subbands around a point, shared by
+// the descriptor kernels and built into their programs ahead of them.  The
+// interpolation weights are cubic (see Keys 1981, Cubic Convolution
+// Interpolation for Digital Image Processing).
+//
+// SubbandElement, subbandOffset and readSubband come from subbandLayout.cl,
+// built in ahead of this.
+
+
+float2 readSBAndDerotate(const __global SubbandElement* sb, int2 pos,
+                        float2 angFreq, float2 offset,
+                        unsigned int padding, unsigned int stride,
+                        unsigned int pitch,
+                        uint2 sbSize)
+{
+    // Read pos, apply offset and derotate by angFreq
+
+    // Check in image; otherwise, return zero (to avoid reading garbage)
+    bool inSB = all((int2) (0,0) <= pos) & all(pos < convert_int2(sbSize));
+
+    float2 val = inSB? readSubband(sb, subbandOffset(pos.x, pos.y, stride),
+                                    pitch)
+                     : (float2) (0.f, 0.f);
+
+    // Apply offset to give consistent phase behaviour relative to sampling
+    // point between subbands
+    val = (float2) (val.x * offset.x - val.y * offset.y,
+                    val.x * offset.y + val.y * offset.x);
+
+    // Find phase in each direction
+    float phase = pos.x * angFreq.x + pos.y * angFreq.y;
+
+    // Find coefficients to multiply by
+    float cosComp;
+    float sinComp = sincos(-phase, &cosComp);
+
+    // Multiply and return
+    return (float2) (cosComp * val.x - sinComp * val.y,
+                     cosComp * val.y + sinComp * val.x);
+
+}
+
+
+
+
+void cubicCoefficients(float x, float coeffs[4])
+{
+    // x is between 0 and 1, and is the position of the point being
+    // interpolated (minus the integer position).
+    
+    coeffs[0] = -0.5 * (x+1)*(x+1)*(x+1) + 2.5 * (x+1)*(x+1) - 4 * (x+1) + 2;
+    coeffs[1] =  1.5 * (x  )*(x  )*(x  ) - 2.5 * (x  )*(x  )             + 1;
+    coeffs[2] =  1.5 * (1-x)*(1-x)*(1-x) - 2.5 * (1-x)*(1-x)             + 1;
+    coeffs[3] = -0.5 * (2-x)*(2-x)*(2-x) + 2.5 * (2-x)*(2-x) - 4 * (2-x) + 2;
+}
+
+
+
+
+float2 interp(const __local float2* values, unsigned int stride,
+              int2 pos, 
+              const float coeffsX[4],
+              const float coeffsY[4]) 
+{
+    // Convolves the x and y filters with the values (a 2D array, with stride
+    // length stride), starting the square at pos.
+    float2 result = (float2) (0.f, 0.f);
+
+    for (int iy = 0; iy < 4; ++iy) {
+
+        float2 tmp = (float2) (0.f, 0.f);
+
+        for (int ix = 0; ix < 4; ++ix) 
+            tmp += coeffsX[ix] * values[stride * (pos.y + iy) +  pos.x + ix];
+
+        result += coeffsY[iy] * tmp;
+    }
+
+    return result;
+}
+
+
+
+
+
+float2 rerotate(float2 dcValue, float2 pos, float2 angFreq)
+{
+    // Given location pos (relative to whereever the dcValue was derotated
+    // from originally) and angular frequencies.
+
+    // Calculate the complex phasor
+    float c;
+    float s = sincos(dot(pos, angFreq), &c);
+
+    // Rotate by that phasor
+    return (float2) (dcValue.x * c - dcValue.y * s,
+                     dcValue.x * s + dcValue.y * c);
+}
+
+
+
+
+int2 ifract(float2 num, __private float2* fraction)
+{
+    // Convert a float2 to the integer part (returned)
+    // and the remainder (fraction).
+    float2 wholeNumf;
+    *fraction = fract(num, &wholeNumf);
+    return convert_int2(wholeNumf);
+}
@@ -0,0 +1,14 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef INTERPOLATE_H
+#define INTERPOLATE_H
+
+// The subband reading and interpolation helpers (see interpolate.cl), for
+// the descriptor programs to build in ahead of their own source.  kernel.h
+// headers share an include guard, hence this is kept separate.
+
+namespace ExtractDescriptorsNS {
+    extern const unsigned char interpolate_cl[];
+    extern const unsigned int interpolate_cl_len;
+}
+
+#endif
@@ -1,113 +1,7 @@
 // Copyright (C) 2013 Timothy Gale
-// Function to calculate the cubic interpolation weights (see Keys 1981,
-// Cubic Convolution Interpolation for Digital Image Processing).
-
-
-float2 readSBAndDerotate(const __global float2* sb, int2 pos,
-                        float2 angFreq, float2 offset,
-                        unsigned int padding, unsigned int stride,
-                        uint2 sbSize)
-{
-    // Read pos, apply offset and derotate by angFreq
-
-    // Check in image; otherwise, return zero (to avoid reading garbage)
-    bool inSB = all((int2) (0,0) <= pos) & all(pos < convert_int2(sbSize));
-
-    float2 val = inSB? sb[pos.x + pos.y * stride]
-                     : (float2) (0.f, 0.f);
-
-    // Apply offset to give consistent phase behaviour relative to sampling
-    // point between subbands
-    val = (float2) (val.x * offset.x - val.y * offset.y,
-                    val.x * offset.y + val.y * offset.x);
-
-    // Find phase in each direction
-    float phase = pos.x * angFreq.x + pos.y * angFreq.y;
-
-    // Find coefficients to multiply by
-    float cosComp;
-    float sinComp = sincos(-phase, &cosComp);
-
-    // Multiply and return
-    return (float2) (cosComp * val.x - sinComp * val.y,
-                     cosComp * val.y + sinComp * val.x);
-
-}
-
-
-
-
-void cubicCoefficients(float x, float coeffs[4])
-{
-    // x is between 0 and 1, and is the position of the point being
-    // interpolated (minus the integer position).
-    
-    coeffs[0] = -0.5 * (x+1)*(x+1)*(x+1) + 2.5 * (x+1)*(x+1) - 4 * (x+1) + 2;
-    coeffs[1] =  1.5 * (x  )*(x  )*(x  ) - 2.5 * (x  )*(x  )             + 1;
-    coeffs[2] =  1.5 * (1-x)*(1-x)*(1-x) - 2.5 * (1-x)*(1-x)             + 1;
-    coeffs[3] = -0.5 * (2-x)*(2-x)*(2-x) + 2.5 * (2-x)*(2-x) - 4 * (2-x) + 2;
-}
-
-
-
-
-float2 interp(const __local float2* values, unsigned int stride,
-              int2 pos, 
-              const float coeffsX[4],
-              const float coeffsY[4]) 
-{
-    // Convolves the x and y filters with the values (a 2D array, with stride
-    // length stride), starting the square at pos.
-    float2 result = (float2) (0.f, 0.f);
-
-    for (int iy = 0; iy < 4; ++iy) {
-
-        float2 tmp = (float2) (0.f, 0.f);
-
-        for (int ix = 0; ix < 4; ++ix) 
-            tmp += coeffsX[ix] * values[stride * (pos.y + iy) +  pos.x + ix];
-
-        result += coeffsY[iy] * tmp;
-    }
-
-    return result;
-}
-
-
-
-
-
-float2 rerotate(float2 dcValue, float2 pos, float2 angFreq)
-{
-    // Given location pos (relative to whereever the dcValue was derotated
-    // from originally) and angular frequencies.
-
-    // Calculate the complex phasor
-    float c;
-    float s = sincos(dot(pos, angFreq), &c);
-
-    // Rotate by that phasor
-    return (float2) (dcValue.x * c - dcValue.y * s,
-                     dcValue.x * s + dcValue.y * c);
-}
-
-
-
-
-int2 ifract(float2 num, __private float2* fraction)
-{
-    // Convert a float2 to the integer part (returned)
-    // and the remainder (fraction).
-    float2 wholeNumf;
-    *fraction = fract(num, &wholeNumf);
-    return convert_int2(wholeNumf);
-}
-
-
-
-
-
-
+// Descriptors at a list of keypoints.  DIAMETER and NUM_FLOATS_PER_POS
+// should be defined externally; the helpers come from interpolate.cl, built
+// in ahead of this.
 
 __kernel void extractDescriptor(const __global float* pos,
                                 float scale,
@@ -117,13 +11,14 @@ __kernel void extractDescriptor(const __global float* pos,
                                 const int numSampleLocs,
                                 int stride, int offset,
                                 __global float2* output,
-                                const __global float2* sb,
+                                const __global SubbandElement* sb,
                                 unsigned int sbStart,
                                 unsigned int sbPitch,
                                 unsigned int sbPadding,
                                 unsigned int sbStride,
                                 unsigned int sbWidth,
-                                unsigned int sbHeight)
+                                unsigned int sbHeight,
+                                int maxNumKPs)
 {
 
     // Complex numbers to subbands multiply by
@@ -145,15 +40,10 @@ __kernel void extractDescriptor(const __global float* pos,
 
 
 
+    // No more than maxNumKPs from this level
     size_t kpIdxsBegin = kpOffsets[kpOffsetsIdx],
-           kpIdxsEnd = kpOffsets[kpOffsetsIdx+1];
-
-    // Work out which input/output index we're working with
-    const size_t kpIdx = kpIdxsBegin + get_global_id(0);
-
-    // See whether we need to do anything
-    if (kpIdx >= kpIdxsEnd)
-        return;
+           kpIdxsEnd = min(kpOffsets[kpOffsetsIdx+1],
+                           kpOffsets[kpOffsetsIdx] + maxNumKPs);
 
     const int2 idx = (int2) (get_global_id(1), get_global_id(2));
     const int wgWidth = get_local_size(1);
@@ -163,72 +53,79 @@ __kernel void extractDescriptor(const __global float* pos,
     const int samplerIdx = idx.x + idx.y * wgWidth;
     const bool isSampler = samplerIdx < numSampleLocs;
 
+    // Storage for the subband values
+    __local float2 sbVals[DIAMETER+4][DIAMETER+4];
 
+    // Each workgroup does one keypoint at a time, taking every
+    // get_num_groups(0)th, so only as much work is done as there are
+    // keypoints, whatever the launch was sized for.  The trip count is the
+    // same for the whole workgroup, so the barriers are safe.
+    for (size_t kpIdx = kpIdxsBegin + get_group_id(0);
+         kpIdx < kpIdxsEnd; kpIdx += get_num_groups(0)) {
 
-    // Read coordinates from the input matrix
-    float2 kpPos = (float2) (pos[NUM_FLOATS_PER_POS * kpIdx],
-                             pos[NUM_FLOATS_PER_POS * kpIdx + 1])
-                            / (float2) scale
-                  + (float2) (sbWidth-1, sbHeight-1) / 2.f;
+        // Read coordinates from the input matrix
+        float2 kpPos = (float2) (pos[NUM_FLOATS_PER_POS * kpIdx],
+                                 pos[NUM_FLOATS_PER_POS * kpIdx + 1])
+                                / (float2) scale
+                      + (float2) (sbWidth-1, sbHeight-1) / 2.f;
 
-    
-    // Calculate how far the keypoint is from the upper-left nearest pixel,
-    // and the nearest lower integer location
-    float2 kpRemPos;
-    int2 kpIntPos = ifract(kpPos, &kpRemPos);
 
+        // Calculate how far the keypoint is from the upper-left nearest pixel,
+        // and the nearest lower integer location
+        float2 kpRemPos;
+        int2 kpIntPos = ifract(kpPos, &kpRemPos);
 
 
-    // Calculate where this worker should be reading from.  The -1 at the 
-    // end is to include enough area to do the interpolation properly.
-    int2 readPos = kpIntPos + idx - (DIAMETER / 2) - 1;
 
-    
-    // The place where this worker picks its sample
-    float2 sampleRemPosLocal;     
-    int2 sampleIntPosLocal = ifract(1.0 + DIAMETER / 2.0
-                               + kpRemPos + sampleLocs[samplerIdx],
-                               &sampleRemPosLocal);
+        // Calculate where this worker should be reading from.  The -1 at the 
+        // end is to include enough area to do the interpolation properly.
+        int2 readPos = kpIntPos + idx - (DIAMETER / 2) - 1;
 
 
-    // Work out interpolation coefficient for current work item
-    float interpCoeffsX[4];
-    cubicCoefficients(sampleRemPosLocal.x, interpCoeffsX);
-    float interpCoeffsY[4];
-    cubicCoefficients(sampleRemPosLocal.y, interpCoeffsY);
-        
+        // The place where this worker picks its sample
+        float2 sampleRemPosLocal;     
+        int2 sampleIntPosLocal = ifract(1.0 + DIAMETER / 2.0
+                                   + kpRemPos + sampleLocs[samplerIdx],
+                                   &sampleRemPosLocal);
 
-    // Storage for the subband values
-    __local float2 sbVals[DIAMETER+4][DIAMETER+4];
 
+        // Work out interpolation coefficient for current work item
+        float interpCoeffsX[4];
+        cubicCoefficients(sampleRemPosLocal.x, interpCoeffsX);
+        float interpCoeffsY[4];
+        cubicCoefficients(sampleRemPosLocal.y, interpCoeffsY);
 
-    // For each subband
-    for (int n = 0; n < 6; ++n) {
 
-        sbVals[idx.y][idx.x]
-                   = readSBAndDerotate(sb + sbStart + n * sbPitch, 
-                                       readPos, 
-                                       angularFreq[n], offsets[n],
-                                       sbPadding, sbStride,
-                                       (uint2) (sbWidth, sbHeight));
+        // For each subband
+        for (int n = 0; n < 6; ++n) {
 
-        // Make sure all items have got here
-        barrier(CLK_LOCAL_MEM_FENCE);
+            sbVals[idx.y][idx.x]
+                       = readSBAndDerotate(sb + orientationStart(sbStart,
+                                                                 sbPitch, n),
+                                           readPos, 
+                                           angularFreq[n], offsets[n],
+                                           sbPadding, sbStride, sbPitch,
+                                           (uint2) (sbWidth, sbHeight));
 
-        // If we are one of sampling points, sample
-        if (isSampler) {
+            // Make sure all items have got here
+            barrier(CLK_LOCAL_MEM_FENCE);
 
-            // Interpolate and rerotate
-            output[n + samplerIdx * 6 + kpIdx * stride * 6 + offset * 6]
-              = rerotate(interp(&sbVals[0][0], wgWidth, 
-                                sampleIntPosLocal - 1,
-                                interpCoeffsX, interpCoeffsY),
-                         kpPos + sampleLocs[samplerIdx],
-                         angularFreq[n]);
-        }
+            // If we are one of sampling points, sample
+            if (isSampler) {
 
-        // Only move on when all local memory values are done being used
-        barrier(CLK_LOCAL_MEM_FENCE);
+                // Interpolate and rerotate
+                output[n + samplerIdx * 6 + kpIdx * stride * 6 + offset * 6]
+                  = rerotate(interp(&sbVals[0][0], wgWidth, 
+                                    sampleIntPosLocal - 1,
+                                    interpCoeffsX, interpCoeffsY),
+                             kpPos + sampleLocs[samplerIdx],
+                             angularFreq[n]);
+            }
+
+            // Only move on when all local memory values are done being used
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+        }
 
     }
 }
@@ -0,0 +1,89 @@
+// Copyright (C) 2013 Timothy Gale
+#include "adaptiveThreshold.h"
+#include "kernel.h"
+
+using namespace AdaptiveThresholdNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <stdexcept>
+
+
+AdaptiveThreshold::AdaptiveThreshold(cl::Context& context,
+                                     const std::vector<cl::Device>& devices,
+                                     size_t numFloatsPerItem,
+                                     size_t strengthIndex)
+   : context_(context)
+{
+    if (strengthIndex >= numFloatsPerItem)
+        throw std::logic_error("AdaptiveThreshold: strength index outside "
+                               "item");
+
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (kernel_cl);
+    size_t fileTextLength = kernel_cl_len;
+
+    // Bundle the code up
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(fileText, fileTextLength));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_
+                        << " -D POS_LEN=" << numFloatsPerItem
+                        << " -D STRENGTH_IDX=" << strengthIndex;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful part, viz the kernel
+    kernel_ = cl::Kernel(program, "adaptThreshold");
+}
+
+
+
+
+void AdaptiveThreshold::operator()
+      (cl::CommandQueue& commandQueue,
+       cl::Buffer& candidates,
+       cl::Buffer& levelStarts, cl::Buffer& levelCapacities,
+       cl::Buffer& counts, size_t numLevels,
+       const Settings& settings,
+       cl::Buffer& thresholds,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    if (!(settings.minThreshold > 0.f)
+     || !(settings.maxThreshold >= settings.minThreshold))
+        throw std::logic_error("AdaptiveThreshold: bad threshold limits");
+
+    if (!(settings.smoothing > 0.f && settings.smoothing <= 1.f))
+        throw std::logic_error("AdaptiveThreshold: smoothing must be in "
+                               "(0, 1]");
+
+    kernel_.setArg(0, candidates);
+    kernel_.setArg(1, levelStarts);
+    kernel_.setArg(2, levelCapacities);
+    kernel_.setArg(3, counts);
+    kernel_.setArg(4, cl_uint(numLevels));
+    kernel_.setArg(5, cl_uint(settings.perLevel));
+    kernel_.setArg(6, cl_uint(settings.target));
+    kernel_.setArg(7, settings.smoothing);
+    kernel_.setArg(8, settings.minThreshold);
+    kernel_.setArg(9, settings.maxThreshold);
+    kernel_.setArg(10, thresholds);
+
+    // One workgroup does the lot
+    commandQueue.enqueueNDRangeKernel(kernel_, cl::NullRange,
+                                      {wgSize_}, {wgSize_},
+                                      &waitEvents, doneEvent);
+}
+
@@ -0,0 +1,67 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef ADAPTIVETHRESHOLD_H
+#define ADAPTIVETHRESHOLD_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+
+
+class AdaptiveThreshold {
+// Works out the peak threshold for the next frame from the peaks found in
+// this one, aiming for a target number of peaks, all on the device.  The
+// thresholds live in a buffer of floats (one per level) that FindMax or
+// CrossProductFindMax read when they run, so the host never has to wait
+// for the counts.
+//
+// Where there were too many peaks, their strengths show where the threshold
+// should have been.  Where there were too few, the threshold is lowered by
+// up to half.  The change is smoothed over frames either way.
+
+public:
+
+    struct Settings {
+        size_t target;      // Peaks wanted per frame (in total)
+        bool perLevel;      // Each level aims for an equal share of the
+                            // target, with its own threshold; otherwise all
+                            // levels share one
+        float smoothing;    // Fraction of the way (in log terms) to move
+                            // towards this frame's ideal, in (0, 1]
+        float minThreshold; // Limits on the threshold (minThreshold > 0)
+        float maxThreshold;
+    };
+
+    AdaptiveThreshold() = default;
+    AdaptiveThreshold(const AdaptiveThreshold&) = default;
+    AdaptiveThreshold(cl::Context& context,
+                      const std::vector<cl::Device>& devices,
+                      size_t numFloatsPerItem, size_t strengthIndex);
+    // Each keypoint is numFloatsPerItem floats long, with the strength at
+    // strengthIndex
+
+    void operator() (cl::CommandQueue& commandQueue,
+       cl::Buffer& candidates,
+       cl::Buffer& levelStarts, cl::Buffer& levelCapacities,
+       cl::Buffer& counts, size_t numLevels,
+       const Settings& settings,
+       cl::Buffer& thresholds,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // Level n's peaks, as found with threshold thresholds[n], are in
+    // candidates starting at item levelStarts[n], with room for
+    // levelCapacities[n].  counts[n] is how many were found (which may be
+    // more than were stored).  Updates thresholds for the next frame.
+
+private:
+    cl::Context context_;
+    cl::Kernel kernel_;
+
+    static const size_t wgSize_ = 256;
+};
+
+
+
+#endif
@@ -0,0 +1,114 @@
+// Copyright (C) 2013 Timothy Gale
+// Adjusting the peak threshold from one frame to the next, so that about a
+// target number of peaks are found, without the counts leaving the device.
+// WG_SIZE (the workgroup size), POS_LEN (floats per keypoint) and
+// STRENGTH_IDX should be defined externally.
+//
+// The strengths of the peaks found are histogrammed in bins spaced evenly
+// in log(strength / threshold).  With too many peaks, the histogram says
+// where the threshold should have been; with too few, we can't see below
+// the threshold, so it is lowered by at most a factor of two per frame.
+// Either way the new threshold only moves part of the way there
+// (geometrically), to smooth over frame-to-frame noise.
+
+#define BINS_PER_OCTAVE 32
+#define NUM_BINS 256
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void adaptThreshold(__global const float* candidates,
+                    __global const unsigned int* levelStarts,
+                    __global const unsigned int* levelCapacities,
+                    __global const unsigned int* counts,
+                    unsigned int numLevels,
+                    unsigned int perLevel,
+                    unsigned int target,
+                    float smoothing,
+                    float minThreshold,
+                    float maxThreshold,
+                    __global float* thresholds)
+{
+    // Level n's peaks are candidates[levelStarts[n]] onwards; counts[n] were
+    // found, of which up to levelCapacities[n] were stored.  If perLevel,
+    // each level's threshold is set separately, aiming for an equal share
+    // of target; otherwise they are pooled and all get the same threshold.
+    // smoothing is the fraction of the way (in log terms) to move towards
+    // the threshold this frame suggests.
+    __local uint hist[NUM_BINS];
+    __local float newThreshold;
+
+    const uint l = get_local_id(0);
+
+    const uint numGroups = perLevel? numLevels : 1;
+    const uint groupTarget = max(perLevel? target / max(numLevels, 1u)
+                                         : target, 1u);
+
+    for (uint g = 0; g < numGroups; ++g) {
+
+        const uint first = perLevel? g : 0,
+                   end = perLevel? g + 1 : numLevels;
+
+        const float current = clamp(thresholds[first],
+                                    minThreshold, maxThreshold);
+
+        for (uint b = l; b < NUM_BINS; b += WG_SIZE)
+            hist[b] = 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        uint numFound = 0, numStored = 0;
+
+        for (uint n = first; n < end; ++n) {
+
+            const uint found = counts[n],
+                       stored = min(found, levelCapacities[n]);
+            numFound += found;
+            numStored += stored;
+
+            for (uint i = l; i < stored; i += WG_SIZE) {
+                float s = candidates[(levelStarts[n] + i) * POS_LEN
+                                     + STRENGTH_IDX];
+                int b = convert_int_rtn(log2(max(s / current, 1.f))
+                                         * BINS_PER_OCTAVE);
+                atomic_inc(&hist[clamp(b, 0, NUM_BINS - 1)]);
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (l == 0) {
+
+            float desired;
+
+            if (numFound > groupTarget && numStored > 0) {
+
+                // Keep the same fraction of those stored as we'd like of
+                // those found, counting down from the strongest
+                uint wanted = max(convert_uint((float) numStored
+                                                * groupTarget / numFound),
+                                  1u);
+
+                uint acc = 0;
+                int b;
+                for (b = NUM_BINS - 1; b > 0; --b) {
+                    acc += hist[b];
+                    if (acc >= wanted)
+                        break;
+                }
+
+                desired = current * exp2((float) b / BINS_PER_OCTAVE);
+
+            } else
+                desired = current * clamp((float) numFound / groupTarget,
+                                          0.5f, 1.f);
+
+            newThreshold = clamp(exp2(mix(log2(current), log2(desired),
+                                          smoothing)),
+                                 minThreshold, maxThreshold);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (uint n = first + l; n < end; n += WG_SIZE)
+            thresholds[n] = newThreshold;
+        barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+    }
+}
+
@@ -0,0 +1,165 @@
+// Copyright (C) 2013 Timothy Gale
+#include "crossProductFindMax.h"
+#include "kernel.h"
+using namespace CrossProductFindMaxNS;
+
+#include "util/clUtil.h"
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+
+#include <stdexcept>
+
+
+CrossProductFindMax::CrossProductFindMax
+                    (cl::Context& context,
+                     const std::vector<cl::Device>& devices,
+                     bool checkScales)
+   : context_(context)
+{
+    // The OpenCL kernel:
+    std::ostringstream kernelInput;
+
+    // Define some constants
+    kernelInput << "#define WG_SIZE_X (" << wgSizeX_ << ")\n"
+                   "#define WG_SIZE_Y (" << wgSizeY_ << ")\n"
+                   "#define POS_LEN (" << posLen_ << ")\n";
+
+    if (checkScales)
+        kernelInput << "#define CHECK_SCALE_MAX\n";
+   
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (kernel_cl);
+    size_t fileTextLength = kernel_cl_len;
+
+    std::copy(fileText, fileText + fileTextLength,
+              std::ostream_iterator<char>(kernelInput));
+
+    // Convert to string
+    const std::string sourceCode = kernelInput.str();
+
+    // Bundle the code up
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(sourceCode.c_str(), sourceCode.length()));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        program.build(devices);
+    } catch(cl::Error err) {
+	    std::cerr 
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    } 
+        
+    // ...and extract the useful part, i.e. the kernel
+    kernel_ = cl::Kernel(program, "crossProductFindMax");
+
+    noThresholds_ = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(cl_float));
+}
+
+
+
+static void setSubbandArgs(cl::Kernel& kernel, int firstArg,
+                           const Subbands& sb, float scale)
+{
+    kernel.setArg(firstArg + 0, sb.buffer());
+    kernel.setArg(firstArg + 1, cl_uint(sb.start()));
+    kernel.setArg(firstArg + 2, cl_uint(sb.pitch()));
+    kernel.setArg(firstArg + 3, cl_uint(sb.stride()));
+    kernel.setArg(firstArg + 4, cl_uint(sb.width()));
+    kernel.setArg(firstArg + 5, cl_uint(sb.height()));
+    kernel.setArg(firstArg + 6, scale);
+}
+
+
+void CrossProductFindMax::operator() 
+      (cl::CommandQueue& commandQueue,
+       const Subbands& input,          float inputScale,
+       const Subbands* inputFiner,     float finerScale,
+       const Subbands* inputCoarser,   float coarserScale,
+       float threshold,
+       cl::Buffer& output,
+       cl::Buffer& numOutputs,
+       unsigned int numOutputsOffset,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    kernel_.setArg(23, threshold);
+    kernel_.setArg(24, noThresholds_);
+    kernel_.setArg(25, cl_int(-1));
+
+    run(commandQueue, input, inputScale, inputFiner, finerScale,
+        inputCoarser, coarserScale,
+        output, numOutputs, numOutputsOffset, waitEvents, doneEvent);
+}
+
+
+void CrossProductFindMax::operator() 
+      (cl::CommandQueue& commandQueue,
+       const Subbands& input,          float inputScale,
+       const Subbands* inputFiner,     float finerScale,
+       const Subbands* inputCoarser,   float coarserScale,
+       const cl::Buffer& thresholds, size_t thresholdIndex,
+       cl::Buffer& output,
+       cl::Buffer& numOutputs,
+       unsigned int numOutputsOffset,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    kernel_.setArg(23, 0.f);
+    kernel_.setArg(24, thresholds);
+    kernel_.setArg(25, cl_int(thresholdIndex));
+
+    run(commandQueue, input, inputScale, inputFiner, finerScale,
+        inputCoarser, coarserScale,
+        output, numOutputs, numOutputsOffset, waitEvents, doneEvent);
+}
+
+
+void CrossProductFindMax::run
+      (cl::CommandQueue& commandQueue,
+       const Subbands& input,          float inputScale,
+       const Subbands* inputFiner,     float finerScale,
+       const Subbands* inputCoarser,   float coarserScale,
+       cl::Buffer& output,
+       cl::Buffer& numOutputs,
+       unsigned int numOutputsOffset,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    // Missing levels are stood in for by this one, and flagged as such
+    setSubbandArgs(kernel_, 0, input, inputScale);
+    setSubbandArgs(kernel_, 7, inputFiner? *inputFiner : input, finerScale);
+    kernel_.setArg(14, cl_int(inputFiner != nullptr));
+    setSubbandArgs(kernel_, 15, inputCoarser? *inputCoarser : input,
+                   coarserScale);
+    kernel_.setArg(22, cl_int(inputCoarser != nullptr));
+
+    kernel_.setArg(26, output);
+    kernel_.setArg(27, numOutputs);
+    kernel_.setArg(28, cl_int(numOutputsOffset));
+    kernel_.setArg(29, cl_int(output.getInfo<CL_MEM_SIZE>() 
+                               / (posLen_ * sizeof(float))));
+
+    cl::NDRange globalSize = {
+        size_t(roundWGs(input.width(), wgSizeX_)), 
+        size_t(roundWGs(input.height(), wgSizeY_))
+    }; 
+
+    commandQueue.enqueueNDRangeKernel(kernel_, cl::NullRange,
+                                      globalSize,
+                                      {wgSizeX_, wgSizeY_},
+                                      &waitEvents, doneEvent);
+}
+
+
+size_t CrossProductFindMax::getPosLength() const
+{
+    return posLen_;
+}
+
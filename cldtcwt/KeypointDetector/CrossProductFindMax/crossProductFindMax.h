@@ -0,0 +1,89 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef CROSSPRODUCTFINDMAX_H
+#define CROSSPRODUCTFINDMAX_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+#include "DTCWT/dtcwt.h"
+
+
+
+class CrossProductFindMax {
+// Finds the peaks of the CrossProductMap energy of a level, without
+// writing the energy map out: each workgroup calculates the energy for its
+// tile in local memory, then looks for maxima in it as FindMax does.  Saves
+// an image write and three image reads per level.
+
+public:
+
+    CrossProductFindMax() = default;
+    CrossProductFindMax(const CrossProductFindMax&) = default;
+    CrossProductFindMax(cl::Context& context,
+                        const std::vector<cl::Device>& devices,
+                        bool checkScales = false);
+    // checkScales: whether peaks also have to beat the energy of the
+    // finer and coarser levels at the same point.  Like FindMax, this is
+    // off by default.
+
+    void operator() (cl::CommandQueue& commandQueue,
+       const Subbands& input,          float inputScale,
+       const Subbands* inputFiner,     float finerScale,
+       const Subbands* inputCoarser,   float coarserScale,
+       float threshold,
+       cl::Buffer& output,
+       cl::Buffer& numOutputs,
+       unsigned int numOutputsOffset,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // As FindMax, but from the subbands of a level rather than its energy
+    // map.  The finer and coarser levels may be null if there are none.
+
+    void operator() (cl::CommandQueue& commandQueue,
+       const Subbands& input,          float inputScale,
+       const Subbands* inputFiner,     float finerScale,
+       const Subbands* inputCoarser,   float coarserScale,
+       const cl::Buffer& thresholds, size_t thresholdIndex,
+       cl::Buffer& output,
+       cl::Buffer& numOutputs,
+       unsigned int numOutputsOffset,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // With the threshold read on the device from thresholds[thresholdIndex],
+    // again as FindMax
+
+    size_t getPosLength() const;
+    // Floats per output, in the same format as FindMax: (x, y, scale,
+    // strength)
+
+private:
+    cl::Context context_;
+    cl::Kernel kernel_;
+
+    // Stands in for the thresholds buffer when a fixed one is given
+    cl::Buffer noThresholds_;
+
+    void run(cl::CommandQueue& commandQueue,
+             const Subbands& input,          float inputScale,
+             const Subbands* inputFiner,     float finerScale,
+             const Subbands* inputCoarser,   float coarserScale,
+             cl::Buffer& output,
+             cl::Buffer& numOutputs,
+             unsigned int numOutputsOffset,
+             const std::vector<cl::Event>& waitEvents,
+             cl::Event* doneEvent);
+    // Everything except setting the threshold arguments
+
+    static const int wgSizeX_ = 16;
+    static const int wgSizeY_ = 16;
+
+    const size_t posLen_ = 4;
+};
+
+
+
+#endif
+
@@ -0,0 +1,567 @@
+// Copyright (C) 2013 Timothy Gale
+// Cross-product energy map and peak finding in one pass.  Each workgroup
+// calculates the energy for its tile plus a border of one in local memory,
+// straight from the subbands, then looks for maxima in it just as FindMax
+// does on an energy map image.  The energy calculation is that of
+// CrossProductMap; see EnergyMaps/CrossProduct/kernel.cl.
+//
+// Parameters: WG_SIZE_X, WG_SIZE_Y need to be set for the work group size.
+// POS_LEN should be the number of floats to make the output structure.
+// Define CHECK_SCALE_MAX to also require peaks to beat the energy of the
+// finer and coarser levels at the same place.
+
+typedef float2 Complex;
+
+typedef struct {
+    Complex a, b;
+} ComplexPair;
+
+
+// Energy tile, with a border of one all around, and the subbands needed to
+// calculate it (a further border of one)
+#define TILE_X (WG_SIZE_X+2)
+#define TILE_Y (WG_SIZE_Y+2)
+#define SB_REGION_X (WG_SIZE_X+4)
+#define SB_REGION_Y (WG_SIZE_Y+4)
+
+#define WG_NUM_ITEMS (WG_SIZE_X*WG_SIZE_Y)
+#define TILE_POINTS_PER_ITEM ((TILE_X*TILE_Y + WG_NUM_ITEMS - 1) / WG_NUM_ITEMS)
+
+
+//  Angles (radians) of the subband orientations
+__constant float subbandDirections[6] = {
+    -0.2606,  -0.7854,  -1.3102,   4.4518,   3.9270,   3.4022
+};
+
+// Generated by coeffs.m.
+__constant float2 interpCoeffs[6][4] = {
+    {
+        (Complex) (-0.005240f,0.015359f),
+        (Complex) (-0.292823f,-0.065229f),
+        (Complex) (0.035089f,0.000000f),
+        (Complex) (0.070947f,0.644792f)
+    },
+    {
+        (Complex) (-0.205471f,0.025978f),
+        (Complex) (0.500000f,0.000000f),
+        (Complex) (0.085786f,0.000000f),
+        (Complex) (-0.205471f,-0.025978f)
+    },
+    {
+        (Complex) (0.070947f,-0.644792f),
+        (Complex) (-0.292823f,0.065229f),
+        (Complex) (0.035089f,0.000000f),
+        (Complex) (-0.005240f,-0.015359f)
+    },
+    {
+        (Complex) (-0.292823f,-0.065229f),
+        (Complex) (0.070947f,0.644792f),
+        (Complex) (-0.005240f,0.015359f),
+        (Complex) (0.035089f,0.000000f)
+    },
+    {
+        (Complex) (0.500000f,0.000000f),
+        (Complex) (-0.205471f,-0.025978f),
+        (Complex) (-0.205471f,0.025978f),
+        (Complex) (0.085786f,0.000000f)
+    },
+    {
+        (Complex) (-0.292823f,0.065229f),
+        (Complex) (-0.005240f,-0.015359f),
+        (Complex) (0.070947f,-0.644792f),
+        (Complex) (0.035089f,0.000000f)
+    }
+};
+
+
+
+Complex complexMul(Complex v1, Complex v2)
+{
+    Complex result;
+
+    result.s0 = v1.s0 * v2.s0 - v1.s1 * v2.s1;
+    result.s1 = v1.s0 * v2.s1 + v2.s0 * v1.s1;
+
+    return result;
+}
+
+
+Complex complexConj(Complex v1)
+{
+    Complex result;
+    result.s0 = v1.s0;
+    result.s1 = -v1.s1;
+    return result;
+}
+
+
+
+ComplexPair interpDiagonallySymmetricULLR(const Complex v[3][3],
+                                          __constant const Complex c[4])
+{
+    // Interpolate in the upper-left and lower-right (matrix notation) of the
+    // 3x3 neighbourhood v (centre v[1][1]), using the coefficients for
+    // upper left, upper right, lower left, lower right.  They are rotated by
+    // 180 degrees for the lower-right region and complex-conjugated.
+    ComplexPair result;
+
+    result.a = complexMul(v[0][0], c[0])
+             + complexMul(v[0][1], c[1])
+             + complexMul(v[1][0], c[2])
+             + complexMul(v[1][1], c[3]);
+
+    result.b = complexMul(v[2][2], complexConj(c[0]))
+             + complexMul(v[2][1], complexConj(c[1]))
+             + complexMul(v[1][2], complexConj(c[2]))
+             + complexMul(v[1][1], complexConj(c[3]));
+
+    return result;
+}
+
+
+ComplexPair interpDiagonallySymmetricURLL(const Complex v[3][3],
+                                          __constant const Complex c[4])
+{
+    // As above, for the upper-right and lower-left
+    ComplexPair result;
+
+    result.a = complexMul(v[0][1], c[0])
+             + complexMul(v[0][2], c[1])
+             + complexMul(v[1][1], c[2])
+             + complexMul(v[1][2], c[3]);
+
+    result.b = complexMul(v[2][0], complexConj(c[1]))
+             + complexMul(v[2][1], complexConj(c[0]))
+             + complexMul(v[1][0], complexConj(c[3]))
+             + complexMul(v[1][1], complexConj(c[2]));
+
+    return result;
+}
+
+
+
+float2 subbandSlope(const Complex v[3][3], int n, float* slpLen)
+{
+    // Direction and strength of the change in subband n about the centre of
+    // v, as in CrossProductMap
+    ComplexPair y;
+
+    if (n < 3)
+        y = interpDiagonallySymmetricURLL(v, interpCoeffs[n]);
+    else
+        y = interpDiagonallySymmetricULLR(v, interpCoeffs[n]);
+
+    // Calculate weights for the two phases, normalised to add to 1
+    float w[2] = {dot(y.a, y.a), dot(y.b, y.b)};
+    float sumw = w[0] + w[1];
+    w[0] /= sumw;
+    w[1] /= sumw;
+
+    // Find the rotations between the three sampling points
+    y.a = complexMul(v[1][1], complexConj(y.a));
+    y.b = complexMul(y.b, complexConj(v[1][1]));
+
+    float dphase1 = atan2(y.a.y, y.a.x);
+    float dphase2 = atan2(y.b.y, y.b.x);
+
+    // Absolute value of angular frequency
+    const float absw = 3.1623f * M_PI_F / 2.15f;
+
+    // Difference from original direction (in rad)
+    float phase = subbandDirections[n]
+                    - (w[0] * dphase1 + w[1] * dphase2) / absw;
+
+    const float taperStart = 90.f / 180.f * M_PI_F,
+                taperEnd   = 150.f / 180.f * M_PI_F;
+
+    // Scale down if passing through the taper regions
+    *slpLen = length(v[1][1])
+            * (w[0] *
+               clamp((taperEnd - fabs(dphase1)) / (taperEnd - taperStart),
+                     0.f, 1.f)
+             + w[1] *
+               clamp((taperEnd - fabs(dphase2)) / (taperEnd - taperStart),
+                     0.f, 1.f));
+
+    // Convert to cartesian
+    float xComp, yComp;
+    yComp = sincos(phase, &xComp);
+
+    return *slpLen * (float2) (xComp, yComp);
+}
+
+
+float energyFromSlopes(const float2 slp[6], const float slpLen[6])
+{
+    float energy = 0;
+
+    for (size_t s1 = 0; s1 < 6; ++s1) {
+        for (size_t s2 = 0; s2 < 6; ++s2) {
+            energy +=
+                fabs(slp[s1].x * slp[s2].y - slp[s2].x * slp[s1].y)
+                    / (fmax(slpLen[s1], slpLen[s2]) + 1.e-9f);
+        }
+    }
+
+    return energy / 7.5f;
+}
+
+
+
+// Load a rectangular region from a subband, with zeros outside it
+void readImageRegionToShared(const __global float2* input,
+                unsigned int stride,
+                int2 inSize,
+                int2 regionStart,
+                int2 regionSize,
+                __local volatile Complex* output)
+{
+    int2 localPos = (int2) (get_local_id(0), get_local_id(1));
+
+    for (int x = 0; x < regionSize.x; x += get_local_size(0)) {
+        for (int y = 0; y < regionSize.y; y += get_local_size(1)) {
+
+            int2 readPosOffset = (int2) (x,y) + localPos;
+
+            if (all(readPosOffset < regionSize)) {
+
+                int2 pos = regionStart + readPosOffset;
+
+                bool inImage = all((int2) (0, 0) <= pos)
+                                & all(pos < inSize);
+
+                output[readPosOffset.y * regionSize.x + readPosOffset.x]
+                    = inImage?
+                        input[pos.x + pos.y * stride]
+                      : (float2) (0.f, 0.f);
+            }
+
+        }
+    }
+}
+
+
+
+#ifdef CHECK_SCALE_MAX
+
+float energyAt(const __global float2* sb,
+               unsigned int start, unsigned int pitch, unsigned int stride,
+               int2 size, int2 pos)
+{
+    // Energy at a single sample of another level, read directly from global
+    // memory.  Positions outside take the nearest edge value, as reads from
+    // an energy map image would.
+    pos = clamp(pos, (int2) (0, 0), size - (int2) (1, 1));
+
+    float2 slp[6];
+    float slpLen[6];
+
+    for (int n = 0; n < 6; ++n) {
+
+        Complex v[3][3];
+        for (int dy = 0; dy < 3; ++dy)
+            for (int dx = 0; dx < 3; ++dx) {
+                int2 q = pos + (int2) (dx - 1, dy - 1);
+                v[dy][dx] = (all((int2) (0, 0) <= q) & all(q < size))?
+                              sb[start + n * pitch + q.x + q.y * stride]
+                            : (float2) (0.f, 0.f);
+            }
+
+        slp[n] = subbandSlope(v, n, &slpLen[n]);
+    }
+
+    return energyFromSlopes(slp, slpLen);
+}
+
+
+float energyInterpolated(const __global float2* sb,
+                         unsigned int start, unsigned int pitch,
+                         unsigned int stride, int2 size, float2 coords)
+{
+    // Bilinear interpolation of the energy, coords in samples
+    float2 f = floor(coords);
+    int2 i = convert_int2(f);
+    float2 w = coords - f;
+
+    float e00 = energyAt(sb, start, pitch, stride, size, i),
+          e10 = energyAt(sb, start, pitch, stride, size, i + (int2) (1, 0)),
+          e01 = energyAt(sb, start, pitch, stride, size, i + (int2) (0, 1)),
+          e11 = energyAt(sb, start, pitch, stride, size, i + (int2) (1, 1));
+
+    return mix(mix(e00, e10, w.x), mix(e01, e11, w.x), w.y);
+}
+
+#endif
+
+
+
+typedef struct {
+    float a0, ax, ay, ahalfxx, ahalfyy, axy;
+} QuadraticCoeffs;
+
+
+void solveQuadraticCoefficients(__private QuadraticCoeffs* coeffs,
+                                __local const volatile float* row0,
+                                __local const volatile float* row1,
+                                __local const volatile float* row2)
+{
+    // Takes a 3x3 area (one value of y for each row), and fits a quadratic
+    // surface.  Corners are given 1/4 the weight for fitting purposes.  See
+    // FindMax/kernel.cl for how the pseudoinverse was generated.
+
+    const float inverse[6][9] =
+    {
+        {-0.027778,    0.055556,   -0.027778,    0.055556,     0.88889,    0.055556,   -0.027778,    0.055556,   -0.027778},
+        {-0.083333,           0,    0.083333,    -0.33333,           0,     0.33333,   -0.083333,           0,    0.083333},
+        {-0.083333,    -0.33333,   -0.083333,           0,           0,           0,    0.083333,     0.33333,    0.083333},
+        {  0.16667,    -0.33333,     0.16667,     0.66667,     -1.3333,     0.66667,     0.16667,    -0.33333,     0.16667},
+        {  0.16667,     0.66667,     0.16667,    -0.33333,     -1.3333,    -0.33333,     0.16667,     0.66667,     0.16667},
+        {     0.25,           0,       -0.25,           0,           0,           0,       -0.25,           0,        0.25}
+    };
+
+    coeffs->a0 = 0;
+    coeffs->ax = 0;
+    coeffs->ay = 0;
+    coeffs->ahalfxx = 0;
+    coeffs->ahalfyy = 0;
+    coeffs->axy = 0;
+
+    for (size_t n = 0; n < 9; ++n) {
+
+        float v;
+
+        if (n < 3)
+            v = row0[n];
+        else if (n < 6)
+            v = row1[n-3];
+        else
+            v = row2[n-6];
+
+        coeffs->a0 += v * inverse[0][n];
+        coeffs->ax += v * inverse[1][n];
+        coeffs->ay += v * inverse[2][n];
+        coeffs->ahalfxx += v * inverse[3][n];
+        coeffs->ahalfyy += v * inverse[4][n];
+        coeffs->axy += v * inverse[5][n];
+    }
+
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE_X, WG_SIZE_Y, 1)))
+void crossProductFindMax(const __global float2* sb,
+                         const unsigned int sbStart,
+                         const unsigned int sbPitch,
+                         const unsigned int sbStride,
+                         const unsigned int sbWidth,
+                         const unsigned int sbHeight,
+                         const float inputScale,
+
+                         const __global float2* sbFiner,
+                         const unsigned int finerStart,
+                         const unsigned int finerPitch,
+                         const unsigned int finerStride,
+                         const unsigned int finerWidth,
+                         const unsigned int finerHeight,
+                         const float finerScale,
+                         const int hasFiner,
+
+                         const __global float2* sbCoarser,
+                         const unsigned int coarserStart,
+                         const unsigned int coarserPitch,
+                         const unsigned int coarserStride,
+                         const unsigned int coarserWidth,
+                         const unsigned int coarserHeight,
+                         const float coarserScale,
+                         const int hasCoarser,
+
+                         const float fixedThreshold,
+                         __global const float* thresholds,
+                         const int thresholdIndex,
+
+                         __global float* maxCoords,
+                         global volatile unsigned int* numOutputs,
+                         int numOutputsOffset,
+                         const int maxNumOutputs)
+{
+    // Scales are how many pixels there are in the original image for each
+    // pixel in this level.  Outputs, and the choice of threshold, are as
+    // for FindMax.
+
+    const float threshold = (thresholdIndex >= 0)?
+                                thresholds[thresholdIndex] : fixedThreshold;
+
+    __local Complex sbVals[SB_REGION_Y][SB_REGION_X];
+    __local volatile float energy[TILE_Y][TILE_X];
+
+    const int2 g = (int2) (get_global_id(0), get_global_id(1)),
+               l = (int2) (get_local_id(0), get_local_id(1));
+    const int lIdx = l.y * WG_SIZE_X + l.x;
+
+    const int2 groupStart = (int2) (get_group_id(0) * WG_SIZE_X,
+                                    get_group_id(1) * WG_SIZE_Y);
+    const int2 sbSize = (int2) (sbWidth, sbHeight);
+
+    // Each work item works out the energy at one or two points of the tile,
+    // building up the contribution of each subband in turn
+    float2 slp[TILE_POINTS_PER_ITEM][6];
+    float slpLen[TILE_POINTS_PER_ITEM][6];
+
+    for (int n = 0; n < 6; ++n) {
+
+        readImageRegionToShared(sb + sbStart + n * sbPitch,
+                                sbStride, sbSize,
+                                groupStart - (int2) (2, 2),
+                                (int2) (SB_REGION_X, SB_REGION_Y),
+                                &sbVals[0][0]);
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int p = 0; p < TILE_POINTS_PER_ITEM; ++p) {
+
+            const int t = lIdx + p * WG_NUM_ITEMS;
+
+            if (t < TILE_X * TILE_Y) {
+                const int tx = t % TILE_X, ty = t / TILE_X;
+
+                // Tile point (tx, ty) has its subband neighbourhood centred
+                // on (tx+1, ty+1) of the loaded region
+                Complex v[3][3];
+                for (int dy = 0; dy < 3; ++dy)
+                    for (int dx = 0; dx < 3; ++dx)
+                        v[dy][dx] = sbVals[ty + dy][tx + dx];
+
+                slp[p][n] = subbandSlope(v, n, &slpLen[p][n]);
+            }
+        }
+
+        // Make sure values aren't overwritten while they might still be
+        // being used
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int p = 0; p < TILE_POINTS_PER_ITEM; ++p) {
+        const int t = lIdx + p * WG_NUM_ITEMS;
+        if (t < TILE_X * TILE_Y)
+            energy[t / TILE_X][t % TILE_X] = energyFromSlopes(slp[p],
+                                                              slpLen[p]);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Outside the level, repeat the nearest edge value, as the clamped
+    // reads of an energy map would.  Only values inside are read, and only
+    // values outside are written, so this can be done in place.
+    for (int p = 0; p < TILE_POINTS_PER_ITEM; ++p) {
+        const int t = lIdx + p * WG_NUM_ITEMS;
+
+        if (t < TILE_X * TILE_Y) {
+            const int2 tp = (int2) (t % TILE_X, t / TILE_X);
+            const int2 pos = groupStart - (int2) (1, 1) + tp;
+            const int2 clamped = clamp(pos, (int2) (0, 0),
+                                       sbSize - (int2) (1, 1));
+
+            if (any(pos != clamped)) {
+                int2 src = clamp(clamped - groupStart + (int2) (1, 1),
+                                 (int2) (0, 0),
+                                 (int2) (TILE_X - 1, TILE_Y - 1));
+                energy[tp.y][tp.x] = energy[src.y][src.x];
+            }
+        }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // From here on, as FindMax
+
+    if (g.x >= sbWidth || g.y >= sbHeight)
+        return;
+
+    float surroundMax = threshold;
+    surroundMax = max(surroundMax, energy[l.y+0][l.x+0]);
+    surroundMax = max(surroundMax, energy[l.y+1][l.x+0]);
+    surroundMax = max(surroundMax, energy[l.y+2][l.x+0]);
+    surroundMax = max(surroundMax, energy[l.y+0][l.x+1]);
+    surroundMax = max(surroundMax, energy[l.y+2][l.x+1]);
+    surroundMax = max(surroundMax, energy[l.y+0][l.x+2]);
+    surroundMax = max(surroundMax, energy[l.y+1][l.x+2]);
+    surroundMax = max(surroundMax, energy[l.y+2][l.x+2]);
+
+    if (!(energy[l.y+1][l.x+1] > surroundMax))
+        return;
+
+    float2 inputCoords = (float2) ((float)g.x, (float)g.y);
+
+    // Fit coefficients of a quadratic to the surface
+    QuadraticCoeffs c;
+    solveQuadraticCoefficients(&c,
+                               &energy[l.y  ][l.x],
+                               &energy[l.y+1][l.x],
+                               &energy[l.y+2][l.x]);
+
+    // Find the peak of the surface
+    float det = 1.f / (c.ahalfxx * c.ahalfyy - c.axy * c.axy);
+
+    float2 invhessian[2] =
+    {
+        (float2) (det * c.ahalfyy,     det * -c.axy),
+        (float2) (   det * -c.axy,  det * c.ahalfxx)
+    };
+
+    float2 grad = (float2) (c.ax, c.ay);
+
+    float2 move = -(float2)(dot(invhessian[0], grad),
+                            dot(invhessian[1], grad));
+
+    // Drop if the displacement suggests it should be elsewhere entirely
+    if (any(fabs(move) > 1.f))
+        return;
+
+    inputCoords += move;
+
+    float strength = c.a0 + 0.5f * dot(grad, move);
+
+    // Output position relative to the centre of the image in the native
+    // scaling
+    float2 outPos = inputScale *
+        (inputCoords - (float2) 0.5 * convert_float2(sbSize - (int2) 1));
+
+#ifdef CHECK_SCALE_MAX
+    // Must beat the other levels at the same place.  The centres of the
+    // levels coincide.
+    if (hasFiner) {
+        const int2 finerSize = (int2) (finerWidth, finerHeight);
+        float2 finerCoords = outPos / finerScale
+            + (float2) 0.5f * convert_float2(finerSize - (int2) 1);
+
+        if (!(strength > energyInterpolated(sbFiner, finerStart, finerPitch,
+                                            finerStride, finerSize,
+                                            finerCoords)))
+            return;
+    }
+
+    if (hasCoarser) {
+        const int2 coarserSize = (int2) (coarserWidth, coarserHeight);
+        float2 coarserCoords = outPos / coarserScale
+            + (float2) 0.5f * convert_float2(coarserSize - (int2) 1);
+
+        if (!(strength > energyInterpolated(sbCoarser, coarserStart,
+                                            coarserPitch, coarserStride,
+                                            coarserSize, coarserCoords)))
+            return;
+    }
+#endif
+
+    int ourOutputPos = atomic_inc(&numOutputs[numOutputsOffset]);
+
+    // Write it out (if there's enough space)
+    if (ourOutputPos < maxNumOutputs) {
+        maxCoords[ourOutputPos*POS_LEN + 0] = outPos.x;
+        maxCoords[ourOutputPos*POS_LEN + 1] = outPos.y;
+        maxCoords[ourOutputPos*POS_LEN + 2] = inputScale;
+        maxCoords[ourOutputPos*POS_LEN + 3] = strength;
+    } else
+        numOutputs[numOutputsOffset] = maxNumOutputs;
+}
+
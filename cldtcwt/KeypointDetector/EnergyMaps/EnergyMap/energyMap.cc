@@ -3,15 +3,26 @@
 #include "util/clUtil.h"
 
 #include <iostream>
+#include <stdexcept>
 
 #include "kernel.h"
+#include "Filter/subbandLayout.h"
 
 EnergyMap::EnergyMap(cl::Context& context,
-                     const std::vector<cl::Device>& devices)
-   : context_(context)
+                     const std::vector<cl::Device>& devices,
+                     SubbandFormat layout)
+   : context_(context), layout_(layout)
 {
-    // Bundle the code up
+    if (layout != SubbandsComplex && layout != SubbandsPlanar
+     && layout != SubbandsTiled)
+        throw std::logic_error("EnergyMap needs complex subbands");
+
+    // Bundle the code up, after the subband reading functions
     cl::Program::Sources source;
+    source.push_back(std::make_pair(
+                reinterpret_cast<const char*>(
+                    SubbandLayoutNS::subbandLayout_cl), 
+                SubbandLayoutNS::subbandLayout_cl_len));
     source.push_back(std::make_pair(
                 reinterpret_cast<const char*>(EnergyMapNS::kernel_cl), 
                 EnergyMapNS::kernel_cl_len));
@@ -20,7 +31,10 @@ EnergyMap::EnergyMap(cl::Context& context,
     cl::Program program(context, source);
 
     try {
-        program.build(devices);
+        program.build(devices, layout_ == SubbandsPlanar?
+                                    "-D PLANAR_SUBBANDS"
+                             : layout_ == SubbandsTiled?
+                                    "-D TILED_SUBBANDS" : "");
     } catch(cl::Error err) {
 	    std::cerr 
 		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
@@ -42,6 +56,44 @@ void EnergyMap::operator() (cl::CommandQueue& commandQueue,
                             const std::vector<cl::Event>& preconditions,
                             cl::Event* doneEvent)
 {
+    enqueue_(commandQueue, levelOutput, energyMap, preconditions, doneEvent);
+}
+
+
+
+void EnergyMap::operator() (cl::CommandQueue& commandQueue,
+                            const PlanarSubbands& levelOutput,
+                            cl::Image2D& energyMap,
+                            const std::vector<cl::Event>& preconditions,
+                            cl::Event* doneEvent)
+{
+    enqueue_(commandQueue, levelOutput, energyMap, preconditions, doneEvent);
+}
+
+
+
+void EnergyMap::operator() (cl::CommandQueue& commandQueue,
+                            const TiledSubbands& levelOutput,
+                            cl::Image2D& energyMap,
+                            const std::vector<cl::Event>& preconditions,
+                            cl::Event* doneEvent)
+{
+    enqueue_(commandQueue, levelOutput, energyMap, preconditions, doneEvent);
+}
+
+
+
+template <typename Level>
+void EnergyMap::enqueue_(cl::CommandQueue& commandQueue,
+                         const Level& levelOutput,
+                         cl::Image2D& energyMap,
+                         const std::vector<cl::Event>& preconditions,
+                         cl::Event* doneEvent)
+{
+    if (SubbandLayout<Level>::format != layout_)
+        throw std::logic_error("EnergyMap: subbands not in the layout it "
+                               "was built for");
+
     // Set up all the arguments to the kernel
     kernel_.setArg(0, levelOutput.buffer());
     kernel_.setArg(1, cl_uint(levelOutput.start()));
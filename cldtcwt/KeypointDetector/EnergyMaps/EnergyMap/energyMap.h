@@ -15,7 +15,10 @@ public:
     EnergyMap(const EnergyMap&) = default;
 
     EnergyMap(cl::Context& context,
-              const std::vector<cl::Device>& devices);
+              const std::vector<cl::Device>& devices,
+              SubbandFormat layout = SubbandsComplex);
+    // layout is SubbandsComplex, SubbandsPlanar or SubbandsTiled,
+    // whichever the levels passed in will be
 
     void
     operator() (cl::CommandQueue& commandQueue,
@@ -24,9 +27,31 @@ public:
            const std::vector<cl::Event>& preconditions = {},
            cl::Event* doneEvent = nullptr);
 
+    void
+    operator() (cl::CommandQueue& commandQueue,
+           const PlanarSubbands& levelOutput,
+           cl::Image2D& energyMap,
+           const std::vector<cl::Event>& preconditions = {},
+           cl::Event* doneEvent = nullptr);
+
+    void
+    operator() (cl::CommandQueue& commandQueue,
+           const TiledSubbands& levelOutput,
+           cl::Image2D& energyMap,
+           const std::vector<cl::Event>& preconditions = {},
+           cl::Event* doneEvent = nullptr);
+
 private:
     cl::Context context_;
     cl::Kernel kernel_;
+    SubbandFormat layout_ = SubbandsComplex;
+
+    template <typename Level>
+    void enqueue_(cl::CommandQueue& commandQueue,
+                  const Level& levelOutput,
+                  cl::Image2D& energyMap,
+                  const std::vector<cl::Event>& preconditions,
+                  cl::Event* doneEvent);
 
 };
 
@@ -1,5 +1,7 @@
 // Copyright (C) 2013 Timothy Gale
-__kernel void energyMap(const __global float2* sb,
+// SubbandElement, subbandOffset and readSubband come from subbandLayout.cl,
+// built in ahead of this.
+__kernel void energyMap(const __global SubbandElement* sb,
                         const unsigned int sbStart,
                         const unsigned int sbPitch,
                         const unsigned int sbStride,
@@ -17,7 +19,7 @@ __kernel void energyMap(const __global float2* sb,
 
     if (all(pos < (int2)(sbWidth, sbHeight))) {
     
-        size_t idx = sbStart + pos.x + pos.y * sbStride;
+        size_t idx = subbandOffset(pos.x, pos.y, sbStride);
 
         float abs_h_2[6];
 
@@ -25,7 +27,10 @@ __kernel void energyMap(const __global float2* sb,
         for (int n = 0; n < 6; ++n) {
         
             // Sample the subband
-            float2 h = sb[idx + sbPitch * n];
+            float2 h = readSubband(sb,
+                                   orientationStart(sbStart, sbPitch, n)
+                                    + idx,
+                                   sbPitch);
 
             // Convert to absolute (still squared, because it's more
             // convenient)
@@ -1,4 +1,5 @@
 // Copyright (C) 2013 Timothy Gale
+// subbandOffset comes from subbandLayout.cl, built in ahead of this.
 typedef float2 Complex;
 
 // Load a rectangular region from a floating-point image
@@ -37,7 +38,7 @@ void readImageRegionToShared(const __global float2* input,
 
                 output[readPosOffset.y * regionSize.x + readPosOffset.x]
                     = inImage? 
-                        input[pos.x + pos.y * stride]
+                        input[subbandOffset(pos.x, pos.y, stride)]
                       : (float2) (0.f, 0.f);
             }
 
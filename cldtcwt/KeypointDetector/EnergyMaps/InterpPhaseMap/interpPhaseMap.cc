@@ -17,20 +17,35 @@ static const char clBuildOptions[] = "";
 
 
 #include "kernel.h"
+#include "Filter/subbandLayout.h"
 using namespace InterpPhaseMapNS;
 
 InterpPhaseMap::InterpPhaseMap(cl::Context& context,
-                     const std::vector<cl::Device>& devices)
-   : context_(context)
+                     const std::vector<cl::Device>& devices,
+                     SubbandFormat layout)
+   : context_(context), layout_(layout)
 {
+    if (layout != SubbandsComplex && layout != SubbandsTiled)
+        throw std::logic_error("InterpPhaseMap needs complex or tiled "
+                               "subbands");
+
     // The OpenCL kernel:
     std::ostringstream kernelInput;
 
     // Define some constants
     kernelInput << "#define WG_SIZE_X (16)\n"
                    "#define WG_SIZE_Y (16)\n";
+
+    if (layout_ == SubbandsTiled)
+        kernelInput << "#define TILED_SUBBANDS\n";
    
-    // Get input from the source file
+    // Get input from the source files: the subband addressing, then the
+    // kernel
+    const char* layoutText = reinterpret_cast<const char*>
+                            (SubbandLayoutNS::subbandLayout_cl);
+    std::copy(layoutText, layoutText + SubbandLayoutNS::subbandLayout_cl_len,
+              std::ostream_iterator<char>(kernelInput));
+
     const char* fileText = reinterpret_cast<const char*> (kernel_cl);
     size_t fileTextLength = kernel_cl_len;
 
@@ -68,9 +83,36 @@ InterpPhaseMap::InterpPhaseMap(cl::Context& context,
 void InterpPhaseMap::operator() (cl::CommandQueue& commandQueue,
                             const Subbands& subbands,
                             cl::Image2D& energyMap,
-           const std::vector<cl::Event>& preconditions,
+                            const std::vector<cl::Event>& preconditions,
+                            cl::Event* doneEvent)
+{
+    enqueue_(commandQueue, subbands, energyMap, preconditions, doneEvent);
+}
+
+
+
+void InterpPhaseMap::operator() (cl::CommandQueue& commandQueue,
+                            const TiledSubbands& subbands,
+                            cl::Image2D& energyMap,
+                            const std::vector<cl::Event>& preconditions,
+                            cl::Event* doneEvent)
+{
+    enqueue_(commandQueue, subbands, energyMap, preconditions, doneEvent);
+}
+
+
+
+template <typename Level>
+void InterpPhaseMap::enqueue_(cl::CommandQueue& commandQueue,
+                            const Level& subbands,
+                            cl::Image2D& energyMap,
+                            const std::vector<cl::Event>& preconditions,
                             cl::Event* doneEvent)
 {
+    if (SubbandLayout<Level>::format != layout_)
+        throw std::logic_error("InterpPhaseMap: subbands not in the layout "
+                               "it was built for");
+
     // Set up all the arguments to the kernel
     kernel_.setArg(0, subbands.buffer());
     kernel_.setArg(1, cl_uint(subbands.start()));
@@ -26,7 +26,10 @@ public:
     InterpPhaseMap(const InterpPhaseMap&) = default;
 
     InterpPhaseMap(cl::Context& context,
-              const std::vector<cl::Device>& devices);
+              const std::vector<cl::Device>& devices,
+              SubbandFormat layout = SubbandsComplex);
+    // layout is SubbandsComplex or SubbandsTiled, whichever the levels
+    // passed in will be
 
     void
     operator() (cl::CommandQueue& commandQueue,
@@ -35,9 +38,24 @@ public:
            const std::vector<cl::Event>& preconditions = {},
            cl::Event* doneEvent = nullptr);
 
+    void
+    operator() (cl::CommandQueue& commandQueue,
+           const TiledSubbands& levelOutput,
+           cl::Image2D& energyMap,
+           const std::vector<cl::Event>& preconditions = {},
+           cl::Event* doneEvent = nullptr);
+
 private:
     cl::Context context_;
     cl::Kernel kernel_;
+    SubbandFormat layout_ = SubbandsComplex;
+
+    template <typename Level>
+    void enqueue_(cl::CommandQueue& commandQueue,
+                  const Level& levelOutput,
+                  cl::Image2D& energyMap,
+                  const std::vector<cl::Event>& preconditions,
+                  cl::Event* doneEvent);
 
 };
 
@@ -1,4 +1,5 @@
 // Copyright (C) 2013 Timothy Gale
+// subbandOffset comes from subbandLayout.cl, built in ahead of this.
 typedef struct {
     float len;
     float arg;
@@ -44,7 +45,7 @@ void readImageRegionToShared(const __global float2* input,
                 // Read in cartesian
                 float2 cart =
                     inImage? 
-                        input[pos.x + pos.y * stride]
+                        input[subbandOffset(pos.x, pos.y, stride)]
                       : (float2) (0.f, 0.f);
 
                 // Convert to polar
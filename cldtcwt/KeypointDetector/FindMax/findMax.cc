@@ -49,6 +49,8 @@ FindMax::FindMax(cl::Context& context,
         
     // ...and extract the useful part, i.e. the kernel
     kernel_ = cl::Kernel(program, "findMax");
+
+    noThresholds_ = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(cl_float));
 }
 
 static int roundWGs(int l, int lWG)
@@ -74,13 +76,59 @@ void FindMax::operator()
     // *Scale says how many real distance units there are per pixel of input*.
     //
     // No more outputs are produced than will fit into the buffer output, and the
-    // values placed there are floats in (x, y) format relative to the centre of the
-    // image, in real distance units.  The total number of maxima found is placed in
+    // values placed there are floats in (x, y, scale, strength) format, the position
+    // relative to the centre of the image, in real distance units.  The total number of maxima found is placed in
     // numOutputs[numOutputsOffset] as an integer.
     //
     // The command will not start until all of waitEvents have completed, and
     // once done will flag doneEvent.
 
+    kernel_.setArg(6, (threshold));
+    kernel_.setArg(7, noThresholds_);
+    kernel_.setArg(8, cl_int(-1));
+
+    run(commandQueue, input, inputScale, inputFiner, finerScale,
+        inputCoarser, coarserScale, eigenRatioThreshold,
+        output, numOutputs, numOutputsOffset, waitEvents, doneEvent);
+}
+
+
+
+void FindMax::operator() 
+      (cl::CommandQueue& commandQueue,
+       cl::Image& input,        float inputScale,
+       cl::Image& inputFiner,   float finerScale,
+       cl::Image& inputCoarser, float coarserScale,
+       const cl::Buffer& thresholds, size_t thresholdIndex,
+       float eigenRatioThreshold,
+       cl::Buffer& output,
+       cl::Buffer& numOutputs,
+       unsigned int numOutputsOffset,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    kernel_.setArg(6, 0.f);
+    kernel_.setArg(7, thresholds);
+    kernel_.setArg(8, cl_int(thresholdIndex));
+
+    run(commandQueue, input, inputScale, inputFiner, finerScale,
+        inputCoarser, coarserScale, eigenRatioThreshold,
+        output, numOutputs, numOutputsOffset, waitEvents, doneEvent);
+}
+
+
+
+void FindMax::run(cl::CommandQueue& commandQueue,
+                  cl::Image& input,        float inputScale,
+                  cl::Image& inputFiner,   float finerScale,
+                  cl::Image& inputCoarser, float coarserScale,
+                  float eigenRatioThreshold,
+                  cl::Buffer& output,
+                  cl::Buffer& numOutputs,
+                  unsigned int numOutputsOffset,
+                  const std::vector<cl::Event>& waitEvents,
+                  cl::Event* doneEvent)
+{
     cl::NDRange WorkgroupSize = {wgSizeX_, wgSizeY_};
 
     cl::NDRange GlobalSize = {
@@ -95,12 +143,11 @@ void FindMax::operator()
     kernel_.setArg(3, (finerScale));
     kernel_.setArg(4, sizeof(inputCoarser), &inputCoarser);
     kernel_.setArg(5, (coarserScale));
-    kernel_.setArg(6, (threshold));
-    kernel_.setArg(7, (eigenRatioThreshold));
-    kernel_.setArg(8, output);
-    kernel_.setArg(9, numOutputs);
-    kernel_.setArg(10, (numOutputsOffset));
-    kernel_.setArg(11, int(output.getInfo<CL_MEM_SIZE>() 
+    kernel_.setArg(9, (eigenRatioThreshold));
+    kernel_.setArg(10, output);
+    kernel_.setArg(11, numOutputs);
+    kernel_.setArg(12, (numOutputsOffset));
+    kernel_.setArg(13, int(output.getInfo<CL_MEM_SIZE>() 
                             / (posLen_ * sizeof(float)))); // Max number of outputs
 
     // Execute
@@ -116,3 +163,9 @@ size_t FindMax::getPosLength() const
     return posLen_;
 }
 
+
+size_t FindMax::getStrengthIndex() const
+{
+    return 3;
+}
+
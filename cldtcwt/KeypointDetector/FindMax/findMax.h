@@ -32,19 +32,53 @@ public:
        const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
        cl::Event* doneEvent = nullptr);
 
+    void operator() (cl::CommandQueue& commandQueue,
+       cl::Image& input,        float inputScale,
+       cl::Image& inputFiner,   float finerScale,
+       cl::Image& inputCoarser, float coarserScale,
+       const cl::Buffer& thresholds, size_t thresholdIndex,
+       float eigenRatioThreshold,
+       cl::Buffer& output,
+       cl::Buffer& numOutputs,
+       unsigned int numOutputsOffset,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // The same, but with the threshold read from thresholds[thresholdIndex]
+    // (floats) when the kernel runs, so it can come from earlier work on
+    // the device
+
     size_t getPosLength() const;
     // Returns the number of floats included in each output.  At the moment, that
-    // is (x, y, scale, --), so 4.
+    // is (x, y, scale, strength), so 4.
+
+    size_t getStrengthIndex() const;
+    // Which of those floats is the strength
 
 private:
     cl::Context context_;
     cl::Kernel kernel_;
 
+    // Stands in for the thresholds buffer when a fixed one is given
+    cl::Buffer noThresholds_;
+
+    void run(cl::CommandQueue& commandQueue,
+             cl::Image& input,        float inputScale,
+             cl::Image& inputFiner,   float finerScale,
+             cl::Image& inputCoarser, float coarserScale,
+             float eigenRatioThreshold,
+             cl::Buffer& output,
+             cl::Buffer& numOutputs,
+             unsigned int numOutputsOffset,
+             const std::vector<cl::Event>& waitEvents,
+             cl::Event* doneEvent);
+    // Sets the remaining arguments (the threshold ones having been set)
+    // and enqueues the kernel
+
     static const int wgSizeX_ = 16;
     static const int wgSizeY_ = 16;
 
     // Number of floats long to make each output position.  Comes in format
-    // x, y, scale.
+    // x, y, scale, strength (the height of the fitted peak).
     const size_t posLen_ = 4;
 };
 
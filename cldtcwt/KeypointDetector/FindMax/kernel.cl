@@ -111,7 +111,9 @@ void findMax(__read_only image2d_t input,
              __read_only image2d_t inCoarser,
              const float coarserScale,
 
-             const float threshold,
+             const float fixedThreshold,
+             __global const float* thresholds,
+             const int thresholdIndex,
              const float eigenRatioThreshold,
 
              __write_only __global float* maxCoords,
@@ -121,7 +123,12 @@ void findMax(__read_only image2d_t input,
              const int maxNumOutputs)
 {
     // Scales are how many pixels there are in the original image for each
-    // pixel in this image
+    // pixel in this image.  The threshold is fixedThreshold, unless
+    // thresholdIndex is non-negative, when it is thresholds[thresholdIndex]
+    // (so it can be set on the device).
+
+    const float threshold = (thresholdIndex >= 0)?
+                                thresholds[thresholdIndex] : fixedThreshold;
 
     sampler_t sampler =
         CLK_NORMALIZED_COORDS_FALSE
@@ -201,6 +208,9 @@ void findMax(__read_only image2d_t input,
 
         inputCoords += move;
 
+        // Height of the fitted surface at the peak, for ranking keypoints
+        float strength = c.a0 + 0.5f * dot(grad, move);
+
         // Check the eigenvalues of the Hessian of this fit to check that it
         // enough of a dot, rather than a line
 #if 0
@@ -257,6 +267,7 @@ void findMax(__read_only image2d_t input,
                 maxCoords[ourOutputPos*POS_LEN + 0] = outPos.x;
                 maxCoords[ourOutputPos*POS_LEN + 1] = outPos.y;
                 maxCoords[ourOutputPos*POS_LEN + 2] = inputScale;
+                maxCoords[ourOutputPos*POS_LEN + 3] = strength;
             } else
                 numOutputs[numOutputsOffset] = maxNumOutputs;
 
@@ -0,0 +1,119 @@
+// Copyright (C) 2013 Timothy Gale
+#include "gridSelect.h"
+#include "kernel.h"
+#include "MiscKernels/Primitives/scan.h"
+
+using namespace GridSelectNS;
+
+#include "util/clUtil.h"
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <stdexcept>
+
+
+GridSelect::GridSelect(cl::Context& context,
+                       const std::vector<cl::Device>& devices,
+                       size_t numFloatsPerItem, size_t strengthIndex)
+   : context_(context),
+     numFloatsPerItem_(numFloatsPerItem)
+{
+    if (numFloatsPerItem < 3 || strengthIndex >= numFloatsPerItem)
+        throw std::logic_error("GridSelect: bad keypoint layout");
+
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (kernel_cl);
+    size_t fileTextLength = kernel_cl_len;
+
+    // Bundle the code up, after the shared workgroup scan
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(
+        reinterpret_cast<const char*>(PrimitivesNS::scan_cl),
+        PrimitivesNS::scan_cl_len));
+    source.push_back(std::make_pair(fileText, fileTextLength));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_
+                        << " -D POS_LEN=" << numFloatsPerItem
+                        << " -D STRENGTH_IDX=" << strengthIndex
+                        << " -D MAX_SEGMENTS=" << maxNumSegments;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr 
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    } 
+        
+    // ...and extract the useful parts, i.e. the kernels
+    suppressKernel_ = cl::Kernel(program, "suppress");
+    rankKernel_ = cl::Kernel(program, "rankInCell");
+    compactKernel_ = cl::Kernel(program, "compactKept");
+}
+
+
+
+
+void GridSelect::operator() 
+      (cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& cumCounts, size_t numSegments,
+       const Settings& settings,
+       cl::Buffer& survives, cl::Buffer& keep,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    if (numSegments > maxNumSegments)
+        throw std::logic_error("GridSelect: too many segments");
+
+    if (!(settings.cellSize > 0.f))
+        throw std::logic_error("GridSelect: cell size must be positive");
+
+    // The actual length is only known on the device, so cover everything
+    // the list could hold; workgroups past the end return straight away
+    const size_t capacity = list.getInfo<CL_MEM_SIZE>()
+                             / (numFloatsPerItem_ * sizeof(float));
+    const cl::NDRange globalSize = {size_t(roundWGs(capacity, wgSize_))};
+
+    suppressKernel_.setArg(0, list);
+    suppressKernel_.setArg(1, cumCounts);
+    suppressKernel_.setArg(2, cl_uint(numSegments));
+    suppressKernel_.setArg(3, settings.suppressionRadius);
+    suppressKernel_.setArg(4, survives);
+
+    cl::Event suppressDone;
+    commandQueue.enqueueNDRangeKernel(suppressKernel_, cl::NullRange,
+                                      globalSize, {wgSize_},
+                                      &waitEvents, &suppressDone);
+
+    rankKernel_.setArg(0, list);
+    rankKernel_.setArg(1, cumCounts);
+    rankKernel_.setArg(2, cl_uint(numSegments));
+    rankKernel_.setArg(3, survives);
+    rankKernel_.setArg(4, settings.cellSize);
+    rankKernel_.setArg(5, cl_uint(settings.maxPerCell));
+    rankKernel_.setArg(6, keep);
+
+    std::vector<cl::Event> rankWait = {suppressDone};
+    cl::Event rankDone;
+    commandQueue.enqueueNDRangeKernel(rankKernel_, cl::NullRange,
+                                      globalSize, {wgSize_},
+                                      &rankWait, &rankDone);
+
+    // Compaction is done by a single workgroup
+    compactKernel_.setArg(0, list);
+    compactKernel_.setArg(1, cumCounts);
+    compactKernel_.setArg(2, cl_uint(numSegments));
+    compactKernel_.setArg(3, keep);
+
+    std::vector<cl::Event> compactWait = {rankDone};
+    commandQueue.enqueueNDRangeKernel(compactKernel_, cl::NullRange,
+                                      {wgSize_}, {wgSize_},
+                                      &compactWait, doneEvent);
+}
+
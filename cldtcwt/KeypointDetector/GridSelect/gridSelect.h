@@ -0,0 +1,64 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef GRIDSELECT_H
+#define GRIDSELECT_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+
+
+class GridSelect {
+// Thins out a list of keypoints so they are spread over the image.  A
+// keypoint is suppressed if there is a stronger one nearby, at any scale;
+// then the image is split into square cells, and only the strongest few
+// survivors in each cell are kept.  The list is compacted in place,
+// keeping each level's keypoints together and in order.
+
+public:
+
+    struct Settings {
+        float cellSize;             // Side of a grid cell, in pixels
+        size_t maxPerCell;          // Keypoints kept in each cell
+        float suppressionRadius;    // As a multiple of keypoint scale
+    };
+
+    GridSelect() = default;
+    GridSelect(const GridSelect&) = default;
+    GridSelect(cl::Context& context,
+               const std::vector<cl::Device>& devices,
+               size_t numFloatsPerItem, size_t strengthIndex);
+    // Each keypoint is numFloatsPerItem floats, starting (x, y, scale), with
+    // the strength at strengthIndex
+
+    void operator() (cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& cumCounts, size_t numSegments,
+       const Settings& settings,
+       cl::Buffer& survives, cl::Buffer& keep,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // list holds numSegments runs of keypoints, run n occupying items
+    // cumCounts[n] up to cumCounts[n+1].  survives and keep are workspace,
+    // each with room for a cl_uint per item list can hold.  cumCounts is
+    // rewritten to match the thinned list.
+
+    static const size_t maxNumSegments = 16;
+
+private:
+    cl::Context context_;
+    cl::Kernel suppressKernel_;
+    cl::Kernel rankKernel_;
+    cl::Kernel compactKernel_;
+
+    size_t numFloatsPerItem_;
+
+    static const size_t wgSize_ = 256;
+};
+
+
+
+#endif
+
@@ -0,0 +1,199 @@
+// Copyright (C) 2013 Timothy Gale
+// Spreading keypoints over the image: suppression of weaker keypoints near
+// stronger ones (at any scale), then a cap on how many survive in each cell
+// of a grid, then compaction of what is left.
+//
+// WG_SIZE (the workgroup size, a power of two), POS_LEN (floats per
+// keypoint, which start x, y, scale), STRENGTH_IDX and MAX_SEGMENTS should
+// be defined externally.  exclusiveScan comes from the primitives' scan.cl,
+// which is built in ahead of this.
+//
+// Keypoint a beats keypoint b if it is stronger, or equally strong and
+// earlier in the list, so the results do not depend on scheduling.
+
+
+float4 loadKeypoint(__global const float* list, uint idx)
+{
+    // (x, y, scale, strength)
+    return (float4) (list[idx * POS_LEN + 0],
+                     list[idx * POS_LEN + 1],
+                     list[idx * POS_LEN + 2],
+                     list[idx * POS_LEN + STRENGTH_IDX]);
+}
+
+
+bool beats(float4 a, uint aIdx, float4 b, uint bIdx)
+{
+    return a.w > b.w || (a.w == b.w && aIdx < bIdx);
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void suppress(__global const float* list,
+              __global const unsigned int* cumCounts,
+              unsigned int numSegments,
+              float radiusFactor,
+              __global unsigned int* survives)
+{
+    // survives[i] is set if no keypoint within radiusFactor times the larger
+    // of the two scales beats keypoint i.  Every keypoint is compared with
+    // every other, a tile at a time through local memory.
+    __local float4 tile[WG_SIZE];
+
+    const uint total = cumCounts[numSegments];
+    const uint i = get_global_id(0), l = get_local_id(0);
+
+    // Whole workgroups beyond the list have nothing to do
+    if (get_group_id(0) * WG_SIZE >= total)
+        return;
+
+    float4 p = (float4) 0.f;
+    if (i < total)
+        p = loadKeypoint(list, i);
+
+    bool ok = true;
+
+    for (uint base = 0; base < total; base += WG_SIZE) {
+
+        if (base + l < total)
+            tile[l] = loadKeypoint(list, base + l);
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        const uint n = min((uint) WG_SIZE, total - base);
+
+        for (uint t = 0; t < n; ++t) {
+            float4 q = tile[t];
+            float r = radiusFactor * max(p.z, q.z);
+            float2 d = q.xy - p.xy;
+
+            if (dot(d, d) < r * r && beats(q, base + t, p, i))
+                ok = false;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (i < total)
+        survives[i] = ok;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void rankInCell(__global const float* list,
+                __global const unsigned int* cumCounts,
+                unsigned int numSegments,
+                __global const unsigned int* survives,
+                float cellSize,
+                unsigned int maxPerCell,
+                __global unsigned int* keep)
+{
+    // keep[i] is set if keypoint i survived suppression, and fewer than
+    // maxPerCell of the other survivors in its grid cell beat it.  The grid
+    // is aligned with the image centre (the origin of the coordinates).
+    __local float4 tile[WG_SIZE];
+
+    const uint total = cumCounts[numSegments];
+    const uint i = get_global_id(0), l = get_local_id(0);
+
+    if (get_group_id(0) * WG_SIZE >= total)
+        return;
+
+    float4 p = (float4) 0.f;
+    bool ok = false;
+    if (i < total) {
+        p = loadKeypoint(list, i);
+        ok = survives[i];
+    }
+
+    const int2 cell = convert_int2_rtn(p.xy / cellSize);
+
+    uint numBetter = 0;
+
+    for (uint base = 0; base < total; base += WG_SIZE) {
+
+        // Those suppressed can't beat anything
+        if (base + l < total) {
+            float4 q = loadKeypoint(list, base + l);
+            if (!survives[base + l])
+                q.w = -INFINITY;
+            tile[l] = q;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        const uint n = min((uint) WG_SIZE, total - base);
+
+        for (uint t = 0; t < n; ++t) {
+            float4 q = tile[t];
+            int2 qCell = convert_int2_rtn(q.xy / cellSize);
+
+            if (all(qCell == cell) && beats(q, base + t, p, i))
+                ++numBetter;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (i < total)
+        keep[i] = ok && numBetter < maxPerCell;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void compactKept(__global float* list,
+                 __global unsigned int* cumCounts,
+                 unsigned int numSegments,
+                 __global const unsigned int* keep)
+{
+    // Moves the kept keypoints down to be contiguous, in order, in place;
+    // then rewrites cumCounts so each segment holds its own survivors.  A
+    // single workgroup does this, a chunk at a time: each chunk is read
+    // entirely before any of it is written, and nothing moves up.
+    __local uint scanBuf[WG_SIZE];
+    __local uint newCumCounts[MAX_SEGMENTS + 1];
+
+    const uint total = cumCounts[numSegments];
+    const uint l = get_local_id(0);
+
+    uint outBase = 0;
+
+    for (uint chunk = 0; chunk < total; chunk += WG_SIZE) {
+
+        const uint i = chunk + l;
+        const bool valid = i < total;
+
+        float record[POS_LEN];
+        bool k = false;
+        if (valid) {
+            for (int n = 0; n < POS_LEN; ++n)
+                record[n] = list[i * POS_LEN + n];
+            k = keep[i];
+        }
+
+        uint numKept;
+        uint rank = exclusiveScan(k, scanBuf, &numKept);
+
+        for (uint s = 0; s <= numSegments; ++s)
+            if (valid && cumCounts[s] == i)
+                newCumCounts[s] = outBase + rank;
+
+        if (k)
+            for (int n = 0; n < POS_LEN; ++n)
+                list[(outBase + rank) * POS_LEN + n] = record[n];
+
+        outBase += numKept;
+
+        barrier(CLK_GLOBAL_MEM_FENCE | CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (uint s = l; s <= numSegments; s += WG_SIZE)
+        if (cumCounts[s] >= total)
+            newCumCounts[s] = outBase;
+    barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+
+    for (uint s = l; s <= numSegments; s += WG_SIZE)
+        cumCounts[s] = newCumCounts[s];
+}
+
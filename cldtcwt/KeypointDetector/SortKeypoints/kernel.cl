@@ -0,0 +1,193 @@
+// Copyright (C) 2013 Timothy Gale
+// Sorting each segment of a keypoint list by position, so that the order no
+// longer depends on which work items found the keypoints first.  One
+// workgroup sorts each segment, with a stable radix sort of indices
+// RADIX_BITS at a time, then moves the keypoints into that order.  Each
+// pass counts the digits over the segment, then places the keys a chunk
+// of WG_SIZE at a time, sorting the chunk by digit in local memory so
+// each key's place within its digit comes from its position there.
+//
+// WG_SIZE (the workgroup size, a power of two) and POS_LEN (floats per
+// keypoint, which start x, y, scale) should be defined externally.
+// exclusiveScan comes from the primitives' scan.cl, which is built in ahead
+// of this.
+//
+// The key is three words, most significant first: the pixel at the
+// keypoint's own scale, in row-major (ORDER_ROW_MAJOR) or Morton
+// (ORDER_MORTON) order; then the exact y; then the exact x.
+
+#define ORDER_ROW_MAJOR 0
+#define ORDER_MORTON 1
+
+#define NUM_KEY_WORDS 3
+
+#define RADIX_BITS 4
+#define RADIX (1 << RADIX_BITS)
+
+
+uint orderable(float f)
+{
+    // Bit pattern that sorts as unsigned in the same order as f
+    uint u = as_uint(f);
+    return (u & 0x80000000u)? ~u : (u | 0x80000000u);
+}
+
+
+uint spreadBits(uint v)
+{
+    // Moves the low 16 bits of v to the even bits
+    v &= 0xFFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+
+uint keyWord(__global const float* list, uint idx, int word, uint order)
+{
+    const float x = list[idx * POS_LEN + 0],
+                y = list[idx * POS_LEN + 1];
+
+    if (word == 1)
+        return orderable(y);
+    if (word == 2)
+        return orderable(x);
+
+    // Pixel at the keypoint's scale, offset so the image centre is
+    // comfortably inside the 16 bits
+    const float scale = list[idx * POS_LEN + 2];
+    uint2 q = convert_uint2(clamp(convert_int2_rtn((float2) (x, y) / scale)
+                                   + 32768, 0, 65535));
+
+    if (order == ORDER_MORTON)
+        return spreadBits(q.x) | (spreadBits(q.y) << 1);
+    else
+        return (q.y << 16) | q.x;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void sortSegments(__global float* list,
+                  __global const unsigned int* cumCounts,
+                  unsigned int order,
+                  __global unsigned int* indices,
+                  unsigned int capacity,
+                  __global float* scratch)
+{
+    // Segment get_group_id(0) occupies items cumCounts[s] up to
+    // cumCounts[s+1].  indices (2 * capacity long) and scratch (capacity
+    // keypoints) are workspace, each segment using its own part.
+    __local uint buf[WG_SIZE];
+    __local uint digits[2][WG_SIZE], items[2][WG_SIZE];
+    __local uint hist[RADIX], bucketNext[RADIX], chunkStart[RADIX];
+    __local uint uniformLocal;
+
+    const uint s = get_group_id(0), l = get_local_id(0);
+    const uint begin = cumCounts[s], n = cumCounts[s+1] - begin;
+
+    __global uint* from = indices + begin;
+    __global uint* to = indices + capacity + begin;
+
+    for (uint i = l; i < n; i += WG_SIZE)
+        from[i] = begin + i;
+    barrier(CLK_GLOBAL_MEM_FENCE);
+
+    // Least significant digit first; each pass keeps the order of the last
+    // among keys with the same digit
+    for (int word = NUM_KEY_WORDS - 1; word >= 0; --word)
+        for (uint shift = 0; shift < 32; shift += RADIX_BITS) {
+
+            if (l < RADIX)
+                hist[l] = 0;
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            for (uint i = l; i < n; i += WG_SIZE)
+                atomic_inc(&hist[(keyWord(list, from[i], word, order)
+                                  >> shift) & (RADIX - 1)]);
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            // Where each digit's keys start, and whether they all have the
+            // same one
+            if (l == 0) {
+                uint sum = 0;
+                uniformLocal = false;
+                for (uint d = 0; d < RADIX; ++d) {
+                    uniformLocal |= hist[d] == n;
+                    bucketNext[d] = sum;
+                    sum += hist[d];
+                }
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            // Nothing moves if every key has the same digit here
+            if (uniformLocal)
+                continue;
+
+            for (uint chunk = 0; chunk < n; chunk += WG_SIZE) {
+
+                const uint i = chunk + l;
+                const uint numValid = min((uint) WG_SIZE, n - chunk);
+
+                // Past the end of the segment counts as the largest digit,
+                // so stays behind the real keys
+                digits[0][l] = (i < n)?
+                    (keyWord(list, from[i], word, order) >> shift)
+                        & (RADIX - 1)
+                  : RADIX - 1;
+                items[0][l] = (i < n)? from[i] : 0;
+                barrier(CLK_LOCAL_MEM_FENCE);
+
+                // Sort the chunk by digit, a bit at a time, zeros first
+                uint cur = 0;
+                for (uint b = 0; b < RADIX_BITS; ++b) {
+                    const uint d = digits[cur][l], item = items[cur][l];
+                    const uint zero = !((d >> b) & 1);
+
+                    uint numZeros;
+                    uint zeroRank = exclusiveScan(zero, buf, &numZeros);
+                    const uint pos = zero? zeroRank
+                                         : numZeros + l - zeroRank;
+
+                    digits[1 - cur][pos] = d;
+                    items[1 - cur][pos] = item;
+                    cur = 1 - cur;
+                    barrier(CLK_LOCAL_MEM_FENCE);
+                }
+
+                const uint d = digits[cur][l];
+                const bool valid = l < numValid;
+
+                if (valid && (l == 0 || digits[cur][l - 1] != d))
+                    chunkStart[d] = l;
+                barrier(CLK_LOCAL_MEM_FENCE);
+
+                if (valid)
+                    to[bucketNext[d] + l - chunkStart[d]] = items[cur][l];
+                barrier(CLK_LOCAL_MEM_FENCE);
+
+                // The last of each digit moves its bucket on
+                if (valid && (l == numValid - 1 || digits[cur][l + 1] != d))
+                    bucketNext[d] += l - chunkStart[d] + 1;
+                barrier(CLK_LOCAL_MEM_FENCE);
+            }
+
+            __global uint* t = from;
+            from = to;
+            to = t;
+            barrier(CLK_GLOBAL_MEM_FENCE);
+        }
+
+    // Move the keypoints into the sorted order, via the scratch space
+    for (uint i = l; i < n; i += WG_SIZE)
+        for (int k = 0; k < POS_LEN; ++k)
+            scratch[(begin + i) * POS_LEN + k] = list[from[i] * POS_LEN + k];
+    barrier(CLK_GLOBAL_MEM_FENCE);
+
+    for (uint i = l; i < n; i += WG_SIZE)
+        for (int k = 0; k < POS_LEN; ++k)
+            list[(begin + i) * POS_LEN + k] = scratch[(begin + i) * POS_LEN + k];
+}
+
@@ -0,0 +1,87 @@
+// Copyright (C) 2013 Timothy Gale
+#include "sortKeypoints.h"
+#include "kernel.h"
+#include "MiscKernels/Primitives/scan.h"
+
+using namespace SortKeypointsNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <stdexcept>
+
+
+SortKeypoints::SortKeypoints(cl::Context& context,
+                             const std::vector<cl::Device>& devices,
+                             size_t numFloatsPerItem)
+   : context_(context),
+     numFloatsPerItem_(numFloatsPerItem)
+{
+    if (numFloatsPerItem < 3)
+        throw std::logic_error("SortKeypoints: bad keypoint layout");
+
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (kernel_cl);
+    size_t fileTextLength = kernel_cl_len;
+
+    // Bundle the code up, after the shared workgroup scan
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(
+        reinterpret_cast<const char*>(PrimitivesNS::scan_cl),
+        PrimitivesNS::scan_cl_len));
+    source.push_back(std::make_pair(fileText, fileTextLength));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_
+                        << " -D POS_LEN=" << numFloatsPerItem;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful part, viz the kernel
+    kernel_ = cl::Kernel(program, "sortSegments");
+}
+
+
+
+
+void SortKeypoints::operator()
+      (cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& cumCounts, size_t numSegments,
+       Order order,
+       cl::Buffer& indices, cl::Buffer& scratch,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    if (numSegments == 0 || numSegments > maxNumSegments)
+        throw std::logic_error("SortKeypoints: bad number of segments");
+
+    const size_t capacity = list.getInfo<CL_MEM_SIZE>()
+                             / (numFloatsPerItem_ * sizeof(float));
+
+    if (indices.getInfo<CL_MEM_SIZE>() < 2 * capacity * sizeof(cl_uint)
+     || scratch.getInfo<CL_MEM_SIZE>() < list.getInfo<CL_MEM_SIZE>())
+        throw std::logic_error("SortKeypoints: workspace too small");
+
+    kernel_.setArg(0, list);
+    kernel_.setArg(1, cumCounts);
+    kernel_.setArg(2, cl_uint(order));
+    kernel_.setArg(3, indices);
+    kernel_.setArg(4, cl_uint(capacity));
+    kernel_.setArg(5, scratch);
+
+    // A workgroup per segment
+    commandQueue.enqueueNDRangeKernel(kernel_, cl::NullRange,
+                                      {numSegments * wgSize_}, {wgSize_},
+                                      &waitEvents, doneEvent);
+}
+
@@ -0,0 +1,60 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef SORTKEYPOINTS_H
+#define SORTKEYPOINTS_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+
+
+class SortKeypoints {
+// Puts each segment of a keypoint list into order of position, on the
+// device.  Peaks are appended to the lists in whatever order the work items
+// find them, which varies from run to run; once sorted, the same frame
+// always gives the same list, and later stages read the subbands in a more
+// regular pattern.
+//
+// Keypoints are ordered first by the pixel they fall in at their own scale,
+// row by row or along a Morton (Z-order) curve, then by exact y and x.
+
+public:
+
+    enum Order { RowMajor = 0, Morton = 1 };
+
+    SortKeypoints() = default;
+    SortKeypoints(const SortKeypoints&) = default;
+    SortKeypoints(cl::Context& context,
+                  const std::vector<cl::Device>& devices,
+                  size_t numFloatsPerItem);
+    // Each item in the lists is numFloatsPerItem floats long, starting
+    // x, y, scale
+
+    void operator() (cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& cumCounts, size_t numSegments,
+       Order order,
+       cl::Buffer& indices, cl::Buffer& scratch,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // list is made of numSegments runs, run n occupying items cumCounts[n]
+    // up to cumCounts[n+1], each of which is sorted in place.  indices
+    // (two cl_uints per item of list) and scratch (the same size as list)
+    // are workspace.
+
+    static const size_t maxNumSegments = 16;
+
+private:
+    cl::Context context_;
+    cl::Kernel kernel_;
+
+    size_t numFloatsPerItem_;
+
+    static const size_t wgSize_ = 256;
+};
+
+
+
+#endif
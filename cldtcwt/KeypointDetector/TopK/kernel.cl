@@ -0,0 +1,206 @@
+// Copyright (C) 2013 Timothy Gale
+// Selection of the K strongest keypoints from a list, done by a single
+// workgroup.  WG_SIZE (the workgroup size, a power of two), POS_LEN (floats
+// per keypoint), STRENGTH_IDX (which of those is the strength) and
+// MAX_SEGMENTS should be defined externally.  exclusiveScan comes from the
+// primitives' scan.cl, which is built in ahead of this.
+//
+// Strengths are compared through their bit patterns, which order the same
+// way as the values for non-negative floats.  A radix select over those
+// finds the K-th largest key (one byte at a time), then the list is
+// compacted in place, keeping the original order of what survives.  Ties
+// at the threshold are resolved in favour of earlier entries.
+
+
+uint keyOf(__global const float* list, uint idx)
+{
+    float s = list[idx * POS_LEN + STRENGTH_IDX];
+    return s > 0.f? as_uint(s) : 0u;
+}
+
+
+void selectThreshold(__global const float* list, uint count, uint k,
+                     __local uint* hist, __local uint* result,
+                     uint* threshold, uint* numEqualToKeep)
+{
+    // Find the key of the k-th largest entry (k < count), and how many
+    // entries with exactly that key are among the top k
+    const uint l = get_local_id(0);
+
+    uint prefix = 0, prefixMask = 0, remaining = k;
+
+    for (int shift = 24; shift >= 0; shift -= 8) {
+
+        for (uint b = l; b < 256; b += WG_SIZE)
+            hist[b] = 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Histogram of the next byte, among those matching so far
+        for (uint i = l; i < count; i += WG_SIZE) {
+            uint key = keyOf(list, i);
+            if ((key & prefixMask) == prefix)
+                atomic_inc(&hist[(key >> shift) & 0xFF]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Walk down from the largest bin until we have enough
+        if (l == 0) {
+            uint acc = 0;
+            int b;
+            for (b = 255; b > 0; --b) {
+                if (acc + hist[b] >= remaining)
+                    break;
+                acc += hist[b];
+            }
+
+            result[0] = b;
+            result[1] = remaining - acc;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        prefix |= result[0] << shift;
+        prefixMask |= 0xFFu << shift;
+        remaining = result[1];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    *threshold = prefix;
+    *numEqualToKeep = remaining;
+}
+
+
+uint compact(__global float* list, uint count,
+             uint threshold, uint numEqualToKeep,
+             __local uint* scanBuf,
+             __global const uint* boundaries, uint numBoundaries,
+             __local uint* newBoundaries)
+{
+    // Keep everything above threshold, and the first numEqualToKeep equal
+    // to it, moving them down to be contiguous.  Entries only ever move
+    // towards the start, and each chunk is entirely read before any of it
+    // is written, so this can be done in place.
+    //
+    // Optionally (numBoundaries > 0), maps each boundary index in the
+    // original list to the corresponding one in the compacted list.
+    //
+    // Returns the number kept.
+    const uint l = get_local_id(0);
+
+    uint outBase = 0, equalSoFar = 0;
+
+    for (uint chunk = 0; chunk < count; chunk += WG_SIZE) {
+
+        const uint i = chunk + l;
+        const bool valid = i < count;
+
+        float record[POS_LEN];
+        uint key = 0;
+        if (valid) {
+            for (int n = 0; n < POS_LEN; ++n)
+                record[n] = list[i * POS_LEN + n];
+            key = keyOf(list, i);
+        }
+
+        // Ties are kept in order until the quota runs out
+        uint numEqual;
+        uint equalRank = exclusiveScan(valid && key == threshold,
+                                       scanBuf, &numEqual);
+
+        bool keep = valid
+                 && (key > threshold
+                     || (key == threshold
+                         && equalSoFar + equalRank < numEqualToKeep));
+
+        uint numKept;
+        uint keepRank = exclusiveScan(keep, scanBuf, &numKept);
+
+        for (uint s = 0; s < numBoundaries; ++s)
+            if (valid && boundaries[s] == i)
+                newBoundaries[s] = outBase + keepRank;
+
+        // (exclusiveScan has already synchronised after the reads)
+        if (keep)
+            for (int n = 0; n < POS_LEN; ++n)
+                list[(outBase + keepRank) * POS_LEN + n] = record[n];
+
+        outBase += numKept;
+        equalSoFar += numEqual;
+
+        barrier(CLK_GLOBAL_MEM_FENCE | CLK_LOCAL_MEM_FENCE);
+    }
+
+    // Boundaries at the very end
+    for (uint s = l; s < numBoundaries; s += WG_SIZE)
+        if (boundaries[s] >= count)
+            newBoundaries[s] = outBase;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    return outBase;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void topKLevel(__global float* list,
+               __global unsigned int* counts,
+               unsigned int countsIdx,
+               unsigned int capacity,
+               unsigned int k)
+{
+    // Reduce a single list, whose length is counts[countsIdx], to its k
+    // strongest entries.  The count may have overshot the capacity of the
+    // list, in which case only what was stored is considered.
+    __local uint hist[256];
+    __local uint scanBuf[WG_SIZE];
+    __local uint result[2];
+
+    const uint count = min(counts[countsIdx], capacity);
+
+    if (count > k) {
+        uint threshold, numEqualToKeep;
+        selectThreshold(list, count, k, hist, result,
+                        &threshold, &numEqualToKeep);
+
+        compact(list, count, threshold, numEqualToKeep, scanBuf,
+                counts, 0, result);
+    }
+
+    barrier(CLK_GLOBAL_MEM_FENCE);
+
+    if (get_local_id(0) == 0)
+        counts[countsIdx] = min(count, k);
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void topKSegmented(__global float* list,
+                   __global unsigned int* cumCounts,
+                   unsigned int numSegments,
+                   unsigned int k)
+{
+    // The list is made up of numSegments consecutive segments, segment n
+    // running from cumCounts[n] to cumCounts[n+1].  Keep the k strongest
+    // entries overall, leaving each segment's survivors in that segment,
+    // and update cumCounts to match.
+    __local uint hist[256];
+    __local uint scanBuf[WG_SIZE];
+    __local uint result[2];
+    __local uint newCumCounts[MAX_SEGMENTS + 1];
+
+    const uint count = cumCounts[numSegments];
+
+    if (count <= k)
+        return;
+
+    uint threshold, numEqualToKeep;
+    selectThreshold(list, count, k, hist, result,
+                    &threshold, &numEqualToKeep);
+
+    compact(list, count, threshold, numEqualToKeep, scanBuf,
+            cumCounts, numSegments + 1, newCumCounts);
+
+    for (uint s = get_local_id(0); s <= numSegments; s += WG_SIZE)
+        cumCounts[s] = newCumCounts[s];
+}
+
@@ -0,0 +1,104 @@
+// Copyright (C) 2013 Timothy Gale
+#include "topK.h"
+#include "kernel.h"
+#include "MiscKernels/Primitives/scan.h"
+
+using namespace TopKNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <stdexcept>
+
+
+TopK::TopK(cl::Context& context,
+           const std::vector<cl::Device>& devices,
+           size_t numFloatsPerItem, size_t strengthIndex)
+   : context_(context),
+     numFloatsPerItem_(numFloatsPerItem)
+{
+    if (strengthIndex >= numFloatsPerItem)
+        throw std::logic_error("TopK: strength index outside item");
+
+    // Get input from the source file
+    const char* fileText = reinterpret_cast<const char*> (kernel_cl);
+    size_t fileTextLength = kernel_cl_len;
+
+    // Bundle the code up, after the shared workgroup scan
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(
+        reinterpret_cast<const char*>(PrimitivesNS::scan_cl),
+        PrimitivesNS::scan_cl_len));
+    source.push_back(std::make_pair(fileText, fileTextLength));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_
+                        << " -D POS_LEN=" << numFloatsPerItem
+                        << " -D STRENGTH_IDX=" << strengthIndex
+                        << " -D MAX_SEGMENTS=" << maxNumSegments;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr 
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    } 
+        
+    // ...and extract the useful parts, i.e. the kernels
+    levelKernel_ = cl::Kernel(program, "topKLevel");
+    segmentedKernel_ = cl::Kernel(program, "topKSegmented");
+}
+
+
+
+
+void TopK::level
+      (cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& counts, size_t countsIndex,
+       size_t k,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    const size_t capacity = list.getInfo<CL_MEM_SIZE>()
+                             / (numFloatsPerItem_ * sizeof(float));
+
+    levelKernel_.setArg(0, list);
+    levelKernel_.setArg(1, counts);
+    levelKernel_.setArg(2, cl_uint(countsIndex));
+    levelKernel_.setArg(3, cl_uint(capacity));
+    levelKernel_.setArg(4, cl_uint(k));
+
+    // One workgroup does the lot
+    commandQueue.enqueueNDRangeKernel(levelKernel_, cl::NullRange,
+                                      {wgSize_}, {wgSize_},
+                                      &waitEvents, doneEvent);
+}
+
+
+
+void TopK::segmented
+      (cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& cumCounts, size_t numSegments,
+       size_t k,
+       const std::vector<cl::Event>& waitEvents,
+       cl::Event* doneEvent)
+{
+    if (numSegments > maxNumSegments)
+        throw std::logic_error("TopK: too many segments");
+
+    segmentedKernel_.setArg(0, list);
+    segmentedKernel_.setArg(1, cumCounts);
+    segmentedKernel_.setArg(2, cl_uint(numSegments));
+    segmentedKernel_.setArg(3, cl_uint(k));
+
+    commandQueue.enqueueNDRangeKernel(segmentedKernel_, cl::NullRange,
+                                      {wgSize_}, {wgSize_},
+                                      &waitEvents, doneEvent);
+}
+
@@ -0,0 +1,64 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef TOPK_H
+#define TOPK_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+
+
+class TopK {
+// Cuts lists of keypoints down to the k strongest, on the device, without
+// reading the counts back.  Survivors stay in their original order, and ties
+// at the cut-off go to whichever came first in the list.  Each list is
+// handled by a single workgroup, which is plenty for a few thousand keypoints.
+
+public:
+
+    TopK() = default;
+    TopK(const TopK&) = default;
+    TopK(cl::Context& context,
+         const std::vector<cl::Device>& devices,
+         size_t numFloatsPerItem, size_t strengthIndex);
+    // Each item in the lists is numFloatsPerItem floats long, with the
+    // strength at strengthIndex
+
+    void level(cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& counts, size_t countsIndex,
+       size_t k,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // list holds counts[countsIndex] items (or as many as fit, if the count
+    // has overrun the buffer).  Keeps the k strongest, and sets the count to
+    // how many remain.
+
+    void segmented(cl::CommandQueue& commandQueue,
+       cl::Buffer& list,
+       cl::Buffer& cumCounts, size_t numSegments,
+       size_t k,
+       const std::vector<cl::Event>& waitEvents = std::vector<cl::Event>(),
+       cl::Event* doneEvent = nullptr);
+    // list is made of numSegments runs, run n occupying items cumCounts[n]
+    // up to cumCounts[n+1].  Keeps the k strongest overall, each in its own
+    // run, and rewrites cumCounts to suit.
+
+    static const size_t maxNumSegments = 16;
+
+private:
+    cl::Context context_;
+    cl::Kernel levelKernel_;
+    cl::Kernel segmentedKernel_;
+
+    size_t numFloatsPerItem_;
+
+    static const size_t wgSize_ = 256;
+};
+
+
+
+#endif
+
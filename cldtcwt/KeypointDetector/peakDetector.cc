@@ -1,6 +1,7 @@
 // Copyright (C) 2013 Timothy Gale
 #include "peakDetector.h"
 #include <stdexcept>
+#include <algorithm>
 
 
 
@@ -35,6 +36,137 @@ std::vector<cl::Event> PeakDetectorResults::listDone() const
 }
 
 
+void PeakDetectorResults::setListLengthLimit(size_t limit)
+{
+    listLengthLimit_ = std::min(limit, maxListLength_);
+}
+
+
+size_t PeakDetectorResults::listLengthLimit() const
+{
+    return listLengthLimit_;
+}
+
+
+void PeakDetectorResults::setLevelLimits(const std::vector<size_t>& limits)
+{
+    if (limits.size() != levelLimits_.size())
+        throw std::logic_error("PeakDetectorResults: wrong number of "
+                               "level limits");
+
+    for (size_t n = 0; n < limits.size(); ++n)
+        levelLimits_[n] = std::min({limits[n], maxLevelCounts_[n],
+                                    maxListLength_});
+}
+
+
+std::vector<size_t> PeakDetectorResults::levelLimits() const
+{
+    return levelLimits_;
+}
+
+
+void PeakDetectorResults::setGridSelection
+        (const GridSelect::Settings& settings)
+{
+    if (!(settings.cellSize > 0.f))
+        throw std::logic_error("PeakDetectorResults: grid cell size must "
+                               "be positive");
+
+    gridSettings_ = settings;
+    gridSelection_ = true;
+}
+
+
+void PeakDetectorResults::clearGridSelection()
+{
+    gridSelection_ = false;
+}
+
+
+bool PeakDetectorResults::gridSelection() const
+{
+    return gridSelection_;
+}
+
+
+GridSelect::Settings PeakDetectorResults::gridSelectionSettings() const
+{
+    return gridSettings_;
+}
+
+
+void PeakDetectorResults::setAdaptiveThreshold
+        (const AdaptiveThreshold::Settings& settings)
+{
+    if (!(settings.minThreshold > 0.f)
+     || !(settings.maxThreshold >= settings.minThreshold)
+     || !(settings.smoothing > 0.f && settings.smoothing <= 1.f))
+        throw std::logic_error("PeakDetectorResults: bad adaptive "
+                               "threshold settings");
+
+    adaptiveSettings_ = settings;
+    adaptive_ = true;
+    thresholdsSet_ = false;
+}
+
+
+void PeakDetectorResults::clearAdaptiveThreshold()
+{
+    adaptive_ = false;
+}
+
+
+bool PeakDetectorResults::adaptiveThreshold() const
+{
+    return adaptive_;
+}
+
+
+AdaptiveThreshold::Settings
+    PeakDetectorResults::adaptiveThresholdSettings() const
+{
+    return adaptiveSettings_;
+}
+
+
+cl::Buffer PeakDetectorResults::thresholds() const
+{
+    return thresholds_;
+}
+
+
+cl::Event PeakDetectorResults::thresholdsDone() const
+{
+    return thresholdsDone_;
+}
+
+
+void PeakDetectorResults::setSortOrder(SortKeypoints::Order order)
+{
+    sortOrder_ = order;
+    sorting_ = true;
+}
+
+
+void PeakDetectorResults::clearSortOrder()
+{
+    sorting_ = false;
+}
+
+
+bool PeakDetectorResults::sorted() const
+{
+    return sorting_;
+}
+
+
+SortKeypoints::Order PeakDetectorResults::sortOrder() const
+{
+    return sortOrder_;
+}
+
+
 size_t PeakDetectorResults::numLevels() const
 {
     return zeroCounts_.size();
@@ -49,8 +181,15 @@ PeakDetector::PeakDetector(cl::Context& context,
                            const std::vector<cl::Device>& devices)
  : context_(context),
    findMax_(context, devices),
-   accumulate_(context, devices),
-   concat_(context, devices)
+   primitives_(context, devices),
+   topK_(context, devices,
+         findMax_.getPosLength(), findMax_.getStrengthIndex()),
+   gridSelect_(context, devices,
+               findMax_.getPosLength(), findMax_.getStrengthIndex()),
+   sortKeypoints_(context, devices, findMax_.getPosLength()),
+   adaptiveThreshold_(context, devices,
+                      findMax_.getPosLength(), findMax_.getStrengthIndex()),
+   crossProductFindMax_(context, devices)
 {
     float zerof = 0.0f;
 
@@ -64,12 +203,28 @@ PeakDetector::PeakDetector(cl::Context& context,
 
 
 
+static constexpr size_t fewest(size_t a, size_t b)
+{
+    return a < b? a : b;
+}
+
+
+const size_t PeakDetector::maxNumLevels
+    = fewest(fewest(TopK::maxNumSegments, GridSelect::maxNumSegments),
+             fewest(SortKeypoints::maxNumSegments,
+                    Primitives::maxNumSegments));
+
+
+
 PeakDetectorResults PeakDetector::createResultsStructure
         (const std::vector<size_t>& maxLevelCounts, size_t maxTotalCount)
 {
     // Create the intermediates and final outputs.
     PeakDetectorResults results;
 
+    if (maxLevelCounts.size() > maxNumLevels)
+        throw std::logic_error("PeakDetector: too many levels");
+
     results.numFloatsPerPosition_ = findMax_.getPosLength();
 
     // Per-level counts
@@ -81,27 +236,107 @@ PeakDetectorResults PeakDetector::createResultsStructure
     // of going away while doing an operation.
     results.zeroCounts_ = std::vector<cl_uint>(maxLevelCounts.size(), 0);
 
-    // Per-level lists
-    for (size_t maxCount: maxLevelCounts) 
-        // Allocate space to put the results into, and somewhere to store
-        // their done events
-        results.levelLists_.emplace_back(context_, CL_MEM_READ_WRITE,
-                    maxCount * results.numFloatsPerPosition_ * sizeof(float));
+    // Per-level lists, as consecutive parts of one buffer.  Each has to
+    // start on a boundary the devices allow sub-buffers to start on.
+    const size_t positionBytes = results.numFloatsPerPosition_
+                                  * sizeof(float);
+    size_t alignBytes = 1;
+    for (const cl::Device& device: context_.getInfo<CL_CONTEXT_DEVICES>())
+        alignBytes = std::max<size_t>(alignBytes,
+                        device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8);
+
+    // The fewest positions that make a whole number of those boundaries
+    size_t alignPositions = 1;
+    while ((alignPositions * positionBytes) % alignBytes)
+        ++alignPositions;
+
+    std::vector<cl_uint> levelStarts;
+    size_t numCandidates = 0;
+    for (size_t maxCount: maxLevelCounts) {
+        levelStarts.push_back(numCandidates);
+        numCandidates += std::max<size_t>(maxCount, 1);
+        numCandidates = (numCandidates + alignPositions - 1)
+                         / alignPositions * alignPositions;
+    }
+
+    results.candidates_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
+                std::max<size_t>(numCandidates, 1) * positionBytes);
+
+    std::vector<cl_uint> levelCapacities(maxLevelCounts.begin(),
+                                         maxLevelCounts.end());
+
+    if (!levelStarts.empty()) {
+        results.levelStarts_ = cl::Buffer(context_,
+                    CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                    levelStarts.size() * sizeof(cl_uint), &levelStarts[0]);
+        results.levelCapacities_ = cl::Buffer(context_,
+                    CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                    levelCapacities.size() * sizeof(cl_uint),
+                    &levelCapacities[0]);
+    }
+
+    for (size_t n = 0; n < maxLevelCounts.size(); ++n) {
+        cl_buffer_region region = {
+            levelStarts[n] * positionBytes,
+            std::max<size_t>(maxLevelCounts[n], 1) * positionBytes
+        };
+        results.levelLists_.push_back(results.candidates_.createSubBuffer(
+                    CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION,
+                    &region));
+    }
 
     results.maxLevelCounts_ = maxLevelCounts;
     results.levelListsDone_.resize(maxLevelCounts.size());
+    results.levelTopKDone_.resize(maxLevelCounts.size());
+
+    // By default, any level may supply everything
+    for (size_t maxCount: maxLevelCounts)
+        results.levelLimits_.push_back(std::min(maxCount, maxTotalCount));
 
     // Cumulative counts
     results.cumCounts_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
                                (maxLevelCounts.size() + 1) * sizeof(cl_uint));
 
-    // Concatenated list
+    // Concatenated list, big enough for every level to be at its limit
+    // before the overall cut
+    results.listCapacity_ = 0;
+    for (size_t limit: results.levelLimits_)
+        results.listCapacity_ += limit;
+
     results.list_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
-                maxTotalCount * results.numFloatsPerPosition_ * sizeof(float));
+                std::max<size_t>(results.listCapacity_, 1)
+                  * results.numFloatsPerPosition_ * sizeof(float));
 
     results.maxListLength_ = maxTotalCount;
-
-    results.listDone_.resize(maxLevelCounts.size());
+    results.listLengthLimit_ = maxTotalCount;
+
+    results.listDone_.resize(1);
+
+    // Workspace for grid selection, which starts off disabled
+    results.gridSelection_ = false;
+    results.gridSettings_ = {32.f, 2, 1.f};
+    results.gridSurvives_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
+                std::max<size_t>(results.listCapacity_, 1) * sizeof(cl_uint));
+    results.gridKeep_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
+                std::max<size_t>(results.listCapacity_, 1) * sizeof(cl_uint));
+
+    // Thresholds for adapting, again off to start with
+    results.adaptive_ = false;
+    results.adaptiveSettings_ = {maxTotalCount, false, 0.3f, 1e-4f, 1e4f};
+    results.initialThresholds_.resize(maxLevelCounts.size());
+    results.thresholdsSet_ = false;
+    results.thresholds_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
+                std::max<size_t>(maxLevelCounts.size(), 1) * sizeof(cl_float));
+
+    // Workspace for sorting, also off to start with
+    results.sorting_ = false;
+    results.sortOrder_ = SortKeypoints::RowMajor;
+    results.sortIndices_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
+                2 * std::max<size_t>(results.listCapacity_, 1)
+                  * sizeof(cl_uint));
+    results.sortScratch_ = cl::Buffer(context_, CL_MEM_READ_WRITE,
+                std::max<size_t>(results.listCapacity_, 1)
+                  * results.numFloatsPerPosition_ * sizeof(float));
 
     return results;
 }
@@ -116,25 +351,25 @@ void PeakDetector::operator() (cl::CommandQueue& cq,
                                const std::vector<cl::Event>& waitEvents)
 {
     // Check we have been given the right number of scales and energyMaps
-    if (energyMaps.size() < results.levelLists_.size())
+    if (energyMaps.size() > results.levelLists_.size()
+     || energyMaps.empty())
         throw std::logic_error("PeakDetector: wrong number of energy maps");
 
-    if (scales.size() < results.levelLists_.size())
+    if (scales.size() < energyMaps.size())
         throw std::logic_error("PeakDetector: wrong number of scales");
 
-    // Clear the counts
-    cq.enqueueWriteBuffer(results.counts_, CL_FALSE, 
-                          0, results.zeroCounts_.size() * sizeof(cl_uint), 
-                          &results.zeroCounts_[0],
-                          nullptr, &results.countsCleared_);
-    
-
     // Find the maxima (which means clearing needs to have finished)
-    std::vector<cl::Event> findWaitEvents = waitEvents;
-    findWaitEvents.push_back(results.countsCleared_);
+    std::vector<cl::Event> findWaitEvents
+        = startFrame(cq, threshold, results, waitEvents);
 
     for (int n = 0; n < results.levelLists_.size(); ++n) {
 
+        // Levels without an energy map just keep their zero count
+        if (n >= energyMaps.size()) {
+            results.levelListsDone_[n] = results.countsCleared_;
+            continue;
+        }
+
         // Work out what the finer image is (zero if none)
         cl::Image* finerImage = &zeroImage_;
         float finerScale = 1.f;
@@ -152,29 +387,194 @@ void PeakDetector::operator() (cl::CommandQueue& cq,
         } 
 
         // Execute the kernel
-        findMax_(cq, *energyMaps[n], scales[n],
-                     *finerImage, finerScale,
-                     *coarserImage, coarserScale,
-                     threshold, eigenRatioThreshold,
-                     results.levelLists_[n], 
-                     results.counts_, n,
-                     findWaitEvents, &results.levelListsDone_[n]);
+        if (results.adaptive_)
+            findMax_(cq, *energyMaps[n], scales[n],
+                         *finerImage, finerScale,
+                         *coarserImage, coarserScale,
+                         results.thresholds_, n, eigenRatioThreshold,
+                         results.levelLists_[n], 
+                         results.counts_, n,
+                         findWaitEvents, &results.levelListsDone_[n]);
+        else
+            findMax_(cq, *energyMaps[n], scales[n],
+                         *finerImage, finerScale,
+                         *coarserImage, coarserScale,
+                         threshold, eigenRatioThreshold,
+                         results.levelLists_[n], 
+                         results.counts_, n,
+                         findWaitEvents, &results.levelListsDone_[n]);
     }
 
-    // Accumulate the counts
-    accumulate_(cq, results.counts_, results.cumCounts_,
-                    results.maxListLength_,
-                    results.levelListsDone_, 
-                    &results.cumCountsDone_);
+    selectPeaks(cq, energyMaps.size(), results);
+}
+
+
+
+void PeakDetector::operator() (cl::CommandQueue& cq,
+                               const std::vector<const Subbands*> levels,
+                               const std::vector<float> scales,
+                               float threshold,
+                               PeakDetectorResults& results,
+                               const std::vector<cl::Event>& waitEvents)
+{
+    if (levels.size() > results.levelLists_.size() || levels.empty())
+        throw std::logic_error("PeakDetector: wrong number of levels");
+
+    if (scales.size() < levels.size())
+        throw std::logic_error("PeakDetector: wrong number of scales");
 
-    // Concatenate the maximum positions
-    for (int n = 0; n < results.levelLists_.size(); ++n) 
-        concat_(cq, results.levelLists_[n], results.list_,
-                    results.cumCounts_, n,
-                    results.numFloatsPerPosition_,
-                    {results.cumCountsDone_},
-                    &results.listDone_[n]);
+    std::vector<cl::Event> findWaitEvents
+        = startFrame(cq, threshold, results, waitEvents);
+
+    for (int n = 0; n < results.levelLists_.size(); ++n) {
+
+        if (n >= levels.size()) {
+            results.levelListsDone_[n] = results.countsCleared_;
+            continue;
+        }
+
+        const Subbands* finer = (n > 0)? levels[n-1] : nullptr;
+        const Subbands* coarser = (n + 1 < levels.size())?
+                                    levels[n+1] : nullptr;
+
+        if (results.adaptive_)
+            crossProductFindMax_(cq, *levels[n], scales[n],
+                                     finer, finer? scales[n-1] : 1.f,
+                                     coarser, coarser? scales[n+1] : 1.f,
+                                     results.thresholds_, n,
+                                     results.levelLists_[n],
+                                     results.counts_, n,
+                                     findWaitEvents,
+                                     &results.levelListsDone_[n]);
+        else
+            crossProductFindMax_(cq, *levels[n], scales[n],
+                                     finer, finer? scales[n-1] : 1.f,
+                                     coarser, coarser? scales[n+1] : 1.f,
+                                     threshold,
+                                     results.levelLists_[n],
+                                     results.counts_, n,
+                                     findWaitEvents,
+                                     &results.levelListsDone_[n]);
+    }
+
+    selectPeaks(cq, levels.size(), results);
+}
+
+
+
+std::vector<cl::Event> PeakDetector::startFrame
+        (cl::CommandQueue& cq, float threshold,
+         PeakDetectorResults& results,
+         const std::vector<cl::Event>& waitEvents)
+{
+    // Clear the counts
+    cq.enqueueWriteBuffer(results.counts_, CL_FALSE, 
+                          0, results.zeroCounts_.size() * sizeof(cl_uint), 
+                          &results.zeroCounts_[0],
+                          nullptr, &results.countsCleared_);
+
+    std::vector<cl::Event> findWaitEvents = waitEvents;
+    findWaitEvents.push_back(results.countsCleared_);
+
+    if (results.adaptive_) {
+
+        // Start from the threshold given, the first time; after that the
+        // previous frame will have set them
+        if (!results.thresholdsSet_) {
+            std::fill(results.initialThresholds_.begin(),
+                      results.initialThresholds_.end(), threshold);
+            cq.enqueueWriteBuffer(results.thresholds_, CL_FALSE,
+                          0, results.initialThresholds_.size()
+                                * sizeof(cl_float),
+                          &results.initialThresholds_[0],
+                          nullptr, &results.thresholdsDone_);
+            results.thresholdsSet_ = true;
+        }
+
+        findWaitEvents.push_back(results.thresholdsDone_);
+    }
+
+    return findWaitEvents;
+}
+
+
+
+void PeakDetector::selectPeaks(cl::CommandQueue& cq, size_t numActiveLevels,
+                               PeakDetectorResults& results)
+{
+    // Work out the thresholds for next time, before anything changes the
+    // lists or counts
+    if (results.adaptive_)
+        adaptiveThreshold_(cq, results.candidates_,
+                               results.levelStarts_,
+                               results.levelCapacities_,
+                               results.counts_, numActiveLevels,
+                               results.adaptiveSettings_,
+                               results.thresholds_,
+                               results.levelListsDone_,
+                               &results.thresholdsDone_);
+
+    // Keep only the strongest in each level (no more than could survive
+    // the overall cut anyway).  This also clamps counts that overran.
+    for (int n = 0; n < results.levelLists_.size(); ++n) {
+
+        if (n >= numActiveLevels) {
+            results.levelTopKDone_[n] = results.countsCleared_;
+            continue;
+        }
+
+        topK_.level(cq, results.levelLists_[n],
+                        results.counts_, n,
+                        std::min(results.levelLimits_[n],
+                                 results.listLengthLimit_),
+                        {results.adaptive_? results.thresholdsDone_
+                                          : results.levelListsDone_[n]},
+                        &results.levelTopKDone_[n]);
+    }
+
+    // Gather the levels into one list, working out where each starts as
+    // it goes
+    primitives_.segmentedCopy(cq, results.candidates_,
+                                  results.levelStarts_, results.counts_,
+                                  results.levelLists_.size(),
+                                  results.listCapacity_,
+                                  results.numFloatsPerPosition_,
+                                  results.list_, results.cumCounts_,
+                                  results.levelTopKDone_,
+                                  &results.cumCountsDone_);
+
+    std::vector<cl::Event> topKWait = {results.cumCountsDone_};
+
+    // Spread them out, if asked to
+    if (results.gridSelection_) {
+        gridSelect_(cq, results.list_,
+                        results.cumCounts_, results.levelLists_.size(),
+                        results.gridSettings_,
+                        results.gridSurvives_, results.gridKeep_,
+                        {results.cumCountsDone_},
+                        &results.gridDone_);
+
+        topKWait = {results.gridDone_};
+    }
 
+    // Then the strongest overall, which updates the cumulative counts too
+    topK_.segmented(cq, results.list_,
+                        results.cumCounts_, results.levelLists_.size(),
+                        results.listLengthLimit_,
+                        topKWait,
+                        results.sorting_? &results.topKDone_
+                                        : &results.listDone_[0]);
+
+    // And into a repeatable order, if asked to
+    if (results.sorting_)
+        sortKeypoints_(cq, results.list_,
+                           results.cumCounts_, results.levelLists_.size(),
+                           results.sortOrder_,
+                           results.sortIndices_, results.sortScratch_,
+                           {results.topKDone_},
+                           &results.listDone_[0]);
+
+    results.cumCountsDone_ = results.listDone_[0];
 }
 
 
@@ -8,9 +8,13 @@
 #include "CL/cl.hpp"
 #include <vector>
 
-#include "Concat/concat.h"
 #include "FindMax/findMax.h"
-#include "Accumulate/accumulate.h"
+#include "TopK/topK.h"
+#include "GridSelect/gridSelect.h"
+#include "SortKeypoints/sortKeypoints.h"
+#include "AdaptiveThreshold/adaptiveThreshold.h"
+#include "CrossProductFindMax/crossProductFindMax.h"
+#include "MiscKernels/Primitives/primitives.h"
 
 class PeakDetector;
 
@@ -21,22 +25,53 @@ private:
     // Number of floats used for each position detected
     size_t numFloatsPerPosition_;
 
-    // Intermediates: the per-level lists (as opposed to the full one)
+    // Intermediates: the per-level lists (as opposed to the full one).
+    // These are sub-buffers of a single candidates buffer, starting at
+    // levelStarts_ (in positions), so they can be gathered in one go.
     std::vector<cl_uint> zeroCounts_; // For zeroing the counts
     cl::Buffer counts_;
     cl::Event countsCleared_;
+    cl::Buffer candidates_;
+    cl::Buffer levelStarts_, levelCapacities_;
     std::vector<cl::Buffer> levelLists_;
     std::vector<size_t> maxLevelCounts_;
+    std::vector<size_t> levelLimits_;
     std::vector<cl::Event> levelListsDone_;
+    std::vector<cl::Event> levelTopKDone_;
 
     // Counts from each level
     cl::Buffer cumCounts_;
     cl::Event cumCountsDone_;
 
-    // List of positions relative to the image centre with scales
+    // List of positions relative to the image centre with scales, first
+    // with everything the levels keep, then cut down to the strongest
     cl::Buffer list_;
+    size_t listCapacity_;
+
+    // Spatial thinning, if used
+    bool gridSelection_;
+    GridSelect::Settings gridSettings_;
+    cl::Buffer gridSurvives_, gridKeep_;
+    cl::Event gridDone_;
+
+    // Thresholds worked out on the device, if used, starting from
+    // initialThresholds_
+    bool adaptive_;
+    AdaptiveThreshold::Settings adaptiveSettings_;
+    std::vector<float> initialThresholds_;
+    bool thresholdsSet_;
+    cl::Buffer thresholds_;
+    cl::Event thresholdsDone_;
+
+    // Putting into a repeatable order, if used
+    bool sorting_;
+    SortKeypoints::Order sortOrder_;
+    cl::Buffer sortIndices_, sortScratch_;
+    cl::Event topKDone_;
+
     std::vector<cl::Event> listDone_;
     size_t maxListLength_;
+    size_t listLengthLimit_;
 
 public:
     size_t numFloatsPerPosition() const;
@@ -53,6 +88,48 @@ public:
     std::vector<cl::Event> listDone() const;
     // List of peak locations.
 
+    void setListLengthLimit(size_t limit);
+    size_t listLengthLimit() const;
+    // Cap on the total number of peaks kept, no more than the
+    // maxTotalCount the structure was created with.  The strongest are
+    // the ones kept.
+
+    void setLevelLimits(const std::vector<size_t>& limits);
+    std::vector<size_t> levelLimits() const;
+    // Cap on the peaks each level may contribute (again the strongest),
+    // before the overall cap is applied.  Each is no more than the
+    // corresponding maxLevelCount or maxTotalCount.
+
+    void setGridSelection(const GridSelect::Settings& settings);
+    void clearGridSelection();
+    bool gridSelection() const;
+    GridSelect::Settings gridSelectionSettings() const;
+    // When set, weaker peaks near stronger ones (at any level) are
+    // suppressed, and only the strongest few in each grid cell are kept,
+    // before the overall cap.  Off by default.
+
+    void setAdaptiveThreshold(const AdaptiveThreshold::Settings& settings);
+    void clearAdaptiveThreshold();
+    bool adaptiveThreshold() const;
+    AdaptiveThreshold::Settings adaptiveThresholdSettings() const;
+    // When set, the threshold given to PeakDetector is only where the
+    // first frame starts: after each frame, the threshold for the next is
+    // adjusted on the device towards finding settings.target peaks (see
+    // AdaptiveThreshold).  Setting it again restarts from the given
+    // threshold.  Off by default.
+
+    cl::Buffer thresholds() const;
+    cl::Event thresholdsDone() const;
+    // The thresholds (a float per level) for the next frame, when adaptive
+
+    void setSortOrder(SortKeypoints::Order order);
+    void clearSortOrder();
+    bool sorted() const;
+    SortKeypoints::Order sortOrder() const;
+    // When set, each level's peaks are sorted by position at the end, so
+    // the list is the same every time for the same input (otherwise it is
+    // in whatever order the peaks happened to be found).  Off by default.
+
     friend PeakDetector;
 
 };
@@ -63,6 +140,11 @@ class PeakDetector {
     // Takes a list of energy maps and scale values, and finds where the 
     // peaks are, putting them into a list.  A second list says where
     // each scale starts within that list.
+    //
+    // Where there are more peaks than the limits allow, the weakest are
+    // dropped: first within each level, then across the whole list.
+    // Optionally, peaks can be spread out over the image with a grid
+    // between those two steps, and the final list sorted by position.
 
 private:
 
@@ -72,8 +154,23 @@ private:
 
     // Kernels to use
     FindMax findMax_;
-    Accumulate accumulate_;
-    Concat concat_;
+    Primitives primitives_;
+    TopK topK_;
+    GridSelect gridSelect_;
+    SortKeypoints sortKeypoints_;
+    AdaptiveThreshold adaptiveThreshold_;
+    CrossProductFindMax crossProductFindMax_;
+
+    std::vector<cl::Event> startFrame(cl::CommandQueue& cq, float threshold,
+                                      PeakDetectorResults& results,
+                                      const std::vector<cl::Event>& waitEvents);
+    // Clears the counts (and sets the starting thresholds, if they are
+    // adaptive and not yet set), returning what peak finding should wait
+    // for
+
+    void selectPeaks(cl::CommandQueue& cq, size_t numActiveLevels,
+                     PeakDetectorResults& results);
+    // The stages after the per-level peak finding
 
 public:
 
@@ -82,9 +179,17 @@ public:
     PeakDetector(cl::Context& context,
                  const std::vector<cl::Device>& devices);
 
+    static const size_t maxNumLevels;
+    // The most levels results can be created for: the fewest segments any
+    // of the stages gathering and selecting the peaks can take
+
     PeakDetectorResults createResultsStructure
         (const std::vector<size_t>& maxLevelCounts,
          size_t maxTotalCount);
+    // maxLevelCounts are how many candidates each level can hold as they
+    // are found.  Once a level's list is full, further peaks are lost
+    // regardless of strength, so these should be generous.  There can be
+    // up to maxNumLevels of them.
 
     void operator() (cl::CommandQueue& cq,
                      const std::vector<cl::Image*> energyMaps,
@@ -96,6 +201,19 @@ public:
                                     // try to supress edges
                      PeakDetectorResults& results,
                      const std::vector<cl::Event>& waitEvents = {});
+    // energyMaps may be shorter than the number of levels results was
+    // created for, in which case the missing (coarsest) levels get no
+    // peaks.
+
+    void operator() (cl::CommandQueue& cq,
+                     const std::vector<const Subbands*> levels,
+                     const std::vector<float> scales,
+                     float threshold,
+                     PeakDetectorResults& results,
+                     const std::vector<cl::Event>& waitEvents = {});
+    // The same, but working out the cross-product energy from the subbands
+    // of each level as it goes (see CrossProductFindMax), so the energy
+    // maps never need to be written out.
 
     size_t getPosLength();
     // Returns the number of floats in the position vector
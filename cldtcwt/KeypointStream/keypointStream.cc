@@ -0,0 +1,264 @@
+// Copyright (C) 2013 Timothy Gale
+#include "keypointStream.h"
+#include "util/fileIO.h"
+
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace {
+
+const char fileMagic[8] = {'C', 'L', 'D', 'T', 'K', 'P', 'S', '1'};
+const char recordMagic[8] = {'K', 'P', 'S', 'F', 'R', 'A', 'M', 'E'};
+
+const uint64_t alignment = 64;
+
+const std::string what = "Keypoint stream";
+
+
+struct FileHeader {
+    char magic[8];
+    uint64_t descriptorLength;
+    uint32_t format;
+    uint32_t descriptorBytes;
+    uint64_t reserved[5];
+};
+
+
+struct RecordHeader {
+    char magic[8];
+    uint64_t frame;
+    uint64_t numKeypoints;
+    uint64_t length;                // Including this header
+    uint64_t keypointsOffset;       // From the start of the record
+    uint64_t descriptorsOffset;
+    uint64_t reserved;
+    uint64_t checksum;              // Of everything before it
+};
+
+static_assert(sizeof(FileHeader) == alignment
+           && sizeof(RecordHeader) == alignment,
+              "Keypoint stream headers should be 64 bytes");
+
+}
+
+
+
+KeypointStreamWriter::KeypointStreamWriter(const std::string& filename,
+                                           size_t descriptorLength,
+                                           HDFWriter::DescriptorFormat format)
+ : descriptorBytes_(descriptorLength * HDFWriter::elementSize(format))
+{
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+        throwErrno(what, "could not open " + filename);
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.descriptorLength = descriptorLength;
+    header.format = format;
+    header.descriptorBytes = descriptorBytes_;
+
+    try {
+        writeAll(fd_, &header, sizeof(header), 0, what);
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+
+    end_ = sizeof(header);
+}
+
+
+KeypointStreamWriter::~KeypointStreamWriter()
+{
+    close(fd_);
+}
+
+
+void KeypointStreamWriter::append(size_t numKeypoints,
+                                  const float* keypoints,
+                                  const void* descriptors)
+{
+    static const char padding[alignment] = {};
+
+    const uint64_t keypointBytes = 4 * sizeof(float) * numKeypoints,
+                   descriptorBytes = descriptorBytes_ * numKeypoints;
+
+    RecordHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, recordMagic, sizeof(recordMagic));
+    header.frame = numFrames_;
+    header.numKeypoints = numKeypoints;
+    header.keypointsOffset = sizeof(header);
+    header.descriptorsOffset = header.keypointsOffset
+                             + alignUp(keypointBytes, alignment);
+    header.length = header.descriptorsOffset
+                  + alignUp(descriptorBytes, alignment);
+    header.checksum = fnv1a(&header, offsetof(RecordHeader, checksum));
+
+    // The data first, straight from the caller's arrays...
+    std::vector<iovec> parts;
+    parts.reserve(4);
+    if (keypointBytes > 0) {
+        parts.push_back({const_cast<float*>(keypoints), keypointBytes});
+        parts.push_back({const_cast<char*>(padding),
+                         alignUp(keypointBytes, alignment)
+                            - keypointBytes});
+    }
+    if (descriptorBytes > 0) {
+        parts.push_back({const_cast<void*>(descriptors), descriptorBytes});
+        parts.push_back({const_cast<char*>(padding),
+                         alignUp(descriptorBytes, alignment)
+                            - descriptorBytes});
+    }
+    writeAll(fd_, parts, end_ + sizeof(header), what);
+
+    // ...then the header that makes it visible
+    writeAll(fd_, &header, sizeof(header), end_, what);
+
+    end_ += header.length;
+    ++numFrames_;
+}
+
+
+void KeypointStreamWriter::sync()
+{
+    if (fdatasync(fd_) != 0)
+        throwErrno(what, "sync failed");
+}
+
+
+
+KeypointStreamReader::KeypointStreamReader(const std::string& filename)
+{
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        throwErrno(what, "could not open " + filename);
+
+    FileHeader header;
+    if (pread(fd_, &header, sizeof(header), 0) != sizeof(header)
+     || std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0
+     || header.format > HDFWriter::Binary) {
+        close(fd_);
+        throw std::runtime_error("Keypoint stream: " + filename
+                                 + " is not a keypoint stream");
+    }
+
+    descriptorLength_ = header.descriptorLength;
+    format_ = HDFWriter::DescriptorFormat(header.format);
+    descriptorBytes_ = header.descriptorBytes;
+
+    scanned_ = sizeof(header);
+
+    try {
+        refresh();
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+}
+
+
+KeypointStreamReader::~KeypointStreamReader()
+{
+    close(fd_);
+}
+
+
+size_t KeypointStreamReader::refresh()
+{
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        throwErrno(what, "stat failed");
+
+    const uint64_t fileLength = st.st_size;
+
+    if (fileLength <= scanned_)
+        return numFrames();
+
+    // Map the whole file afresh when it has grown.  Frames handed out
+    // keep the old mapping alive until they go.
+    if (fileLength > mappedLength_) {
+        void* map = mmap(nullptr, fileLength, PROT_READ, MAP_SHARED,
+                         fd_, 0);
+        if (map == MAP_FAILED)
+            throwErrno(what, "mmap failed");
+
+        mapping_ = std::shared_ptr<const void>(map,
+            [fileLength] (const void* p) {
+                munmap(const_cast<void*>(p), fileLength);
+            });
+        mappedLength_ = fileLength;
+    }
+
+    const char* base = static_cast<const char*> (mapping_.get());
+
+    // Take each complete record in turn
+    while (scanned_ + sizeof(RecordHeader) <= mappedLength_) {
+        RecordHeader header;
+        std::memcpy(&header, base + scanned_, sizeof(header));
+
+        if (std::memcmp(header.magic, recordMagic, sizeof(recordMagic)) != 0
+         || header.checksum != fnv1a(&header,
+                                        offsetof(RecordHeader, checksum))
+         || header.frame != numFrames()
+         || header.length > mappedLength_ - scanned_)
+            break;
+
+        frameOffsets_.push_back(scanned_);
+        numKeypoints_ += header.numKeypoints;
+        scanned_ += header.length;
+    }
+
+    // The data was written before the headers just read, so shouldn't be
+    // read as from before them
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return numFrames();
+}
+
+
+size_t KeypointStreamReader::waitForFrames(
+    size_t numFrames,
+    std::chrono::milliseconds timeout,
+    std::chrono::milliseconds pollInterval)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (refresh() < numFrames
+        && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(pollInterval);
+
+    return this->numFrames();
+}
+
+
+KeypointStreamReader::Frame KeypointStreamReader::frame(size_t n) const
+{
+    if (n >= numFrames())
+        throw std::out_of_range("Keypoint stream: no such frame");
+
+    const char* record = static_cast<const char*> (mapping_.get())
+                       + frameOffsets_[n];
+
+    RecordHeader header;
+    std::memcpy(&header, record, sizeof(header));
+
+    Frame frame;
+    frame.numKeypoints = header.numKeypoints;
+    frame.keypoints = reinterpret_cast<const float*>
+                        (record + header.keypointsOffset);
+    frame.descriptors = record + header.descriptorsOffset;
+    frame.mapping = mapping_;
+    return frame;
+}
+
@@ -0,0 +1,119 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef KEYPOINTSTREAM_H
+#define KEYPOINTSTREAM_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#include "hdf5/hdfwriter.h"
+
+
+// A flat file of keypoints and descriptors, frame after frame, that is only
+// ever appended to.  Readers memory-map it and can follow it as it grows,
+// getting pointers straight into the mapping, without going through HDF5
+// (so without its per-call costs, or its lock).
+//
+// Everything is native endian and starts on a multiple of 64 bytes.  A
+// 64-byte file header is followed by one record per frame: a 64-byte
+// record header, the keypoints (four floats each) and the descriptors
+// (as for HDFWriter).  A record's header is written after its data and
+// carries a checksum, so readers take a record with a bad or missing
+// header as not written yet (or, once the writer has gone, cut short).
+
+
+class KeypointStreamWriter {
+// Creates (replacing any existing file) and appends to a keypoint stream
+
+public:
+
+    KeypointStreamWriter(const std::string& filename, size_t descriptorLength,
+                         HDFWriter::DescriptorFormat format
+                            = HDFWriter::Float32);
+    // descriptorLength is in elements: floats, or bytes for codes
+
+    KeypointStreamWriter(const KeypointStreamWriter&) = delete;
+    KeypointStreamWriter& operator= (const KeypointStreamWriter&) = delete;
+    ~KeypointStreamWriter();
+
+    void append(size_t numKeypoints, const float* keypoints,
+                const void* descriptors);
+    // Adds a frame; readers can see it as soon as this returns
+
+    void sync();
+    // Waits for everything appended to reach the disk
+
+    size_t numFrames() const { return numFrames_; }
+
+private:
+    int fd_ = -1;
+    size_t descriptorBytes_;
+    uint64_t numFrames_ = 0;
+    uint64_t end_;
+};
+
+
+
+class KeypointStreamReader {
+// Reads a keypoint stream, possibly while it is still being written.  Not
+// thread safe: share frames between threads, not the reader.
+
+public:
+
+    struct Frame {
+        size_t numKeypoints;
+        const float* keypoints;     // Four per keypoint
+        const void* descriptors;    // descriptorBytes() per keypoint
+
+        std::shared_ptr<const void> mapping;
+        // Keeps the pointers valid after the reader remaps, or is gone
+    };
+
+    KeypointStreamReader(const std::string& filename);
+
+    KeypointStreamReader(const KeypointStreamReader&) = delete;
+    KeypointStreamReader& operator= (const KeypointStreamReader&) = delete;
+    ~KeypointStreamReader();
+
+    size_t refresh();
+    // Picks up any frames appended since opening or the last refresh, and
+    // returns the number of frames
+
+    size_t waitForFrames(size_t numFrames,
+                         std::chrono::milliseconds timeout,
+                         std::chrono::milliseconds pollInterval
+                            = std::chrono::milliseconds(1));
+    // Refreshes until there are at least numFrames frames or the timeout
+    // passes, returning the number of frames
+
+    size_t numFrames() const { return frameOffsets_.size(); }
+    size_t numKeypoints() const { return numKeypoints_; }
+
+    Frame frame(size_t n) const;
+
+    size_t descriptorLength() const { return descriptorLength_; }
+    HDFWriter::DescriptorFormat format() const { return format_; }
+    size_t descriptorBytes() const { return descriptorBytes_; }
+
+private:
+    int fd_ = -1;
+
+    size_t descriptorLength_;
+    HDFWriter::DescriptorFormat format_;
+    size_t descriptorBytes_;
+
+    std::shared_ptr<const void> mapping_;
+    uint64_t mappedLength_ = 0;
+
+    std::vector<uint64_t> frameOffsets_;
+    uint64_t scanned_;      // Where the next record should start
+    size_t numKeypoints_ = 0;
+};
+
+
+
+#endif
+
@@ -0,0 +1,145 @@
+// Copyright (C) 2013 Timothy Gale
+// Parallel building blocks for lists on the device: a clamped prefix sum,
+// stream compaction by flags, and copying several segments of a buffer into
+// one contiguous list.  Built after scan.cl, which provides exclusiveScan.
+// WG_SIZE (the workgroup size, a power of two) should be defined externally.
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void scanClamped(__global const unsigned int* input,
+                 unsigned int numInputs,
+                 __global unsigned int* cumSum,
+                 unsigned int maxSum)
+{
+    // Write out the cumulative sum of inputs, with the first output zero and
+    // numInputs + 1 outputs in all, never exceeding maxSum.  One workgroup
+    // does the lot, a chunk at a time.
+    __local uint buf[WG_SIZE];
+
+    const uint l = get_local_id(0);
+
+    // Clamping the running total as we go gives the same results as
+    // clamping each output, since the inputs are never negative
+    uint carry = 0;
+
+    for (uint chunk = 0; chunk < numInputs; chunk += WG_SIZE) {
+
+        const uint i = chunk + l;
+        uint v = (i < numInputs)? input[i] : 0;
+
+        uint chunkTotal;
+        uint before = exclusiveScan(v, buf, &chunkTotal);
+
+        if (i < numInputs)
+            cumSum[i] = min(carry + before, maxSum);
+
+        carry = min(carry + chunkTotal, maxSum);
+    }
+
+    if (l == 0)
+        cumSum[numInputs] = carry;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void compact(__global const float* input,
+             __global const unsigned int* flags,
+             unsigned int numItems,
+             unsigned int numFloatsPerItem,
+             __global float* output,
+             __global unsigned int* count)
+{
+    // Copies the items of input (numFloatsPerItem each) whose flags are set
+    // to the start of output, in their original order, and writes how many
+    // there were to count.  Done by a single workgroup, so the order needs
+    // no passing between workgroups.
+    __local uint buf[WG_SIZE];
+
+    const uint l = get_local_id(0);
+
+    uint outBase = 0;
+
+    for (uint chunk = 0; chunk < numItems; chunk += WG_SIZE) {
+
+        const uint i = chunk + l;
+        const bool keep = i < numItems && flags[i];
+
+        uint numKept;
+        uint rank = exclusiveScan(keep, buf, &numKept);
+
+        if (keep)
+            for (uint n = 0; n < numFloatsPerItem; ++n)
+                output[(outBase + rank) * numFloatsPerItem + n]
+                    = input[i * numFloatsPerItem + n];
+
+        outBase += numKept;
+    }
+
+    if (l == 0)
+        *count = outBase;
+}
+
+
+
+__kernel __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+void segmentedCopy(__global const float* input,
+                   __global const unsigned int* segmentStarts,
+                   __global const unsigned int* counts,
+                   unsigned int numSegments,
+                   unsigned int maxSum,
+                   unsigned int numFloatsPerItem,
+                   __global float* output,
+                   __global unsigned int* cumCounts)
+{
+    // Segment s of input starts at item segmentStarts[s] and has counts[s]
+    // items.  They are copied one after another to output, with where each
+    // ends up going to cumCounts (numSegments + 1 long, as from
+    // scanClamped), and no more than maxSum items in all.
+    //
+    // Every workgroup works out the (short) cumulative counts for itself,
+    // so that the whole job is a single launch; then each work item copies
+    // items, finding which segment they are from by bisection.  numSegments
+    // must be no more than WG_SIZE.
+    __local uint buf[WG_SIZE];
+    __local uint cum[WG_SIZE + 1];
+
+    const uint l = get_local_id(0);
+
+    uint v = (l < numSegments)? counts[l] : 0;
+
+    uint total;
+    uint before = exclusiveScan(v, buf, &total);
+
+    if (l < numSegments)
+        cum[l] = min(before, maxSum);
+    if (l == 0)
+        cum[numSegments] = min(total, maxSum);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (get_group_id(0) == 0)
+        for (uint s = l; s <= numSegments; s += WG_SIZE)
+            cumCounts[s] = cum[s];
+
+    const uint numItems = cum[numSegments];
+
+    for (uint r = get_global_id(0); r < numItems; r += get_global_size(0)) {
+
+        // Find s such that cum[s] <= r < cum[s+1]
+        uint lo = 0, hi = numSegments;
+        while (hi - lo > 1) {
+            uint mid = (lo + hi) / 2;
+            if (cum[mid] <= r)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        const uint src = segmentStarts[lo] + (r - cum[lo]);
+
+        for (uint n = 0; n < numFloatsPerItem; ++n)
+            output[r * numFloatsPerItem + n] = input[src * numFloatsPerItem + n];
+    }
+}
+
@@ -0,0 +1,120 @@
+// Copyright (C) 2013 Timothy Gale
+#include "primitives.h"
+#include "util/clUtil.h"
+
+#include "kernel.h"
+#include "scan.h"
+
+using namespace PrimitivesNS;
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <stdexcept>
+
+
+Primitives::Primitives(cl::Context& context,
+                       const std::vector<cl::Device>& devices)
+   : context_(context)
+{
+    // Bundle the code up: the scan first, as the kernels use it
+    cl::Program::Sources source;
+    source.push_back(std::make_pair(reinterpret_cast<const char*>(scan_cl),
+                                    scan_cl_len));
+    source.push_back(std::make_pair(reinterpret_cast<const char*>(kernel_cl),
+                                    kernel_cl_len));
+
+    // Compile it...
+    cl::Program program(context, source);
+    try {
+        std::ostringstream compilerOptions;
+        compilerOptions << "-D WG_SIZE=" << wgSize_;
+        program.build(devices, compilerOptions.str().c_str());
+    } catch(cl::Error err) {
+	    std::cerr
+		    << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0])
+		    << std::endl;
+	    throw;
+    }
+
+    // ...and extract the useful parts, i.e. the kernels
+    scanKernel_ = cl::Kernel(program, "scanClamped");
+    compactKernel_ = cl::Kernel(program, "compact");
+    segmentedCopyKernel_ = cl::Kernel(program, "segmentedCopy");
+}
+
+
+
+
+void Primitives::scan(cl::CommandQueue& cq,
+                      cl::Buffer& input, size_t numInputs,
+                      cl::Buffer& cumSum, cl_uint maxSum,
+                      const std::vector<cl::Event>& waitEvents,
+                      cl::Event* doneEvent)
+{
+    scanKernel_.setArg(0, input);
+    scanKernel_.setArg(1, cl_uint(numInputs));
+    scanKernel_.setArg(2, cumSum);
+    scanKernel_.setArg(3, maxSum);
+
+    // One workgroup does the lot
+    cq.enqueueNDRangeKernel(scanKernel_, cl::NullRange,
+                            {wgSize_}, {wgSize_},
+                            &waitEvents, doneEvent);
+}
+
+
+
+void Primitives::compact(cl::CommandQueue& cq,
+                         cl::Buffer& input, cl::Buffer& flags,
+                         size_t numItems, size_t numFloatsPerItem,
+                         cl::Buffer& output, cl::Buffer& count,
+                         const std::vector<cl::Event>& waitEvents,
+                         cl::Event* doneEvent)
+{
+    compactKernel_.setArg(0, input);
+    compactKernel_.setArg(1, flags);
+    compactKernel_.setArg(2, cl_uint(numItems));
+    compactKernel_.setArg(3, cl_uint(numFloatsPerItem));
+    compactKernel_.setArg(4, output);
+    compactKernel_.setArg(5, count);
+
+    cq.enqueueNDRangeKernel(compactKernel_, cl::NullRange,
+                            {wgSize_}, {wgSize_},
+                            &waitEvents, doneEvent);
+}
+
+
+
+void Primitives::segmentedCopy(cl::CommandQueue& cq,
+                               cl::Buffer& input,
+                               cl::Buffer& segmentStarts, cl::Buffer& counts,
+                               size_t numSegments, cl_uint maxSum,
+                               size_t numFloatsPerItem,
+                               cl::Buffer& output, cl::Buffer& cumCounts,
+                               const std::vector<cl::Event>& waitEvents,
+                               cl::Event* doneEvent)
+{
+    if (numSegments > maxNumSegments)
+        throw std::logic_error("Primitives: too many segments");
+
+    segmentedCopyKernel_.setArg(0, input);
+    segmentedCopyKernel_.setArg(1, segmentStarts);
+    segmentedCopyKernel_.setArg(2, counts);
+    segmentedCopyKernel_.setArg(3, cl_uint(numSegments));
+    segmentedCopyKernel_.setArg(4, maxSum);
+    segmentedCopyKernel_.setArg(5, cl_uint(numFloatsPerItem));
+    segmentedCopyKernel_.setArg(6, output);
+    segmentedCopyKernel_.setArg(7, cumCounts);
+
+    // An item per work item, for as many as could fit in the output
+    const size_t globalSize
+        = roundWGs(std::max<size_t>(maxSum, 1), wgSize_);
+
+    cq.enqueueNDRangeKernel(segmentedCopyKernel_, cl::NullRange,
+                            {globalSize}, {wgSize_},
+                            &waitEvents, doneEvent);
+}
+
@@ -0,0 +1,77 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+#include <vector>
+
+
+class Primitives {
+    // Parallel building blocks for handling lists on the device, each a
+    // single launch: a clamped cumulative sum, stream compaction by flags,
+    // and gathering several segments of a buffer into one list.  Items are
+    // numFloatsPerItem floats long, and keep their order throughout.
+    //
+    // The workgroup scan these are built on is also available to other
+    // kernels (see scan.h).
+
+public:
+
+    static const size_t maxNumSegments = 256;
+
+    Primitives() = default;
+    Primitives(const Primitives&) = default;
+    Primitives(cl::Context& context, const std::vector<cl::Device>& devices);
+
+    void scan(cl::CommandQueue& cq,
+              cl::Buffer& input, size_t numInputs,
+              cl::Buffer& cumSum, cl_uint maxSum,
+              const std::vector<cl::Event>& waitEvents
+                  = std::vector<cl::Event>(),
+              cl::Event* doneEvent = nullptr);
+    // cumSum (numInputs + 1 cl_uints) gets the cumulative sum of input,
+    // starting with zero, and never more than maxSum.
+
+    void compact(cl::CommandQueue& cq,
+                 cl::Buffer& input, cl::Buffer& flags, size_t numItems,
+                 size_t numFloatsPerItem,
+                 cl::Buffer& output, cl::Buffer& count,
+                 const std::vector<cl::Event>& waitEvents
+                     = std::vector<cl::Event>(),
+                 cl::Event* doneEvent = nullptr);
+    // Copies the items whose (cl_uint) flags are non-zero to the start of
+    // output, and how many there were to count.
+
+    void segmentedCopy(cl::CommandQueue& cq,
+                       cl::Buffer& input,
+                       cl::Buffer& segmentStarts, cl::Buffer& counts,
+                       size_t numSegments, cl_uint maxSum,
+                       size_t numFloatsPerItem,
+                       cl::Buffer& output, cl::Buffer& cumCounts,
+                       const std::vector<cl::Event>& waitEvents
+                           = std::vector<cl::Event>(),
+                       cl::Event* doneEvent = nullptr);
+    // Segment s of input starts at item segmentStarts[s] and holds counts[s]
+    // items.  These are concatenated into output, with the cumulative
+    // counts (as from scan) written to cumCounts.  Nothing beyond maxSum
+    // items is copied, so maxSum should be output's capacity.
+
+private:
+
+    static const size_t wgSize_ = 256;
+
+    cl::Context context_;
+    cl::Kernel scanKernel_;
+    cl::Kernel compactKernel_;
+    cl::Kernel segmentedCopyKernel_;
+
+};
+
+
+
+#endif
+
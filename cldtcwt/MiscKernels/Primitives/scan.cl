@@ -0,0 +1,49 @@
+// Copyright (C) 2013 Timothy Gale
+// Exclusive prefix sum across a workgroup, for building into other programs
+// ahead of their own source.  WG_SIZE (the workgroup size, a power of two)
+// should be defined externally, and the whole workgroup must call it.
+
+
+uint exclusiveScan(uint v, __local uint* buf, uint* total)
+{
+    // Work-efficient (Blelloch) scan of one value per work item, using buf
+    // (WG_SIZE long) as scratch.  Returns the sum of the values of all
+    // lower-numbered items, with the sum of everything in total.  Finishes
+    // with a barrier, so buf may be reused straight away.
+    const uint l = get_local_id(0);
+
+    buf[l] = v;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Up-sweep: build partial sums in a tree
+    for (uint d = 1; d < WG_SIZE; d *= 2) {
+        uint i = (l + 1) * 2 * d - 1;
+        if (i < WG_SIZE)
+            buf[i] += buf[i - d];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    *total = buf[WG_SIZE - 1];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (l == 0)
+        buf[WG_SIZE - 1] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Down-sweep: push the sums of everything to the left back down
+    for (uint d = WG_SIZE / 2; d > 0; d /= 2) {
+        uint i = (l + 1) * 2 * d - 1;
+        if (i < WG_SIZE) {
+            uint t = buf[i - d];
+            buf[i - d] = buf[i];
+            buf[i] += t;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    uint result = buf[l];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    return result;
+}
+
@@ -0,0 +1,14 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef SCAN_H
+#define SCAN_H
+
+// The workgroup scan function on its own (see scan.cl), for other programs
+// to build in ahead of their own source.  Their kernel.h headers share an
+// include guard, hence this is kept separate.
+
+namespace PrimitivesNS {
+    extern const unsigned char scan_cl[];
+    extern const unsigned int scan_cl_len;
+}
+
+#endif
@@ -0,0 +1,215 @@
+// Copyright (C) 2013 Timothy Gale
+#include "deadlineScheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+DeadlineScheduler::DeadlineScheduler
+        (Milliseconds deadline,
+         const std::vector<QualityLevel>& qualityLevels,
+         size_t latencyWindow)
+ : deadline_(deadline),
+   qualityLevels_(qualityLevels),
+   latencyWindow_(latencyWindow)
+{
+    if (qualityLevels_.empty())
+        throw std::logic_error("DeadlineScheduler: no quality levels");
+
+    if (deadline_.count() <= 0)
+        throw std::logic_error("DeadlineScheduler: deadline must be "
+                               "positive");
+}
+
+
+
+std::vector<DeadlineScheduler::QualityLevel>
+    DeadlineScheduler::defaultQualityLevels
+        (size_t numLevels, float threshold, size_t maxNumKeypoints)
+{
+    std::vector<QualityLevel> levels;
+
+    QualityLevel q = {numLevels, threshold, maxNumKeypoints};
+    levels.push_back(q);
+
+    // Fewer, stronger keypoints: cheaper descriptors and readback
+    q.threshold *= 1.5f;
+    q.maxNumKeypoints = std::max<size_t>(q.maxNumKeypoints / 2, 1);
+    levels.push_back(q);
+
+    q.threshold *= 1.5f;
+    q.maxNumKeypoints = std::max<size_t>(q.maxNumKeypoints / 2, 1);
+    levels.push_back(q);
+
+    // Then stop looking at the coarser levels
+    while (q.numLevels > 1) {
+        --q.numLevels;
+        levels.push_back(q);
+    }
+
+    return levels;
+}
+
+
+
+bool DeadlineScheduler::shouldProcess(Clock::time_point arrival,
+                                      Clock::time_point now)
+{
+    ++numOffered_;
+
+    // Not worth starting if it's already past its deadline
+    if (Milliseconds(now - arrival) > deadline_) {
+        ++numDropped_;
+        record(true);
+        return false;
+    }
+
+    return true;
+}
+
+
+
+void DeadlineScheduler::frameDone(Clock::time_point arrival,
+                                  Clock::time_point now)
+{
+    ++numProcessed_;
+
+    double latency = Milliseconds(now - arrival).count();
+
+    latencies_.push_back(latency);
+    while (latencies_.size() > latencyWindow_)
+        latencies_.pop_front();
+
+    if (latency > deadline_.count())
+        ++numLate_;
+
+    record(latency > overloadFraction_ * deadline_.count());
+
+    // Plenty of headroom?
+    if (latency < headroomFraction_ * deadline_.count())
+        ++numComfortable_;
+    else
+        numComfortable_ = 0;
+
+    if (numComfortable_ >= stepUpFrames_ && qualityIdx_ > 0)
+        changeQuality(qualityIdx_ - 1);
+}
+
+
+
+void DeadlineScheduler::record(bool overloaded)
+{
+    if (overloaded)
+        numComfortable_ = 0;
+
+    recentOverloaded_.push_back(overloaded);
+    while (recentOverloaded_.size() > overloadWindow_)
+        recentOverloaded_.pop_front();
+
+    size_t numOverloaded = std::count(recentOverloaded_.begin(),
+                                      recentOverloaded_.end(), true);
+
+    // Sustained, not just a one-off spike, and still going on
+    if (overloaded
+            && recentOverloaded_.size() == overloadWindow_
+            && 2 * numOverloaded >= overloadWindow_
+            && qualityIdx_ + 1 < qualityLevels_.size())
+        changeQuality(qualityIdx_ + 1);
+}
+
+
+
+void DeadlineScheduler::changeQuality(size_t newIdx)
+{
+    if (newIdx > qualityIdx_)
+        ++numStepsDown_;
+    else
+        ++numStepsUp_;
+
+    qualityIdx_ = newIdx;
+
+    // Judge the new level on its own merits
+    recentOverloaded_.clear();
+    numComfortable_ = 0;
+}
+
+
+
+const DeadlineScheduler::QualityLevel& DeadlineScheduler::quality() const
+{
+    return qualityLevels_[qualityIdx_];
+}
+
+
+size_t DeadlineScheduler::qualityIndex() const
+{
+    return qualityIdx_;
+}
+
+
+DeadlineScheduler::Milliseconds DeadlineScheduler::deadline() const
+{
+    return deadline_;
+}
+
+
+
+static double percentile(std::vector<double>& values, double p)
+{
+    // Nearest rank; reorders values
+    if (values.empty())
+        return 0.0;
+
+    size_t idx = std::min(values.size() - 1,
+                          size_t(p * (values.size() - 1) + 0.5));
+    std::nth_element(values.begin(), values.begin() + idx, values.end());
+
+    return values[idx];
+}
+
+
+DeadlineScheduler::Metrics DeadlineScheduler::metrics() const
+{
+    Metrics m;
+    m.numOffered = numOffered_;
+    m.numProcessed = numProcessed_;
+    m.numDropped = numDropped_;
+    m.numLate = numLate_;
+    m.numStepsDown = numStepsDown_;
+    m.numStepsUp = numStepsUp_;
+    m.qualityIndex = qualityIdx_;
+
+    std::vector<double> values(latencies_.begin(), latencies_.end());
+    m.latencyP50Ms = percentile(values, 0.5);
+    m.latencyP90Ms = percentile(values, 0.9);
+    m.latencyP99Ms = percentile(values, 0.99);
+    m.latencyMaxMs = values.empty()?
+                        0.0 : *std::max_element(values.begin(), values.end());
+
+    return m;
+}
+
+
+
+void DeadlineScheduler::writeMetrics(std::ostream& os) const
+{
+    Metrics m = metrics();
+    const QualityLevel& q = quality();
+
+    os << "offered=" << m.numOffered
+       << " processed=" << m.numProcessed
+       << " dropped=" << m.numDropped
+       << " late=" << m.numLate
+       << " steps_down=" << m.numStepsDown
+       << " steps_up=" << m.numStepsUp
+       << " quality=" << m.qualityIndex
+       << " levels=" << q.numLevels
+       << " threshold=" << q.threshold
+       << " max_keypoints=" << q.maxNumKeypoints
+       << " latency_p50_ms=" << m.latencyP50Ms
+       << " latency_p90_ms=" << m.latencyP90Ms
+       << " latency_p99_ms=" << m.latencyP99Ms
+       << " latency_max_ms=" << m.latencyMaxMs
+       << "\n";
+}
+
@@ -0,0 +1,115 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef DEADLINESCHEDULER_H
+#define DEADLINESCHEDULER_H
+
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+
+class DeadlineScheduler {
+    // Keeps live processing within a latency budget.  Each frame has a
+    // deadline, counted from when it arrived.  Frames that are already too
+    // old when they come up for processing are dropped rather than
+    // uploaded.  If frames keep finishing late (or being dropped) the
+    // scheduler steps down to cheaper quality settings.  Once there has
+    // been plenty of headroom for a while, it steps back up.
+    //
+    // The scheduler only makes decisions; the caller applies the current
+    // QualityLevel to whatever does the work.  Not thread safe.
+
+public:
+
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    struct QualityLevel {
+        size_t numLevels;           // Detection levels to use
+        float threshold;            // Peak detection threshold
+        size_t maxNumKeypoints;     // Keypoint cap per frame
+    };
+
+    struct Metrics {
+        uint64_t numOffered;        // Frames asked about
+        uint64_t numProcessed;      // Frames reported done
+        uint64_t numDropped;        // Frames rejected as stale
+        uint64_t numLate;           // Processed frames that missed deadline
+        uint64_t numStepsDown, numStepsUp;
+        size_t qualityIndex;        // 0 is the best quality
+
+        // Over the recent latency window (arrival to done)
+        double latencyP50Ms, latencyP90Ms, latencyP99Ms, latencyMaxMs;
+    };
+
+    DeadlineScheduler() = default;
+    DeadlineScheduler(const DeadlineScheduler&) = default;
+
+    DeadlineScheduler(Milliseconds deadline,
+                      const std::vector<QualityLevel>& qualityLevels,
+                      size_t latencyWindow = 256);
+    // qualityLevels are ordered best first
+
+    static std::vector<QualityLevel> defaultQualityLevels
+        (size_t numLevels, float threshold, size_t maxNumKeypoints);
+    // A ladder starting from the given settings: raising the threshold,
+    // lowering the keypoint cap and then dropping levels in turn
+
+    bool shouldProcess(Clock::time_point arrival,
+                       Clock::time_point now = Clock::now());
+    // Whether a frame that arrived at arrival is still worth processing.
+    // Drops count against the current quality level.
+
+    void frameDone(Clock::time_point arrival,
+                   Clock::time_point now = Clock::now());
+    // Report that a frame (one that shouldProcess accepted) is finished.
+    // May change the quality level.
+
+    const QualityLevel& quality() const;
+    size_t qualityIndex() const;
+    // The settings to use for the next frame
+
+    Milliseconds deadline() const;
+
+    Metrics metrics() const;
+
+    void writeMetrics(std::ostream& os) const;
+    // One line of space-separated key=value pairs, for logs and scraping
+
+private:
+
+    Milliseconds deadline_;
+    std::vector<QualityLevel> qualityLevels_;
+    size_t qualityIdx_ = 0;
+
+    // Recent latencies, for percentiles
+    std::deque<double> latencies_;
+    size_t latencyWindow_;
+
+    // For the governor: recent frames (processed or dropped) and whether
+    // each was in trouble; and how many in a row have had headroom
+    std::deque<bool> recentOverloaded_;
+    size_t numComfortable_ = 0;
+
+    uint64_t numOffered_ = 0, numProcessed_ = 0, numDropped_ = 0,
+             numLate_ = 0, numStepsDown_ = 0, numStepsUp_ = 0;
+
+    // Tuning of the governor
+    static const size_t overloadWindow_ = 8;
+    // Step down if at least half of this many recent frames overran
+    static constexpr double overloadFraction_ = 0.9;
+    // Count as overrunning from this fraction of the deadline
+    static const size_t stepUpFrames_ = 60;
+    static constexpr double headroomFraction_ = 0.6;
+    // Step up after this many frames in a row finishing within this
+    // fraction of the deadline
+
+    void record(bool overloaded);
+    void changeQuality(size_t newIdx);
+};
+
+
+#endif
+
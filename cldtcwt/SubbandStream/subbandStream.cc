@@ -0,0 +1,631 @@
+// Copyright (C) 2013 Timothy Gale
+#include "subbandStream.h"
+#include "util/fileIO.h"
+
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace {
+
+const char fileMagic[8] = {'C', 'L', 'D', 'T', 'S', 'B', 'D', '1'};
+const char recordMagic[8] = {'S', 'B', 'D', 'F', 'R', 'A', 'M', 'E'};
+
+const uint64_t alignment = 64;
+
+const std::string what = "Subband stream";
+
+
+struct FileHeader {
+    char magic[8];
+    uint32_t startLevel;
+    uint32_t numLevels;
+    uint64_t recordLength;
+    uint64_t reserved[5];
+};
+
+
+struct LevelHeader {
+    SubbandLevelLayout layout;
+    uint64_t reserved[3];
+};
+
+
+struct RecordHeader {
+    char magic[8];
+    uint64_t frame;
+    uint64_t length;
+    uint64_t reserved[4];
+    uint64_t checksum;              // Of everything before it
+};
+
+static_assert(sizeof(FileHeader) == alignment
+           && sizeof(LevelHeader) == alignment
+           && sizeof(RecordHeader) == alignment,
+              "Subband stream headers should be 64 bytes");
+
+
+const size_t elementSize = sizeof(Complex<cl_float>);
+
+
+size_t numOutputLevels(const DtcwtOutput& output)
+{
+    return output.end() - output.begin();
+}
+
+
+// Where each slice of a level's device buffer starts, in elements
+std::vector<size_t> sliceStarts(const Subbands& subbands)
+{
+    std::vector<size_t> starts;
+    for (size_t s = 0; s < subbands.numSlices(); ++s)
+        starts.push_back(subbands.start(s));
+    return starts;
+}
+
+
+// Check output has the levels and sizes of the file
+void checkMatches(const DtcwtOutput& output, size_t startLevel,
+                  const std::vector<SubbandLevelLayout>& levels)
+{
+    bool matches = output.format() == SubbandsComplex
+                && output.startLevel() == startLevel
+                && numOutputLevels(output) == levels.size();
+
+    for (size_t n = 0; matches && n < levels.size(); ++n)
+        matches = output[n].width() == levels[n].width
+               && output[n].height() == levels[n].height
+               && output[n].numSlices() == levels[n].numSlices;
+
+    if (!matches)
+        throw std::logic_error("Subband stream: DTCWT output levels don't "
+                               "match the stream's");
+}
+
+
+// Events that have been set, from waitEvents and each output level
+std::vector<cl::Event> levelWaitEvents(const DtcwtOutput& output,
+                                       size_t levelNum,
+                                       const std::vector<cl::Event>&
+                                            waitEvents)
+{
+    std::vector<cl::Event> events;
+    for (const cl::Event& e: waitEvents)
+        if (e())
+            events.push_back(e);
+
+    for (const cl::Event& e: output.doneEvents(levelNum))
+        if (e())
+            events.push_back(e);
+
+    return events;
+}
+
+}
+
+
+
+SubbandWriter::SubbandWriter(cl::Context& context,
+                             const std::vector<cl::Device>& devices,
+                             const std::string& filename,
+                             const DtcwtOutput& layout,
+                             size_t numBuffers)
+ : startLevel_(layout.startLevel()),
+   mapQueue_(context, devices[0]),
+   stats_ {0, 0, 0., 0.}
+{
+    if (numBuffers == 0)
+        throw std::logic_error("SubbandWriter needs at least one buffer");
+
+    if (layout.format() != SubbandsComplex)
+        throw std::logic_error("SubbandWriter only stores complex subbands");
+
+    // Lay the levels out in a record, and in the pinned buffers as they
+    // are on the device
+    const size_t numLevels = numOutputLevels(layout);
+    dataStart_ = sizeof(FileHeader) + numLevels * sizeof(LevelHeader);
+
+    uint64_t recordOffset = sizeof(RecordHeader);
+    size_t hostBytes = 0;
+
+    for (size_t n = 0; n < numLevels; ++n) {
+        const Subbands& subbands = layout[n];
+
+        SubbandLevelLayout level;
+        level.width = subbands.width();
+        level.height = subbands.height();
+        level.numSlices = subbands.numSlices();
+        level.offset = recordOffset;
+        level.bytes = level.width * level.height * level.numSlices
+                    * elementSize;
+        levels_.push_back(level);
+
+        recordOffset += alignUp(level.bytes, alignment);
+
+        DeviceLevel device;
+        device.bufferBytes = subbands.buffer().getInfo<CL_MEM_SIZE>();
+        device.stride = subbands.stride();
+        device.starts = sliceStarts(subbands);
+        device.hostOffset = hostBytes;
+        deviceLevels_.push_back(device);
+
+        hostBytes += alignUp(device.bufferBytes, alignment);
+    }
+
+    recordLength_ = recordOffset;
+
+    for (size_t n = 0; n < numBuffers; ++n) {
+        std::unique_ptr<Slot> slot(new Slot);
+        slot->host.reset(new PinnedBuffer(context, mapQueue_,
+                                          std::max<size_t>(hostBytes, 1)));
+        free_.push_back(std::move(slot));
+    }
+
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+        throwErrno(what, "could not open " + filename);
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.startLevel = startLevel_;
+    header.numLevels = numLevels;
+    header.recordLength = recordLength_;
+
+    std::vector<LevelHeader> levelHeaders(numLevels);
+    std::memset(levelHeaders.data(), 0,
+                levelHeaders.size() * sizeof(LevelHeader));
+    for (size_t n = 0; n < numLevels; ++n)
+        levelHeaders[n].layout = levels_[n];
+
+    try {
+        writeAll(fd_, &header, sizeof(header), 0, what);
+        writeAll(fd_, levelHeaders.data(),
+                 levelHeaders.size() * sizeof(LevelHeader), sizeof(header),
+                 what);
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+
+    thread_ = std::thread(&SubbandWriter::writeSlots_, this);
+}
+
+
+SubbandWriter::~SubbandWriter()
+{
+    try {
+        close();
+    } catch (std::exception& e) {
+        std::cerr << "SubbandWriter: " << e.what() << std::endl;
+    }
+}
+
+
+void SubbandWriter::operator() (cl::CommandQueue& cq,
+                                const DtcwtOutput& output,
+                                const std::vector<cl::Event>& waitEvents)
+{
+    rethrowError_();
+
+    if (closed_)
+        throw std::logic_error("SubbandWriter written to after close");
+
+    checkMatches(output, startLevel_, levels_);
+    for (size_t n = 0; n < levels_.size(); ++n)
+        if (output[n].buffer().getInfo<CL_MEM_SIZE>()
+                != deviceLevels_[n].bufferBytes
+         || output[n].stride() != deviceLevels_[n].stride
+         || sliceStarts(output[n]) != deviceLevels_[n].starts)
+            throw std::logic_error("SubbandWriter: DTCWT output laid out "
+                                   "differently on the device");
+
+    std::unique_ptr<Slot> slot;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            ++stats_.numStalls;
+            slotWritten_.wait(lock, [&] { return !free_.empty(); });
+        }
+        slot = std::move(free_.front());
+        free_.pop_front();
+    }
+
+    // Read each level's whole buffer in one go; the padding gets dropped
+    // when writing the file
+    slot->frame = numFrames_;
+    slot->readsDone.resize(levels_.size());
+
+    for (size_t n = 0; n < levels_.size(); ++n) {
+        const std::vector<cl::Event> events
+            = levelWaitEvents(output, startLevel_ + n, waitEvents);
+
+        cq.enqueueReadBuffer(output[n].buffer(), CL_FALSE, 0,
+                             deviceLevels_[n].bufferBytes,
+                             slot->host->data()
+                                + deviceLevels_[n].hostOffset,
+                             &events, &slot->readsDone[n]);
+    }
+
+    // The writing thread will be waiting on these
+    cq.flush();
+
+    lastReads_ = slot->readsDone;
+    ++numFrames_;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(slot));
+    }
+    slotQueued_.notify_one();
+}
+
+
+void SubbandWriter::flush()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slotWritten_.wait(lock, [&] { return queue_.empty(); });
+    }
+
+    rethrowError_();
+}
+
+
+void SubbandWriter::close()
+{
+    if (closed_)
+        return;
+    closed_ = true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    slotQueued_.notify_one();
+    thread_.join();
+
+    ::close(fd_);
+
+    rethrowError_();
+}
+
+
+std::vector<cl::Event> SubbandWriter::doneEvents() const
+{
+    return lastReads_;
+}
+
+
+SubbandWriter::Stats SubbandWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+
+void SubbandWriter::writeSlots_()
+{
+    typedef std::chrono::duration<double, std::milli> DurationMs;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (1) {
+        slotQueued_.wait(lock, [&] { return !queue_.empty() || closing_; });
+
+        if (queue_.empty())
+            break;
+
+        // Leave it on the queue while writing, so flush waits for it
+        const Slot& slot = *queue_.front();
+        const bool skip = bool(error_);
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        std::exception_ptr error;
+
+        // Once something has gone wrong, don't write anything further
+        if (!skip) {
+            try {
+                writeSlot_(slot);
+            } catch (cl::Error& e) {
+                error = std::make_exception_ptr(
+                    std::runtime_error(std::string("Reading subbands "
+                                                   "failed: ") + e.what()));
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        const double ms = DurationMs(std::chrono::steady_clock::now()
+                                      - start).count();
+
+        lock.lock();
+
+        if (error && !error_)
+            error_ = error;
+
+        free_.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+
+        if (!error) {
+            ++stats_.numFrames;
+            stats_.maxWriteMs = std::max(stats_.maxWriteMs, ms);
+            totalWriteMs_ += ms;
+            stats_.meanWriteMs = totalWriteMs_ / stats_.numFrames;
+        }
+
+        slotWritten_.notify_all();
+    }
+}
+
+
+void SubbandWriter::writeSlot_(const Slot& slot)
+{
+    static const char padding[alignment] = {};
+
+    cl::WaitForEvents(slot.readsDone);
+
+    // Gather the slices (or their rows, when padded) from the pinned copy
+    // of the device buffers
+    std::vector<iovec> parts;
+
+    for (size_t n = 0; n < levels_.size(); ++n) {
+        const SubbandLevelLayout& level = levels_[n];
+        const DeviceLevel& device = deviceLevels_[n];
+
+        char* buffer = slot.host->data() + device.hostOffset;
+        const size_t rowBytes = level.width * elementSize;
+
+        for (size_t start: device.starts) {
+            char* slice = buffer + start * elementSize;
+
+            if (device.stride == level.width)
+                parts.push_back({slice, rowBytes * level.height});
+            else
+                for (size_t y = 0; y < level.height; ++y)
+                    parts.push_back({slice + y * device.stride * elementSize,
+                                     rowBytes});
+        }
+
+        parts.push_back({const_cast<char*>(padding),
+                         alignUp(level.bytes, alignment) - level.bytes});
+    }
+
+    RecordHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, recordMagic, sizeof(recordMagic));
+    header.frame = slot.frame;
+    header.length = recordLength_;
+    header.checksum = fnv1a(&header, offsetof(RecordHeader, checksum));
+
+    // The data first, then the header that marks it complete
+    const uint64_t offset = dataStart_ + slot.frame * recordLength_;
+    writeAll(fd_, parts, offset + sizeof(header), what);
+    writeAll(fd_, &header, sizeof(header), offset, what);
+}
+
+
+void SubbandWriter::rethrowError_()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error = error_;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+
+SubbandReader::SubbandReader(const std::string& filename)
+{
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        throwErrno(what, "could not open " + filename);
+
+    try {
+        struct stat st;
+        if (fstat(fd_, &st) != 0)
+            throwErrno(what, "stat failed");
+        mappedLength_ = st.st_size;
+
+        FileHeader header;
+        if (mappedLength_ < sizeof(header)
+         || pread(fd_, &header, sizeof(header), 0) != sizeof(header)
+         || std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0
+         || header.recordLength == 0)
+            throw std::runtime_error(what + ": " + filename
+                                     + " is not a subband stream");
+
+        startLevel_ = header.startLevel;
+        recordLength_ = header.recordLength;
+        dataStart_ = sizeof(FileHeader)
+                   + uint64_t(header.numLevels) * sizeof(LevelHeader);
+
+        if (mappedLength_ < dataStart_)
+            throw std::runtime_error(what + ": " + filename
+                                     + " is cut short");
+
+        void* map = mmap(nullptr, mappedLength_, PROT_READ, MAP_SHARED,
+                         fd_, 0);
+        if (map == MAP_FAILED)
+            throwErrno(what, "mmap failed");
+        map_ = static_cast<const char*>(map);
+
+        const LevelHeader* levelHeaders
+            = reinterpret_cast<const LevelHeader*>(map_ + sizeof(header));
+        for (size_t n = 0; n < header.numLevels; ++n)
+            levels_.push_back(levelHeaders[n].layout);
+
+        // Count the complete records
+        numFrames_ = 0;
+        while (dataStart_ + (numFrames_ + 1) * recordLength_
+                <= mappedLength_) {
+            RecordHeader record;
+            std::memcpy(&record,
+                        map_ + dataStart_ + numFrames_ * recordLength_,
+                        sizeof(record));
+
+            if (std::memcmp(record.magic, recordMagic,
+                            sizeof(recordMagic)) != 0
+             || record.checksum != fnv1a(&record,
+                                         offsetof(RecordHeader, checksum))
+             || record.frame != numFrames_
+             || record.length != recordLength_)
+                break;
+
+            ++numFrames_;
+        }
+
+    } catch (...) {
+        if (map_)
+            munmap(const_cast<char*>(map_), mappedLength_);
+        ::close(fd_);
+        throw;
+    }
+}
+
+
+SubbandReader::~SubbandReader()
+{
+    munmap(const_cast<char*>(map_), mappedLength_);
+    ::close(fd_);
+}
+
+
+const SubbandLevelLayout& SubbandReader::layout(int levelNum) const
+{
+    if (levelNum < int(startLevel_)
+     || levelNum >= int(startLevel_ + levels_.size()))
+        throw std::out_of_range("Subband stream: no such level");
+
+    return levels_[levelNum - startLevel_];
+}
+
+
+const Complex<cl_float>* SubbandReader::level(size_t frame,
+                                              int levelNum) const
+{
+    if (frame >= numFrames_)
+        throw std::out_of_range("Subband stream: no such frame");
+
+    return reinterpret_cast<const Complex<cl_float>*>
+            (map_ + dataStart_ + frame * recordLength_
+                  + layout(levelNum).offset);
+}
+
+
+
+SubbandReplay::SubbandReplay(cl::Context& context,
+                             const std::vector<cl::Device>& devices,
+                             const SubbandReader& reader,
+                             size_t numBuffers)
+ : context_(context),
+   mapQueue_(context, devices[0]),
+   reader_(&reader),
+   slots_(numBuffers)
+{
+    if (numBuffers == 0)
+        throw std::logic_error("SubbandReplay needs at least one buffer");
+}
+
+
+DtcwtOutput SubbandReplay::createOutputs()
+{
+    // As DtcwtTemps::createOutputs would
+    DtcwtOutput output;
+
+    output.startLevel_ = reader_->startLevel();
+    output.numLevels_ = reader_->numLevels();
+
+    for (size_t n = 0; n < reader_->numLevels(); ++n) {
+        const SubbandLevelLayout& level
+            = reader_->layout(reader_->startLevel() + n);
+
+        output.levels_.emplace_back(context_,
+                CL_MEM_READ_WRITE,
+                level.width, level.height,
+                0, 1,
+                level.numSlices);
+
+        output.doneEvents_.emplace_back();
+    }
+
+    return output;
+}
+
+
+void SubbandReplay::operator() (cl::CommandQueue& cq, size_t frame,
+                                DtcwtOutput& output,
+                                const std::vector<cl::Event>& waitEvents)
+{
+    std::vector<SubbandLevelLayout> levels;
+    for (size_t n = 0; n < reader_->numLevels(); ++n)
+        levels.push_back(reader_->layout(reader_->startLevel() + n));
+
+    checkMatches(output, reader_->startLevel(), levels);
+
+    // Where each level's buffer goes in the pinned copy
+    std::vector<size_t> hostOffsets;
+    size_t hostBytes = 0;
+    for (const Subbands& subbands: output) {
+        hostOffsets.push_back(hostBytes);
+        hostBytes += alignUp(subbands.buffer().getInfo<CL_MEM_SIZE>(),
+                             alignment);
+    }
+
+    // The uploads from this buffer last time round must have finished
+    // before it's reused
+    Slot& slot = slots_[nextSlot_];
+    nextSlot_ = (nextSlot_ + 1) % slots_.size();
+
+    if (!slot.writesDone.empty())
+        cl::WaitForEvents(slot.writesDone);
+    slot.writesDone.resize(levels.size());
+
+    if (!slot.host || slot.host->size() < hostBytes)
+        slot.host.reset(new PinnedBuffer(context_, mapQueue_, hostBytes));
+
+    std::vector<cl::Event> events;
+    for (const cl::Event& e: waitEvents)
+        if (e())
+            events.push_back(e);
+
+    for (size_t n = 0; n < levels.size(); ++n) {
+        const SubbandLevelLayout& level = levels[n];
+        const Subbands& subbands = output[n];
+
+        const Complex<cl_float>* input
+            = reader_->level(frame, reader_->startLevel() + n);
+        Complex<cl_float>* buffer = reinterpret_cast<Complex<cl_float>*>
+                                        (slot.host->data() + hostOffsets[n]);
+
+        // Row by row into the device layout
+        for (size_t s = 0; s < level.numSlices; ++s)
+            for (size_t y = 0; y < level.height; ++y, input += level.width)
+                std::copy(input, input + level.width,
+                          buffer + subbands.start(s)
+                                 + y * subbands.stride());
+
+        cq.enqueueWriteBuffer(subbands.buffer(), CL_FALSE, 0,
+                              subbands.buffer().getInfo<CL_MEM_SIZE>(),
+                              buffer, &events, &slot.writesDone[n]);
+
+        output.doneEvents_[n] = {slot.writesDone[n]};
+    }
+
+    cq.flush();
+}
+
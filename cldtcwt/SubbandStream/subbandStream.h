@@ -0,0 +1,212 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef SUBBANDSTREAM_H
+#define SUBBANDSTREAM_H
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+
+#include "DTCWT/dtcwt.h"
+#include "util/clUtil.h"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <cstdint>
+
+
+// A file of DTCWT outputs, every level's subbands for frame after frame,
+// so detection and description can be rerun on them without the
+// transform.
+//
+// Like a keypoint stream, it is flat, native endian, aligned to 64 bytes
+// and only appended to.  A 64-byte file header (start level, number of
+// levels, record length) is followed by a 64-byte description of each
+// level (width, height, slices, where it sits in a record), then one
+// record per frame.  Every record is the same length: a 64-byte header
+// carrying a checksum, written last, then each level in turn as
+// slice-major, row-major complex floats without padding.  That makes
+// frame n's offset a multiplication, and a level straightforward to load
+// elsewhere (e.g. with numpy.memmap).
+
+
+struct SubbandLevelLayout {
+    uint64_t width, height, numSlices;
+    uint64_t offset;        // From the start of a frame's record
+    uint64_t bytes;
+};
+
+
+
+class SubbandWriter {
+    // Reads each frame's subbands back from the device without blocking,
+    // into pinned host buffers, and leaves a background thread to wait for
+    // the reads and write the file.  The caller only waits if every buffer
+    // is still waiting to be written.  An error while writing comes out of
+    // the next call.
+
+public:
+
+    struct Stats {
+        size_t numFrames;       // Written to the file
+        size_t numStalls;       // Frames that waited for a free buffer
+        double meanWriteMs, maxWriteMs;
+    };
+
+    SubbandWriter(cl::Context& context,
+                  const std::vector<cl::Device>& devices,
+                  const std::string& filename,
+                  const DtcwtOutput& layout,
+                  size_t numBuffers = 4);
+    // Every frame written must have the same levels and sizes as layout
+
+    SubbandWriter(const SubbandWriter&) = delete;
+    SubbandWriter& operator= (const SubbandWriter&) = delete;
+
+    ~SubbandWriter();
+    // Closes, reporting any error on std::cerr
+
+    void operator() (cl::CommandQueue& cq, const DtcwtOutput& output,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>());
+    // Queues a frame, after output's done events and waitEvents.  Once
+    // this returns the subbands can be overwritten by anything that waits
+    // for doneEvents(); the reads are enqueued (and flushed) on cq.
+
+    void flush();
+    // Returns once every frame so far is in the file
+
+    void close();
+
+    std::vector<cl::Event> doneEvents() const;
+    // The device reads for the last frame
+
+    size_t numFrames() const { return numFrames_; }
+    Stats stats() const;
+
+private:
+
+    struct Slot {
+        std::unique_ptr<PinnedBuffer> host;
+        std::vector<cl::Event> readsDone;
+        uint64_t frame;
+    };
+
+    struct DeviceLevel {
+        size_t bufferBytes;
+        size_t stride;
+        std::vector<size_t> starts;     // Of each slice
+        size_t hostOffset;              // In a pinned buffer
+    };
+
+    int fd_ = -1;
+    uint64_t dataStart_, recordLength_;
+    std::vector<SubbandLevelLayout> levels_;
+    std::vector<DeviceLevel> deviceLevels_;
+    size_t startLevel_;
+    uint64_t numFrames_ = 0;
+    std::vector<cl::Event> lastReads_;
+
+    cl::CommandQueue mapQueue_;
+
+    // Shared with the writing thread
+    mutable std::mutex mutex_;
+    std::condition_variable slotQueued_, slotWritten_;
+    std::deque<std::unique_ptr<Slot>> queue_, free_;
+    bool closing_ = false, closed_ = false;
+    std::exception_ptr error_;
+    Stats stats_;
+    double totalWriteMs_ = 0.;
+
+    std::thread thread_;
+
+    void writeSlots_();
+    void writeSlot_(const Slot& slot);
+    void rethrowError_();
+};
+
+
+
+class SubbandReader {
+    // Maps a subband file for reading on the host.  Records past the last
+    // complete one are ignored.
+
+public:
+
+    SubbandReader(const std::string& filename);
+
+    SubbandReader(const SubbandReader&) = delete;
+    SubbandReader& operator= (const SubbandReader&) = delete;
+    ~SubbandReader();
+
+    size_t numFrames() const { return numFrames_; }
+    size_t startLevel() const { return startLevel_; }
+    size_t numLevels() const { return levels_.size(); }
+
+    const SubbandLevelLayout& layout(int levelNum) const;
+
+    const Complex<cl_float>* level(size_t frame, int levelNum) const;
+    // Slice s, row y, column x is at (s * height + y) * width + x
+
+private:
+    int fd_ = -1;
+    const char* map_ = nullptr;
+    size_t mappedLength_ = 0;
+
+    uint64_t dataStart_, recordLength_;
+    size_t startLevel_;
+    std::vector<SubbandLevelLayout> levels_;
+    size_t numFrames_;
+};
+
+
+
+class SubbandReplay {
+    // Uploads frames from a SubbandReader into a DtcwtOutput, in place of
+    // running the transform.  Each frame is copied into a pinned buffer
+    // laid out as the device buffers are, and written from there without
+    // blocking; the pinned buffers are used in turn, so preparing one frame
+    // overlaps with the last one's upload.
+
+public:
+
+    SubbandReplay(cl::Context& context,
+                  const std::vector<cl::Device>& devices,
+                  const SubbandReader& reader,
+                  size_t numBuffers = 2);
+
+    DtcwtOutput createOutputs();
+    // Outputs with the levels and sizes in the file
+
+    void operator() (cl::CommandQueue& cq, size_t frame,
+                     DtcwtOutput& output,
+                     const std::vector<cl::Event>& waitEvents
+                        = std::vector<cl::Event>());
+    // Sets output's done events to the uploads.  waitEvents should cover
+    // anything still reading output from the last frame.
+
+private:
+
+    struct Slot {
+        std::unique_ptr<PinnedBuffer> host;
+        std::vector<cl::Event> writesDone;
+    };
+
+    cl::Context context_;
+    cl::CommandQueue mapQueue_;
+    const SubbandReader* reader_;
+
+    std::vector<Slot> slots_;
+    size_t nextSlot_ = 0;
+};
+
+
+
+#endif
+
@@ -0,0 +1,237 @@
+// Copyright (C) 2013 Timothy Gale
+#include "bufferedHDFWriter.h"
+#include "hdfLock.h"
+
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+
+BufferedHDFWriter::BufferedHDFWriter(const std::string& filename,
+                                     size_t descriptorLength,
+                                     HDFWriter::DescriptorFormat format,
+                                     const HDFWriter::Storage& storage,
+                                     size_t blockKeypoints,
+                                     size_t blockFrames,
+                                     size_t maxQueuedBlocks)
+ : descriptorBytes_(descriptorLength * HDFWriter::elementSize(format)),
+   blockKeypoints_(blockKeypoints), blockFrames_(blockFrames),
+   stats_ {0, 0, 0, 0, 0., 0., 0.}
+{
+    if (blockKeypoints == 0 || blockFrames == 0 || maxQueuedBlocks == 0)
+        throw std::logic_error("BufferedHDFWriter needs room for at least "
+                               "one frame and one queued block");
+
+    HDFWriter::Storage blockStorage = storage;
+    if (blockStorage.chunkRows == 0)
+        blockStorage.chunkRows = blockKeypoints;
+
+    {
+        std::lock_guard<std::mutex> hdfLock(hdfMutex());
+        writer_ = HDFWriter(filename, descriptorLength, format,
+                            blockStorage);
+    }
+
+    // One block for each queue place, plus the one being filled
+    for (size_t n = 0; n < maxQueuedBlocks + 1; ++n) {
+        std::unique_ptr<Block> block(new Block);
+        block->keypointCounts.reserve(blockFrames);
+        block->keypoints.reserve(4 * blockKeypoints);
+        block->descriptors.reserve(descriptorBytes_ * blockKeypoints);
+        free_.push_back(std::move(block));
+    }
+
+    thread_ = std::thread(&BufferedHDFWriter::writeBlocks_, this);
+}
+
+
+BufferedHDFWriter::~BufferedHDFWriter()
+{
+    try {
+        close();
+    } catch (std::exception& e) {
+        std::cerr << "BufferedHDFWriter: " << e.what() << std::endl;
+    }
+}
+
+
+void BufferedHDFWriter::append(size_t numKeypoints, const float* keypoints,
+                               const void* descriptors)
+{
+    rethrowError_();
+
+    if (closed_)
+        throw std::logic_error("BufferedHDFWriter appended to after close");
+
+    // Send the current block first if this frame won't fit
+    if (current_ && current_->numKeypoints > 0
+     && current_->numKeypoints + numKeypoints > blockKeypoints_)
+        queueCurrent_();
+
+    if (!current_) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            ++stats_.numStalls;
+            blockWritten_.wait(lock, [&] { return !free_.empty(); });
+        }
+        current_ = std::move(free_.front());
+        free_.pop_front();
+    }
+
+    Block& block = *current_;
+    block.keypointCounts.push_back(numKeypoints);
+    block.keypoints.insert(block.keypoints.end(),
+                           keypoints, keypoints + 4 * numKeypoints);
+    const char* descriptorBytes = static_cast<const char*>(descriptors);
+    block.descriptors.insert(block.descriptors.end(),
+                             descriptorBytes,
+                             descriptorBytes
+                                + descriptorBytes_ * numKeypoints);
+    block.numKeypoints += numKeypoints;
+
+    if (block.keypointCounts.size() >= blockFrames_
+     || block.numKeypoints >= blockKeypoints_)
+        queueCurrent_();
+}
+
+
+void BufferedHDFWriter::flush()
+{
+    if (current_)
+        queueCurrent_();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        blockWritten_.wait(lock, [&] { return queue_.empty(); });
+    }
+
+    rethrowError_();
+}
+
+
+void BufferedHDFWriter::close()
+{
+    if (closed_)
+        return;
+    closed_ = true;
+
+    if (current_)
+        queueCurrent_();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    blockQueued_.notify_one();
+    thread_.join();
+
+    {
+        // Closing the file goes through the library too
+        std::lock_guard<std::mutex> hdfLock(hdfMutex());
+        writer_ = HDFWriter();
+    }
+
+    rethrowError_();
+}
+
+
+BufferedHDFWriter::Stats BufferedHDFWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+
+void BufferedHDFWriter::queueCurrent_()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(current_));
+        stats_.queueDepth = queue_.size();
+        stats_.maxQueueDepth = std::max(stats_.maxQueueDepth,
+                                        stats_.queueDepth);
+    }
+    blockQueued_.notify_one();
+}
+
+
+void BufferedHDFWriter::writeBlocks_()
+{
+    typedef std::chrono::duration<double, std::milli> DurationMs;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (1) {
+        blockQueued_.wait(lock, [&] { return !queue_.empty() || closing_; });
+
+        if (queue_.empty())
+            break;
+
+        // Leave it on the queue while writing, so it counts towards the
+        // depth and flush waits for it
+        Block& block = *queue_.front();
+        const bool skip = bool(error_);
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        std::exception_ptr error;
+
+        // Once something has gone wrong, don't write anything further
+        if (!skip) {
+            try {
+                std::lock_guard<std::mutex> hdfLock(hdfMutex());
+                writer_.appendFrames(block.keypointCounts.size(),
+                                     block.keypointCounts.data(),
+                                     block.keypoints.data(),
+                                     block.descriptors.data());
+            } catch (H5::Exception& e) {
+                error = std::make_exception_ptr(
+                    std::runtime_error("Writing HDF5 failed: "
+                                       + e.getDetailMsg()));
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        const double ms = DurationMs(std::chrono::steady_clock::now()
+                                      - start).count();
+
+        // Clear it out for reuse; capacity is kept
+        block.keypointCounts.clear();
+        block.keypoints.clear();
+        block.descriptors.clear();
+        block.numKeypoints = 0;
+
+        lock.lock();
+
+        if (error && !error_)
+            error_ = error;
+
+        free_.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+
+        stats_.queueDepth = queue_.size();
+        ++stats_.numFlushes;
+        stats_.lastFlushMs = ms;
+        stats_.maxFlushMs = std::max(stats_.maxFlushMs, ms);
+        totalFlushMs_ += ms;
+        stats_.meanFlushMs = totalFlushMs_ / stats_.numFlushes;
+
+        blockWritten_.notify_all();
+    }
+}
+
+
+void BufferedHDFWriter::rethrowError_()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error = error_;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
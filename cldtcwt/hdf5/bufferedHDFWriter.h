@@ -0,0 +1,101 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef BUFFEREDHDFWRITER_H
+#define BUFFEREDHDFWRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+#include "hdfwriter.h"
+
+
+class BufferedHDFWriter {
+    // Writes the same file as HDFWriter, but append only copies the frame
+    // into a host-side block.  Full blocks are queued for a background
+    // thread, which writes each with one HDFWriter::appendFrames, so the
+    // caller doesn't wait on the disk unless the queue is full.  Unless
+    // storage says otherwise, the keypoints and descriptors tables are
+    // chunked to the block size.
+    //
+    // The blocks are allocated up front and reused.  Every call into HDF5
+    // holds hdfMutex(), so several writers can run in different threads.
+    // An error while writing comes out of the next append, flush or close.
+
+public:
+
+    struct Stats {
+        size_t queueDepth;      // Blocks waiting to be written, or being
+        size_t maxQueueDepth;
+        size_t numFlushes;      // Blocks written
+        size_t numStalls;       // Appends that waited for a free block
+        double lastFlushMs, meanFlushMs, maxFlushMs;
+    };
+
+    BufferedHDFWriter(const std::string& filename, size_t descriptorLength,
+                      HDFWriter::DescriptorFormat format = HDFWriter::Float32,
+                      const HDFWriter::Storage& storage = HDFWriter::Storage(),
+                      size_t blockKeypoints = 4096, size_t blockFrames = 64,
+                      size_t maxQueuedBlocks = 4);
+    // A block is written once it holds blockKeypoints keypoints or
+    // blockFrames frames, whichever comes first.  Frames with more than
+    // blockKeypoints keypoints get a block to themselves.
+
+    BufferedHDFWriter(const BufferedHDFWriter&) = delete;
+    BufferedHDFWriter& operator= (const BufferedHDFWriter&) = delete;
+
+    ~BufferedHDFWriter();
+    // Closes, reporting any error on std::cerr
+
+    void append(size_t numKeypoints, const float* keypoints,
+                const void* descriptors);
+    // As HDFWriter::append
+
+    void flush();
+    // Returns once everything appended so far has been written
+
+    void close();
+    // Writes everything and closes the file; nothing can be appended after
+
+    Stats stats() const;
+
+private:
+
+    struct Block {
+        std::vector<size_t> keypointCounts;
+        std::vector<float> keypoints;
+        std::vector<char> descriptors;
+        size_t numKeypoints = 0;
+    };
+
+    HDFWriter writer_;
+    size_t descriptorBytes_;
+    size_t blockKeypoints_, blockFrames_;
+
+    // The block being filled by append (only touched by the caller)
+    std::unique_ptr<Block> current_;
+
+    // Shared with the writing thread
+    mutable std::mutex mutex_;
+    std::condition_variable blockQueued_, blockWritten_;
+    std::deque<std::unique_ptr<Block>> queue_, free_;
+    bool closing_ = false, closed_ = false;
+    std::exception_ptr error_;
+    Stats stats_;
+    double totalFlushMs_ = 0.;
+
+    std::thread thread_;
+
+    void queueCurrent_();
+    void writeBlocks_();
+    void rethrowError_();
+};
+
+
+
+#endif
+
@@ -0,0 +1,67 @@
+// Copyright (C) 2013 Timothy Gale
+#include "halfFloat.h"
+
+#include <cstring>
+#include <cmath>
+
+
+H5::FloatType halfFloatType()
+{
+    H5::FloatType type(H5::PredType::IEEE_F32LE);
+    type.setFields(15, 10, 5, 0, 10);
+    type.setSize(2);
+    type.setEbias(15);
+    return type;
+}
+
+
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    // Infinity and NaN
+    if (magnitude >= 0x7f800000)
+        return sign | ((magnitude > 0x7f800000)? 0x7e00 : 0x7c00);
+
+    // Too big (rounds to 65520 or more)
+    if (magnitude >= 0x477ff000)
+        return sign | 0x7c00;
+
+    // Below the smallest normal half: in units of the denormals
+    if (magnitude < 0x38800000)
+        return sign | uint16_t(std::nearbyint(std::fabs(value) * 16777216.f));
+
+    // Round off the extra mantissa bits (a carry goes into the exponent),
+    // then rebias the exponent
+    magnitude += 0xfff + ((magnitude >> 13) & 1);
+    return sign | uint16_t((magnitude - ((127 - 15) << 23)) >> 13);
+}
+
+
+float halfToFloat(uint16_t half)
+{
+    const uint32_t sign = uint32_t(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1f;
+    const uint32_t mantissa = half & 0x3ff;
+
+    // Denormals (and zero) are exact as floats
+    if (exponent == 0) {
+        float value = std::ldexp(float(mantissa), -24);
+        return sign? -value : value;
+    }
+
+    uint32_t bits;
+    if (exponent == 0x1f)
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    else
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
@@ -0,0 +1,23 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef HALFFLOAT_H
+#define HALFFLOAT_H
+
+#include <H5Cpp.h>
+#include <cstdint>
+
+// IEEE 754 half precision, as HDFWriter can store descriptors.  HDF5 can
+// convert to and from floats itself, but slowly, and rounding floats it can
+// get the exponent wrong when the rounding carries into it.
+
+H5::FloatType halfFloatType();
+// The HDF5 type
+
+uint16_t floatToHalf(float value);
+// Rounded to the nearest, ties to even
+
+float halfToFloat(uint16_t half);
+// Exact
+
+
+#endif
+
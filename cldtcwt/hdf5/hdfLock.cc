@@ -0,0 +1,10 @@
+// Copyright (C) 2013 Timothy Gale
+#include "hdfLock.h"
+
+
+std::mutex& hdfMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
@@ -0,0 +1,14 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef HDFLOCK_H
+#define HDFLOCK_H
+
+#include <mutex>
+
+std::mutex& hdfMutex();
+// The HDF5 library is not thread safe in the usual builds, so every call
+// into it from a program that uses it from more than one thread should
+// hold this (BufferedHDFWriter does)
+
+
+#endif
+
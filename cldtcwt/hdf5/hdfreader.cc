@@ -0,0 +1,253 @@
+// Copyright (C) 2013 Timothy Gale
+#include "hdfreader.h"
+#include "hdfLock.h"
+#include "halfFloat.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <mutex>
+#include <cstdint>
+
+
+// Read rows [first, first + numRows) of a 2D table
+template<typename T>
+static void readRows(const H5::DataSet& dataset, hsize_t first,
+                     hsize_t numRows, T* data, const H5::DataType& memType)
+{
+    H5::DataSpace dataspace = dataset.getSpace();
+    hsize_t dims[2];
+    dataspace.getSimpleExtentDims(dims);
+
+    hsize_t offset[] = {first, 0};
+    hsize_t range[] = {numRows, dims[1]};
+    dataspace.selectHyperslab(H5S_SELECT_SET, range, offset);
+
+    H5::DataSpace memSpace(2, range);
+    dataset.read(data, memType, memSpace, dataspace);
+}
+
+
+// Open a table with room in the chunk cache for two of its chunks, so
+// reading a few frames at a time doesn't decompress each chunk repeatedly
+static H5::DataSet openTable(const H5::H5File& file, const char* name)
+{
+    H5::DataSet dataset = file.openDataSet(name);
+
+    H5::DSetCreatPropList parms = dataset.getCreatePlist();
+    if (parms.getLayout() != H5D_CHUNKED)
+        return dataset;
+
+    hsize_t chunkDims[2];
+    parms.getChunk(2, chunkDims);
+    const size_t chunkBytes = chunkDims[0] * chunkDims[1]
+                            * dataset.getDataType().getSize();
+
+    // The default's big enough
+    if (2 * chunkBytes <= 1024 * 1024)
+        return dataset;
+
+    // Opening it again while it's open would share the first's cache
+    dataset.close();
+
+    H5::DSetAccPropList access;
+    access.setChunkCache(521, 2 * chunkBytes, 0.75);
+    return file.openDataSet(name, access);
+}
+
+
+HDFReader::HDFReader(const std::string& filename)
+{
+    std::lock_guard<std::mutex> hdfLock(hdfMutex());
+
+    file_ = H5::H5File(filename, H5F_ACC_RDONLY);
+
+    keypoints_ = openTable(file_, "keypoints");
+    descriptors_ = openTable(file_, "descriptors");
+
+    hsize_t dims[2];
+    descriptors_.getSpace().getSimpleExtentDims(dims);
+    descriptorLength_ = dims[1];
+
+    if (descriptors_.attrExists("format")) {
+        H5::Attribute formatAttr = descriptors_.openAttribute("format");
+        H5std_string formatName;
+        formatAttr.read(formatAttr.getStrType(), formatName);
+
+        if (formatName == "int8")
+            format_ = HDFWriter::Int8;
+        else if (formatName == "binary")
+            format_ = HDFWriter::Binary;
+    }
+
+    halfPrecision_ = format_ == HDFWriter::Float32
+                  && descriptors_.getTypeClass() == H5T_FLOAT
+                  && descriptors_.getFloatType().getSize() == 2;
+
+    // The index: pairs of first keypoint and number of keypoints
+    H5::DataSet frames = file_.openDataSet("frames");
+    frames.getSpace().getSimpleExtentDims(dims);
+
+    std::vector<hsize_t> index(2 * dims[0]);
+    if (!index.empty())
+        frames.read(index.data(), H5::PredType::NATIVE_HSIZE);
+
+    frameStarts_.resize(dims[0]);
+    frameCounts_.resize(dims[0]);
+    for (size_t n = 0; n < dims[0]; ++n) {
+        frameStarts_[n] = index[2*n];
+        frameCounts_[n] = index[2*n + 1];
+    }
+}
+
+
+size_t HDFReader::numKeypoints() const
+{
+    if (frameStarts_.empty())
+        return 0;
+
+    return frameStarts_.back() + frameCounts_.back();
+}
+
+
+HDFReader::Frames HDFReader::read(size_t firstFrame, size_t numFrames) const
+{
+    Frames frames;
+    read(firstFrame, numFrames, frames);
+    return frames;
+}
+
+
+void HDFReader::read(size_t firstFrame, size_t numFrames,
+                     Frames& frames) const
+{
+    if (firstFrame > this->numFrames()
+     || numFrames > this->numFrames() - firstFrame)
+        throw std::out_of_range("HDFReader: frames out of range");
+
+    const size_t endFrame = firstFrame + numFrames;
+
+    // The frames' keypoints follow on from each other
+    const size_t first = numFrames? frameStarts_[firstFrame] : 0;
+    const size_t end = numFrames?
+        frameStarts_[endFrame - 1] + frameCounts_[endFrame - 1] : 0;
+    const size_t numKeypoints = end - first;
+
+    frames.firstFrame = firstFrame;
+    frames.keypointCounts.assign(frameCounts_.begin() + firstFrame,
+                                 frameCounts_.begin() + endFrame);
+    frames.keypointStarts.resize(numFrames);
+    for (size_t n = 0; n < numFrames; ++n)
+        frames.keypointStarts[n] = frameStarts_[firstFrame + n] - first;
+
+    frames.keypoints.resize(4 * numKeypoints);
+    frames.descriptors.resize(descriptorBytes() * numKeypoints);
+
+    if (numKeypoints == 0)
+        return;
+
+    std::vector<uint16_t> halves;
+
+    {
+        std::lock_guard<std::mutex> hdfLock(hdfMutex());
+
+        readRows(keypoints_, first, numKeypoints, frames.keypoints.data(),
+                 H5::PredType::NATIVE_FLOAT);
+
+        if (halfPrecision_) {
+            halves.resize(descriptorLength_ * numKeypoints);
+            readRows(descriptors_, first, numKeypoints, halves.data(),
+                     halfFloatType());
+        } else
+            readRows(descriptors_, first, numKeypoints,
+                     frames.descriptors.data(),
+                     HDFWriter::descriptorType(format_));
+    }
+
+    if (halfPrecision_) {
+        float* values = reinterpret_cast<float*>(frames.descriptors.data());
+        std::transform(halves.begin(), halves.end(), values, halfToFloat);
+    }
+}
+
+
+
+void HDFReader::readDescriptorRows(size_t first, size_t numRows,
+                                   float* descriptors) const
+{
+    if (format_ != HDFWriter::Float32)
+        throw std::runtime_error(std::string("HDFReader: descriptors are ")
+                                 + HDFWriter::formatName(format_)
+                                 + " codes, not floats");
+
+    if (numRows == 0)
+        return;
+
+    std::vector<uint16_t> halves;
+
+    {
+        std::lock_guard<std::mutex> hdfLock(hdfMutex());
+
+        if (halfPrecision_) {
+            halves.resize(descriptorLength_ * numRows);
+            readRows(descriptors_, first, numRows, halves.data(),
+                     halfFloatType());
+        } else
+            readRows(descriptors_, first, numRows, descriptors,
+                     H5::PredType::NATIVE_FLOAT);
+    }
+
+    if (halfPrecision_)
+        std::transform(halves.begin(), halves.end(), descriptors,
+                       halfToFloat);
+}
+
+
+
+static HDFReader::Frames readBlock(const HDFReader* reader,
+                                   size_t firstFrame, size_t numFrames,
+                                   HDFReader::Frames buffer)
+{
+    reader->read(firstFrame, numFrames, buffer);
+    return buffer;
+}
+
+
+HDFReader::Stream::Stream(const HDFReader& reader, size_t framesPerBlock,
+                          size_t firstFrame, size_t endFrame)
+ : reader_(&reader), framesPerBlock_(std::max<size_t>(framesPerBlock, 1)),
+   nextFrame_(firstFrame),
+   endFrame_(std::min(endFrame, reader.numFrames()))
+{
+    prefetch_(Frames());
+}
+
+
+bool HDFReader::Stream::next(Frames& frames)
+{
+    if (!pending_.valid())
+        return false;
+
+    // Rethrows anything that went wrong reading
+    Frames ready = pending_.get();
+    std::swap(frames, ready);
+
+    prefetch_(std::move(ready));
+    return true;
+}
+
+
+void HDFReader::Stream::prefetch_(Frames buffer)
+{
+    if (nextFrame_ >= endFrame_) {
+        pending_ = std::future<Frames>();
+        return;
+    }
+
+    const size_t numFrames = std::min(framesPerBlock_,
+                                      endFrame_ - nextFrame_);
+
+    pending_ = std::async(std::launch::async, readBlock, reader_,
+                          nextFrame_, numFrames, std::move(buffer));
+    nextFrame_ += numFrames;
+}
+
@@ -0,0 +1,119 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef HDFREADER_H
+#define HDFREADER_H
+
+
+#include <H5Cpp.h>
+#include <string>
+#include <vector>
+#include <future>
+
+#include "hdfwriter.h"
+
+class HDFReader {
+    // Reads files written by HDFWriter (or BufferedHDFWriter).  The frames
+    // table is loaded when opening, so reading any range of frames takes
+    // one read from each of the keypoints and descriptors tables.
+    //
+    // Reads are const and take hdfMutex() while in the HDF5 library, so
+    // one reader can be shared between threads; the index lookups and any
+    // conversion (half precision descriptors are widened here, which is
+    // much quicker than HDF5's conversion) happen outside it.  Copies share
+    // the open file, but copying and destroying aren't locked, so do those
+    // while no other thread is using HDF5.
+    //
+
+public:
+
+    struct Frames {
+        // The keypoints and descriptors of a run of frames, as written
+
+        size_t firstFrame = 0;
+        std::vector<size_t> keypointCounts;     // One per frame
+        std::vector<size_t> keypointStarts;     // Within this block
+        std::vector<float> keypoints;           // Four per keypoint
+        std::vector<char> descriptors;          // descriptorBytes() each
+
+        size_t numFrames() const { return keypointCounts.size(); }
+        size_t numKeypoints() const { return keypoints.size() / 4; }
+    };
+
+    class Stream;
+
+    HDFReader() = default;
+    HDFReader(const HDFReader&) = default;
+
+    HDFReader(const std::string& filename);
+    // Opens read only
+
+    size_t numFrames() const { return frameStarts_.size(); }
+    size_t numKeypoints() const;
+    size_t numKeypoints(size_t frame) const { return frameCounts_[frame]; }
+
+    size_t descriptorLength() const { return descriptorLength_; }
+    // In elements: floats, or bytes for codes
+
+    HDFWriter::DescriptorFormat format() const { return format_; }
+    // From the descriptors' format attribute (float32 if it has none)
+
+    size_t descriptorBytes() const
+    {
+        return descriptorLength_ * HDFWriter::elementSize(format_);
+    }
+
+    Frames read(size_t firstFrame, size_t numFrames) const;
+    void read(size_t firstFrame, size_t numFrames, Frames& frames) const;
+    // Frames firstFrame onwards; the second form reuses frames' storage
+
+    void readDescriptorRows(size_t first, size_t numRows,
+                            float* descriptors) const;
+    // Rows first onwards of the descriptors table, whatever the frames,
+    // as floats (e.g. for indexing).  Quantised codes aren't floats, so
+    // throws std::runtime_error unless format() is float32.
+
+private:
+
+    H5::H5File file_;
+    H5::DataSet keypoints_, descriptors_;
+
+    std::vector<size_t> frameStarts_, frameCounts_;
+
+    size_t descriptorLength_ = 0;
+    HDFWriter::DescriptorFormat format_ = HDFWriter::Float32;
+    bool halfPrecision_ = false;
+};
+
+
+
+class HDFReader::Stream {
+    // Goes through a reader's frames in blocks, reading the next block on
+    // a background thread while the current one is used
+
+public:
+
+    Stream(const HDFReader& reader, size_t framesPerBlock = 64,
+           size_t firstFrame = 0, size_t endFrame = size_t(-1));
+    // Frames firstFrame up to (not including) endFrame, or the end.  The
+    // reader must outlive the stream.
+
+    Stream(const Stream&) = delete;
+    Stream& operator= (const Stream&) = delete;
+
+    bool next(Frames& frames);
+    // Swaps the next block into frames (and its old storage back for
+    // reuse), or returns false at the end
+
+private:
+    const HDFReader* reader_;
+    size_t framesPerBlock_;
+    size_t nextFrame_, endFrame_;
+
+    std::future<Frames> pending_;
+
+    void prefetch_(Frames buffer);
+};
+
+
+
+#endif
+
@@ -1,10 +1,96 @@
 // Copyright (C) 2013 Timothy Gale
 #include "hdfwriter.h"
+#include "halfFloat.h"
 
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
 
-HDFWriter::HDFWriter(std::string filename, size_t descriptorLength)
+
+const H5::DataType& HDFWriter::descriptorType(DescriptorFormat format)
+{
+    switch (format) {
+        case HDFWriter::Int8:
+            return H5::PredType::NATIVE_INT8;
+        case HDFWriter::Binary:
+            return H5::PredType::NATIVE_UINT8;
+        default:
+            return H5::PredType::NATIVE_FLOAT;
+    }
+}
+
+
+const char* HDFWriter::formatName(DescriptorFormat format)
 {
-    file = H5::H5File(H5std_string(filename.c_str()), H5F_ACC_TRUNC);
+    switch (format) {
+        case HDFWriter::Int8:
+            return "int8";
+        case HDFWriter::Binary:
+            return "binary";
+        default:
+            return "float32";
+    }
+}
+
+
+// Registered ids of the filter plugins
+static const H5Z_filter_t lz4FilterId = 32004, zstdFilterId = 32015;
+
+
+// Add the compression filters storage asks for.  Shuffling the bytes of
+// each element first groups the exponents together, which compress well.
+static void addCompression(H5::DSetCreatPropList& parms,
+                           const HDFWriter::Storage& storage, bool shuffle)
+{
+    if (storage.compression == HDFWriter::Uncompressed)
+        return;
+
+    if (shuffle)
+        parms.setShuffle();
+
+    if (storage.compression == HDFWriter::Deflate) {
+        parms.setDeflate(storage.level);
+        return;
+    }
+
+    const bool zstd = storage.compression == HDFWriter::Zstd;
+    const H5Z_filter_t id = zstd? zstdFilterId : lz4FilterId;
+
+    // Loads the plugin if it can
+    if (H5Zfilter_avail(id) <= 0)
+        throw std::runtime_error(std::string("HDF5 ")
+                                 + (zstd? "Zstd" : "LZ4")
+                                 + " filter plugin not available");
+
+    if (zstd) {
+        const unsigned int level = storage.level;
+        parms.setFilter(id, H5Z_FLAG_MANDATORY, 1, &level);
+    } else
+        parms.setFilter(id, H5Z_FLAG_MANDATORY);
+}
+
+
+HDFWriter::HDFWriter(std::string filename, size_t descriptorLength,
+                     DescriptorFormat format, const Storage& storage)
+ : descriptorLength_(descriptorLength), format_(format),
+   precision_(storage.precision)
+{
+    if (storage.precision != FullPrecision && format != Float32)
+        throw std::logic_error("Reduced precision storage needs float "
+                               "descriptors");
+
+    const size_t chunkRows = storage.chunkRows? storage.chunkRows : 1024;
+
+    // Leave room in the chunk cache for the descriptor chunk being filled
+    // and the next, so writes that straddle them don't go back to the disk
+    const size_t descriptorChunkBytes
+        = chunkRows * descriptorLength * elementSize(format);
+    H5::FileAccPropList accessParms;
+    accessParms.setCache(0, 521, std::max<size_t>(2 * descriptorChunkBytes,
+                                                  1024 * 1024), 0.75);
+
+    file = H5::H5File(H5std_string(filename.c_str()), H5F_ACC_TRUNC,
+                      H5::FileCreatPropList::DEFAULT, accessParms);
 
     // Create the frames dataset (pairs of starting index, number of
     // keypoints/descriptors)
@@ -23,8 +109,10 @@ HDFWriter::HDFWriter(std::string filename, size_t descriptorLength)
 
     // Create the keypoints dataset (x, y, scale, weight)
     H5::DSetCreatPropList keypointsCparms;
+    chunkDims[0] = chunkRows;
     chunkDims[1] = 4;
     keypointsCparms.setChunk(2, chunkDims);
+    addCompression(keypointsCparms, storage, true);
 
     const hsize_t keypointsDims[] = {0, 4};
     const hsize_t keypointsMaxDims[] = {H5S_UNLIMITED, 4};
@@ -40,14 +128,34 @@ HDFWriter::HDFWriter(std::string filename, size_t descriptorLength)
     chunkDims[1] = descriptorLength;
     descriptorsCparms.setChunk(2, chunkDims);
 
+    // The type in the file can differ from that written; HDF5 converts
+    H5::DataType fileType = descriptorType(format);
+
+    if (storage.precision == HalfPrecision)
+        fileType = halfFloatType();
+    else if (storage.precision == Scaled)
+        H5Pset_scaleoffset(descriptorsCparms.getId(), H5Z_SO_FLOAT_DSCALE,
+                           storage.scaleDigits);
+
+    // Shuffling is no help after scale-offset has packed the bits
+    addCompression(descriptorsCparms, storage,
+                   storage.precision != Scaled);
+
     const hsize_t descriptorsDims[] = {0, descriptorLength};
     const hsize_t descriptorsMaxDims[] = {H5S_UNLIMITED, descriptorLength};
     H5::DataSpace descriptorsDataspace(2, descriptorsDims, descriptorsMaxDims);
 
     descriptors = file.createDataSet(H5std_string("descriptors"), 
-                                   H5::PredType::NATIVE_FLOAT,
+                                   fileType,
                                    descriptorsDataspace,
                                    descriptorsCparms);
+
+    const std::string formatName = HDFWriter::formatName(format);
+    H5::StrType formatType(H5::PredType::C_S1, formatName.size());
+    H5::Attribute formatAttr
+        = descriptors.createAttribute("format", formatType,
+                                      H5::DataSpace(H5S_SCALAR));
+    formatAttr.write(formatType, formatName);
                                 
 }
 
@@ -57,6 +165,9 @@ template<typename T>
 void appendRows(H5::DataSet dataset, size_t numRows,
                 const T* data, const H5::DataType& memType)
 {    
+    if (numRows == 0)
+        return;
+
     // Work out where we need to start writing from
     H5::DataSpace dataspace = dataset.getSpace();
     hsize_t existingDims[2];
@@ -84,23 +195,54 @@ void appendRows(H5::DataSet dataset, size_t numRows,
 
 void HDFWriter::append(size_t numKeypoints,
                        const float *keypointsData,
-                       const float *descriptorsData) 
+                       const void *descriptorsData) 
+{
+    appendFrames(1, &numKeypoints, keypointsData, descriptorsData);
+}
+
+
+void HDFWriter::appendFrames(size_t numFrames,
+                             const size_t* keypointCounts,
+                             const float* keypointsData,
+                             const void* descriptorsData)
 {
     // Work out where the first keypoint will be
     hsize_t keypointDims[2];
     H5::DataSpace ds = keypoints.getSpace();
     ds.getSimpleExtentDims(keypointDims);
 
-    hsize_t position[] = {keypointDims[0], numKeypoints};
+    // Lay out the frame rows, each following on from the last
+    std::vector<hsize_t> positions(2 * numFrames);
+    hsize_t numKeypoints = 0;
+    for (size_t n = 0; n < numFrames; ++n) {
+        positions[2*n] = keypointDims[0] + numKeypoints;
+        positions[2*n + 1] = keypointCounts[n];
+        numKeypoints += keypointCounts[n];
+    }
 
-    appendRows(frames, 1, position,
+    appendRows(frames, numFrames, positions.data(),
                H5::PredType::NATIVE_HSIZE);
 
     appendRows(keypoints, numKeypoints, keypointsData, 
                H5::PredType::NATIVE_FLOAT);
 
-    appendRows(descriptors, numKeypoints, descriptorsData, 
-               H5::PredType::NATIVE_FLOAT);
+    if (precision_ == HalfPrecision) {
+        // Write them already converted
+        const float* values = static_cast<const float*>(descriptorsData);
+        std::vector<uint16_t> halves(numKeypoints * descriptorLength_);
+        std::transform(values, values + halves.size(), halves.begin(),
+                       floatToHalf);
+
+        appendRows(descriptors, numKeypoints, halves.data(), halfFloatType());
+    } else
+        appendRows(descriptors, numKeypoints, descriptorsData, 
+                   descriptorType(format_));
+}
+
+
+size_t HDFWriter::elementSize(DescriptorFormat format)
+{
+    return (format == Float32)? sizeof(float) : 1;
 }
 
 
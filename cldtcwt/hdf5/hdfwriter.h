@@ -4,6 +4,7 @@
 
 
 #include <H5Cpp.h>
+#include <string>
 
 class HDFWriter {
     // Class to create and write to an HDF file
@@ -16,24 +17,96 @@ class HDFWriter {
     //      One row per keypoint.  x, y, scale, keypoint strength.
     //   descriptors
     //      One row per descriptor (lines up with the appropriate keypoint).
+    //      Its "format" attribute says what the elements are: float32, or
+    //      int8 or binary for quantised codes (see DescriptorQuantiser),
+    //      stored as signed and unsigned bytes.
     //
+    // Storage can make the keypoints and descriptors tables smaller, with
+    // filters HDF5 undoes on reading: compression, and for float
+    // descriptors, lower precision.  The tables still read back as floats,
+    // so readers need no changes (beyond having any filter plugin used).
+    //
+
+public:
+
+    enum DescriptorFormat { Float32 = 0, Int8 = 1, Binary = 2 };
+
+    enum Compression {
+        Uncompressed = 0,
+        Deflate = 1,    // Built into HDF5
+        LZ4 = 2,        // These two need the HDF5 filter plugins installed
+        Zstd = 3        // (found through HDF5_PLUGIN_PATH), for reading too
+    };
+
+    enum Precision {
+        FullPrecision = 0,
+        HalfPrecision = 1,  // Stored as IEEE half floats
+        Scaled = 2          // Stored as integers, rounded to scaleDigits
+                            // decimal places (HDF5's scale-offset filter)
+    };
+
+    struct Storage {
+        Compression compression;
+        int level;              // For Deflate (1-9) and Zstd (1-22)
+        Precision precision;
+        int scaleDigits;
+
+        size_t chunkRows;
+        // Rows per chunk of the keypoints and descriptors tables; 0 leaves
+        // it to the writer.  A read decompresses whole chunks, so for
+        // reading whole frames make them hold a few frames' worth, and for
+        // looking up single keypoints keep them small (say 64 rows).
+
+        Storage()
+         : compression(Uncompressed), level(4),
+           precision(FullPrecision), scaleDigits(3), chunkRows(0)
+        {}
+    };
+
+private:
 
     H5::H5File file;
 
     H5::DataSet frames, keypoints, descriptors;
 
+    size_t descriptorLength_ = 0;
+    DescriptorFormat format_ = Float32;
+    Precision precision_ = FullPrecision;
+
 
 public:
 
     HDFWriter() = default;
     HDFWriter(const HDFWriter&) = default;
 
-    HDFWriter(std::string filename, size_t descriptorLength);
+    HDFWriter(std::string filename, size_t descriptorLength,
+              DescriptorFormat format = Float32,
+              const Storage& storage = Storage());
+    // descriptorLength is in elements: floats, or bytes for codes.  Unless
+    // storage says otherwise, chunks are 1024 rows; writes are cheapest
+    // when they cover whole chunks, so for appendFrames they are best
+    // about the size of a typical batch.  Reduced precision needs Float32
+    // descriptors, and unavailable filters throw std::runtime_error.
 
     void append(size_t numKeypoints, const float* keypoints,
-                const float* descriptors);
+                const void* descriptors);
     //   Appends adds an extra frame with associated keypoints
 
+    void appendFrames(size_t numFrames, const size_t* keypointCounts,
+                      const float* keypoints, const void* descriptors);
+    //   As append, for numFrames frames at once, with one write to each
+    //   table.  Frame n has keypointCounts[n] keypoints; keypoints and
+    //   descriptors hold all of them, one frame after the other.
+
+    static size_t elementSize(DescriptorFormat format);
+    //   Bytes per descriptor element
+
+    static const H5::DataType& descriptorType(DescriptorFormat format);
+    //   The type of the descriptor elements in memory
+
+    static const char* formatName(DescriptorFormat format);
+    //   As written in the descriptors' format attribute
+
 };
 
 
@@ -0,0 +1,260 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+
+template <typename T>
+class BoundedQueue {
+    // Fixed-capacity queue connecting exactly one producer thread to
+    // exactly one consumer thread, without locks.  A full queue makes
+    // push() wait, which gives backpressure on the producer; an empty one
+    // makes pop() wait.  Time spent waiting on either side is counted so
+    // that the slow stage of a pipeline can be found.
+    //
+    // The producer calls close() when it has nothing more to send; pop()
+    // then returns false once the queue has drained.
+
+public:
+
+    struct Stats {
+        size_t depth;
+        size_t maxDepth;
+        uint64_t numPushed;
+        double pushStallMs;     // Producer time spent waiting for space
+        double popStallMs;      // Consumer time spent waiting for items
+    };
+
+    BoundedQueue(size_t capacity)
+     : slots_(capacity + 1)
+    {
+        if (capacity == 0)
+            throw std::logic_error("BoundedQueue needs a non-zero capacity");
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator= (const BoundedQueue&) = delete;
+
+    bool push(T&& item);
+    // Producer only.  Waits for space, then moves item in.  Returns false
+    // (dropping item) if the queue was cancelled while waiting.
+
+    bool tryPush(T&& item);
+    // Producer only.  As push(), but returns false immediately when full.
+
+    bool pop(T* item);
+    // Consumer only.  Waits for an item.  Returns false when the queue is
+    // closed and empty, or has been cancelled.
+
+    bool tryPop(T* item);
+    // Consumer only.  Returns false immediately if nothing is waiting.
+
+    void close();
+    // Producer only: no more items will follow
+
+    void cancel();
+    // Any thread: wake both sides and make all further operations fail,
+    // e.g. when the pipeline is being torn down early.
+
+    bool isClosed() const;
+    // True once close() has been called and everything has been popped,
+    // or after cancel()
+
+    size_t capacity() const { return slots_.size() - 1; }
+    size_t depth() const;
+
+    Stats stats() const;
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<T> slots_;
+
+    // Producer writes tail_, consumer writes head_.  Keep them on
+    // separate cache lines so the two threads don't fight over one.
+    alignas(64) std::atomic<size_t> head_ {0};
+    alignas(64) std::atomic<size_t> tail_ {0};
+
+    alignas(64) std::atomic<bool> closed_ {false};
+    std::atomic<bool> cancelled_ {false};
+
+    std::atomic<size_t> maxDepth_ {0};
+    std::atomic<uint64_t> numPushed_ {0};
+    std::atomic<int64_t> pushStallNs_ {0}, popStallNs_ {0};
+
+    size_t next(size_t idx) const { return (idx + 1) % slots_.size(); }
+
+    static void backOff(unsigned int& spins);
+    static int64_t nsSince(Clock::time_point start);
+};
+
+
+
+template <typename T>
+void BoundedQueue<T>::backOff(unsigned int& spins)
+{
+    // Spin briefly (the other side is usually quick), then give the
+    // processor up, then sleep so an idle stage doesn't burn a core.
+    ++spins;
+    if (spins < 64)
+        return;
+    else if (spins < 256)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+
+template <typename T>
+int64_t BoundedQueue<T>::nsSince(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+                (Clock::now() - start).count();
+}
+
+
+template <typename T>
+bool BoundedQueue<T>::tryPush(T&& item)
+{
+    if (cancelled_.load(std::memory_order_relaxed))
+        return false;
+
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t newTail = next(tail);
+
+    if (newTail == head_.load(std::memory_order_acquire))
+        return false;       // Full
+
+    slots_[tail] = std::move(item);
+    tail_.store(newTail, std::memory_order_release);
+
+    ++numPushed_;
+
+    // Only the producer raises the maximum, so no need to compare-exchange
+    size_t d = depth();
+    if (d > maxDepth_.load(std::memory_order_relaxed))
+        maxDepth_.store(d, std::memory_order_relaxed);
+
+    return true;
+}
+
+
+template <typename T>
+bool BoundedQueue<T>::push(T&& item)
+{
+    if (tryPush(std::move(item)))
+        return true;
+
+    auto start = Clock::now();
+    unsigned int spins = 0;
+
+    bool pushed;
+    while (!(pushed = tryPush(std::move(item)))
+            && !cancelled_.load(std::memory_order_relaxed))
+        backOff(spins);
+
+    pushStallNs_ += nsSince(start);
+    return pushed;
+}
+
+
+template <typename T>
+bool BoundedQueue<T>::tryPop(T* item)
+{
+    if (cancelled_.load(std::memory_order_relaxed))
+        return false;
+
+    size_t head = head_.load(std::memory_order_relaxed);
+
+    if (head == tail_.load(std::memory_order_acquire))
+        return false;       // Empty
+
+    *item = std::move(slots_[head]);
+    slots_[head] = T();     // Release whatever the slot was holding
+    head_.store(next(head), std::memory_order_release);
+
+    return true;
+}
+
+
+template <typename T>
+bool BoundedQueue<T>::pop(T* item)
+{
+    if (tryPop(item))
+        return true;
+
+    auto start = Clock::now();
+    unsigned int spins = 0;
+
+    bool popped = false;
+    while (!cancelled_.load(std::memory_order_relaxed)) {
+
+        // Check closed before trying, so an item pushed just before
+        // closing isn't missed
+        bool closed = closed_.load(std::memory_order_acquire);
+
+        if ((popped = tryPop(item)) || closed)
+            break;
+
+        backOff(spins);
+    }
+
+    popStallNs_ += nsSince(start);
+    return popped;
+}
+
+
+template <typename T>
+void BoundedQueue<T>::close()
+{
+    closed_.store(true, std::memory_order_release);
+}
+
+
+template <typename T>
+void BoundedQueue<T>::cancel()
+{
+    cancelled_.store(true);
+}
+
+
+template <typename T>
+bool BoundedQueue<T>::isClosed() const
+{
+    return cancelled_.load()
+        || (closed_.load(std::memory_order_acquire) && depth() == 0);
+}
+
+
+template <typename T>
+size_t BoundedQueue<T>::depth() const
+{
+    size_t head = head_.load(std::memory_order_acquire),
+           tail = tail_.load(std::memory_order_acquire);
+
+    return (tail + slots_.size() - head) % slots_.size();
+}
+
+
+template <typename T>
+typename BoundedQueue<T>::Stats BoundedQueue<T>::stats() const
+{
+    Stats s;
+    s.depth = depth();
+    s.maxDepth = maxDepth_.load();
+    s.numPushed = numPushed_.load();
+    s.pushStallMs = pushStallNs_.load() / 1.0e6;
+    s.popStallMs = popStallNs_.load() / 1.0e6;
+    return s;
+}
+
+
+#endif
+
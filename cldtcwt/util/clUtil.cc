@@ -184,3 +184,24 @@ void displayRealImage(cl::CommandQueue& cq, cl::Image2D& image)
 }
 
 
+
+PinnedBuffer::PinnedBuffer(cl::Context& context, cl::CommandQueue& cq,
+                           size_t size)
+ : buffer_(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size),
+   cq_(cq), size_(size)
+{
+    data_ = static_cast<char*>(cq_.enqueueMapBuffer(buffer_, CL_TRUE,
+                                   CL_MAP_READ | CL_MAP_WRITE, 0, size));
+}
+
+
+PinnedBuffer::~PinnedBuffer()
+{
+    try {
+        cq_.enqueueUnmapMemObject(buffer_, data_);
+        cq_.finish();
+    } catch (cl::Error&) {
+        // Nothing useful to do about it here
+    }
+}
+
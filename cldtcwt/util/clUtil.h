@@ -79,6 +79,31 @@ void saveComplexBuffer(std::string filename,
 void displayRealImage(cl::CommandQueue& cq, cl::Image2D& image);
 
 
+class PinnedBuffer {
+    // Host memory the device can copy to and from directly (page-locked on
+    // most implementations), so non-blocking reads and writes through it
+    // don't need a staging copy by the driver.  Allocated with
+    // CL_MEM_ALLOC_HOST_PTR and mapped for as long as it lives; pass data()
+    // as the host pointer to enqueueReadBuffer/enqueueWriteBuffer.
+
+public:
+    PinnedBuffer(cl::Context& context, cl::CommandQueue& cq, size_t size);
+
+    PinnedBuffer(const PinnedBuffer&) = delete;
+    PinnedBuffer& operator= (const PinnedBuffer&) = delete;
+    ~PinnedBuffer();
+
+    char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    cl::Buffer buffer_;
+    cl::CommandQueue cq_;
+    char* data_;
+    size_t size_;
+};
+
+
 class CLContext {
 public:
 
@@ -0,0 +1,102 @@
+// Copyright (C) 2013 Timothy Gale
+#include "fileIO.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+
+#include <unistd.h>
+
+
+void throwErrno(const std::string& what, const std::string& message)
+{
+    throw std::runtime_error(what + ": " + message + ": "
+                             + std::strerror(errno));
+}
+
+
+void writeAll(int fd, const void* data, size_t length, uint64_t offset,
+              const std::string& what)
+{
+    const char* p = static_cast<const char*> (data);
+
+    while (length > 0) {
+        ssize_t written = pwrite(fd, p, length, offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throwErrno(what, "write failed");
+        }
+        p += written;
+        offset += written;
+        length -= written;
+    }
+}
+
+
+bool readAll(int fd, void* data, size_t length, uint64_t offset,
+             const std::string& what)
+{
+    char* p = static_cast<char*> (data);
+
+    while (length > 0) {
+        ssize_t numRead = pread(fd, p, length, offset);
+        if (numRead < 0) {
+            if (errno == EINTR)
+                continue;
+            throwErrno(what, "read failed");
+        }
+        if (numRead == 0)
+            return false;
+        p += numRead;
+        offset += numRead;
+        length -= numRead;
+    }
+
+    return true;
+}
+
+
+void writeAll(int fd, std::vector<iovec> parts, uint64_t offset,
+              const std::string& what)
+{
+    size_t first = 0;
+
+    while (first < parts.size()) {
+        const size_t num = std::min<size_t>(parts.size() - first, IOV_MAX);
+
+        ssize_t written = pwritev(fd, &parts[first], int(num), offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throwErrno(what, "write failed");
+        }
+        offset += written;
+
+        // Step over what went
+        while (first < parts.size()
+            && size_t(written) >= parts[first].iov_len)
+            written -= parts[first++].iov_len;
+        if (first < parts.size()) {
+            parts[first].iov_base
+                = static_cast<char*>(parts[first].iov_base) + written;
+            parts[first].iov_len -= written;
+        }
+    }
+}
+
+
+uint64_t fnv1a(const void* data, size_t length)
+{
+    const unsigned char* p = static_cast<const unsigned char*> (data);
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t n = 0; n < length; ++n) {
+        hash ^= p[n];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
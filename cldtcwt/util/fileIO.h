@@ -0,0 +1,42 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/uio.h>
+
+// Helpers for the flat, append-only files (keypoint and subband streams,
+// and the index): positioned reads and writes that finish what they
+// start, and a cheap checksum for record headers.  Errors come out as
+// std::runtime_error, prefixed with what.
+
+
+void writeAll(int fd, const void* data, size_t length, uint64_t offset,
+              const std::string& what);
+// pwrite the lot, retrying partial writes
+
+void writeAll(int fd, std::vector<iovec> parts, uint64_t offset,
+              const std::string& what);
+// pwritev the lot, in as many calls as it takes
+
+bool readAll(int fd, void* data, size_t length, uint64_t offset,
+             const std::string& what);
+// pread the lot, retrying partial reads; false if the file ends first
+
+uint64_t fnv1a(const void* data, size_t length);
+// 64-bit FNV-1a hash
+
+void throwErrno(const std::string& what, const std::string& message);
+// Throws "what: message: strerror(errno)"
+
+inline uint64_t alignUp(uint64_t n, uint64_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+
+#endif
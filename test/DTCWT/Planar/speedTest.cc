@@ -0,0 +1,212 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "DTCWT/dtcwt.h"
+#include "KeypointDetector/EnergyMaps/EnergyMap/energyMap.h"
+#include "KeypointDescriptor/extractDescriptors.h"
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+// Magnitudes of every coefficient of a level read back to the host, the
+// way a CPU consumer would: from pairs if interleaved, from two runs of
+// floats if planar
+static void hostMagnitudes(const std::vector<Complex<cl_float>>& level,
+                           std::vector<float>& magnitudes)
+{
+    for (size_t n = 0; n < magnitudes.size(); ++n)
+        magnitudes[n] = std::sqrt(level[n].real * level[n].real
+                                + level[n].imag * level[n].imag);
+}
+
+
+static void hostMagnitudes(const std::vector<float>& level,
+                           std::vector<float>& magnitudes)
+{
+    // Real and imaginary slices alternate, each sliceSize long
+    const size_t sliceSize = magnitudes.size() / 6;
+
+    for (size_t s = 0; s < 6; ++s) {
+        const float* re = &level[2 * s * sliceSize];
+        const float* im = re + sliceSize;
+        float* m = &magnitudes[s * sliceSize];
+
+        for (size_t n = 0; n < sliceSize; ++n)
+            m[n] = std::sqrt(re[n] * re[n] + im[n] * im[n]);
+    }
+}
+
+
+template <typename Level>
+static void timeLayout(CLContext& context, cl::CommandQueue& cq,
+                       const char* name,
+                       size_t width, size_t height,
+                       size_t numKeypoints, size_t numIterations)
+{
+    const SubbandFormat layout = SubbandLayout<Level>::format;
+    const int startLevel = 1, numLevels = 3;
+
+    DtcwtTemps env(context.context, width, height, startLevel, numLevels);
+    Dtcwt dtcwt(context.context, context.devices, 0.5f, layout);
+    DtcwtOutput output = env.createOutputs(layout);
+
+    ImageBuffer<cl_float> input(context.context, CL_MEM_READ_WRITE,
+                                width, height, 16, 32);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> value(0.f, 1.f);
+    std::vector<float> image(width * height);
+    for (float& v: image)
+        v = value(rng);
+    input.write(cq, image.data());
+
+    dtcwt(cq, input, env, output);
+    cq.finish();
+
+    const Level& fine = output.template levelAs<Level>(2);
+    const Level& coarse = output.template levelAs<Level>(3);
+
+    // Energy map of level 2
+    EnergyMap energyMap(context.context, context.devices, layout);
+    cl::Image2D map = createImage2D(context.context,
+                                    fine.width(), fine.height());
+
+    energyMap(cq, fine, map);
+    cq.finish();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < numIterations; ++n)
+        energyMap(cq, fine, map);
+    cq.finish();
+    DurationSeconds energyTime = std::chrono::steady_clock::now() - start;
+
+    // Descriptors at random points
+    std::vector<float> locations;
+    std::uniform_real_distribution<float> x(-0.4f * width, 0.4f * width),
+                                          y(-0.4f * height, 0.4f * height);
+    for (size_t n = 0; n < numKeypoints; ++n) {
+        locations.push_back(x(rng));
+        locations.push_back(y(rng));
+    }
+
+    DescriptorExtracter extracter(context.context, context.devices, 2,
+                                  layout);
+    cl::Buffer kpLocations = createBuffer(context.context, cq, locations);
+    std::vector<cl_uint> offsets = {0, cl_uint(numKeypoints)};
+    cl::Buffer kpOffsets = {context.context,
+                            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                            offsets.size() * sizeof(cl_uint), &offsets[0]};
+    cl::Buffer descriptors(context.context, CL_MEM_READ_WRITE,
+                           extracter.getNumFloatsInDescriptor()
+                            * numKeypoints * sizeof(float));
+
+    extracter(cq, fine, 4.f, coarse, 8.f, kpLocations, kpOffsets, 0,
+              numKeypoints, descriptors);
+    cq.finish();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < numIterations; ++n)
+        extracter(cq, fine, 4.f, coarse, 8.f, kpLocations, kpOffsets, 0,
+                  numKeypoints, descriptors);
+    cq.finish();
+    DurationSeconds describeTime = std::chrono::steady_clock::now() - start;
+
+    // Readback of level 1 and magnitudes on the host
+    const Level& first = output.template levelAs<Level>(1);
+    const size_t numCoeffs = first.width() * first.height() * 6;
+    typedef typename SubbandLayout<Level>::Element Element;
+    std::vector<Element> host(first.buffer().template getInfo<CL_MEM_SIZE>()
+                              / sizeof(Element));
+    std::vector<float> magnitudes(numCoeffs);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < numIterations; ++n)
+        cq.enqueueReadBuffer(first.buffer(), CL_TRUE, 0,
+                             host.size() * sizeof(host[0]), &host[0]);
+    DurationSeconds readTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < numIterations; ++n)
+        hostMagnitudes(host, magnitudes);
+    DurationSeconds hostTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << " energy map "
+              << energyTime.count() * 1e3 / numIterations << " ms, "
+              << numKeypoints << " descriptors "
+              << describeTime.count() * 1e3 / numIterations << " ms, "
+              << "level 1 readback "
+              << readTime.count() * 1e3 / numIterations << " ms, "
+              << "host magnitudes "
+              << hostTime.count() * 1e3 / numIterations << " ms"
+              << std::endl;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Times each consumer of the subbands on interleaved and then planar
+    // levels of a 720p transform: the energy map, descriptor extraction,
+    // and reading a level back to work out magnitudes on the host.
+
+    size_t width = 1280, height = 720,
+           numKeypoints = 10000, numIterations = 100;
+
+    // First and second arguments: width and height
+    if (argc > 2) {
+        width = readStr<size_t>(argv[1]);
+        height = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: number of keypoints to describe
+    if (argc > 3)
+        numKeypoints = readStr<size_t>(argv[3]);
+
+    // Fourth argument: number of iterations
+    if (argc > 4)
+        numIterations = readStr<size_t>(argv[4]);
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        timeLayout<Subbands>(context, cq, "Interleaved:",
+                             width, height, numKeypoints, numIterations);
+        timeLayout<PlanarSubbands>(context, cq, "Planar:     ",
+                                   width, height, numKeypoints,
+                                   numIterations);
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
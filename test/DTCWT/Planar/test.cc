@@ -0,0 +1,158 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+#include "DTCWT/dtcwt.h"
+#include "KeypointDetector/EnergyMaps/EnergyMap/energyMap.h"
+#include "KeypointDescriptor/extractDescriptors.h"
+#include "randomTransform.h"
+
+// Transforms a random image into interleaved and planar subbands, and
+// checks that the coefficients read back, the energy map and a set of
+// descriptors all come out the same from either layout.  The arithmetic is
+// the same, so they should match exactly.
+
+
+template <typename Level>
+static std::vector<float> energyMap(cl::Context& context,
+                                    cl::CommandQueue& cq,
+                                    EnergyMap& energyMap,
+                                    const DtcwtOutput& output, int level)
+{
+    const Level& subbands = output.levelAs<Level>(level);
+
+    cl::Image2D map = createImage2D(context, subbands.width(),
+                                    subbands.height());
+    energyMap(cq, subbands, map);
+
+    std::vector<float> values(subbands.width() * subbands.height());
+    readImage2D(cq, values.data(), map);
+    return values;
+}
+
+
+template <typename Level>
+static std::vector<float> describe(cl::Context& context,
+                                   cl::CommandQueue& cq,
+                                   DescriptorExtracter& extracter,
+                                   const DtcwtOutput& output,
+                                   const std::vector<float>& locations)
+{
+    const size_t numKeypoints = locations.size() / 2;
+
+    cl::Buffer kpLocations = createBuffer(context, cq, locations);
+    std::vector<cl_uint> offsets = {0, cl_uint(numKeypoints)};
+    cl::Buffer kpOffsets = {context,
+                            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                            offsets.size() * sizeof(cl_uint), &offsets[0]};
+
+    cl::Buffer descriptors = createBuffer(context, cq,
+        std::vector<float>(extracter.getNumFloatsInDescriptor()
+                           * numKeypoints));
+
+    extracter(cq, output.levelAs<Level>(2), 4.f,
+                  output.levelAs<Level>(3), 8.f,
+                  kpLocations, kpOffsets, 0, numKeypoints,
+                  descriptors);
+
+    return readBuffer<float>(cq, descriptors);
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        RandomTransform random(context.context, cq, 48);
+
+        Dtcwt interleavedDtcwt(context.context, context.devices),
+              planarDtcwt(context.context, context.devices, 1.f,
+                          SubbandsPlanar);
+
+        DtcwtOutput interleaved = random.env.createOutputs(),
+                    planar = random.env.createOutputs(SubbandsPlanar);
+
+        interleavedDtcwt(cq, random.input, random.env, interleaved);
+        planarDtcwt(cq, random.input, random.env, planar);
+        cq.finish();
+
+        for (int l = random.startLevel;
+                 l < random.startLevel + random.numLevels; ++l)
+            if (!equal(readLevel(cq, interleaved.level(l)),
+                       readLevel(cq, planar.planar(l)))) {
+                std::cerr << "Level " << l << " differs when planar"
+                          << std::endl;
+                failed = true;
+            }
+
+        // Energy map of the second level
+        EnergyMap interleavedMap(context.context, context.devices),
+                  planarMap(context.context, context.devices,
+                            SubbandsPlanar);
+
+        if (energyMap<Subbands>(context.context, cq, interleavedMap,
+                                interleaved, 2)
+         != energyMap<PlanarSubbands>(context.context, cq, planarMap,
+                                      planar, 2)) {
+            std::cerr << "Energy maps differ" << std::endl;
+            failed = true;
+        }
+
+        // Descriptors from the second and third levels, at points near
+        // the middle and close to the edges
+        std::vector<float> locations;
+        std::uniform_real_distribution<float> x(-0.5f * random.width,
+                                                0.5f * random.width),
+                                              y(-0.5f * random.height,
+                                                0.5f * random.height);
+        for (int n = 0; n < 50; ++n) {
+            locations.push_back(x(random.rng));
+            locations.push_back(y(random.rng));
+        }
+
+        DescriptorExtracter interleavedExtracter(context.context,
+                                                 context.devices, 2),
+                            planarExtracter(context.context,
+                                            context.devices, 2,
+                                            SubbandsPlanar);
+
+        if (describe<Subbands>(context.context, cq, interleavedExtracter,
+                               interleaved, locations)
+         != describe<PlanarSubbands>(context.context, cq, planarExtracter,
+                                     planar, locations)) {
+            std::cerr << "Descriptors differ" << std::endl;
+            failed = true;
+        }
+
+        // Levels in the wrong layout should be refused
+        cl::Image2D unused = createImage2D(context.context, 8, 8);
+        try {
+            planarMap(cq, interleaved.level(2), unused);
+            std::cerr << "Mismatched layout accepted" << std::endl;
+            failed = true;
+        } catch (std::logic_error&) {
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
@@ -0,0 +1,138 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "DTCWT/dtcwt.h"
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Times a 720p DTCWT producing each of the subband formats, on its own
+    // and then with every level read back, and reports how much memory the
+    // levels take.
+
+    size_t width = 1280, height = 720, numIterations = 100;
+
+    // First and second arguments: width and height
+    if (argc > 2) {
+        width = readStr<size_t>(argv[1]);
+        height = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: number of iterations
+    if (argc > 3)
+        numIterations = readStr<size_t>(argv[3]);
+
+    const int startLevel = 1, numLevels = 4;
+
+    const SubbandFormat formats[] = {
+        SubbandsComplex, SubbandsMagnitude, SubbandsPolar
+    };
+    const char* names[] = {"Complex:  ", "Magnitude:", "Polar:    "};
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        DtcwtTemps env(context.context, width, height,
+                       startLevel, numLevels);
+
+        ImageBuffer<cl_float> input(context.context, CL_MEM_READ_WRITE,
+                                    width, height, 16, 32);
+
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<float> value(0.f, 1.f);
+        std::vector<float> image(width * height);
+        for (float& v: image)
+            v = value(rng);
+        input.write(cq, image.data());
+
+        for (int f = 0; f < 3; ++f) {
+
+            Dtcwt dtcwt(context.context, context.devices, 0.5f, formats[f]);
+            DtcwtOutput output = env.createOutputs(formats[f]);
+
+            // Where every level lives, whatever the format
+            std::vector<cl::Buffer> buffers;
+            std::vector<std::vector<char>> host;
+            size_t bytes = 0;
+            for (int l = startLevel; l < startLevel + numLevels; ++l) {
+                switch (formats[f]) {
+                case SubbandsComplex:
+                    buffers.push_back(output.level(l).buffer());
+                    break;
+                case SubbandsMagnitude:
+                    buffers.push_back(output.magnitudes(l).buffer());
+                    break;
+                case SubbandsPolar:
+                    buffers.push_back(output.polar(l).buffer());
+                    break;
+                }
+                host.emplace_back(buffers.back().getInfo<CL_MEM_SIZE>());
+                bytes += host.back().size();
+            }
+
+            // Warm up
+            dtcwt(cq, input, env, output);
+            cq.finish();
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t n = 0; n < numIterations; ++n)
+                dtcwt(cq, input, env, output);
+            cq.finish();
+            DurationSeconds transformTime
+                = std::chrono::steady_clock::now() - start;
+
+            start = std::chrono::steady_clock::now();
+            for (size_t n = 0; n < numIterations; ++n) {
+                dtcwt(cq, input, env, output);
+                for (size_t l = 0; l < buffers.size(); ++l)
+                    cq.enqueueReadBuffer(buffers[l], CL_FALSE, 0,
+                                         host[l].size(), &host[l][0]);
+                cq.finish();
+            }
+            DurationSeconds readTime
+                = std::chrono::steady_clock::now() - start;
+
+            std::cout << std::fixed << std::setprecision(3)
+                      << names[f] << " " << bytes / 1e6 << " MB, "
+                      << transformTime.count() * 1e3 / numIterations
+                      << " ms per transform, "
+                      << readTime.count() * 1e3 / numIterations
+                      << " ms with readback" << std::endl;
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,139 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+#include "DTCWT/dtcwt.h"
+#include "randomTransform.h"
+
+// Transforms a random image three times, once for each subband format, and
+// checks the magnitudes and packed magnitudes and phases against those
+// worked out on the host from the complex coefficients.  Level one comes
+// from QuadToComplex, the rest from TripleQuadToComplexDecimateFilterY.
+// Then checks formats can't be mixed up.
+
+
+static bool closeMagnitude(float value, float expected, float tolerance)
+{
+    return std::abs(value - expected) <= tolerance * expected + 1e-7f;
+}
+
+
+static bool closePhase(float value, float expected)
+{
+    // Within half a step, either way round
+    float d = std::abs(value - expected);
+    d = std::min<float>(d, 2 * M_PI - d);
+    return d <= M_PI / polarPhaseSteps + 1e-4f;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        RandomTransform random(context.context, cq, 47);
+
+        // The same transform in each format
+        Dtcwt complexDtcwt(context.context, context.devices),
+              magnitudeDtcwt(context.context, context.devices, 1.f,
+                             SubbandsMagnitude),
+              polarDtcwt(context.context, context.devices, 1.f,
+                         SubbandsPolar);
+
+        DtcwtOutput complexOut = random.env.createOutputs(),
+                    magnitudeOut = random.env.createOutputs(SubbandsMagnitude),
+                    polarOut = random.env.createOutputs(SubbandsPolar);
+
+        complexDtcwt(cq, random.input, random.env, complexOut);
+        magnitudeDtcwt(cq, random.input, random.env, magnitudeOut);
+        polarDtcwt(cq, random.input, random.env, polarOut);
+        cq.finish();
+
+        for (int l = random.startLevel;
+                 l < random.startLevel + random.numLevels; ++l) {
+
+            const auto z = readLevel(cq, complexOut.level(l));
+            const auto magnitudes = readSlices(cq,
+                                               magnitudeOut.magnitudes(l));
+            const auto polar = readSlices(cq, polarOut.polar(l));
+
+            size_t magnitudeErrors = 0, polarErrors = 0;
+
+            for (size_t n = 0; n < z.size(); ++n) {
+                const float expected = std::hypot(z[n].real, z[n].imag);
+
+                magnitudeErrors
+                    += !closeMagnitude(magnitudes[n], expected, 1e-5f);
+
+                // Phases of tiny coefficients are too sensitive to rounding
+                // to pin down
+                polarErrors
+                    += !closeMagnitude(polarMagnitude(polar[n]), expected,
+                                       1e-5f + 1.f / (1 << 15))
+                    || (expected > 1e-4f
+                     && !closePhase(polarPhase(polar[n]),
+                                    std::atan2(z[n].imag, z[n].real)));
+            }
+
+            if (magnitudeErrors) {
+                std::cerr << "Level " << l << ": " << magnitudeErrors
+                          << " magnitudes wrong" << std::endl;
+                failed = true;
+            }
+
+            if (polarErrors) {
+                std::cerr << "Level " << l << ": " << polarErrors
+                          << " polar coefficients wrong" << std::endl;
+                failed = true;
+            }
+        }
+
+        // Outputs of the wrong format should be refused, as should levels
+        // asked for in a format the output doesn't have
+        try {
+            magnitudeDtcwt(cq, random.input, random.env, polarOut);
+            std::cerr << "Mismatched output format accepted" << std::endl;
+            failed = true;
+        } catch (std::logic_error&) {
+        }
+
+        try {
+            polarOut.level(random.startLevel);
+            std::cerr << "Complex level of a polar output given"
+                      << std::endl;
+            failed = true;
+        } catch (std::logic_error&) {
+        }
+
+        try {
+            complexOut.polar(random.startLevel);
+            std::cerr << "Polar level of a complex output given"
+                      << std::endl;
+            failed = true;
+        } catch (std::logic_error&) {
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
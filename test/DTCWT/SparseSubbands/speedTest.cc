@@ -0,0 +1,148 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "DTCWT/dtcwt.h"
+#include "DTCWT/SparseSubbands/sparseSubbands.h"
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Compare reading back every level of a 720p DTCWT in full against
+    // compacting the significant coefficients and reading back only those.
+    // The image is made of overlapping flat rectangles, so like a natural
+    // image most coefficients are small, away from edges.
+
+    size_t width = 1280, height = 720, numIterations = 100;
+    float threshold = 0.1f;
+
+    // First and second arguments: width and height
+    if (argc > 2) {
+        width = readStr<size_t>(argv[1]);
+        height = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: magnitude threshold, the same for every level
+    if (argc > 3)
+        threshold = readStr<float>(argv[3]);
+
+    // Fourth argument: number of iterations
+    if (argc > 4)
+        numIterations = readStr<size_t>(argv[4]);
+
+    const int startLevel = 1, numLevels = 4;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        Dtcwt dtcwt(context.context, context.devices, 0.5f);
+        DtcwtTemps env(context.context, width, height,
+                       startLevel, numLevels);
+        DtcwtOutput output = env.createOutputs();
+
+        ImageBuffer<cl_float> input(context.context, CL_MEM_READ_WRITE,
+                                    width, height, 16, 32);
+
+        std::mt19937 rng(0);
+        std::uniform_int_distribution<size_t> x(0, width - 1),
+                                              y(0, height - 1);
+        std::uniform_real_distribution<float> value(0.f, 1.f);
+
+        std::vector<float> image(width * height, 0.5f);
+        for (int r = 0; r < 40; ++r) {
+            size_t x0 = x(rng), x1 = x(rng), y0 = y(rng), y1 = y(rng);
+            const float v = value(rng);
+            for (size_t j = std::min(y0, y1); j < std::max(y0, y1); ++j)
+                std::fill(&image[j * width + std::min(x0, x1)],
+                          &image[j * width + std::max(x0, x1)], v);
+        }
+
+        input.write(cq, image.data());
+        dtcwt(cq, input, env, output);
+        cq.finish();
+
+        SparseSubbands sparseSubbands(context.context, context.devices);
+
+        // Room for every coefficient, so nothing is dropped
+        const size_t capacity = output[0].width() * output[0].height() * 6;
+        SparseSubbandsOutput sparse
+            = sparseSubbands.createOutputs(output, capacity);
+        const std::vector<float> thresholds(numLevels, threshold);
+
+        std::vector<std::vector<char>> dense;
+        size_t denseBytes = 0;
+        for (const Subbands& level: output) {
+            dense.emplace_back(level.buffer().getInfo<CL_MEM_SIZE>());
+            denseBytes += dense.back().size();
+        }
+
+        // Full readback
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < numIterations; ++n) {
+            for (size_t l = 0; l < dense.size(); ++l)
+                cq.enqueueReadBuffer(output[l].buffer(), CL_FALSE, 0,
+                                     dense[l].size(), &dense[l][0]);
+            cq.finish();
+        }
+        DurationSeconds denseTime = std::chrono::steady_clock::now() - start;
+
+        // Compaction and sparse readback
+        std::vector<std::vector<SparseCoefficient>> lists;
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < numIterations; ++n) {
+            sparseSubbands(cq, output, thresholds, sparse);
+            sparse.read(cq, lists);
+        }
+        DurationSeconds sparseTime = std::chrono::steady_clock::now() - start;
+
+        size_t sparseBytes = 0;
+        for (const auto& list: lists)
+            sparseBytes += list.size() * sizeof(SparseCoefficient);
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "Full readback:   " << denseBytes / 1e6 << " MB, "
+                  << denseTime.count() * 1e3 / numIterations << " ms"
+                  << std::endl
+                  << "Sparse readback: " << sparseBytes / 1e6 << " MB, "
+                  << sparseTime.count() * 1e3 / numIterations
+                  << " ms including compaction" << std::endl
+                  << "Volume cut " << double(denseBytes)
+                                       / std::max<size_t>(sparseBytes, 1)
+                  << "x" << std::endl;
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,148 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+#include "DTCWT/dtcwt.h"
+#include "DTCWT/SparseSubbands/sparseSubbands.h"
+#include "randomTransform.h"
+
+// Transforms a random image, compacts its significant coefficients and
+// checks them against thresholding the read-back subbands on the host: the
+// same coefficients, with the same values, in the same order.  The device
+// may square magnitudes a little differently, so coefficients right at the
+// threshold can go either way.  Then again with lists too short to hold
+// everything, which should keep the first ones and still count them all,
+// and checks subbands in another format are refused.
+
+
+static float magnitudeSq(const Complex<cl_float>& v)
+{
+    return v.real * v.real + v.imag * v.imag;
+}
+
+
+static bool check(const Coefficients& level,
+                  size_t sliceSize, float threshold, size_t capacity,
+                  cl_uint total,
+                  const std::vector<SparseCoefficient>& list)
+{
+    const float lowSq = threshold * threshold * (1.f - 1e-5f),
+                highSq = threshold * threshold * (1.f + 1e-5f);
+
+    size_t minTotal = 0, maxTotal = 0;
+    for (const Complex<cl_float>& v: level) {
+        minTotal += magnitudeSq(v) > highSq;
+        maxTotal += magnitudeSq(v) > lowSq;
+    }
+
+    if (total < minTotal || total > maxTotal
+     || list.size() != std::min<size_t>(total, capacity))
+        return false;
+
+    // Step through the level alongside the list
+    size_t n = 0;
+    for (size_t i = 0; i < level.size() && n < list.size(); ++i) {
+        const float m = magnitudeSq(level[i]);
+
+        const bool listed = list[n].orientation == i / sliceSize
+                         && list[n].index == i % sliceSize;
+
+        if (listed) {
+            if (m <= lowSq
+             || list[n].value.real != level[i].real
+             || list[n].value.imag != level[i].imag)
+                return false;
+            ++n;
+        } else if (m > highSq)
+            return false;
+    }
+
+    return n == list.size();
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        RandomTransform random(context.context, cq, 46);
+
+        Dtcwt dtcwt(context.context, context.devices);
+        DtcwtOutput output = random.env.createOutputs();
+
+        dtcwt(cq, random.input, random.env, output);
+        cq.finish();
+
+        const std::vector<Coefficients> levels = readLevels(cq, output);
+
+        // Thresholds that keep roughly the top tenth of each level
+        std::vector<float> thresholds;
+        for (const auto& level: levels) {
+            std::vector<float> mags;
+            for (const Complex<cl_float>& v: level)
+                mags.push_back(std::sqrt(magnitudeSq(v)));
+
+            auto cut = mags.begin() + mags.size() * 9 / 10;
+            std::nth_element(mags.begin(), cut, mags.end());
+            thresholds.push_back(*cut);
+        }
+
+        SparseSubbands sparseSubbands(context.context, context.devices);
+
+        for (size_t capacity: {random.width * random.height * 6,
+                               size_t(100)}) {
+
+            SparseSubbandsOutput sparse
+                = sparseSubbands.createOutputs(output, capacity);
+
+            sparseSubbands(cq, output, thresholds, sparse);
+
+            std::vector<std::vector<SparseCoefficient>> lists;
+            sparse.read(cq, lists);
+            const std::vector<cl_uint> totals = sparse.totals(cq);
+
+            for (int l = 0; l < random.numLevels; ++l)
+                if (!check(levels[l], output[l].width() * output[l].height(),
+                           thresholds[l], capacity, totals[l], lists[l])) {
+                    std::cerr << "Level " << random.startLevel + l
+                              << " wrong with capacity " << capacity
+                              << " (" << totals[l] << " coefficients)"
+                              << std::endl;
+                    failed = true;
+                }
+        }
+
+        // Only complex subbands can be compacted
+        try {
+            sparseSubbands.createOutputs(
+                random.env.createOutputs(SubbandsMagnitude), 100);
+            std::cerr << "Magnitude subbands accepted" << std::endl;
+            failed = true;
+        } catch (std::logic_error&) {
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
@@ -0,0 +1,181 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "DTCWT/dtcwt.h"
+#include "KeypointDetector/EnergyMaps/InterpMap/interpMap.h"
+#include "KeypointDetector/EnergyMaps/InterpPhaseMap/interpPhaseMap.h"
+#include "KeypointDescriptor/extractDescriptors.h"
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+template <typename Map, typename Level>
+static double timeMap(CLContext& context, cl::CommandQueue& cq,
+                      const Level& level, size_t numIterations)
+{
+    // Milliseconds per map of level
+    Map map(context.context, context.devices,
+            SubbandLayout<Level>::format);
+    cl::Image2D output = createImage2D(context.context,
+                                       level.width(), level.height());
+
+    map(cq, level, output);
+    cq.finish();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < numIterations; ++n)
+        map(cq, level, output);
+    cq.finish();
+    DurationSeconds time = std::chrono::steady_clock::now() - start;
+
+    return time.count() * 1e3 / numIterations;
+}
+
+
+template <typename Level>
+static void timeLayout(CLContext& context, cl::CommandQueue& cq,
+                       const char* name,
+                       size_t width, size_t height,
+                       size_t maxNumKeypoints, size_t numIterations)
+{
+    const SubbandFormat layout = SubbandLayout<Level>::format;
+    const int startLevel = 1, numLevels = 3;
+
+    DtcwtTemps env(context.context, width, height, startLevel, numLevels);
+    Dtcwt dtcwt(context.context, context.devices, 0.5f, layout);
+    DtcwtOutput output = env.createOutputs(layout);
+
+    ImageBuffer<cl_float> input(context.context, CL_MEM_READ_WRITE,
+                                width, height, 16, 32);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> value(0.f, 1.f);
+    std::vector<float> image(width * height);
+    for (float& v: image)
+        v = value(rng);
+    input.write(cq, image.data());
+
+    dtcwt(cq, input, env, output);
+    cq.finish();
+
+    const Level& fine = output.template levelAs<Level>(2);
+    const Level& coarse = output.template levelAs<Level>(3);
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << " interpolation map "
+              << timeMap<InterpMapEigen>(context, cq, fine, numIterations)
+              << " ms, phase map "
+              << timeMap<InterpPhaseMap>(context, cq, fine, numIterations)
+              << " ms" << std::endl;
+
+    // Descriptors at random points, at ten times as many keypoints each
+    // time up to maxNumKeypoints
+    std::vector<float> locations;
+    std::uniform_real_distribution<float> x(-0.5f * width, 0.5f * width),
+                                          y(-0.5f * height, 0.5f * height);
+    for (size_t n = 0; n < maxNumKeypoints; ++n) {
+        locations.push_back(x(rng));
+        locations.push_back(y(rng));
+    }
+
+    DescriptorExtracter extracter(context.context, context.devices, 2,
+                                  layout);
+    cl::Buffer kpLocations = createBuffer(context.context, cq, locations);
+    cl::Buffer descriptors(context.context, CL_MEM_READ_WRITE,
+                           extracter.getNumFloatsInDescriptor()
+                            * maxNumKeypoints * sizeof(float));
+
+    for (size_t numKeypoints = 1000; numKeypoints <= maxNumKeypoints;
+         numKeypoints *= 10) {
+
+        std::vector<cl_uint> offsets = {0, cl_uint(numKeypoints)};
+        cl::Buffer kpOffsets = {context.context,
+                                CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                offsets.size() * sizeof(cl_uint),
+                                &offsets[0]};
+
+        extracter(cq, fine, 4.f, coarse, 8.f, kpLocations, kpOffsets, 0,
+                  numKeypoints, descriptors);
+        cq.finish();
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < numIterations; ++n)
+            extracter(cq, fine, 4.f, coarse, 8.f, kpLocations, kpOffsets, 0,
+                      numKeypoints, descriptors);
+        cq.finish();
+        DurationSeconds time = std::chrono::steady_clock::now() - start;
+
+        std::cout << name << " " << std::setw(7) << numKeypoints
+                  << " descriptors " << time.count() * 1e3 / numIterations
+                  << " ms, " << std::setprecision(2)
+                  << numKeypoints * numIterations / time.count() * 1e-6
+                  << " million/s" << std::setprecision(3) << std::endl;
+    }
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Times the interpolating consumers on row-major and then tiled levels
+    // of a 720p transform: both interpolation maps, and descriptor
+    // extraction at up to 100,000 keypoints scattered over the image.
+
+    size_t width = 1280, height = 720,
+           maxNumKeypoints = 100000, numIterations = 20;
+
+    // First and second arguments: width and height
+    if (argc > 2) {
+        width = readStr<size_t>(argv[1]);
+        height = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: most keypoints to describe
+    if (argc > 3)
+        maxNumKeypoints = readStr<size_t>(argv[3]);
+
+    // Fourth argument: number of iterations
+    if (argc > 4)
+        numIterations = readStr<size_t>(argv[4]);
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        timeLayout<Subbands>(context, cq, "Row-major:",
+                             width, height, maxNumKeypoints, numIterations);
+        timeLayout<TiledSubbands>(context, cq, "Tiled:    ",
+                                  width, height, maxNumKeypoints,
+                                  numIterations);
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
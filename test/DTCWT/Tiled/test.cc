@@ -0,0 +1,186 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+#include "DTCWT/dtcwt.h"
+#include "KeypointDetector/EnergyMaps/EnergyMap/energyMap.h"
+#include "KeypointDetector/EnergyMaps/InterpMap/interpMap.h"
+#include "KeypointDetector/EnergyMaps/InterpPhaseMap/interpPhaseMap.h"
+#include "KeypointDescriptor/extractDescriptors.h"
+#include "randomTransform.h"
+
+// Transforms a random image into row-major and tiled subbands, and checks
+// that the coefficients read back, the energy and interpolation maps and a
+// set of descriptors all come out the same from either layout.  Only the
+// order in memory differs, so they should match exactly.  The level sizes
+// are not multiples of the tile size, so the partial tiles at the edges
+// get tried too.
+
+
+template <typename Level, typename Map>
+static std::vector<float> energyMap(cl::Context& context,
+                                    cl::CommandQueue& cq,
+                                    Map& energyMap,
+                                    const DtcwtOutput& output, int level)
+{
+    const Level& subbands = output.levelAs<Level>(level);
+
+    cl::Image2D map = createImage2D(context, subbands.width(),
+                                    subbands.height());
+    energyMap(cq, subbands, map);
+
+    std::vector<float> values(subbands.width() * subbands.height());
+    readImage2D(cq, values.data(), map);
+    return values;
+}
+
+
+template <typename Level>
+static std::vector<float> describe(cl::Context& context,
+                                   cl::CommandQueue& cq,
+                                   DescriptorExtracter& extracter,
+                                   const DtcwtOutput& output,
+                                   const std::vector<float>& locations)
+{
+    const size_t numKeypoints = locations.size() / 2;
+
+    cl::Buffer kpLocations = createBuffer(context, cq, locations);
+    std::vector<cl_uint> offsets = {0, cl_uint(numKeypoints)};
+    cl::Buffer kpOffsets = {context,
+                            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                            offsets.size() * sizeof(cl_uint), &offsets[0]};
+
+    cl::Buffer descriptors = createBuffer(context, cq,
+        std::vector<float>(extracter.getNumFloatsInDescriptor()
+                           * numKeypoints));
+
+    extracter(cq, output.levelAs<Level>(2), 4.f,
+                  output.levelAs<Level>(3), 8.f,
+                  kpLocations, kpOffsets, 0, numKeypoints,
+                  descriptors);
+
+    return readBuffer<float>(cq, descriptors);
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        RandomTransform random(context.context, cq, 49);
+
+        Dtcwt rowMajorDtcwt(context.context, context.devices),
+              tiledDtcwt(context.context, context.devices, 1.f,
+                         SubbandsTiled);
+
+        DtcwtOutput rowMajor = random.env.createOutputs(),
+                    tiled = random.env.createOutputs(SubbandsTiled);
+
+        rowMajorDtcwt(cq, random.input, random.env, rowMajor);
+        tiledDtcwt(cq, random.input, random.env, tiled);
+        cq.finish();
+
+        for (int l = random.startLevel;
+                 l < random.startLevel + random.numLevels; ++l)
+            if (!equal(readLevel(cq, rowMajor.level(l)),
+                       readLevel(cq, tiled.tiled(l)))) {
+                std::cerr << "Level " << l << " differs when tiled"
+                          << std::endl;
+                failed = true;
+            }
+
+        // Maps of the second level
+        EnergyMap rowMajorMap(context.context, context.devices),
+                  tiledMap(context.context, context.devices,
+                           SubbandsTiled);
+
+        if (energyMap<Subbands>(context.context, cq, rowMajorMap,
+                                rowMajor, 2)
+         != energyMap<TiledSubbands>(context.context, cq, tiledMap,
+                                     tiled, 2)) {
+            std::cerr << "Energy maps differ" << std::endl;
+            failed = true;
+        }
+
+        InterpMapEigen rowMajorEigen(context.context, context.devices),
+                       tiledEigen(context.context, context.devices,
+                                  SubbandsTiled);
+
+        if (energyMap<Subbands>(context.context, cq, rowMajorEigen,
+                                rowMajor, 2)
+         != energyMap<TiledSubbands>(context.context, cq, tiledEigen,
+                                     tiled, 2)) {
+            std::cerr << "Interpolation maps differ" << std::endl;
+            failed = true;
+        }
+
+        InterpPhaseMap rowMajorPhase(context.context, context.devices),
+                       tiledPhase(context.context, context.devices,
+                                  SubbandsTiled);
+
+        if (energyMap<Subbands>(context.context, cq, rowMajorPhase,
+                                rowMajor, 2)
+         != energyMap<TiledSubbands>(context.context, cq, tiledPhase,
+                                     tiled, 2)) {
+            std::cerr << "Phase interpolation maps differ" << std::endl;
+            failed = true;
+        }
+
+        // Descriptors from the second and third levels, at points near
+        // the middle and close to the edges
+        std::vector<float> locations;
+        std::uniform_real_distribution<float> x(-0.5f * random.width,
+                                                0.5f * random.width),
+                                              y(-0.5f * random.height,
+                                                0.5f * random.height);
+        for (int n = 0; n < 50; ++n) {
+            locations.push_back(x(random.rng));
+            locations.push_back(y(random.rng));
+        }
+
+        DescriptorExtracter rowMajorExtracter(context.context,
+                                              context.devices, 2),
+                            tiledExtracter(context.context,
+                                           context.devices, 2,
+                                           SubbandsTiled);
+
+        if (describe<Subbands>(context.context, cq, rowMajorExtracter,
+                               rowMajor, locations)
+         != describe<TiledSubbands>(context.context, cq, tiledExtracter,
+                                    tiled, locations)) {
+            std::cerr << "Descriptors differ" << std::endl;
+            failed = true;
+        }
+
+        // Levels in the wrong layout should be refused
+        cl::Image2D unused = createImage2D(context.context, 8, 8);
+        try {
+            tiledEigen(cq, rowMajor.level(2), unused);
+            std::cerr << "Mismatched layout accepted" << std::endl;
+            failed = true;
+        } catch (std::logic_error&) {
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
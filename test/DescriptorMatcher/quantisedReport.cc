@@ -0,0 +1,148 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "DescriptorMatcher/descriptorMatcher.h"
+#include "DescriptorMatcher/quantisedMatcher.h"
+#include "KeypointDescriptor/Quantise/descriptorQuantiser.h"
+
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Report how matching accuracy falls off with descriptor size: the
+    // fraction of noisy queries whose nearest neighbour (among their
+    // originals and distractors) is their original, for float descriptors
+    // and both quantised formats, at several noise levels.
+
+    size_t numQuery = 1000, numTrain = 10000;
+
+    // First and second arguments: queries, and train descriptors (at least
+    // as many)
+    if (argc > 2) {
+        numQuery = readStr<size_t>(argv[1]);
+        numTrain = std::max(readStr<size_t>(argv[2]), numQuery);
+    }
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        DescriptorMatcher matcher(context.context, context.devices);
+        QuantisedMatcher quantisedMatcher(context.context, context.devices);
+        DescriptorQuantiser quantiser(context.context, context.devices,
+                                      descriptorLength);
+
+        std::mt19937 rng(0);
+        std::normal_distribution<float> value(0.f, 1.f);
+
+        std::vector<float> trainV(numTrain * descriptorLength);
+        for (float& v: trainV)
+            v = value(rng);
+        cl::Buffer train = createBuffer(context.context, cq, trainV);
+
+        std::vector<cl_uint> countsV = {cl_uint(numQuery),
+                                        cl_uint(numTrain)};
+        cl::Buffer counts(context.context, CL_MEM_READ_WRITE,
+                          countsV.size() * sizeof(cl_uint));
+        writeBuffer(cq, counts, countsV);
+
+        const DescriptorQuantiser::Format formats[]
+            = {DescriptorQuantiser::Int8, DescriptorQuantiser::Binary};
+
+        std::vector<cl::Buffer> trainCodes;
+        for (auto format: formats) {
+            trainCodes.emplace_back(context.context, CL_MEM_READ_WRITE,
+                                    numTrain * quantiser.codeBytes(format));
+            quantiser(cq, format, train, counts, 1, numTrain,
+                      trainCodes.back());
+        }
+
+        std::cout << "Format  Bytes  Reduction  Recall at noise sigma"
+                  << std::endl;
+
+        const float noiseLevels[] = {0.25f, 0.5f, 0.75f, 1.f};
+
+        std::vector<std::vector<double>> recalls(3);
+
+        for (float sigma: noiseLevels) {
+
+            // Noisy copies of the first numQuery train descriptors
+            std::normal_distribution<float> noise(0.f, sigma);
+            std::vector<float> queryV(trainV.begin(),
+                                      trainV.begin()
+                                        + numQuery * descriptorLength);
+            for (float& v: queryV)
+                v += noise(rng);
+            cl::Buffer query = createBuffer(context.context, cq, queryV);
+
+            auto recall = [&] (const KnnMatches& matches) {
+                size_t numRight = 0;
+                for (size_t q = 0; q < numQuery; ++q)
+                    if (matches.indices[q] == int(q))
+                        ++numRight;
+                return double(numRight) / numQuery;
+            };
+
+            recalls[0].push_back(recall(matcher(cq, query, numQuery,
+                                                train, numTrain,
+                                                MatchSettings {1, 0})));
+
+            for (size_t f = 0; f < 2; ++f) {
+                cl::Buffer queryCodes(context.context, CL_MEM_READ_WRITE,
+                                      numQuery
+                                        * quantiser.codeBytes(formats[f]));
+                quantiser(cq, formats[f], query, counts, 0, numQuery,
+                          queryCodes);
+
+                recalls[f + 1].push_back(recall(
+                    quantisedMatcher(cq, formats[f], queryCodes, numQuery,
+                                     trainCodes[f], numTrain, 1)));
+            }
+        }
+
+        const char* names[] = {"float", "int8", "binary"};
+        const size_t bytes[] = {descriptorLength * sizeof(float),
+                                quantiser.codeBytes(formats[0]),
+                                quantiser.codeBytes(formats[1])};
+
+        for (size_t f = 0; f < 3; ++f) {
+            std::cout << std::setw(6) << names[f]
+                      << std::setw(7) << bytes[f]
+                      << std::setw(10) << std::setprecision(3)
+                      << double(bytes[0]) / bytes[f] << "x ";
+            for (size_t n = 0; n < recalls[f].size(); ++n)
+                std::cout << " " << noiseLevels[n] << ": "
+                          << recalls[f][n];
+            std::cout << std::endl;
+        }
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,140 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "KeypointDescriptor/Quantise/descriptorQuantiser.h"
+#include "DescriptorMatcher/quantisedMatcher.h"
+
+// Quantises random descriptors on the device, with the count coming from a
+// device buffer and more room than descriptors, and checks the codes
+// against the host's.  Then matches noisy copies against the originals in
+// both formats, checking the distances against the host's and that each
+// finds its original.
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        DescriptorQuantiser quantiser(context.context, context.devices,
+                                      descriptorLength);
+        QuantisedMatcher matcher(context.context, context.devices);
+
+        const size_t num = 150, capacity = 200;
+
+        std::mt19937 rng(40);
+        std::normal_distribution<float> value(0.f, 1.f), noise(0.f, 0.1f);
+
+        std::vector<float> trainV(capacity * descriptorLength),
+                           queryV(capacity * descriptorLength);
+        for (size_t n = 0; n < num * descriptorLength; ++n) {
+            trainV[n] = value(rng);
+            queryV[n] = trainV[n] + noise(rng);
+        }
+
+        cl::Buffer train = createBuffer(context.context, cq, trainV),
+                   query = createBuffer(context.context, cq, queryV);
+
+        // The count is the second of these
+        std::vector<cl_uint> countsV = {0, num};
+        cl::Buffer counts(context.context, CL_MEM_READ_WRITE,
+                          countsV.size() * sizeof(cl_uint));
+        writeBuffer(cq, counts, countsV);
+
+        for (auto format: {DescriptorQuantiser::Int8,
+                           DescriptorQuantiser::Binary}) {
+
+            const char* name = (format == DescriptorQuantiser::Int8)?
+                                  "Int8" : "Binary";
+            const size_t codeBytes = quantiser.codeBytes(format);
+
+            cl::Buffer trainCodes(context.context, CL_MEM_READ_WRITE,
+                                  capacity * codeBytes),
+                       queryCodes(context.context, CL_MEM_READ_WRITE,
+                                  capacity * codeBytes);
+
+            quantiser(cq, format, train, counts, 1, capacity, trainCodes);
+            quantiser(cq, format, query, counts, 1, capacity, queryCodes);
+
+            std::vector<uint8_t> trainCodesV
+                = readBuffer<uint8_t>(cq, trainCodes);
+            std::vector<uint8_t> queryCodesV
+                = readBuffer<uint8_t>(cq, queryCodes);
+
+            // Against the host, allowing Int8 a rounding difference
+            std::vector<uint8_t> expected(codeBytes);
+            size_t numBad = 0;
+            for (size_t n = 0; n < num; ++n) {
+                DescriptorQuantiser::quantise(format,
+                                              &trainV[n * descriptorLength],
+                                              descriptorLength,
+                                              &expected[0]);
+                for (size_t b = 0; b < codeBytes; ++b) {
+                    int d = int(trainCodesV[n * codeBytes + b])
+                          - int(expected[b]);
+                    if (format == DescriptorQuantiser::Int8)
+                        d = int8_t(d);
+                    if (std::abs(d) > (format == DescriptorQuantiser::Int8))
+                        ++numBad;
+                }
+            }
+
+            if (numBad > 0) {
+                std::cerr << name << ": " << numBad
+                          << " code bytes differ from the host's"
+                          << std::endl;
+                failed = true;
+            }
+
+            const size_t k = 2;
+            KnnMatches matches = matcher(cq, format, queryCodes, num,
+                                         trainCodes, num, k);
+
+            size_t numWrong = 0, numDistBad = 0;
+            for (size_t q = 0; q < num; ++q) {
+                if (matches.indices[q * k] != int(q))
+                    ++numWrong;
+
+                const int t = matches.indices[q * k + 1];
+                float d = QuantisedMatcher::distance(
+                             format, &queryCodesV[q * codeBytes],
+                             &trainCodesV[t * codeBytes]);
+                if (std::fabs(d - matches.distances[q * k + 1]) > 1e-4f)
+                    ++numDistBad;
+            }
+
+            std::cout << name << ": " << codeBytes << " bytes, "
+                      << num - numWrong << " of " << num
+                      << " matched" << std::endl;
+
+            if (numWrong > 0 || numDistBad > 0) {
+                std::cerr << name << ": " << numWrong << " wrong matches, "
+                          << numDistBad << " wrong distances" << std::endl;
+                failed = true;
+            }
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
@@ -0,0 +1,133 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "DescriptorMatcher/descriptorMatcher.h"
+#include "DescriptorMatcher/cpuMatcher.h"
+
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Measure the throughput of the device and host matchers, in
+    // query-train pairs compared per second (each pair being tried at every
+    // rotation)
+
+    size_t numQuery = 2000, numTrain = 2000, numIterations = 10;
+    int maxRotation = 0;
+
+    // First and second arguments: numbers of query and train descriptors
+    if (argc > 2) {
+        numQuery = readStr<size_t>(argv[1]);
+        numTrain = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: the largest rotation to try, in steps
+    if (argc > 3) {
+        maxRotation = readStr<int>(argv[3]);
+    }
+
+    // Fourth argument: number of iterations
+    if (argc > 4) {
+        numIterations = readStr<size_t>(argv[4]);
+    }
+
+    const MatchSettings settings = {2, maxRotation};
+    const double numPairs = double(numQuery) * numTrain;
+
+    try {
+
+        CLContext context;
+
+        // Ready the command queue on the first device to hand
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        DescriptorMatcher matcher {context.context, context.devices};
+        CPUMatcher cpuMatcher;
+
+        std::mt19937 rng(0);
+        std::normal_distribution<float> value(0.f, 1.f);
+
+        std::vector<float> queryV(numQuery * descriptorLength),
+                           trainV(numTrain * descriptorLength);
+        for (float& v: queryV)
+            v = value(rng);
+        for (float& v: trainV)
+            v = value(rng);
+
+        cl::Buffer query = createBuffer(context.context, cq, queryV),
+                   train = createBuffer(context.context, cq, trainV);
+
+        const size_t numResults = numQuery * settings.k;
+        cl::Buffer indices(context.context, CL_MEM_READ_WRITE,
+                           numResults * sizeof(cl_int)),
+                   distances(context.context, CL_MEM_READ_WRITE,
+                             numResults * sizeof(cl_float)),
+                   rotations(context.context, CL_MEM_READ_WRITE,
+                             numResults * sizeof(cl_int));
+
+        // Once first, so the timing doesn't include getting started
+        matcher(cq, query, numQuery, train, numTrain, settings,
+                indices, distances, rotations);
+        cq.finish();
+
+        {
+            auto start = std::chrono::system_clock::now();
+
+            for (size_t n = 0; n < numIterations; ++n)
+                matcher(cq, query, numQuery, train, numTrain, settings,
+                        indices, distances, rotations);
+
+            cq.finish();
+            auto end = std::chrono::system_clock::now();
+
+            double t = DurationSeconds(end - start).count() / numIterations;
+
+            std::cout << "DescriptorMatcher: " << (t * 1000) << " ms, "
+                      << (numPairs / t) << " matches/s" << std::endl;
+        }
+
+        {
+            auto start = std::chrono::system_clock::now();
+
+            for (size_t n = 0; n < numIterations; ++n)
+                cpuMatcher(queryV, trainV, settings);
+
+            auto end = std::chrono::system_clock::now();
+
+            double t = DurationSeconds(end - start).count() / numIterations;
+
+            std::cout << "CPUMatcher: " << (t * 1000) << " ms, "
+                      << (numPairs / t) << " matches/s" << std::endl;
+        }
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+    }
+
+    return 0;
+}
+
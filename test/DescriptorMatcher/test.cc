@@ -0,0 +1,251 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "DTCWT/dtcwt.h"
+#include "KeypointDescriptor/extractDescriptors.h"
+#include "DescriptorMatcher/descriptorMatcher.h"
+#include "DescriptorMatcher/cpuMatcher.h"
+
+// The train descriptors are the queries, shuffled, rotated by a random number
+// of steps and with a little noise, plus some distractors.  Searching over
+// rotations, both matchers should find each query's true partner and the
+// rotation that was applied, and agree with each other.
+//
+// That only tests the search against rotateDescriptor, so descriptors are
+// also extracted from an image and the same image turned a quarter turn
+// (three steps of the ring), at a grid of points and where they went.  The
+// transform is only nearly rotation invariant, so a few may be missed.
+// Finally, an empty set of queries should give no matches.
+
+
+static bool sameResults(const KnnMatches& a, const KnnMatches& b)
+{
+    if (a.k != b.k || a.indices.size() != b.indices.size())
+        return false;
+
+    for (size_t n = 0; n < a.indices.size(); ++n) {
+
+        if (std::fabs(a.distances[n] - b.distances[n])
+              > 1e-3f * std::max(a.distances[n], 1.f))
+            return false;
+
+        // Indices could swap between near-ties
+        if (a.indices[n] != b.indices[n]
+         && std::fabs(a.distances[n] - b.distances[n])
+              > 1e-4f * std::max(a.distances[n], 1.f))
+            return false;
+    }
+
+    return true;
+}
+
+
+// Descriptors from levels 2 and 3 of a square image, at locations in image
+// pixels from its centre
+static std::vector<float> describeImage(CLContext& context,
+                                        cl::CommandQueue& cq,
+                                        const std::vector<float>& image,
+                                        size_t size,
+                                        const std::vector<float>& locations)
+{
+    Dtcwt dtcwt(context.context, context.devices);
+    DtcwtTemps env(context.context, size, size, 1, 3);
+    DtcwtOutput output = env.createOutputs();
+
+    ImageBuffer<cl_float> input(context.context, CL_MEM_READ_WRITE,
+                                size, size, 16, 32);
+    input.write(cq, image.data());
+    dtcwt(cq, input, env, output);
+
+    DescriptorExtracter extracter(context.context, context.devices, 2);
+
+    const size_t numKeypoints = locations.size() / 2;
+
+    cl::Buffer kpLocations = createBuffer(context.context, cq, locations);
+    std::vector<cl_uint> offsets = {0, cl_uint(numKeypoints)};
+    cl::Buffer kpOffsets = {context.context,
+                            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                            offsets.size() * sizeof(cl_uint), &offsets[0]};
+
+    cl::Buffer descriptors = createBuffer(context.context, cq,
+        std::vector<float>(extracter.getNumFloatsInDescriptor()
+                           * numKeypoints));
+
+    extracter(cq, output.level(2), 4.f, output.level(3), 8.f,
+              kpLocations, kpOffsets, 0, numKeypoints, descriptors);
+
+    return readBuffer<float>(cq, descriptors);
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        DescriptorMatcher matcher(context.context, context.devices);
+        CPUMatcher cpuMatcher;
+
+        const size_t numQuery = 100, numDistractors = 37,
+                     numTrain = numQuery + numDistractors;
+
+        std::mt19937 rng(38);
+        std::normal_distribution<float> value(0.f, 1.f), noise(0.f, 0.01f);
+        std::uniform_int_distribution<int> steps(-5, 5);
+
+        std::vector<float> queryV(numQuery * descriptorLength);
+        for (float& v: queryV)
+            v = value(rng);
+
+        std::vector<int> partner(numTrain);
+        for (size_t n = 0; n < numTrain; ++n)
+            partner[n] = n;
+        std::shuffle(partner.begin(), partner.end(), rng);
+
+        std::vector<float> trainV(numTrain * descriptorLength);
+        std::vector<int> expectedTrain(numQuery), expectedRotation(numQuery);
+        for (size_t t = 0; t < numTrain; ++t) {
+
+            float* out = &trainV[t * descriptorLength];
+
+            if (partner[t] < int(numQuery)) {
+                const int q = partner[t], r = steps(rng);
+                rotateDescriptor(&queryV[q * descriptorLength], r, out);
+                for (size_t n = 0; n < descriptorLength; ++n)
+                    out[n] += noise(rng);
+                expectedTrain[q] = t;
+                expectedRotation[q] = r;
+            } else
+                for (size_t n = 0; n < descriptorLength; ++n)
+                    out[n] = value(rng);
+        }
+
+        cl::Buffer query = createBuffer(context.context, cq, queryV),
+                   train = createBuffer(context.context, cq, trainV);
+
+        MatchSettings settings = {3, maxRotationSteps};
+
+        KnnMatches gpu = matcher(cq, query, numQuery, train, numTrain,
+                                 settings);
+        KnnMatches cpu = cpuMatcher(queryV, trainV, settings);
+
+        if (!sameResults(gpu, cpu)) {
+            std::cerr << "Device and host matches differ" << std::endl;
+            failed = true;
+        }
+
+        size_t numWrong = 0;
+        for (size_t q = 0; q < numQuery; ++q)
+            if (gpu.indices[q * settings.k] != expectedTrain[q]
+             || gpu.rotations[q * settings.k] != expectedRotation[q])
+                ++numWrong;
+
+        if (numWrong > 0) {
+            std::cerr << numWrong << " queries matched wrongly" << std::endl;
+            failed = true;
+        }
+
+        // Without rotation search, only the unrotated ones are reliable
+        MatchSettings unrotated = {2, 0};
+        KnnMatches gpu0 = matcher(cq, query, numQuery, train, numTrain,
+                                  unrotated);
+        if (!sameResults(gpu0, cpuMatcher(queryV, trainV, unrotated))) {
+            std::cerr << "Device and host unrotated matches differ"
+                      << std::endl;
+            failed = true;
+        }
+
+        // Every true pair should pass the ratio test and the mutual check
+        KnnMatches backward = matcher(cq, train, numTrain, query, numQuery,
+                                      settings);
+        std::vector<Match> matches = selectMatches(gpu, 0.8f, &backward);
+
+        std::cout << matches.size() << " of " << numQuery
+                  << " matches selected" << std::endl;
+
+        if (matches.size() != numQuery) {
+            std::cerr << "Wrong number of matches selected" << std::endl;
+            failed = true;
+        }
+
+        // A quarter turn: (x, y) from the centre goes to (-y, x), which is
+        // the way the ring samples are numbered
+        const size_t size = 256;
+        std::uniform_real_distribution<float> pixel(0.f, 1.f);
+        std::vector<float> image(size * size), turned(size * size);
+        for (float& v: image)
+            v = pixel(rng);
+        for (size_t r = 0; r < size; ++r)
+            for (size_t c = 0; c < size; ++c)
+                turned[r * size + c] = image[(size - 1 - c) * size + r];
+
+        std::vector<float> points, turnedPoints;
+        for (int y = -80; y <= 80; y += 32)
+            for (int x = -80; x <= 80; x += 32) {
+                points.push_back(x);
+                points.push_back(y);
+                turnedPoints.push_back(-y);
+                turnedPoints.push_back(x);
+            }
+        const size_t numPoints = points.size() / 2;
+
+        cl::Buffer original = createBuffer(context.context, cq,
+                                  describeImage(context, cq, image, size,
+                                                points)),
+                   rotated = createBuffer(context.context, cq,
+                                  describeImage(context, cq, turned, size,
+                                                turnedPoints));
+
+        KnnMatches turnedMatches = matcher(cq, original, numPoints,
+                                           rotated, numPoints,
+                                           {1, maxRotationSteps});
+
+        size_t numFound = 0;
+        for (size_t q = 0; q < numPoints; ++q)
+            if (turnedMatches.indices[q] == int(q)
+             && turnedMatches.rotations[q] == 3)
+                ++numFound;
+
+        std::cout << numFound << " of " << numPoints
+                  << " points found in the turned image" << std::endl;
+
+        if (numFound < numPoints * 9 / 10) {
+            std::cerr << "Too few points found in the turned image"
+                      << std::endl;
+            failed = true;
+        }
+
+        // No queries
+        KnnMatches none = matcher(cq, query, 0, train, numTrain, settings);
+        if (none.numQueries() != 0 || !none.indices.empty()) {
+            std::cerr << "Matches for no queries" << std::endl;
+            failed = true;
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
@@ -0,0 +1,181 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "Filter/LumaToImageBuffer/lumaToImageBuffer.h"
+
+#include "Filter/imageBuffer.h"
+
+// Check that LumaToImageBuffer scales, respects the input stride and fills
+// the padding by symmetric extension, and that deinterlacing replaces the
+// right lines
+
+
+int symmetric(int n, int width)
+{
+    if (n < 0)
+        n = -1 - n;
+
+    int tmp = n % (2*width);
+    return std::min(tmp, 2*width - 1 - tmp);
+}
+
+
+template <typename T>
+bool testDepth(CLContext& context, int bitDepth)
+{
+    const size_t width = 37, height = 21, inputStride = 48;
+    const float gain = 2.0f;
+    const int maxVal = (1 << bitDepth) - 1;
+
+    // Random input, with junk in the stride beyond the width
+    std::vector<T> input(inputStride * height);
+    for (auto& v: input)
+        v = std::rand() % (maxVal + 1);
+
+    cl::CommandQueue cq(context.context, context.devices[0]);
+
+    LumaToImageBuffer lumaToImageBuffer(context.context, context.devices,
+                                        bitDepth);
+
+    cl::Buffer inputBuffer(context.context,
+                           CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                           input.size() * sizeof(T), &input[0]);
+
+    ImageBuffer<cl_float> output(context.context, CL_MEM_READ_WRITE,
+                                 width, height, 16, 32);
+
+    lumaToImageBuffer(cq, inputBuffer, inputStride, output, gain);
+
+    // Read the whole buffer, so the padding can be checked
+    std::vector<cl_float> result(output.pitch());
+    cq.enqueueReadBuffer(output.buffer(), CL_TRUE, 0,
+                         result.size() * sizeof(cl_float), &result[0]);
+
+    const int p = output.padding();
+    for (int y = -p; y < int(height) + p; ++y)
+        for (int x = -p; x < int(width) + p; ++x) {
+
+            float expected
+                = gain * input[symmetric(y, height) * inputStride
+                               + symmetric(x, width)] / float(maxVal);
+            float actual = result[output.start() + y * output.stride() + x];
+
+            if (std::abs(expected - actual) > 1.e-5) {
+                std::cerr << bitDepth << "-bit: at (" << x << ", " << y
+                          << ") expected " << expected << ", got " << actual
+                          << std::endl;
+                return true;
+            }
+        }
+
+    return false;
+}
+
+
+bool testDeinterlace(CLContext& context,
+                     LumaToImageBuffer::Deinterlace mode,
+                     bool stillPicture)
+{
+    // Each line constant: odd lines bright and even ones a gentle ramp,
+    // to look like combing.
+    // Line doubling (or motion adaptive with everything moving) should
+    // replace the odd lines with the average of the even ones either side;
+    // with nothing moving, motion adaptive should leave it alone.
+    const size_t width = 16, height = 12;
+
+    std::vector<uint8_t> input(width * height), previous(width * height);
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+            input[y*width + x] = (y & 1)? 255 : y * 10;
+            previous[y*width + x] = stillPicture? input[y*width + x] : 128;
+        }
+
+    cl::CommandQueue cq(context.context, context.devices[0]);
+
+    LumaToImageBuffer lumaToImageBuffer(context.context, context.devices,
+                                        8, mode);
+
+    cl::Buffer inputBuffer(context.context,
+                           CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                           input.size(), &input[0]);
+    cl::Buffer previousBuffer(context.context,
+                              CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                              previous.size(), &previous[0]);
+
+    ImageBuffer<cl_float> output(context.context, CL_MEM_READ_WRITE,
+                                 width, height, 16, 32);
+
+    lumaToImageBuffer(cq, inputBuffer, previousBuffer, width, output, 255.f);
+
+    std::vector<cl_float> result(output.pitch());
+    cq.enqueueReadBuffer(output.buffer(), CL_TRUE, 0,
+                         result.size() * sizeof(cl_float), &result[0]);
+
+    const bool interpolate = mode == LumaToImageBuffer::LineDouble
+                          || !stillPicture;
+
+    for (size_t y = 0; y < height; ++y) {
+
+        float expected = input[y*width];
+        if ((y & 1) && interpolate)
+            expected = (y + 1 < height)?
+                0.5f * (input[(y-1)*width] + input[(y+1)*width])
+              : input[(y-1)*width];
+
+        float actual = result[output.start() + y * output.stride()];
+
+        if (std::abs(expected - actual) > 1.e-3) {
+            std::cerr << "Deinterlace mode " << mode << ": line " << y
+                      << " expected " << expected << ", got " << actual
+                      << std::endl;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int main()
+{
+    try {
+
+        CLContext context;
+
+        if (testDepth<uint8_t>(context, 8)) {
+            std::cerr << "Failed 8-bit luma conversion" << std::endl;
+            return -1;
+        }
+
+        if (testDepth<uint16_t>(context, 10)) {
+            std::cerr << "Failed 10-bit luma conversion" << std::endl;
+            return -1;
+        }
+
+        if (testDeinterlace(context, LumaToImageBuffer::LineDouble, true)
+         || testDeinterlace(context, LumaToImageBuffer::MotionAdaptive, true)
+         || testDeinterlace(context, LumaToImageBuffer::MotionAdaptive,
+                            false)) {
+            std::cerr << "Failed deinterlacing" << std::endl;
+            return -1;
+        }
+
+    } catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        return -1;
+    }
+
+    // No failures if we reached here
+    return 0;
+}
+
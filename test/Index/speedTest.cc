@@ -0,0 +1,136 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "Index/ivfpqIndex.h"
+#include "DescriptorMatcher/cpuMatcher.h"
+
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Measure the recall of the index (how often the true nearest neighbour,
+    // by brute force, is among those returned) and its query throughput,
+    // on clustered random descriptors
+
+    size_t numEntries = 50000, numQueries = 500,
+           numProbes = 8, numThreads = 4;
+
+    // First and second arguments: entries and queries
+    if (argc > 2) {
+        numEntries = readStr<size_t>(argv[1]);
+        numQueries = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: lists searched per query
+    if (argc > 3) {
+        numProbes = readStr<size_t>(argv[3]);
+    }
+
+    // Fourth argument: threads
+    if (argc > 4) {
+        numThreads = readStr<size_t>(argv[4]);
+    }
+
+    const size_t k = 10;
+    const char* filename = "speedTestIndex.ivfpq";
+
+    try {
+
+        std::mt19937 rng(0);
+        std::normal_distribution<float> value(0.f, 1.f);
+
+        const size_t numCentres = 1000;
+        std::vector<float> centres(numCentres * descriptorLength);
+        for (float& v: centres)
+            v = value(rng);
+
+        std::uniform_int_distribution<size_t> anyCentre(0, numCentres - 1);
+        auto makeDescriptors = [&] (size_t num) {
+            std::vector<float> result(num * descriptorLength);
+            for (size_t n = 0; n < num; ++n) {
+                size_t c = anyCentre(rng);
+                for (size_t d = 0; d < descriptorLength; ++d)
+                    result[n * descriptorLength + d]
+                        = centres[c * descriptorLength + d]
+                        + 0.5f * value(rng);
+            }
+            return result;
+        };
+
+        std::vector<float> entries = makeDescriptors(numEntries),
+                           queries = makeDescriptors(numQueries);
+
+        IVFPQIndex::Params params = {descriptorLength, 256, 21, 10};
+
+        auto start = std::chrono::system_clock::now();
+        IVFPQIndex index(filename, params, entries.data(),
+                         std::min<size_t>(numEntries, 20000));
+        auto trained = std::chrono::system_clock::now();
+        index.add(entries.data(), numEntries, 0);
+        index.flush();
+        auto built = std::chrono::system_clock::now();
+
+        std::cout << "Training: "
+                  << DurationSeconds(trained - start).count() << " s, "
+                  << "adding: "
+                  << (numEntries / DurationSeconds(built - trained).count())
+                  << " descriptors/s" << std::endl;
+
+        // The true nearest neighbours
+        CPUMatcher matcher;
+        KnnMatches truth = matcher(queries, entries, MatchSettings {1, 0});
+
+        std::vector<int64_t> ids(numQueries * k);
+        std::vector<float> distances(numQueries * k);
+
+        start = std::chrono::system_clock::now();
+        index.search(queries.data(), numQueries, k, numProbes,
+                     ids.data(), distances.data(), numThreads);
+        auto end = std::chrono::system_clock::now();
+
+        size_t numAt1 = 0, numAt10 = 0;
+        for (size_t q = 0; q < numQueries; ++q) {
+            if (ids[q * k] == truth.indices[q])
+                ++numAt1;
+            for (size_t n = 0; n < k; ++n)
+                if (ids[q * k + n] == truth.indices[q])
+                    ++numAt10;
+        }
+
+        double t = DurationSeconds(end - start).count();
+
+        std::cout << "IVFPQIndex (" << numProbes << " probes, "
+                  << numThreads << " threads): "
+                  << (numQueries / t) << " queries/s, recall@1 "
+                  << double(numAt1) / numQueries << ", recall@10 "
+                  << double(numAt10) / numQueries << std::endl;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+    }
+
+    std::remove(filename);
+
+    return 0;
+}
+
@@ -0,0 +1,288 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+#include <unistd.h>
+
+#include "Index/ivfpqIndex.h"
+#include "hdf5/hdfreader.h"
+
+// Builds an index over clustered random descriptors in two goes, reopening
+// it in between, and checks that queries which are (nearly) copies of
+// entries find them, from several threads at once.  Then cuts the last
+// segment short, as a crash would, and checks it is ignored on opening
+// read only and dropped on opening to add, and that corrupt headers are
+// refused rather than trusted.
+// Finally checks that float32 descriptor files read back as rows for
+// indexing, and that int8 ones are refused rather than read as floats.
+
+const size_t dimension = 168;
+const size_t numEntries = 6000;
+
+
+long fileSize(const char* filename)
+{
+    std::FILE* f = std::fopen(filename, "rb");
+    if (f == nullptr)
+        throw std::runtime_error("Couldn't open " + std::string(filename));
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    std::fclose(f);
+    return size;
+}
+
+
+void patch(const char* filename, long offset,
+           const void* data, void* old, size_t length)
+{
+    // Overwrites length bytes at offset, keeping what was there in old
+    std::FILE* f = std::fopen(filename, "r+b");
+    if (f == nullptr)
+        throw std::runtime_error("Couldn't open " + std::string(filename));
+    std::fseek(f, offset, SEEK_SET);
+    if (old != nullptr) {
+        if (std::fread(old, 1, length, f) != length)
+            throw std::runtime_error("Couldn't read the index back");
+        std::fseek(f, offset, SEEK_SET);
+    }
+    std::fwrite(data, 1, length, f);
+    std::fclose(f);
+}
+
+
+bool refused(const char* filename)
+{
+    // Whether opening the index fails with an error, as it should when
+    // the file is corrupt
+    try {
+        IVFPQIndex index(filename, IVFPQIndex::ReadOnly);
+    } catch (std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+
+int main()
+{
+    bool failed = false;
+    const char* filename = "testIndex.ivfpq";
+
+    try {
+
+        std::mt19937 rng(39);
+        std::normal_distribution<float> value(0.f, 1.f), noise(0.f, 0.05f);
+
+        // Entries spread around a few hundred centres
+        const size_t numCentres = 300;
+        std::vector<float> centres(numCentres * dimension);
+        for (float& v: centres)
+            v = value(rng);
+
+        std::uniform_int_distribution<size_t> anyCentre(0, numCentres - 1);
+        std::vector<float> entries(numEntries * dimension);
+        for (size_t n = 0; n < numEntries; ++n) {
+            size_t c = anyCentre(rng);
+            for (size_t d = 0; d < dimension; ++d)
+                entries[n * dimension + d] = centres[c * dimension + d]
+                                           + 0.3f * value(rng);
+        }
+
+        const size_t firstHalf = numEntries / 2;
+        {
+            IVFPQIndex::Params params = {dimension, 64, 21, 8};
+            IVFPQIndex index(filename, params, entries.data(), 2000);
+            index.add(entries.data(), firstHalf, 0);
+        }
+
+        IVFPQIndex index(filename);
+        if (index.size() != firstHalf) {
+            std::cerr << "Entries lost on reopening" << std::endl;
+            failed = true;
+        }
+
+        index.add(&entries[firstHalf * dimension], numEntries - firstHalf,
+                  firstHalf);
+        index.flush();
+
+        // Queries near every 20th entry
+        const size_t numQueries = numEntries / 20, k = 5;
+        std::vector<float> queries(numQueries * dimension);
+        for (size_t q = 0; q < numQueries; ++q)
+            for (size_t d = 0; d < dimension; ++d)
+                queries[q * dimension + d]
+                    = entries[q * 20 * dimension + d] + noise(rng);
+
+        std::vector<int64_t> ids(numQueries * k);
+        std::vector<float> distances(numQueries * k);
+        index.search(queries.data(), numQueries, k, 8,
+                     ids.data(), distances.data(), 4);
+
+        size_t numFound = 0;
+        for (size_t q = 0; q < numQueries; ++q)
+            for (size_t n = 0; n < k; ++n)
+                if (ids[q * k + n] == int64_t(q * 20))
+                    ++numFound;
+
+        std::cout << numFound << " of " << numQueries
+                  << " found in the top " << k << std::endl;
+
+        if (numFound < numQueries * 95 / 100) {
+            std::cerr << "Too few found" << std::endl;
+            failed = true;
+        }
+
+        // Threads shouldn't change the answer
+        std::vector<int64_t> ids1(numQueries * k);
+        std::vector<float> distances1(numQueries * k);
+        index.search(queries.data(), numQueries, k, 8,
+                     ids1.data(), distances1.data(), 1);
+        if (distances1 != distances) {
+            std::cerr << "Results depend on the number of threads"
+                      << std::endl;
+            failed = true;
+        }
+
+        // A half-written segment on the end
+        index.add(entries.data(), 10, numEntries);
+        index.flush();
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    try {
+        // Cut off the end of the last segment
+        long size = fileSize(filename);
+        if (truncate(filename, size - 8) != 0)
+            throw std::runtime_error("Couldn't truncate");
+
+        {
+            IVFPQIndex index(filename, IVFPQIndex::ReadOnly);
+            if (index.size() != numEntries) {
+                std::cerr << "Half-written segment not ignored" << std::endl;
+                failed = true;
+            }
+
+            bool threw = false;
+            try {
+                std::vector<float> descriptor(dimension);
+                index.add(descriptor.data(), 1, 0);
+            } catch (std::logic_error&) {
+                threw = true;
+            }
+            if (!threw) {
+                std::cerr << "Added to a read-only index" << std::endl;
+                failed = true;
+            }
+        }
+
+        if (fileSize(filename) != size - 8) {
+            std::cerr << "Read-only opening changed the file" << std::endl;
+            failed = true;
+        }
+
+        IVFPQIndex index(filename);
+        if (index.size() != numEntries) {
+            std::cerr << "Half-written segment not dropped" << std::endl;
+            failed = true;
+        }
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    try {
+        // No lists at all
+        const uint32_t noLists = 0;
+        uint32_t numLists;
+        patch(filename, 16, &noLists, &numLists, sizeof(noLists));
+        if (!refused(filename)) {
+            std::cerr << "Index with no lists accepted" << std::endl;
+            failed = true;
+        }
+        patch(filename, 16, &numLists, nullptr, sizeof(numLists));
+
+        // A segment claiming more entries than it has room for
+        std::vector<char> contents(fileSize(filename));
+        std::FILE* f = std::fopen(filename, "rb");
+        if (std::fread(contents.data(), 1, contents.size(), f)
+             != contents.size())
+            throw std::runtime_error("Couldn't read the index back");
+        std::fclose(f);
+
+        const char magic[] = "IVPQSEG1";
+        auto segment = std::search(contents.begin(), contents.end(),
+                                   magic, magic + 8);
+        if (segment == contents.end())
+            throw std::runtime_error("No segment found");
+
+        const uint64_t tooMany = uint64_t(1) << 60;
+        patch(filename, (segment - contents.begin()) + 8,
+              &tooMany, nullptr, sizeof(tooMany));
+        if (!refused(filename)) {
+            std::cerr << "Segment with too many entries accepted"
+                      << std::endl;
+            failed = true;
+        }
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    std::remove(filename);
+
+    const char* descriptorFile = "testIndexDescriptors.h5";
+
+    try {
+        const size_t numKeypoints = 5, length = 8;
+        std::vector<float> keypoints(numKeypoints * 4, 0.f);
+        std::vector<float> rows(numKeypoints * length);
+        for (size_t n = 0; n < rows.size(); ++n)
+            rows[n] = 0.25f * n;
+
+        {
+            HDFWriter writer(descriptorFile, length);
+            writer.append(numKeypoints, &keypoints[0], &rows[0]);
+        }
+
+        std::vector<float> readBack(3 * length);
+        HDFReader(descriptorFile).readDescriptorRows(1, 3, &readBack[0]);
+        if (!std::equal(readBack.begin(), readBack.end(),
+                        rows.begin() + length)) {
+            std::cerr << "Float32 rows read back wrongly" << std::endl;
+            failed = true;
+        }
+
+        std::remove(descriptorFile);
+
+        std::vector<signed char> codes(numKeypoints * length, 1);
+        {
+            HDFWriter writer(descriptorFile, length, HDFWriter::Int8);
+            writer.append(numKeypoints, &keypoints[0], &codes[0]);
+        }
+
+        try {
+            HDFReader(descriptorFile).readDescriptorRows(0, numKeypoints,
+                                                         &rows[0]);
+            std::cerr << "Int8 codes read as float rows" << std::endl;
+            failed = true;
+        } catch (std::runtime_error&) {
+        }
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    std::remove(descriptorFile);
+
+    return failed? -1 : 0;
+}
+
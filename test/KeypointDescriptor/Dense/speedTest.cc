@@ -0,0 +1,156 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "DTCWT/dtcwt.h"
+#include "KeypointDescriptor/extractDescriptors.h"
+#include "KeypointDescriptor/denseDescriptors.h"
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Times describing a grid over level 2 of a 720p transform, and the
+    // same points given to DescriptorExtracter as keypoints
+
+    size_t width = 1280, height = 720, numIterations = 20;
+    float gridStep = 1.f;
+
+    // First and second arguments: width and height
+    if (argc > 2) {
+        width = readStr<size_t>(argv[1]);
+        height = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: grid step, in level 2 pixels
+    if (argc > 3)
+        gridStep = readStr<float>(argv[3]);
+
+    // Fourth argument: number of iterations
+    if (argc > 4)
+        numIterations = readStr<size_t>(argv[4]);
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        const int startLevel = 1, numLevels = 3;
+        DtcwtTemps env(context.context, width, height,
+                       startLevel, numLevels);
+        Dtcwt dtcwt(context.context, context.devices, 0.5f);
+        DtcwtOutput output = env.createOutputs();
+
+        ImageBuffer<cl_float> input(context.context, CL_MEM_READ_WRITE,
+                                    width, height, 16, 32);
+
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<float> value(0.f, 1.f);
+        std::vector<float> image(width * height);
+        for (float& v: image)
+            v = value(rng);
+        input.write(cq, image.data());
+
+        dtcwt(cq, input, env, output);
+        cq.finish();
+
+        const Subbands& fine = output.level(2);
+        const Subbands& coarse = output.level(3);
+
+        // Grid
+        DenseDescriptorExtracter dense(context.context, context.devices,
+                                       gridStep);
+
+        const size_t gridWidth = dense.gridWidth(fine.width()),
+                     gridHeight = dense.gridHeight(fine.height()),
+                     numDescriptors = gridWidth * gridHeight;
+
+        cl::Buffer descriptors(context.context, CL_MEM_READ_WRITE,
+                               dense.getNumFloatsInDescriptor()
+                                * numDescriptors * sizeof(float));
+
+        dense(cq, fine, coarse, descriptors, gridWidth);
+        cq.finish();
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < numIterations; ++n)
+            dense(cq, fine, coarse, descriptors, gridWidth);
+        cq.finish();
+        DurationSeconds denseTime = std::chrono::steady_clock::now() - start;
+
+        // The same points as keypoints
+        std::vector<float> locations;
+        for (size_t y = 0; y < gridHeight; ++y)
+            for (size_t x = 0; x < gridWidth; ++x) {
+                locations.push_back(4.f * (x * gridStep
+                                           - 0.5f * (fine.width() - 1)));
+                locations.push_back(4.f * (y * gridStep
+                                           - 0.5f * (fine.height() - 1)));
+            }
+
+        DescriptorExtracter sparse(context.context, context.devices, 2);
+        cl::Buffer kpLocations = createBuffer(context.context, cq,
+                                              locations);
+        std::vector<cl_uint> offsets = {0, cl_uint(numDescriptors)};
+        cl::Buffer kpOffsets = {context.context,
+                                CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                offsets.size() * sizeof(cl_uint),
+                                &offsets[0]};
+
+        sparse(cq, fine, 4.f, coarse, 8.f, kpLocations, kpOffsets, 0,
+               numDescriptors, descriptors);
+        cq.finish();
+
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < numIterations; ++n)
+            sparse(cq, fine, 4.f, coarse, 8.f, kpLocations, kpOffsets, 0,
+                   numDescriptors, descriptors);
+        cq.finish();
+        DurationSeconds sparseTime
+            = std::chrono::steady_clock::now() - start;
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << gridWidth << "x" << gridHeight << " grid: "
+                  << denseTime.count() * 1e3 / numIterations << " ms, "
+                  << numDescriptors * numIterations / denseTime.count() * 1e-6
+                  << " million/s; as keypoints: "
+                  << sparseTime.count() * 1e3 / numIterations << " ms, "
+                  << numDescriptors * numIterations / sparseTime.count()
+                        * 1e-6
+                  << " million/s" << std::endl;
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        return -1;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+#include "DTCWT/dtcwt.h"
+#include "KeypointDescriptor/extractDescriptors.h"
+#include "KeypointDescriptor/denseDescriptors.h"
+#include "randomTransform.h"
+
+// Describes a grid over the second level of a random image's transform,
+// and checks each descriptor against DescriptorExtracter's at the same
+// place, for a couple of grid steps and with rows padded out in the output.
+// The sampling arithmetic is the same, but the positions get there by
+// different routes, so allow for rounding.  Tiled levels should give
+// exactly the same grid.  Wrong layouts and grid steps should be refused.
+
+
+static std::vector<float> describeGrid(cl::Context& context,
+                                       cl::CommandQueue& cq,
+                                       DenseDescriptorExtracter& extracter,
+                                       const Subbands& fine,
+                                       const Subbands& coarse,
+                                       size_t rowStride)
+{
+    const size_t height = extracter.gridHeight(fine.height());
+
+    cl::Buffer descriptors = createBuffer(context, cq,
+        std::vector<float>(extracter.getNumFloatsInDescriptor()
+                           * rowStride * height));
+
+    extracter(cq, fine, coarse, descriptors, rowStride);
+
+    return readBuffer<float>(cq, descriptors);
+}
+
+
+static std::vector<float> describe(cl::Context& context,
+                                   cl::CommandQueue& cq,
+                                   DescriptorExtracter& extracter,
+                                   const Subbands& fine,
+                                   const Subbands& coarse,
+                                   const std::vector<float>& locations)
+{
+    const size_t numKeypoints = locations.size() / 2;
+
+    cl::Buffer kpLocations = createBuffer(context, cq, locations);
+    std::vector<cl_uint> offsets = {0, cl_uint(numKeypoints)};
+    cl::Buffer kpOffsets = {context,
+                            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                            offsets.size() * sizeof(cl_uint), &offsets[0]};
+
+    cl::Buffer descriptors = createBuffer(context, cq,
+        std::vector<float>(extracter.getNumFloatsInDescriptor()
+                           * numKeypoints));
+
+    extracter(cq, fine, 4.f, coarse, 8.f,
+              kpLocations, kpOffsets, 0, numKeypoints, descriptors);
+
+    return readBuffer<float>(cq, descriptors);
+}
+
+
+static bool checkGrid(CLContext& context, cl::CommandQueue& cq,
+                      const DtcwtOutput& output, float gridStep)
+{
+    const Subbands& fine = output.level(2);
+    const Subbands& coarse = output.level(3);
+
+    DenseDescriptorExtracter dense(context.context, context.devices,
+                                   gridStep);
+    DescriptorExtracter sparse(context.context, context.devices, 2);
+
+    const size_t width = dense.gridWidth(fine.width()),
+                 height = dense.gridHeight(fine.height()),
+                 rowStride = width + 3;
+    const size_t descriptorSize = dense.getNumFloatsInDescriptor();
+
+    std::vector<float> grid = describeGrid(context.context, cq, dense,
+                                           fine, coarse, rowStride);
+
+    // The same points in image pixels from the centre, as the keypoint
+    // path expects
+    std::vector<float> locations;
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+            locations.push_back(4.f * (x * gridStep
+                                       - 0.5f * (fine.width() - 1)));
+            locations.push_back(4.f * (y * gridStep
+                                       - 0.5f * (fine.height() - 1)));
+        }
+
+    std::vector<float> keypoints = describe(context.context, cq, sparse,
+                                            fine, coarse, locations);
+
+    float maxDiff = 0.f, maxValue = 0.f;
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x)
+            for (size_t n = 0; n < descriptorSize; ++n) {
+                const float g = grid[(x + y * rowStride) * descriptorSize
+                                     + n],
+                            k = keypoints[(x + y * width) * descriptorSize
+                                          + n];
+                maxDiff = std::max(maxDiff, std::abs(g - k));
+                maxValue = std::max(maxValue, std::abs(k));
+            }
+
+    if (maxDiff > 1e-4f * maxValue) {
+        std::cerr << "Grid step " << gridStep << ": differs from keypoint "
+                     "descriptors by up to " << maxDiff << " (largest "
+                     "value " << maxValue << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        RandomTransform random(context.context, cq, 50);
+
+        Dtcwt dtcwt(context.context, context.devices),
+              tiledDtcwt(context.context, context.devices, 1.f,
+                         SubbandsTiled);
+
+        DtcwtOutput output = random.env.createOutputs(),
+                    tiled = random.env.createOutputs(SubbandsTiled);
+
+        dtcwt(cq, random.input, random.env, output);
+        tiledDtcwt(cq, random.input, random.env, tiled);
+        cq.finish();
+
+        for (float gridStep: {1.f, 2.f, 1.5f})
+            if (!checkGrid(context, cq, output, gridStep))
+                failed = true;
+
+        // Tiled levels
+        DenseDescriptorExtracter dense(context.context, context.devices,
+                                       1.f),
+                                 tiledDense(context.context,
+                                            context.devices, 1.f,
+                                            SubbandsTiled);
+
+        const size_t gridWidth = dense.gridWidth(output.level(2).width()),
+                     gridHeight = dense.gridHeight(output.level(2).height());
+        const size_t size = dense.getNumFloatsInDescriptor()
+                          * gridWidth * gridHeight;
+
+        cl::Buffer rowMajorGrid = createBuffer(context.context, cq,
+                                               std::vector<float>(size)),
+                   tiledGrid = createBuffer(context.context, cq,
+                                            std::vector<float>(size));
+
+        dense(cq, output.level(2), output.level(3), rowMajorGrid, gridWidth);
+        tiledDense(cq, tiled.tiled(2), tiled.tiled(3), tiledGrid, gridWidth);
+
+        if (readBuffer<float>(cq, rowMajorGrid)
+             != readBuffer<float>(cq, tiledGrid)) {
+            std::cerr << "Grid descriptors differ when tiled" << std::endl;
+            failed = true;
+        }
+
+        // Levels in the wrong layout should be refused
+        try {
+            tiledDense(cq, output.level(2), output.level(3),
+                       tiledGrid, gridWidth);
+            std::cerr << "Mismatched layout accepted" << std::endl;
+            failed = true;
+        } catch (std::logic_error&) {
+        }
+
+        // As should a grid step that doesn't step
+        for (float gridStep: {0.f, -1.f}) {
+            try {
+                DenseDescriptorExtracter(context.context, context.devices,
+                                         gridStep);
+                std::cerr << "Grid step " << gridStep << " accepted"
+                          << std::endl;
+                failed = true;
+            } catch (std::logic_error&) {
+            }
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
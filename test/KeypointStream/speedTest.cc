@@ -0,0 +1,179 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "KeypointStream/keypointStream.h"
+#include "hdf5/hdfwriter.h"
+#include "hdf5/hdfreader.h"
+#include "hdf5/bufferedHDFWriter.h"
+
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Compare how fast frames go in through a keypoint stream against
+    // HDFWriter one frame at a time and BufferedHDFWriter, then how fast
+    // they come back out: walking the stream's mapping against HDFReader
+    // reading a frame at a time.  Both read passes sum the descriptors, and
+    // should agree.
+
+    size_t numFrames = 2000, meanKeypoints = 200;
+
+    // First and second arguments: frames, and mean keypoints per frame
+    if (argc > 2) {
+        numFrames = readStr<size_t>(argv[1]);
+        meanKeypoints = readStr<size_t>(argv[2]);
+    }
+
+    const size_t descriptorLength = 2*6*14;
+
+    try {
+
+        std::mt19937 rng(0);
+        std::poisson_distribution<size_t> numKeypoints(meanKeypoints);
+        std::uniform_real_distribution<float> value(-1.f, 1.f);
+
+        std::vector<size_t> counts(numFrames);
+        size_t maxKeypoints = 0;
+        for (size_t& c: counts) {
+            c = numKeypoints(rng);
+            maxKeypoints = std::max(maxKeypoints, c);
+        }
+
+        std::vector<float> keypoints(4 * maxKeypoints),
+                           descriptors(descriptorLength * maxKeypoints);
+        for (float& v: keypoints)
+            v = value(rng);
+        for (float& v: descriptors)
+            v = value(rng);
+
+        auto timeWriting = [&] (std::function<void (size_t)> append,
+                                std::function<void ()> finish) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t c: counts)
+                append(c);
+            finish();
+            return DurationSeconds(std::chrono::steady_clock::now() - start);
+        };
+
+        DurationSeconds streamTime, directTime, bufferedTime;
+        {
+            KeypointStreamWriter writer("speedTest.kpstream",
+                                        descriptorLength);
+            streamTime = timeWriting(
+                [&] (size_t c) {
+                    writer.append(c, keypoints.data(), descriptors.data());
+                },
+                [&] () {});
+        }
+        {
+            HDFWriter writer("speedTestDirect.h5", descriptorLength);
+            directTime = timeWriting(
+                [&] (size_t c) {
+                    writer.append(c, keypoints.data(), descriptors.data());
+                },
+                [&] () { writer = HDFWriter(); });
+        }
+        {
+            BufferedHDFWriter writer("speedTestBuffered.h5",
+                                     descriptorLength);
+            bufferedTime = timeWriting(
+                [&] (size_t c) {
+                    writer.append(c, keypoints.data(), descriptors.data());
+                },
+                [&] () { writer.close(); });
+        }
+
+        // Read back
+        double streamSum = 0., hdfSum = 0.;
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            KeypointStreamReader reader("speedTest.kpstream");
+            for (size_t n = 0; n < reader.numFrames(); ++n) {
+                KeypointStreamReader::Frame frame = reader.frame(n);
+                const float* d
+                    = static_cast<const float*>(frame.descriptors);
+                streamSum += std::accumulate(d,
+                                d + descriptorLength * frame.numKeypoints,
+                                0.);
+            }
+        }
+        DurationSeconds streamReadTime
+            = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        {
+            HDFReader reader("speedTestDirect.h5");
+            HDFReader::Frames frames;
+            for (size_t n = 0; n < reader.numFrames(); ++n) {
+                reader.read(n, 1, frames);
+                const float* d = reinterpret_cast<const float*>
+                                    (frames.descriptors.data());
+                hdfSum += std::accumulate(d,
+                              d + descriptorLength * frames.numKeypoints(),
+                              0.);
+            }
+        }
+        DurationSeconds hdfReadTime
+            = std::chrono::steady_clock::now() - start;
+
+        const double mb = double(std::accumulate(counts.begin(),
+                                                 counts.end(), size_t(0)))
+                        * (4 + descriptorLength) * sizeof(float) / 1e6;
+
+        auto report = [&] (const char* name, DurationSeconds time) {
+            std::cout << name << time.count() * 1e6 / numFrames
+                      << " us per frame, " << mb / time.count() << " MB/s"
+                      << std::endl;
+        };
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << numFrames << " frames, " << mb << " MB" << std::endl
+                  << "Writing" << std::endl;
+        report("  Stream:          ", streamTime);
+        report("  HDF5 per-frame:  ", directTime);
+        report("  HDF5 buffered:   ", bufferedTime);
+        std::cout << "Reading" << std::endl;
+        report("  Stream:          ", streamReadTime);
+        report("  HDF5 per-frame:  ", hdfReadTime);
+
+        if (streamSum != hdfSum) {
+            std::cerr << "Stream and HDF5 descriptors differ" << std::endl;
+            return -1;
+        }
+    }
+    catch (H5::Exception& err) {
+        std::cerr << "Error: " << err.getDetailMsg() << std::endl;
+        return -1;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,128 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <cstdio>
+
+#include "KeypointStream/keypointStream.h"
+
+// Writes frames of random keypoints and int8 descriptors on one thread
+// while another follows the stream as it grows, checking each frame as it
+// arrives.  Then adds a partly written record on the end, which readers
+// should ignore.
+
+
+int main()
+{
+    bool failed = false;
+
+    const size_t numFrames = 200, descriptorLength = 168;
+    const char* filename = "keypointStreamTest.kpstream";
+
+    // What each frame should hold: keypoint n of frame f has values
+    // f * 1000 + n, and its descriptor bytes are (f + n + i) mod 256
+    std::mt19937 rng(44);
+    std::uniform_int_distribution<size_t> numKeypoints(0, 50);
+    std::vector<size_t> counts(numFrames);
+    for (size_t& c: counts)
+        c = numKeypoints(rng);
+
+    try {
+
+        KeypointStreamWriter writer(filename, descriptorLength,
+                                    HDFWriter::Int8);
+
+        // Opened before anything is written
+        KeypointStreamReader reader(filename);
+
+        std::thread writing([&] () {
+            for (size_t f = 0; f < numFrames; ++f) {
+                std::vector<float> keypoints(4 * counts[f]);
+                std::vector<int8_t> descriptors(descriptorLength
+                                                 * counts[f]);
+                for (size_t n = 0; n < counts[f]; ++n) {
+                    for (size_t i = 0; i < 4; ++i)
+                        keypoints[4*n + i] = f * 1000 + n;
+                    for (size_t i = 0; i < descriptorLength; ++i)
+                        descriptors[n * descriptorLength + i]
+                            = int8_t(f + n + i);
+                }
+
+                writer.append(counts[f], keypoints.data(),
+                              descriptors.data());
+
+                if (f % 10 == 0)
+                    std::this_thread::sleep_for(
+                        std::chrono::milliseconds(1));
+            }
+        });
+
+        size_t numBad = 0, numChecked = 0;
+        while (numChecked < numFrames) {
+            if (reader.waitForFrames(numChecked + 1,
+                                     std::chrono::milliseconds(5000))
+                 <= numChecked)
+                break;
+
+            for (; numChecked < reader.numFrames(); ++numChecked) {
+                const size_t f = numChecked;
+                KeypointStreamReader::Frame frame = reader.frame(f);
+
+                if (frame.numKeypoints != counts[f]
+                 || reinterpret_cast<uintptr_t>(frame.keypoints) % 64 != 0
+                 || reinterpret_cast<uintptr_t>(frame.descriptors) % 64
+                     != 0) {
+                    ++numBad;
+                    continue;
+                }
+
+                const int8_t* descriptors
+                    = static_cast<const int8_t*>(frame.descriptors);
+                for (size_t n = 0; n < counts[f]; ++n) {
+                    if (frame.keypoints[4*n + 3] != float(f * 1000 + n))
+                        ++numBad;
+                    for (size_t i = 0; i < descriptorLength; ++i)
+                        if (descriptors[n * descriptorLength + i]
+                             != int8_t(f + n + i))
+                            ++numBad;
+                }
+            }
+        }
+
+        writing.join();
+
+        if (numChecked != numFrames || numBad > 0) {
+            std::cerr << "Followed " << numChecked << " of " << numFrames
+                      << " frames, " << numBad << " wrong" << std::endl;
+            failed = true;
+        }
+
+        // A record cut short: some of its data, and half a header
+        {
+            std::ofstream file(filename, std::ios::binary | std::ios::app);
+            const std::vector<char> junk(96, 'K');
+            file.write(junk.data(), junk.size());
+        }
+
+        KeypointStreamReader reopened(filename);
+        if (reopened.numFrames() != numFrames
+         || reader.refresh() != numFrames) {
+            std::cerr << "Partly written record not ignored" << std::endl;
+            failed = true;
+        }
+
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    std::remove(filename);
+
+    return failed? -1 : 0;
+}
+
@@ -0,0 +1,137 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+#include "DTCWT/dtcwt.h"
+#include "SubbandStream/subbandStream.h"
+#include "randomTransform.h"
+
+// Transforms a few random images, writing each frame's subbands to a
+// stream, and checks that what's in the file (read on the host) and what
+// replay uploads into fresh outputs both match the transform's own outputs
+// exactly.  Then checks a partly written record on the end is ignored.
+
+
+typedef std::vector<Coefficients> Levels;
+
+
+static bool equal(const Coefficients& a, const Complex<cl_float>* b)
+{
+    return std::memcmp(a.data(), b, a.size() * sizeof(a[0])) == 0;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    const size_t width = 160, height = 120, numFrames = 5;
+    const int startLevel = 2, numLevels = 3;
+    const char* filename = "subbandStreamTest.sbd";
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        RandomTransform random(context.context, cq, 45, width, height,
+                               startLevel, numLevels);
+
+        Dtcwt dtcwt(context.context, context.devices);
+        DtcwtOutput output = random.env.createOutputs();
+
+        std::vector<Levels> expected;
+
+        {
+            SubbandWriter writer(context.context, context.devices,
+                                 filename, output, 2);
+
+            for (size_t f = 0; f < numFrames; ++f) {
+                // The last frame's reads must be done before the transform
+                // overwrites the outputs
+                std::vector<cl::Event> waitEvents = writer.doneEvents();
+                cl::Event inputDone;
+                random.randomise(cq, {}, &inputDone);
+                waitEvents.push_back(inputDone);
+
+                dtcwt(cq, random.input, random.env, output, waitEvents);
+                writer(cq, output);
+
+                cq.finish();
+                expected.push_back(readLevels(cq, output));
+            }
+
+            writer.close();
+        }
+
+        SubbandReader reader(filename);
+
+        if (reader.numFrames() != numFrames
+         || reader.startLevel() != startLevel
+         || reader.numLevels() != numLevels) {
+            std::cerr << "Stream has the wrong shape" << std::endl;
+            failed = true;
+        }
+
+        SubbandReplay replay(context.context, context.devices, reader);
+        DtcwtOutput replayed = replay.createOutputs();
+
+        for (size_t f = 0; f < reader.numFrames() && f < numFrames; ++f) {
+
+            replay(cq, f, replayed);
+            cq.finish();
+            Levels uploaded = readLevels(cq, replayed);
+
+            for (int l = 0; l < numLevels; ++l) {
+                if (!equal(expected[f][l],
+                           reader.level(f, startLevel + l))) {
+                    std::cerr << "Frame " << f << " level "
+                              << startLevel + l << " differs in the file"
+                              << std::endl;
+                    failed = true;
+                }
+
+                if (!equal(expected[f][l], uploaded[l].data())) {
+                    std::cerr << "Frame " << f << " level "
+                              << startLevel + l << " differs on replay"
+                              << std::endl;
+                    failed = true;
+                }
+            }
+        }
+
+        // A record cut short
+        {
+            std::ofstream file(filename, std::ios::binary | std::ios::app);
+            const std::vector<char> junk(100, 'S');
+            file.write(junk.data(), junk.size());
+        }
+
+        if (SubbandReader(filename).numFrames() != numFrames) {
+            std::cerr << "Partly written record not ignored" << std::endl;
+            failed = true;
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    std::remove(filename);
+
+    return failed? -1 : 0;
+}
+
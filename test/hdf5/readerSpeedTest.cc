@@ -0,0 +1,178 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "hdf5/hdfreader.h"
+#include "hdf5/bufferedHDFWriter.h"
+
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Write a file of random keypoints, then time reading it back with
+    // HDFReader: a frame at a time, in blocks, streamed with and without
+    // prefetching (with a pause per block standing in for using it), and
+    // random blocks from several threads at once.
+
+    size_t numFrames = 2000, meanKeypoints = 200, numThreads = 4;
+
+    // First and second arguments: frames, and mean keypoints per frame
+    if (argc > 2) {
+        numFrames = readStr<size_t>(argv[1]);
+        meanKeypoints = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: threads
+    if (argc > 3)
+        numThreads = readStr<size_t>(argv[3]);
+
+    // Fourth argument: compression (none or deflate)
+    HDFWriter::Storage storage;
+    if (argc > 4 && std::string(argv[4]) == "deflate")
+        storage.compression = HDFWriter::Deflate;
+
+    const size_t descriptorLength = 2*6*14, framesPerBlock = 32;
+    const char* filename = "readerSpeedTest.h5";
+
+    try {
+
+        {
+            std::mt19937 rng(0);
+            std::poisson_distribution<size_t> numKeypoints(meanKeypoints);
+            std::normal_distribution<float> value(0.f, 0.2f);
+
+            std::vector<float> keypoints(4 * 4 * meanKeypoints),
+                               descriptors(descriptorLength * 4
+                                            * meanKeypoints);
+            for (float& v: keypoints)
+                v = value(rng);
+            for (float& v: descriptors)
+                v = value(rng);
+
+            BufferedHDFWriter writer(filename, descriptorLength,
+                                     HDFWriter::Float32, storage);
+            for (size_t n = 0; n < numFrames; ++n)
+                writer.append(std::min(numKeypoints(rng), 4 * meanKeypoints),
+                              keypoints.data(), descriptors.data());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        HDFReader reader(filename);
+        DurationSeconds openTime = std::chrono::steady_clock::now() - start;
+
+        const double mb = double(reader.numKeypoints())
+                        * (4 * sizeof(float) + reader.descriptorBytes())
+                        / 1e6;
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << reader.numFrames() << " frames, "
+                  << reader.numKeypoints() << " keypoints, " << mb
+                  << " MB; opening took "
+                  << openTime.count() * 1e3 << " ms" << std::endl;
+
+        auto report = [&] (const char* name, DurationSeconds time,
+                           double fraction) {
+            std::cout << std::setw(28) << std::left << name << std::right
+                      << std::setw(10) << fraction * mb / time.count()
+                      << " MB/s" << std::setw(12)
+                      << fraction * reader.numFrames() / time.count()
+                      << " frames/s" << std::endl;
+        };
+
+        HDFReader::Frames frames;
+
+        // A frame at a time
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < reader.numFrames(); ++n)
+            reader.read(n, 1, frames);
+        report("Single frames", std::chrono::steady_clock::now() - start, 1.);
+
+        // Blocks
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < reader.numFrames(); n += framesPerBlock)
+            reader.read(n, std::min(framesPerBlock, reader.numFrames() - n),
+                        frames);
+        DurationSeconds blocksTime = std::chrono::steady_clock::now() - start;
+        report("Blocks", blocksTime, 1.);
+
+        // Streamed, spending as long on each block as it took to read
+        const DurationSeconds pause
+            = blocksTime * double(framesPerBlock)
+                / double(reader.numFrames());
+
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < reader.numFrames(); n += framesPerBlock) {
+            reader.read(n, std::min(framesPerBlock, reader.numFrames() - n),
+                        frames);
+            std::this_thread::sleep_for(pause);
+        }
+        report("Blocks then use", std::chrono::steady_clock::now() - start,
+               1.);
+
+        start = std::chrono::steady_clock::now();
+        {
+            HDFReader::Stream stream(reader, framesPerBlock);
+            while (stream.next(frames))
+                std::this_thread::sleep_for(pause);
+        }
+        report("Stream prefetching use",
+               std::chrono::steady_clock::now() - start, 1.);
+
+        // Random blocks from several threads, each reading as much as the
+        // whole file
+        start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < numThreads; ++t)
+            threads.emplace_back([&, t] () {
+                std::mt19937 rng(t);
+                std::uniform_int_distribution<size_t>
+                    first(0, reader.numFrames() - framesPerBlock);
+                HDFReader::Frames threadFrames;
+                for (size_t n = 0; n < reader.numFrames();
+                     n += framesPerBlock)
+                    reader.read(first(rng), framesPerBlock, threadFrames);
+            });
+        for (auto& t: threads)
+            t.join();
+
+        std::ostringstream name;
+        name << "Random blocks, " << numThreads << " threads";
+        report(name.str().c_str(), std::chrono::steady_clock::now() - start,
+               double(numThreads));
+
+        std::remove(filename);
+    }
+    catch (H5::Exception& err) {
+        std::cerr << "Error: " << err.getDetailMsg() << std::endl;
+        return -1;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,223 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "hdf5/hdfreader.h"
+#include "hdf5/bufferedHDFWriter.h"
+
+// Writes frames of random keypoints, with float descriptors at full and
+// half precision and with int8 codes, then checks that HDFReader gives the
+// same back: for ranges of frames, through a stream, and from several
+// threads at once.
+
+
+struct Written {
+    std::vector<size_t> counts, starts;
+    std::vector<float> keypoints;
+    std::vector<char> descriptors;
+};
+
+
+// Check frames against what was written, allowing tolerance for floats
+static bool matches(const HDFReader::Frames& frames, const Written& written,
+                    size_t descriptorBytes, bool floats, float tolerance)
+{
+    for (size_t n = 0; n < frames.numFrames(); ++n) {
+        const size_t frame = frames.firstFrame + n;
+        const size_t count = written.counts[frame];
+
+        if (frames.keypointCounts[n] != count)
+            return false;
+
+        const size_t from = frames.keypointStarts[n],
+                     to = written.starts[frame];
+
+        if (!std::equal(&frames.keypoints[4 * from],
+                        &frames.keypoints[4 * (from + count)],
+                        &written.keypoints[4 * to]))
+            return false;
+
+        const char* read = &frames.descriptors[descriptorBytes * from];
+        const char* wrote = &written.descriptors[descriptorBytes * to];
+
+        if (!floats) {
+            if (std::memcmp(read, wrote, descriptorBytes * count) != 0)
+                return false;
+            continue;
+        }
+
+        const float* a = reinterpret_cast<const float*>(read);
+        const float* b = reinterpret_cast<const float*>(wrote);
+        for (size_t i = 0; i < descriptorBytes * count / sizeof(float); ++i)
+            if (std::fabs(a[i] - b[i]) > tolerance)
+                return false;
+    }
+
+    return true;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    const size_t numFrames = 300, descriptorLength = 168;
+
+    std::mt19937 rng(43);
+    std::poisson_distribution<size_t> numKeypoints(30);
+    std::normal_distribution<float> value(0.f, 0.2f);
+
+    struct Case {
+        const char* name;
+        HDFWriter::DescriptorFormat format;
+        HDFWriter::Precision precision;
+        float tolerance;
+    };
+
+    const Case cases[] = {
+        {"Float32", HDFWriter::Float32, HDFWriter::FullPrecision, 0.f},
+        {"Half",    HDFWriter::Float32, HDFWriter::HalfPrecision, 1e-3f},
+        {"Int8",    HDFWriter::Int8,    HDFWriter::FullPrecision, 0.f},
+    };
+
+    try {
+
+        for (const Case& c: cases) {
+
+            const size_t descriptorBytes
+                = descriptorLength * HDFWriter::elementSize(c.format);
+
+            // Some empty frames too
+            Written written;
+            for (size_t n = 0; n < numFrames; ++n) {
+                written.starts.push_back(written.keypoints.size() / 4);
+                written.counts.push_back((n % 7 == 3)? 0 : numKeypoints(rng));
+                written.keypoints.resize(written.keypoints.size()
+                                          + 4 * written.counts.back());
+            }
+
+            const size_t total = written.keypoints.size() / 4;
+            for (float& v: written.keypoints)
+                v = value(rng);
+
+            written.descriptors.resize(descriptorBytes * total);
+            if (c.format == HDFWriter::Float32) {
+                float* values
+                    = reinterpret_cast<float*>(written.descriptors.data());
+                for (size_t n = 0; n < descriptorLength * total; ++n)
+                    values[n] = value(rng);
+            } else
+                for (char& v: written.descriptors)
+                    v = char(rng());
+
+            {
+                HDFWriter::Storage storage;
+                storage.precision = c.precision;
+                storage.compression = HDFWriter::Deflate;
+
+                BufferedHDFWriter writer("readerTest.h5", descriptorLength,
+                                         c.format, storage, 256, 16);
+                for (size_t n = 0; n < numFrames; ++n)
+                    writer.append(written.counts[n],
+                                  &written.keypoints[4 * written.starts[n]],
+                                  &written.descriptors[descriptorBytes
+                                                       * written.starts[n]]);
+            }
+
+            HDFReader reader("readerTest.h5");
+            const bool floats = c.format == HDFWriter::Float32;
+
+            if (reader.numFrames() != numFrames
+             || reader.numKeypoints() != total
+             || reader.format() != c.format
+             || reader.descriptorBytes() != descriptorBytes) {
+                std::cerr << c.name << ": wrong sizes or format"
+                          << std::endl;
+                failed = true;
+                continue;
+            }
+
+            // Assorted ranges, including empty ones and the whole file
+            const size_t ranges[][2] = {{0, 1}, {3, 1}, {10, 25},
+                                        {0, numFrames}, {numFrames, 0},
+                                        {numFrames - 5, 5}};
+            for (auto& r: ranges)
+                if (!matches(reader.read(r[0], r[1]), written,
+                             descriptorBytes, floats, c.tolerance)) {
+                    std::cerr << c.name << ": frames " << r[0] << " + "
+                              << r[1] << " wrong" << std::endl;
+                    failed = true;
+                }
+
+            // Streamed, from part way in
+            {
+                HDFReader::Stream stream(reader, 17, 5);
+                HDFReader::Frames frames;
+                size_t nextFrame = 5;
+                while (stream.next(frames)) {
+                    if (frames.firstFrame != nextFrame
+                     || !matches(frames, written, descriptorBytes, floats,
+                                 c.tolerance)) {
+                        std::cerr << c.name << ": stream wrong at frame "
+                                  << nextFrame << std::endl;
+                        failed = true;
+                        break;
+                    }
+                    nextFrame += frames.numFrames();
+                }
+
+                if (nextFrame != numFrames) {
+                    std::cerr << c.name << ": stream ended at frame "
+                              << nextFrame << std::endl;
+                    failed = true;
+                }
+            }
+
+            // Random ranges from several threads
+            std::vector<int> threadFailed(4, 0);
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < threadFailed.size(); ++t)
+                threads.emplace_back([&, t] () {
+                    std::mt19937 threadRng(t);
+                    std::uniform_int_distribution<size_t>
+                        start(0, numFrames - 1), length(1, 20);
+                    HDFReader::Frames frames;
+                    for (int n = 0; n < 200; ++n) {
+                        const size_t first = start(threadRng);
+                        reader.read(first, std::min(length(threadRng),
+                                                    numFrames - first),
+                                    frames);
+                        if (!matches(frames, written, descriptorBytes,
+                                     floats, c.tolerance))
+                            threadFailed[t] = 1;
+                    }
+                });
+            for (auto& t: threads)
+                t.join();
+
+            if (std::count(threadFailed.begin(), threadFailed.end(), 1)) {
+                std::cerr << c.name << ": concurrent reads wrong"
+                          << std::endl;
+                failed = true;
+            }
+        }
+
+    }
+    catch (H5::Exception& err) {
+        std::cerr << "Error: " << err.getDetailMsg() << std::endl;
+        failed = true;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
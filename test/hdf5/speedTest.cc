@@ -0,0 +1,167 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <thread>
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "hdf5/hdfwriter.h"
+#include "hdf5/bufferedHDFWriter.h"
+
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+static std::vector<hsize_t> readFrames(const std::string& filename)
+{
+    H5::H5File file(filename, H5F_ACC_RDONLY);
+    H5::DataSet frames = file.openDataSet("frames");
+
+    hsize_t dims[2];
+    frames.getSpace().getSimpleExtentDims(dims);
+
+    std::vector<hsize_t> result(dims[0] * dims[1]);
+    if (!result.empty())
+        frames.read(result.data(), H5::PredType::NATIVE_HSIZE);
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Compare writing frames one at a time with HDFWriter::append against
+    // BufferedHDFWriter: the time the caller spends appending, and the
+    // total once everything is on disk.  Each frame also sleeps for a
+    // while, standing in for waiting on the device to compute it, which the
+    // buffered writes can overlap with.  Then check both files have the same frames table.
+
+    size_t numFrames = 2000, meanKeypoints = 200;
+
+    // First and second arguments: frames, and mean keypoints per frame
+    if (argc > 2) {
+        numFrames = readStr<size_t>(argv[1]);
+        meanKeypoints = readStr<size_t>(argv[2]);
+    }
+
+    // Third argument: keypoints per block
+    size_t blockKeypoints = 4096;
+    if (argc > 3)
+        blockKeypoints = readStr<size_t>(argv[3]);
+
+    // Fourth argument: microseconds of waiting per frame
+    double workMicroseconds = 200.;
+    if (argc > 4)
+        workMicroseconds = readStr<double>(argv[4]);
+
+    auto work = [=] () {
+        std::this_thread::sleep_for(
+            std::chrono::duration<double, std::micro>(workMicroseconds));
+    };
+
+    const size_t descriptorLength = 2*6*14;
+
+    try {
+
+        std::mt19937 rng(0);
+        std::poisson_distribution<size_t> numKeypoints(meanKeypoints);
+        std::uniform_real_distribution<float> value(-1.f, 1.f);
+
+        std::vector<size_t> counts(numFrames);
+        size_t maxKeypoints = 0;
+        for (size_t& c: counts) {
+            c = numKeypoints(rng);
+            maxKeypoints = std::max(maxKeypoints, c);
+        }
+
+        std::vector<float> keypoints(4 * maxKeypoints),
+                           descriptors(descriptorLength * maxKeypoints);
+        for (float& v: keypoints)
+            v = value(rng);
+        for (float& v: descriptors)
+            v = value(rng);
+
+        // Per-frame appends
+        DurationSeconds directTime;
+        {
+            auto start = std::chrono::steady_clock::now();
+            HDFWriter writer("speedTestDirect.h5", descriptorLength);
+            for (size_t c: counts) {
+                work();
+                writer.append(c, keypoints.data(), descriptors.data());
+            }
+            writer = HDFWriter();
+            directTime = std::chrono::steady_clock::now() - start;
+        }
+
+        // Buffered appends
+        DurationSeconds appendTime, bufferedTime;
+        BufferedHDFWriter::Stats stats;
+        {
+            auto start = std::chrono::steady_clock::now();
+            BufferedHDFWriter writer("speedTestBuffered.h5",
+                                     descriptorLength, HDFWriter::Float32,
+                                     HDFWriter::Storage(), blockKeypoints);
+            for (size_t c: counts) {
+                work();
+                writer.append(c, keypoints.data(), descriptors.data());
+            }
+            appendTime = std::chrono::steady_clock::now() - start;
+
+            writer.close();
+            bufferedTime = std::chrono::steady_clock::now() - start;
+            stats = writer.stats();
+        }
+
+        const double mb = double(std::accumulate(counts.begin(),
+                                                 counts.end(), size_t(0)))
+                        * (4 + descriptorLength) * sizeof(float) / 1e6;
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << numFrames << " frames, " << mb << " MB" << std::endl
+                  << "Per-frame:  " << directTime.count() * 1e6 / numFrames
+                  << " us per frame, " << mb / directTime.count()
+                  << " MB/s" << std::endl
+                  << "Buffered:   " << appendTime.count() * 1e6 / numFrames
+                  << " us per frame until the last append, "
+                  << mb / bufferedTime.count()
+                  << " MB/s including close" << std::endl
+                  << "  " << stats.numFlushes << " blocks, flush mean "
+                  << stats.meanFlushMs << " ms, max " << stats.maxFlushMs
+                  << " ms; max queue depth " << stats.maxQueueDepth
+                  << ", " << stats.numStalls << " stalls" << std::endl;
+
+        if (readFrames("speedTestDirect.h5")
+             != readFrames("speedTestBuffered.h5")) {
+            std::cerr << "Frames tables differ" << std::endl;
+            return -1;
+        }
+    }
+    catch (H5::Exception& err) {
+        std::cerr << "Error: " << err.getDetailMsg() << std::endl;
+        return -1;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
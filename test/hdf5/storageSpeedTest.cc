@@ -0,0 +1,281 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdio>
+#include <sys/stat.h>
+
+#include <chrono>
+typedef std::chrono::duration<double>
+    DurationSeconds;
+
+#include "hdf5/hdfwriter.h"
+
+
+#include <sstream>
+
+template <typename T>
+T readStr(const char* string)
+{
+    std::istringstream s(string);
+
+    T result;
+    s >> result;
+    return result;
+}
+
+
+static void readRows(H5::DataSet& dataset, hsize_t first, hsize_t numRows,
+                     hsize_t rowLength, float* out)
+{
+    H5::DataSpace dataspace = dataset.getSpace();
+    hsize_t offset[] = {first, 0};
+    hsize_t range[] = {numRows, rowLength};
+    dataspace.selectHyperslab(H5S_SELECT_SET, range, offset);
+
+    H5::DataSpace memSpace(2, range);
+    dataset.read(out, H5::PredType::NATIVE_FLOAT, memSpace, dataspace);
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // Write the same keypoints and descriptors with each storage option,
+    // and report the file size against the uncompressed full-precision
+    // layout (1024-row chunks, as HDFWriter has always written), write
+    // and read speeds, and the largest error in the descriptors read back.
+    // Reads are both of whole frames in order, and of single keypoints at
+    // random.
+    //
+    // Descriptors are random unless an HDFWriter file is given to take
+    // them (and the keypoints) from; random ones compress much less than
+    // real ones.
+
+    size_t numFrames = 500, meanKeypoints = 200;
+
+    // First and second arguments: frames, and mean keypoints per frame
+    if (argc > 2) {
+        numFrames = readStr<size_t>(argv[1]);
+        meanKeypoints = readStr<size_t>(argv[2]);
+    }
+
+    const size_t descriptorLength = 2*6*14;
+    const char* filename = "storageSpeedTest.h5";
+
+    try {
+
+        std::mt19937 rng(0);
+        std::vector<size_t> counts(numFrames);
+        std::vector<float> keypoints, descriptors;
+
+        if (argc > 3) {
+            // Third argument: file to take the data from
+            H5::H5File source(argv[3], H5F_ACC_RDONLY);
+            H5::DataSet sourceDescriptors
+                            = source.openDataSet("descriptors"),
+                        sourceKeypoints = source.openDataSet("keypoints");
+
+            hsize_t dims[2];
+            sourceDescriptors.getSpace().getSimpleExtentDims(dims);
+            if (dims[1] != descriptorLength)
+                throw std::runtime_error("Descriptors have the wrong "
+                                         "length");
+
+            const size_t numRows = std::min<size_t>(dims[0],
+                                                   numFrames * meanKeypoints);
+            keypoints.resize(4 * numRows);
+            descriptors.resize(descriptorLength * numRows);
+            readRows(sourceKeypoints, 0, numRows, 4, keypoints.data());
+            readRows(sourceDescriptors, 0, numRows, descriptorLength,
+                     descriptors.data());
+
+            // Equal frames
+            for (size_t n = 0; n < numFrames; ++n)
+                counts[n] = (n + 1) * numRows / numFrames
+                          - n * numRows / numFrames;
+        } else {
+            std::poisson_distribution<size_t> numKeypoints(meanKeypoints);
+            for (size_t& c: counts)
+                c = numKeypoints(rng);
+
+            const size_t numRows = std::accumulate(counts.begin(),
+                                                   counts.end(), size_t(0));
+
+            std::uniform_real_distribution<float> position(0.f, 640.f);
+            std::normal_distribution<float> value(0.f, 1.f);
+            std::lognormal_distribution<float> scale(-2.f, 0.5f);
+
+            keypoints.resize(4 * numRows);
+            for (size_t n = 0; n < numRows; ++n) {
+                keypoints[4*n] = position(rng);
+                keypoints[4*n + 1] = position(rng);
+                keypoints[4*n + 2] = 2.f;
+                keypoints[4*n + 3] = scale(rng);
+            }
+
+            descriptors.resize(descriptorLength * numRows);
+            for (size_t n = 0; n < numRows; ++n) {
+                const float s = scale(rng);
+                for (size_t i = 0; i < descriptorLength; ++i)
+                    descriptors[n * descriptorLength + i] = s * value(rng);
+            }
+        }
+
+        const size_t numRows = keypoints.size() / 4;
+        const double mb = double(keypoints.size() + descriptors.size())
+                        * sizeof(float) / 1e6;
+
+        struct Config {
+            const char* name;
+            HDFWriter::Compression compression;
+            HDFWriter::Precision precision;
+            size_t chunkRows;
+        };
+
+        const Config configs[] = {
+            {"original",       HDFWriter::Uncompressed,
+                               HDFWriter::FullPrecision,  1024},
+            {"deflate",        HDFWriter::Deflate,
+                               HDFWriter::FullPrecision,  4096},
+            {"lz4",            HDFWriter::LZ4,
+                               HDFWriter::FullPrecision,  4096},
+            {"zstd",           HDFWriter::Zstd,
+                               HDFWriter::FullPrecision,  4096},
+            {"half",           HDFWriter::Uncompressed,
+                               HDFWriter::HalfPrecision,  4096},
+            {"half+deflate",   HDFWriter::Deflate,
+                               HDFWriter::HalfPrecision,  4096},
+            {"half+zstd",      HDFWriter::Zstd,
+                               HDFWriter::HalfPrecision,  4096},
+            {"scaled",         HDFWriter::Uncompressed,
+                               HDFWriter::Scaled,         4096},
+            {"scaled+deflate", HDFWriter::Deflate,
+                               HDFWriter::Scaled,         4096},
+            {"half+deflate/64", HDFWriter::Deflate,
+                               HDFWriter::HalfPrecision,  64},
+        };
+
+        std::cout << numFrames << " frames, " << numRows << " keypoints, "
+                  << std::fixed << std::setprecision(1) << mb << " MB"
+                  << std::endl
+                  << "Storage          Chunk   Ratio  Write MB/s  "
+                     "Frames MB/s  Keypoints/s  Max error" << std::endl;
+
+        double originalSize = 0.;
+
+        for (const Config& config: configs) {
+
+            HDFWriter::Storage storage;
+            storage.compression = config.compression;
+            storage.precision = config.precision;
+            storage.chunkRows = config.chunkRows;
+
+            // Write in batches of 16 frames
+            auto start = std::chrono::steady_clock::now();
+            try {
+                HDFWriter writer(filename, descriptorLength,
+                                 HDFWriter::Float32, storage);
+
+                size_t row = 0;
+                for (size_t f = 0; f < numFrames; f += 16) {
+                    const size_t num = std::min<size_t>(16, numFrames - f);
+                    writer.appendFrames(num, &counts[f],
+                                        &keypoints[4 * row],
+                                        &descriptors[descriptorLength
+                                                      * row]);
+                    row += std::accumulate(&counts[f], &counts[f] + num,
+                                           size_t(0));
+                }
+            } catch (std::runtime_error& e) {
+                std::cout << std::setw(16) << std::left << config.name
+                          << std::right << " skipped: " << e.what()
+                          << std::endl;
+                continue;
+            }
+            DurationSeconds writeTime = std::chrono::steady_clock::now()
+                                      - start;
+
+            struct stat fileStat;
+            stat(filename, &fileStat);
+            const double size = fileStat.st_size;
+            if (originalSize == 0.)
+                originalSize = size;
+
+            H5::H5File file(filename, H5F_ACC_RDONLY);
+            H5::DataSet fileDescriptors = file.openDataSet("descriptors"),
+                        fileKeypoints = file.openDataSet("keypoints");
+
+            // Whole frames, in order, 16 at a time
+            std::vector<float> readKeypoints(keypoints.size()),
+                               readDescriptors(descriptors.size());
+            start = std::chrono::steady_clock::now();
+            size_t row = 0;
+            for (size_t f = 0; f < numFrames; f += 16) {
+                const size_t num = std::accumulate(
+                    &counts[f], &counts[f] + std::min<size_t>(16,
+                                                              numFrames - f),
+                    size_t(0));
+                readRows(fileKeypoints, row, num, 4,
+                         &readKeypoints[4 * row]);
+                readRows(fileDescriptors, row, num, descriptorLength,
+                         &readDescriptors[descriptorLength * row]);
+                row += num;
+            }
+            DurationSeconds framesTime = std::chrono::steady_clock::now()
+                                       - start;
+
+            // Single keypoints at random
+            const size_t numLookups = 1000;
+            std::uniform_int_distribution<size_t> randomRow(0, numRows - 1);
+            std::vector<float> one(descriptorLength);
+            start = std::chrono::steady_clock::now();
+            for (size_t n = 0; n < numLookups; ++n)
+                readRows(fileDescriptors, randomRow(rng), 1,
+                         descriptorLength, one.data());
+            DurationSeconds lookupTime = std::chrono::steady_clock::now()
+                                       - start;
+
+            float maxError = 0.f;
+            for (size_t n = 0; n < descriptors.size(); ++n)
+                maxError = std::max(maxError, std::fabs(readDescriptors[n]
+                                                        - descriptors[n]));
+            if (readKeypoints != keypoints) {
+                std::cerr << config.name << ": keypoints differ"
+                          << std::endl;
+                return -1;
+            }
+
+            std::cout << std::setw(16) << std::left << config.name
+                      << std::right
+                      << std::setw(6) << config.chunkRows
+                      << std::setw(7) << std::setprecision(2)
+                      << originalSize / size << "x"
+                      << std::setw(12) << std::setprecision(1)
+                      << mb / writeTime.count()
+                      << std::setw(13) << mb / framesTime.count()
+                      << std::setw(13) << std::setprecision(0)
+                      << numLookups / lookupTime.count()
+                      << std::setw(11) << std::setprecision(5)
+                      << maxError << std::endl;
+        }
+
+        std::remove(filename);
+    }
+    catch (H5::Exception& err) {
+        std::cerr << "Error: " << err.getDetailMsg() << std::endl;
+        return -1;
+    }
+    catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
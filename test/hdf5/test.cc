@@ -2,6 +2,9 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <random>
+#include <cmath>
+#include <algorithm>
 #include "hdf5/hdfwriter.h"
 
 
@@ -17,6 +20,44 @@ int main()
     hwtest.append(2, &zeros[0], &zeros[0]);
     hwtest.append(1, &zeros[0], &zeros[0]);
 
+    // Half precision descriptors, compressed, should read back to within
+    // half a unit in the last place (of 11 significant bits)
+    std::mt19937 rng(0);
+    std::normal_distribution<float> value(0.f, 0.1f);
+    std::vector<float> keypoints(4 * 100), descriptors(10 * 100);
+    for (float& v: descriptors)
+        v = value(rng);
+
+    {
+        HDFWriter::Storage storage;
+        storage.compression = HDFWriter::Deflate;
+        storage.precision = HDFWriter::HalfPrecision;
+
+        HDFWriter writer("test3.h5", 10, HDFWriter::Float32, storage);
+        const size_t counts[] = {60, 40};
+        writer.appendFrames(2, counts, &keypoints[0], &descriptors[0]);
+    }
+
+    H5::H5File file("test3.h5", H5F_ACC_RDONLY);
+    std::vector<float> readBack(descriptors.size());
+    file.openDataSet("descriptors").read(&readBack[0],
+                                         H5::PredType::NATIVE_FLOAT);
+
+    size_t numBad = 0;
+    for (size_t n = 0; n < descriptors.size(); ++n) {
+        const float tolerance
+            = std::max(std::ldexp(std::fabs(descriptors[n]), -11),
+                       std::ldexp(1.f, -25));
+        if (std::fabs(readBack[n] - descriptors[n]) > tolerance)
+            ++numBad;
+    }
+
+    if (numBad > 0) {
+        std::cerr << numBad << " half precision descriptor elements wrong"
+                  << std::endl;
+        return -1;
+    }
+
     return 0;
 }
 
@@ -0,0 +1,124 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef RANDOM_TRANSFORM_H
+#define RANDOM_TRANSFORM_H
+
+// For the tests that transform a random image and compare what comes out:
+// the image and transform setup, and reading levels back to the host.
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#include "CL/cl.hpp"
+
+#include <vector>
+#include <random>
+
+#include "DTCWT/dtcwt.h"
+
+
+typedef std::vector<Complex<cl_float>> Coefficients;
+
+
+struct RandomTransform {
+    // A width x height image of values uniform over [0, 1), uploaded into
+    // input, and the temporaries to transform it from startLevel for
+    // numLevels levels.  The seed makes each test's image its own.
+
+    RandomTransform(cl::Context& context, cl::CommandQueue& cq,
+                    unsigned int seed,
+                    size_t width = 200, size_t height = 150,
+                    int startLevel = 1, int numLevels = 3)
+     : width(width), height(height),
+       startLevel(startLevel), numLevels(numLevels),
+       env(context, width, height, startLevel, numLevels),
+       input(context, CL_MEM_READ_WRITE, width, height, 16, 32),
+       rng(seed), image_(width * height)
+    {
+        randomise(cq);
+    }
+
+    void randomise(cl::CommandQueue& cq,
+                   const std::vector<cl::Event>& waitEvents = {},
+                   cl::Event* doneEvent = nullptr)
+    // A fresh image into input
+    {
+        std::uniform_real_distribution<float> value(0.f, 1.f);
+        for (float& v: image_)
+            v = value(rng);
+
+        input.write(cq, image_.data(), waitEvents, doneEvent);
+    }
+
+    const size_t width, height;
+    const int startLevel, numLevels;
+
+    DtcwtTemps env;
+    ImageBuffer<cl_float> input;
+
+    std::mt19937 rng;       // Carries on after the image, for other values
+
+private:
+    std::vector<float> image_;
+};
+
+
+template <typename Level>
+inline Coefficients readLevel(cl::CommandQueue& cq, const Level& level)
+{
+    // All six orientations, one after the other and interleaved, whichever
+    // the layout
+    const size_t sliceSize = level.width() * level.height();
+    Coefficients values(sliceSize * 6);
+
+    for (size_t n = 0; n < 6; ++n)
+        readComplex(cq, level, n, &values[n * sliceSize]);
+
+    return values;
+}
+
+
+inline std::vector<Coefficients> readLevels(cl::CommandQueue& cq,
+                                            const DtcwtOutput& output)
+{
+    // Every level of a complex output, finest first
+    std::vector<Coefficients> levels;
+
+    for (const Subbands& subbands: output)
+        levels.push_back(readLevel(cq, subbands));
+
+    return levels;
+}
+
+
+template <typename T>
+inline std::vector<T> readSlices(cl::CommandQueue& cq,
+                                 const ImageBuffer<T>& level)
+{
+    // Every slice of a level, one after the other, for the formats that
+    // aren't complex
+    const size_t sliceSize = level.width() * level.height();
+    std::vector<T> values(sliceSize * level.numSlices());
+
+    for (size_t s = 0; s < level.numSlices(); ++s)
+        level.read(cq, &values[s * sliceSize], {}, s);
+
+    return values;
+}
+
+
+inline bool equal(const Coefficients& a, const Coefficients& b)
+{
+    // Exactly
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t n = 0; n < a.size(); ++n)
+        if (a[n].real != b[n].real || a[n].imag != b[n].imag)
+            return false;
+
+    return true;
+}
+
+
+#endif
+
@@ -0,0 +1,107 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "KeypointDetector/AdaptiveThreshold/adaptiveThreshold.h"
+
+// Two levels of made-up peaks: the first with far too many (more than were
+// stored), the second with too few.  Without smoothing, the first level's
+// threshold should land where the target fraction of its peaks are
+// stronger, and the second's should halve.
+
+const size_t posLen = 4, strengthIdx = 3;
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        AdaptiveThreshold adaptiveThreshold(context.context, context.devices,
+                                            posLen, strengthIdx);
+
+        const float initial = 0.05f;
+        const std::vector<cl_uint> startsV = {0, 1024},
+                                   capacitiesV = {1000, 500},
+                                   countsV = {4000, 10};
+
+        // Strengths above the threshold, spread over a few octaves
+        std::mt19937 rng(6);
+        std::uniform_real_distribution<float> octaves(0.f, 4.f);
+
+        std::vector<float> candidatesV((1024 + 500) * posLen, 0.f);
+        std::vector<float> strengths;
+        for (size_t n = 0; n < 2; ++n)
+            for (size_t i = 0; i < std::min(countsV[n], capacitiesV[n]); ++i) {
+                float s = initial * std::exp2(octaves(rng));
+                candidatesV[(startsV[n] + i) * posLen + strengthIdx] = s;
+                if (n == 0)
+                    strengths.push_back(s);
+            }
+
+        cl::Buffer candidates = createBuffer(context.context, cq,
+                                             candidatesV);
+        cl::Buffer starts(context.context, CL_MEM_READ_WRITE,
+                          startsV.size() * sizeof(cl_uint)),
+                   capacities(context.context, CL_MEM_READ_WRITE,
+                              capacitiesV.size() * sizeof(cl_uint)),
+                   counts(context.context, CL_MEM_READ_WRITE,
+                          countsV.size() * sizeof(cl_uint));
+        writeBuffer(cq, starts, startsV);
+        writeBuffer(cq, capacities, capacitiesV);
+        writeBuffer(cq, counts, countsV);
+
+        std::vector<float> thresholdsV = {initial, initial};
+        cl::Buffer thresholds = createBuffer(context.context, cq,
+                                             thresholdsV);
+
+        // 400 wanted per level, of which level 0 stored a quarter of those
+        // it found, so a hundred of those stored should be above
+        AdaptiveThreshold::Settings settings = {800, true, 1.f, 1e-4f, 1e4f};
+        adaptiveThreshold(cq, candidates, starts, capacities, counts, 2,
+                          settings, thresholds);
+
+        std::vector<float> result = readBuffer<float>(cq, thresholds);
+
+        std::sort(strengths.begin(), strengths.end(), std::greater<float>());
+        const float expected0 = strengths[99];
+
+        std::cout << "Thresholds " << result[0] << " (about " << expected0
+                  << "), " << result[1] << std::endl;
+
+        // Within a histogram bin
+        if (!(result[0] <= expected0
+              && result[0] > expected0 * std::exp2(-1.f / 32.f) * 0.999f)) {
+            std::cerr << "Level 0 threshold wrong" << std::endl;
+            failed = true;
+        }
+
+        if (std::fabs(result[1] - initial / 2) > 1e-6f) {
+            std::cerr << "Level 1 threshold should have halved"
+                      << std::endl;
+            failed = true;
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
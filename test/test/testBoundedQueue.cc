@@ -0,0 +1,118 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <thread>
+#include <memory>
+#include <vector>
+
+#include "util/boundedQueue.h"
+
+
+int main()
+{
+    bool failed = false;
+
+    // Single-threaded: capacity, ordering, and closing
+    {
+        BoundedQueue<int> queue(3);
+
+        for (int n = 0; n < 3; ++n)
+            if (!queue.tryPush(std::move(n))) {
+                std::cerr << "Push into non-full queue failed" << std::endl;
+                failed = true;
+            }
+
+        int extra = 3;
+        if (queue.tryPush(std::move(extra))) {
+            std::cerr << "Push into full queue succeeded" << std::endl;
+            failed = true;
+        }
+
+        queue.close();
+
+        int val, expected = 0;
+        while (queue.pop(&val))
+            if (val != expected++) {
+                std::cerr << "Out of order: " << val << std::endl;
+                failed = true;
+            }
+
+        if (expected != 3 || !queue.isClosed()) {
+            std::cerr << "Closed queue didn't drain properly" << std::endl;
+            failed = true;
+        }
+
+        if (queue.stats().maxDepth != 3) {
+            std::cerr << "Max depth " << queue.stats().maxDepth
+                      << ", expected 3" << std::endl;
+            failed = true;
+        }
+    }
+
+    // Threaded: a producer much faster than the consumer should be held
+    // back by the queue, and everything should arrive in order
+    {
+        const int numItems = 100000;
+        BoundedQueue<std::unique_ptr<int>> queue(8);
+
+        std::thread producer([&] () {
+            for (int n = 0; n < numItems; ++n)
+                queue.push(std::unique_ptr<int>(new int(n)));
+            queue.close();
+        });
+
+        std::unique_ptr<int> item;
+        int expected = 0;
+        while (queue.pop(&item)) {
+            if (*item != expected) {
+                std::cerr << "Got " << *item << ", expected " << expected
+                          << std::endl;
+                failed = true;
+                break;
+            }
+            ++expected;
+        }
+
+        producer.join();
+
+        auto stats = queue.stats();
+
+        std::cout << "Pushed " << stats.numPushed
+                  << ", max depth " << stats.maxDepth
+                  << ", push stall " << stats.pushStallMs << "ms"
+                  << ", pop stall " << stats.popStallMs << "ms" << std::endl;
+
+        if (expected != numItems || stats.maxDepth > queue.capacity()) {
+            std::cerr << "Threaded transfer failed" << std::endl;
+            failed = true;
+        }
+    }
+
+    // Cancelling wakes a blocked producer
+    {
+        BoundedQueue<int> queue(1);
+        int first = 0;
+        queue.push(std::move(first));
+
+        bool pushResult = true;
+        std::thread producer([&] () {
+            int second = 1;
+            pushResult = queue.push(std::move(second));
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.cancel();
+        producer.join();
+
+        if (pushResult) {
+            std::cerr << "Push into cancelled queue succeeded" << std::endl;
+            failed = true;
+        }
+    }
+
+    if (failed)
+        return -1;
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
+
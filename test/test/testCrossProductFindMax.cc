@@ -0,0 +1,129 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "KeypointDetector/EnergyMaps/CrossProduct/crossProduct.h"
+#include "KeypointDetector/FindMax/findMax.h"
+#include "KeypointDetector/CrossProductFindMax/crossProductFindMax.h"
+
+// The fused kernel should find the same peaks as CrossProductMap followed
+// by FindMax, on random subbands of a size that doesn't fill the last
+// workgroups
+
+
+static std::vector<std::vector<float>> readPeaks(cl::CommandQueue& cq,
+                                                 cl::Buffer& list,
+                                                 cl::Buffer& count,
+                                                 size_t posLen)
+{
+    // Sorted by position, since the order found is arbitrary
+    std::vector<cl_uint> n = readBuffer<cl_uint>(cq, count);
+    std::vector<float> values = readBuffer<float>(cq, list);
+
+    std::vector<std::vector<float>> peaks;
+    for (size_t k = 0; k < n[0]; ++k)
+        peaks.emplace_back(values.begin() + k * posLen,
+                           values.begin() + (k + 1) * posLen);
+
+    std::sort(peaks.begin(), peaks.end());
+    return peaks;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        const size_t width = 45, height = 37;
+        const float scale = 4.f, threshold = 0.01f;
+
+        Subbands subbands(context.context, CL_MEM_READ_WRITE,
+                          width, height, 2, 32, 6);
+
+        std::mt19937 rng(3);
+        std::normal_distribution<float> dist;
+        std::vector<Complex<cl_float>> values(width * height * 6);
+        for (auto& v: values)
+            v = {dist(rng), dist(rng)};
+        subbands.write(cq, &values[0]);
+
+        // The separate route
+        CrossProductMap crossProductMap(context.context, context.devices);
+        FindMax findMax(context.context, context.devices);
+
+        cl::Image2D energyMap = createImage2D(context.context, width, height);
+        crossProductMap(cq, subbands, energyMap);
+
+        float zero = 0.f;
+        cl::Image2D zeroImage(context.context,
+                              CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                              cl::ImageFormat(CL_LUMINANCE, CL_FLOAT),
+                              1, 1, 0, &zero);
+
+        const size_t posLen = findMax.getPosLength(), maxNum = 2000;
+
+        cl::Buffer separateList(context.context, CL_MEM_READ_WRITE,
+                                maxNum * posLen * sizeof(float));
+        cl::Buffer separateCount(context.context, CL_MEM_READ_WRITE,
+                                 sizeof(cl_uint));
+        std::vector<cl_uint> zeroCount = {0};
+        writeBuffer(cq, separateCount, zeroCount);
+
+        findMax(cq, energyMap, scale, zeroImage, 1.f, zeroImage, 1.f,
+                threshold, 0.f, separateList, separateCount, 0);
+
+        // The fused route
+        CrossProductFindMax fused(context.context, context.devices);
+
+        cl::Buffer fusedList(context.context, CL_MEM_READ_WRITE,
+                             maxNum * posLen * sizeof(float));
+        cl::Buffer fusedCount(context.context, CL_MEM_READ_WRITE,
+                              sizeof(cl_uint));
+        writeBuffer(cq, fusedCount, zeroCount);
+
+        fused(cq, subbands, scale, nullptr, 1.f, nullptr, 1.f,
+              threshold, fusedList, fusedCount, 0);
+
+        auto separate = readPeaks(cq, separateList, separateCount, posLen);
+        auto together = readPeaks(cq, fusedList, fusedCount, posLen);
+
+        std::cout << separate.size() << " peaks separately, "
+                  << together.size() << " fused" << std::endl;
+
+        if (separate.empty() || separate.size() != together.size()) {
+            std::cerr << "Different numbers of peaks" << std::endl;
+            failed = true;
+        } else {
+            for (size_t n = 0; n < separate.size(); ++n)
+                for (size_t m = 0; m < posLen; ++m)
+                    if (std::fabs(separate[n][m] - together[n][m])
+                            > 1e-3f * (1.f + std::fabs(separate[n][m]))) {
+                        std::cerr << "Peak " << n << " differs" << std::endl;
+                        failed = true;
+                        m = posLen;
+                    }
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
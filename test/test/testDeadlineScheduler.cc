@@ -0,0 +1,97 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <chrono>
+
+#include "Scheduling/deadlineScheduler.h"
+
+// Drive the scheduler with made-up timings, checking it drops stale
+// frames, steps down under sustained overload and back up with headroom
+
+typedef DeadlineScheduler::Clock Clock;
+
+
+int main()
+{
+    bool failed = false;
+
+    auto levels = DeadlineScheduler::defaultQualityLevels(3, 0.04f, 1000);
+
+    DeadlineScheduler scheduler(DeadlineScheduler::Milliseconds(40), levels);
+
+    Clock::time_point t = Clock::now();
+    const auto ms = [] (double v) {
+        return std::chrono::duration_cast<Clock::duration>
+                    (DeadlineScheduler::Milliseconds(v));
+    };
+
+    // A stale frame is dropped, a fresh one isn't
+    if (scheduler.shouldProcess(t, t + ms(50))
+     || !scheduler.shouldProcess(t, t + ms(10))) {
+        std::cerr << "Wrong stale frame decision" << std::endl;
+        failed = true;
+    }
+
+    // Comfortable frames: no change from best quality
+    for (int n = 0; n < 20; ++n) {
+        t += ms(33);
+        scheduler.shouldProcess(t, t);
+        scheduler.frameDone(t, t + ms(10));
+    }
+
+    if (scheduler.qualityIndex() != 0) {
+        std::cerr << "Stepped down without overload" << std::endl;
+        failed = true;
+    }
+
+    // Sustained lateness: should step down, repeatedly
+    for (int n = 0; n < 16; ++n) {
+        t += ms(33);
+        scheduler.shouldProcess(t, t);
+        scheduler.frameDone(t, t + ms(60));
+    }
+
+    if (scheduler.qualityIndex() != 2) {
+        std::cerr << "Expected quality 2 after overload, got "
+                  << scheduler.qualityIndex() << std::endl;
+        failed = true;
+    }
+
+    if (scheduler.quality().maxNumKeypoints >= 1000) {
+        std::cerr << "Keypoint cap not lowered" << std::endl;
+        failed = true;
+    }
+
+    // Lots of headroom: should step back up, one level at a time
+    for (int n = 0; n < 120; ++n) {
+        t += ms(33);
+        scheduler.shouldProcess(t, t);
+        scheduler.frameDone(t, t + ms(5));
+    }
+
+    if (scheduler.qualityIndex() != 0) {
+        std::cerr << "Expected quality 0 after recovery, got "
+                  << scheduler.qualityIndex() << std::endl;
+        failed = true;
+    }
+
+    auto metrics = scheduler.metrics();
+
+    if (metrics.numDropped != 1 || metrics.numLate != 16
+            || metrics.numStepsDown != 2 || metrics.numStepsUp != 2) {
+        std::cerr << "Unexpected metrics" << std::endl;
+        failed = true;
+    }
+
+    if (!(metrics.latencyP50Ms <= metrics.latencyP90Ms
+          && metrics.latencyP90Ms <= metrics.latencyP99Ms
+          && metrics.latencyP99Ms <= metrics.latencyMaxMs
+          && metrics.latencyMaxMs == 60.0)) {
+        std::cerr << "Inconsistent latency percentiles" << std::endl;
+        failed = true;
+    }
+
+    scheduler.writeMetrics(std::cout);
+
+    return failed? -1 : 0;
+}
+
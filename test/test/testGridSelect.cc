@@ -0,0 +1,155 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "KeypointDetector/GridSelect/gridSelect.h"
+
+// Checks grid selection on the device against a direct implementation on
+// the host, for a random two-level list with clusters of keypoints
+
+const size_t posLen = 4, strengthIdx = 3;
+
+
+static bool beats(const std::vector<float>& list, size_t a, size_t b)
+{
+    float sa = list[a*posLen + strengthIdx], sb = list[b*posLen + strengthIdx];
+    return sa > sb || (sa == sb && a < b);
+}
+
+
+static std::vector<bool> referenceKeep(const std::vector<float>& list,
+                                       const GridSelect::Settings& s)
+{
+    const size_t num = list.size() / posLen;
+
+    std::vector<bool> survives(num, true);
+    for (size_t i = 0; i < num; ++i)
+        for (size_t j = 0; j < num; ++j) {
+            float dx = list[j*posLen] - list[i*posLen],
+                  dy = list[j*posLen+1] - list[i*posLen+1];
+            float r = s.suppressionRadius
+                        * std::max(list[i*posLen+2], list[j*posLen+2]);
+            if (dx*dx + dy*dy < r*r && beats(list, j, i))
+                survives[i] = false;
+        }
+
+    std::vector<bool> keep(num);
+    for (size_t i = 0; i < num; ++i) {
+        size_t numBetter = 0;
+        for (size_t j = 0; j < num; ++j)
+            if (survives[j]
+             && std::floor(list[j*posLen] / s.cellSize)
+                    == std::floor(list[i*posLen] / s.cellSize)
+             && std::floor(list[j*posLen+1] / s.cellSize)
+                    == std::floor(list[i*posLen+1] / s.cellSize)
+             && beats(list, j, i))
+                ++numBetter;
+
+        keep[i] = survives[i] && numBetter < s.maxPerCell;
+    }
+
+    return keep;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        GridSelect gridSelect(context.context, context.devices,
+                              posLen, strengthIdx);
+
+        // Two levels, clustered so that suppression and the cell cap both
+        // have work to do
+        std::mt19937 rng(2);
+        std::uniform_real_distribution<float> centre(-200.f, 200.f),
+                                              offset(-6.f, 6.f),
+                                              strength(0.f, 1.f);
+
+        const std::vector<cl_uint> cumCountsV = {0, 300, 700};
+        const float scales[] = {4.f, 8.f};
+
+        std::vector<float> listV;
+        for (size_t l = 0; l < 2; ++l)
+            for (size_t n = cumCountsV[l]; n < cumCountsV[l+1]; n += 10) {
+                float cx = centre(rng), cy = centre(rng);
+                for (size_t m = 0; m < 10; ++m) {
+                    listV.push_back(cx + offset(rng));
+                    listV.push_back(cy + offset(rng));
+                    listV.push_back(scales[l]);
+                    listV.push_back(strength(rng));
+                }
+            }
+
+        // Spare room at the end, as in the real lists
+        std::vector<float> paddedV = listV;
+        paddedV.resize(listV.size() + 100 * posLen, 0.f);
+
+        cl::Buffer list = createBuffer(context.context, cq, paddedV);
+        cl::Buffer cumCounts(context.context, CL_MEM_READ_WRITE,
+                             cumCountsV.size() * sizeof(cl_uint));
+        writeBuffer(cq, cumCounts, cumCountsV);
+
+        const size_t capacity = paddedV.size() / posLen;
+        cl::Buffer survives(context.context, CL_MEM_READ_WRITE,
+                            capacity * sizeof(cl_uint)),
+                   keep(context.context, CL_MEM_READ_WRITE,
+                        capacity * sizeof(cl_uint));
+
+        GridSelect::Settings settings = {50.f, 3, 1.f};
+        gridSelect(cq, list, cumCounts, 2, settings, survives, keep);
+
+        std::vector<cl_uint> newCumCounts = readBuffer<cl_uint>(cq, cumCounts);
+        std::vector<float> result = readBuffer<float>(cq, list);
+
+        // What should be left, in order
+        std::vector<bool> expectedKeep = referenceKeep(listV, settings);
+
+        std::vector<float> expected;
+        std::vector<cl_uint> expectedCumCounts = {0};
+        for (size_t l = 0; l < 2; ++l) {
+            for (size_t n = cumCountsV[l]; n < cumCountsV[l+1]; ++n)
+                if (expectedKeep[n])
+                    expected.insert(expected.end(),
+                                    listV.begin() + n*posLen,
+                                    listV.begin() + (n+1)*posLen);
+            expectedCumCounts.push_back(expected.size() / posLen);
+        }
+
+        std::cout << expected.size() / posLen << " of "
+                  << listV.size() / posLen << " kept" << std::endl;
+
+        if (newCumCounts != expectedCumCounts
+         || !std::equal(expected.begin(), expected.end(), result.begin())) {
+            std::cerr << "Grid selection differs from reference" << std::endl;
+            failed = true;
+        }
+
+        if (expectedCumCounts.back() == cumCountsV.back()) {
+            std::cerr << "Test data too sparse to thin out" << std::endl;
+            failed = true;
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
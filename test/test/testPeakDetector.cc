@@ -94,6 +94,16 @@ int main()
 
         }
 
+        // More levels than the selection stages can take should be refused
+        // up front
+        try {
+            peakDetector.createResultsStructure
+                (std::vector<size_t>(PeakDetector::maxNumLevels + 1, 20), 20);
+            std::cerr << "Too many levels accepted" << std::endl;
+            return -1;
+        } catch (std::logic_error&) {
+        }
+
     }
     catch (cl::Error err) {
         std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
@@ -0,0 +1,171 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "MiscKernels/Primitives/primitives.h"
+
+// Checks the scan, compaction and segmented copy against the obvious host
+// versions, on sizes spanning several workgroups and not filling the last
+
+
+static std::vector<cl_uint> clampedCumSum(const std::vector<cl_uint>& v,
+                                          cl_uint maxSum)
+{
+    std::vector<cl_uint> result = {0};
+    cl_uint sum = 0;
+    for (cl_uint x: v) {
+        sum = std::min(sum + x, maxSum);
+        result.push_back(sum);
+    }
+    return result;
+}
+
+
+static cl::Buffer uintBuffer(cl::Context& context, std::vector<cl_uint>& v)
+{
+    return cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                      v.size() * sizeof(cl_uint), &v[0]);
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        Primitives primitives(context.context, context.devices);
+
+        std::mt19937 rng(5);
+        std::uniform_int_distribution<cl_uint> smallInt(0, 9);
+        std::uniform_real_distribution<float> value(-1.f, 1.f);
+
+        // Scan, with the clamp coming into force part way through
+        {
+            std::vector<cl_uint> input(700);
+            for (auto& x: input)
+                x = smallInt(rng);
+
+            const cl_uint maxSum = 2000;
+
+            cl::Buffer inputBuffer = uintBuffer(context.context, input);
+            cl::Buffer cumSum(context.context, CL_MEM_READ_WRITE,
+                              (input.size() + 1) * sizeof(cl_uint));
+
+            primitives.scan(cq, inputBuffer, input.size(), cumSum, maxSum);
+
+            if (readBuffer<cl_uint>(cq, cumSum)
+                    != clampedCumSum(input, maxSum)) {
+                std::cerr << "Scan differs from reference" << std::endl;
+                failed = true;
+            }
+        }
+
+        // Compaction of three-float items
+        {
+            const size_t numItems = 600, itemLen = 3;
+
+            std::vector<float> input(numItems * itemLen);
+            for (auto& x: input)
+                x = value(rng);
+
+            std::vector<cl_uint> flags(numItems);
+            for (auto& f: flags)
+                f = smallInt(rng) < 4;
+
+            std::vector<float> expected;
+            for (size_t n = 0; n < numItems; ++n)
+                if (flags[n])
+                    expected.insert(expected.end(),
+                                    input.begin() + n * itemLen,
+                                    input.begin() + (n+1) * itemLen);
+
+            cl::Buffer inputBuffer = createBuffer(context.context, cq, input);
+            cl::Buffer flagsBuffer = uintBuffer(context.context, flags);
+            cl::Buffer output(context.context, CL_MEM_READ_WRITE,
+                              input.size() * sizeof(float));
+            cl::Buffer count(context.context, CL_MEM_READ_WRITE,
+                             sizeof(cl_uint));
+
+            primitives.compact(cq, inputBuffer, flagsBuffer, numItems,
+                               itemLen, output, count);
+
+            std::vector<cl_uint> countV = readBuffer<cl_uint>(cq, count);
+            std::vector<float> result = readBuffer<float>(cq, output);
+
+            if (countV[0] * itemLen != expected.size()
+             || !std::equal(expected.begin(), expected.end(),
+                            result.begin())) {
+                std::cerr << "Compaction differs from reference"
+                          << std::endl;
+                failed = true;
+            }
+        }
+
+        // Segmented copy, with gaps between the segments, an empty one, and
+        // the last cut short by the output size
+        {
+            const size_t itemLen = 4;
+            std::vector<cl_uint> starts = {0, 400, 410, 900};
+            std::vector<cl_uint> counts = {350, 0, 300, 200};
+            const cl_uint maxSum = 750;
+
+            std::vector<float> input(1200 * itemLen);
+            for (auto& x: input)
+                x = value(rng);
+
+            std::vector<cl_uint> expectedCum = clampedCumSum(counts, maxSum);
+            std::vector<float> expected;
+            for (size_t s = 0; s < starts.size(); ++s) {
+                size_t num = expectedCum[s+1] - expectedCum[s];
+                expected.insert(expected.end(),
+                                input.begin() + starts[s] * itemLen,
+                                input.begin() + (starts[s] + num) * itemLen);
+            }
+
+            cl::Buffer inputBuffer = createBuffer(context.context, cq, input);
+            cl::Buffer startsBuffer = uintBuffer(context.context, starts);
+            cl::Buffer countsBuffer = uintBuffer(context.context, counts);
+            cl::Buffer output(context.context, CL_MEM_READ_WRITE,
+                              maxSum * itemLen * sizeof(float));
+            cl::Buffer cumCounts(context.context, CL_MEM_READ_WRITE,
+                                 (counts.size() + 1) * sizeof(cl_uint));
+
+            primitives.segmentedCopy(cq, inputBuffer,
+                                     startsBuffer, countsBuffer,
+                                     counts.size(), maxSum, itemLen,
+                                     output, cumCounts);
+
+            std::vector<cl_uint> cumResult
+                = readBuffer<cl_uint>(cq, cumCounts);
+            std::vector<float> result = readBuffer<float>(cq, output);
+
+            if (cumResult != expectedCum
+             || !std::equal(expected.begin(), expected.end(),
+                            result.begin())) {
+                std::cerr << "Segmented copy differs from reference"
+                          << std::endl;
+                failed = true;
+            }
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
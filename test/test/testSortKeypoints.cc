@@ -0,0 +1,158 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <tuple>
+#include <cmath>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "KeypointDetector/SortKeypoints/sortKeypoints.h"
+
+// Sorts a two-level list on the device in both orders, and checks it against
+// sorting on the host.  Also checks that a shuffled copy of the list comes
+// out the same, which is the point of sorting.
+
+const size_t posLen = 4;
+
+
+static cl_uint spreadBits(cl_uint v)
+{
+    cl_uint r = 0;
+    for (int b = 0; b < 16; ++b)
+        r |= ((v >> b) & 1) << (2*b);
+    return r;
+}
+
+
+static std::tuple<cl_uint, float, float>
+    key(const float* kp, SortKeypoints::Order order)
+{
+    auto q = [](float v) {
+        return cl_uint(std::min(std::max(int(std::floor(v)) + 32768, 0),
+                                65535));
+    };
+    cl_uint qx = q(kp[0] / kp[2]), qy = q(kp[1] / kp[2]);
+
+    cl_uint pixel = (order == SortKeypoints::Morton)?
+                        spreadBits(qx) | (spreadBits(qy) << 1)
+                      : (qy << 16) | qx;
+
+    return std::make_tuple(pixel, kp[1], kp[0]);
+}
+
+
+static std::vector<float> referenceSort(const std::vector<float>& list,
+                                        const std::vector<cl_uint>& cumCounts,
+                                        SortKeypoints::Order order)
+{
+    std::vector<float> result;
+
+    for (size_t s = 0; s + 1 < cumCounts.size(); ++s) {
+        std::vector<size_t> idx;
+        for (size_t n = cumCounts[s]; n < cumCounts[s+1]; ++n)
+            idx.push_back(n);
+
+        std::stable_sort(idx.begin(), idx.end(), [&](size_t a, size_t b) {
+            return key(&list[a*posLen], order) < key(&list[b*posLen], order);
+        });
+
+        for (size_t n: idx)
+            result.insert(result.end(), list.begin() + n*posLen,
+                                        list.begin() + (n+1)*posLen);
+    }
+
+    return result;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        SortKeypoints sortKeypoints(context.context, context.devices, posLen);
+
+        std::mt19937 rng(4);
+        std::uniform_real_distribution<float> coord(-300.f, 300.f),
+                                              strength(0.f, 1.f);
+
+        const std::vector<cl_uint> cumCountsV = {0, 700, 1000};
+        const float scales[] = {4.f, 8.f};
+
+        std::vector<float> listV;
+        for (size_t l = 0; l < 2; ++l)
+            for (size_t n = cumCountsV[l]; n < cumCountsV[l+1]; ++n) {
+                listV.push_back(coord(rng));
+                listV.push_back(coord(rng));
+                listV.push_back(scales[l]);
+                listV.push_back(strength(rng));
+            }
+
+        // The same keypoints in a different order within each level
+        std::vector<float> shuffledV;
+        for (size_t l = 0; l < 2; ++l) {
+            std::vector<size_t> idx;
+            for (size_t n = cumCountsV[l]; n < cumCountsV[l+1]; ++n)
+                idx.push_back(n);
+            std::shuffle(idx.begin(), idx.end(), rng);
+            for (size_t n: idx)
+                shuffledV.insert(shuffledV.end(), listV.begin() + n*posLen,
+                                                  listV.begin() + (n+1)*posLen);
+        }
+
+        const size_t capacity = listV.size() / posLen;
+
+        cl::Buffer cumCounts(context.context, CL_MEM_READ_WRITE,
+                             cumCountsV.size() * sizeof(cl_uint));
+        writeBuffer(cq, cumCounts, cumCountsV);
+
+        cl::Buffer indices(context.context, CL_MEM_READ_WRITE,
+                           2 * capacity * sizeof(cl_uint));
+        cl::Buffer scratch(context.context, CL_MEM_READ_WRITE,
+                           capacity * posLen * sizeof(float));
+
+        for (auto order: {SortKeypoints::RowMajor, SortKeypoints::Morton}) {
+
+            cl::Buffer list = createBuffer(context.context, cq, listV);
+            cl::Buffer shuffled = createBuffer(context.context, cq, shuffledV);
+
+            sortKeypoints(cq, list, cumCounts, 2, order, indices, scratch);
+            sortKeypoints(cq, shuffled, cumCounts, 2, order,
+                          indices, scratch);
+
+            std::vector<float> result = readBuffer<float>(cq, list);
+            std::vector<float> shuffledResult
+                = readBuffer<float>(cq, shuffled);
+
+            if (result != referenceSort(listV, cumCountsV, order)) {
+                std::cerr << "Order " << order
+                          << " differs from reference" << std::endl;
+                failed = true;
+            }
+
+            if (result != shuffledResult) {
+                std::cerr << "Order " << order
+                          << " depends on the input order" << std::endl;
+                failed = true;
+            }
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
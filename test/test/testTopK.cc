@@ -0,0 +1,177 @@
+// Copyright (C) 2013 Timothy Gale
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "util/clUtil.h"
+
+#include "KeypointDetector/TopK/topK.h"
+
+// Checks the device top-K against a stable sort on the host, for a single
+// list (with an overrun count) and for a segmented one, both with plenty of
+// tied strengths
+
+const size_t posLen = 4, strengthIdx = 3;
+
+
+static std::vector<float> makeList(size_t num, std::mt19937& rng)
+{
+    // Strengths drawn from a small set, so there are ties; the other fields
+    // just identify the entry
+    std::uniform_int_distribution<int> dist(0, 40);
+
+    std::vector<float> list(num * posLen);
+    for (size_t n = 0; n < num; ++n) {
+        list[n*posLen + 0] = n;
+        list[n*posLen + 1] = -float(n);
+        list[n*posLen + 2] = 1.f;
+        list[n*posLen + strengthIdx] = 0.25f * dist(rng);
+    }
+
+    return list;
+}
+
+
+static std::vector<size_t> referenceTopK(const std::vector<float>& list,
+                                         size_t begin, size_t end, size_t k)
+{
+    // Indices of the k strongest in [begin, end), earliest first on ties,
+    // returned in list order
+    std::vector<size_t> idx;
+    for (size_t n = begin; n < end; ++n)
+        idx.push_back(n);
+
+    std::stable_sort(idx.begin(), idx.end(), [&] (size_t a, size_t b) {
+        return list[a*posLen + strengthIdx] > list[b*posLen + strengthIdx];
+    });
+
+    if (idx.size() > k)
+        idx.resize(k);
+
+    std::sort(idx.begin(), idx.end());
+    return idx;
+}
+
+
+static bool matches(const std::vector<float>& original,
+                    const std::vector<size_t>& expected,
+                    const std::vector<float>& result, size_t resultStart)
+{
+    for (size_t n = 0; n < expected.size(); ++n)
+        for (size_t m = 0; m < posLen; ++m)
+            if (result[(resultStart + n)*posLen + m]
+                    != original[expected[n]*posLen + m])
+                return false;
+
+    return true;
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    try {
+
+        CLContext context;
+        cl::CommandQueue cq(context.context, context.devices[0]);
+
+        TopK topK(context.context, context.devices, posLen, strengthIdx);
+
+        std::mt19937 rng(1);
+
+        //-----------------------------------------------------------------
+        // Single list, whose count claims more than the buffer holds
+        {
+            const size_t capacity = 1000, k = 300;
+            std::vector<float> listV = makeList(capacity, rng);
+
+            cl::Buffer list = createBuffer(context.context, cq, listV);
+            cl::Buffer counts(context.context, CL_MEM_READ_WRITE,
+                              2 * sizeof(cl_uint));
+            std::vector<cl_uint> initialCounts = {7, cl_uint(capacity + 50)};
+            writeBuffer(cq, counts, initialCounts);
+
+            topK.level(cq, list, counts, 1, k);
+
+            std::vector<cl_uint> countsV = readBuffer<cl_uint>(cq, counts);
+            std::vector<float> result = readBuffer<float>(cq, list);
+
+            if (countsV[0] != 7 || countsV[1] != k
+             || !matches(listV, referenceTopK(listV, 0, capacity, k),
+                         result, 0)) {
+                std::cerr << "Single list top-K wrong" << std::endl;
+                failed = true;
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Segmented list, including an empty segment
+        {
+            std::vector<cl_uint> cumCountsV = {0, 400, 400, 1100, 1500};
+            const size_t numSegments = cumCountsV.size() - 1, k = 500;
+
+            std::vector<float> listV = makeList(cumCountsV.back(), rng);
+
+            cl::Buffer list = createBuffer(context.context, cq, listV);
+            cl::Buffer cumCounts(context.context, CL_MEM_READ_WRITE,
+                                 cumCountsV.size() * sizeof(cl_uint));
+            writeBuffer(cq, cumCounts, cumCountsV);
+
+            topK.segmented(cq, list, cumCounts, numSegments, k);
+
+            std::vector<cl_uint> newCumCounts
+                = readBuffer<cl_uint>(cq, cumCounts);
+            std::vector<float> result = readBuffer<float>(cq, list);
+
+            std::vector<size_t> expected
+                = referenceTopK(listV, 0, cumCountsV.back(), k);
+
+            // Where each segment should now start
+            std::vector<cl_uint> expectedCumCounts;
+            for (cl_uint c: cumCountsV)
+                expectedCumCounts.push_back(
+                    std::lower_bound(expected.begin(), expected.end(), c)
+                        - expected.begin());
+
+            if (newCumCounts != expectedCumCounts
+             || !matches(listV, expected, result, 0)) {
+                std::cerr << "Segmented top-K wrong" << std::endl;
+                failed = true;
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Nothing to drop: should be left alone
+        {
+            std::vector<cl_uint> cumCountsV = {0, 10, 30};
+            std::vector<float> listV = makeList(30, rng);
+
+            cl::Buffer list = createBuffer(context.context, cq, listV);
+            cl::Buffer cumCounts(context.context, CL_MEM_READ_WRITE,
+                                 cumCountsV.size() * sizeof(cl_uint));
+            writeBuffer(cq, cumCounts, cumCountsV);
+
+            topK.segmented(cq, list, cumCounts, 2, 100);
+
+            if (readBuffer<cl_uint>(cq, cumCounts) != cumCountsV
+             || readBuffer<float>(cq, list) != listV) {
+                std::cerr << "Short list modified" << std::endl;
+                failed = true;
+            }
+        }
+
+    }
+    catch (cl::Error err) {
+        std::cerr << "Error: " << err.what() << "(" << err.err() << ")"
+                  << std::endl;
+        failed = true;
+    }
+
+    return failed? -1 : 0;
+}
+
@@ -0,0 +1,664 @@
+// Copyright (C) 2013 Timothy Gale
+//
+// Headless keypoint extraction.  Processes any number of videos (or
+// directories of images, treated as frame sequences), writing keypoints
+// and descriptors for each without opening a window.  Inputs are shared
+// between a configurable number of concurrent streams, which are spread
+// over the available OpenCL devices.
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "CL/cl.hpp"
+
+#include "DisplayOutput/calculator.h"
+#include "Filter/imageBuffer.h"
+#include "Filter/ImageToImageBuffer/imageToImageBuffer.h"
+#include "util/clUtil.h"
+
+#ifdef BATCH_WITH_FFMPEG
+#include "avmm/avmm.h"
+#endif
+
+#include "frameSource.h"
+#include "keypointSink.h"
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+#include <limits>
+
+
+typedef std::chrono::duration<double, std::milli>
+    DurationMilliseconds;
+
+// Descriptor length, in floats
+static const size_t descriptorLength = 2*6*14;
+
+
+struct Options {
+    std::vector<std::string> inputs;
+    std::string outputDir = ".";
+    std::string format = "hdf5";
+    size_t numStreams = 1;
+    size_t numDevices = 0;      // 0 means all of them
+    size_t maxNumKeypoints = 1000;
+    float gridCellSize = 0.f;   // 0 means no grid selection
+    size_t gridMaxPerCell = 2;
+    float gridRadius = 1.f;
+    std::string order = "found";
+    size_t targetKeypoints = 0; // 0 means a fixed threshold
+    std::string descriptors = "float";
+    std::string compression = "none";
+    int compressionLevel = 4;
+    std::string precision = "full";
+    int scaleDigits = 3;
+    size_t chunkRows = 0;       // 0 means the writer's block size
+};
+
+
+struct Stats {
+    // Accumulated over frames, per stage, for reporting at the end
+    size_t numFrames = 0;
+    size_t numKeypoints = 0;
+    size_t minKeypoints = std::numeric_limits<size_t>::max();
+    size_t maxKeypoints = 0;
+
+    DurationMilliseconds decode {0}, compute {0}, readback {0}, write {0};
+
+    void addFrame(size_t numKPs)
+    {
+        ++numFrames;
+        numKeypoints += numKPs;
+        minKeypoints = std::min(minKeypoints, numKPs);
+        maxKeypoints = std::max(maxKeypoints, numKPs);
+    }
+
+    Stats& operator+= (const Stats& s)
+    {
+        numFrames += s.numFrames;
+        numKeypoints += s.numKeypoints;
+        minKeypoints = std::min(minKeypoints, s.minKeypoints);
+        maxKeypoints = std::max(maxKeypoints, s.maxKeypoints);
+        decode += s.decode;
+        compute += s.compute;
+        readback += s.readback;
+        write += s.write;
+        return *this;
+    }
+};
+
+
+void printUsage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options] INPUT...\n"
+              << "  INPUT is a video file, or a directory of images\n"
+              << "  processed in filename order.\n\n"
+              << "Options:\n"
+              << "  --streams N        Inputs processed concurrently (1)\n"
+              << "  --devices N        OpenCL devices to use (all)\n"
+              << "  --max-keypoints N  Keypoint limit per frame (1000)\n"
+              << "  --grid-cell PIXELS Spread keypoints over a grid of\n"
+              << "                     cells this size (off)\n"
+              << "  --grid-max N       Keypoints kept per grid cell (2)\n"
+              << "  --grid-radius R    Suppress weaker keypoints within R\n"
+              << "                     times the keypoint scale (1)\n"
+              << "  --target-keypoints N\n"
+              << "                     Adapt the threshold each frame to\n"
+              << "                     find about N peaks (fixed)\n"
+              << "  --order O          Keypoint order within each level:\n"
+              << "                     found, raster or morton (found)\n"
+              << "  --descriptors D    float, or quantised to int8 or\n"
+              << "                     binary codes (float; codes need\n"
+              << "                     hdf5 or stream)\n"
+              << "  --compression C    hdf5 compression: none, deflate,\n"
+              << "                     or lz4 or zstd through the filter\n"
+              << "                     plugins (none)\n"
+              << "  --level N          Compression level (4)\n"
+              << "  --precision P      Float descriptor storage: full,\n"
+              << "                     half, or scaled to a number of\n"
+              << "                     decimal places (full)\n"
+              << "  --scale-digits N   Decimal places kept by scaled (3)\n"
+              << "  --chunk-rows N     hdf5 rows per chunk: more for\n"
+              << "                     reading whole frames, fewer for\n"
+              << "                     single keypoints (4096)\n"
+              << "  --format F         hdf5, stream (a flat file readers\n"
+              << "                     can map and follow as it grows)\n"
+              << "                     or binary (hdf5)\n"
+              << "  --output-dir DIR   Where to write results (.)\n";
+}
+
+
+template <typename T>
+T readValue(const std::string& option, const char* str)
+{
+    std::istringstream ss(str);
+    T val;
+    ss >> val;
+
+    if (ss.fail() || !ss.eof())
+        throw std::runtime_error("Bad value for " + option + ": " + str);
+
+    return val;
+}
+
+
+Options parseOptions(int argc, char* argv[])
+{
+    Options opts;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        if (arg.compare(0, 2, "--") != 0) {
+            opts.inputs.push_back(arg);
+            continue;
+        }
+
+        if (n + 1 >= argc)
+            throw std::runtime_error("Missing value for " + arg);
+        const char* value = argv[++n];
+
+        if (arg == "--streams")
+            opts.numStreams = readValue<size_t>(arg, value);
+        else if (arg == "--devices")
+            opts.numDevices = readValue<size_t>(arg, value);
+        else if (arg == "--max-keypoints")
+            opts.maxNumKeypoints = readValue<size_t>(arg, value);
+        else if (arg == "--grid-cell")
+            opts.gridCellSize = readValue<float>(arg, value);
+        else if (arg == "--grid-max")
+            opts.gridMaxPerCell = readValue<size_t>(arg, value);
+        else if (arg == "--grid-radius")
+            opts.gridRadius = readValue<float>(arg, value);
+        else if (arg == "--target-keypoints")
+            opts.targetKeypoints = readValue<size_t>(arg, value);
+        else if (arg == "--order")
+            opts.order = value;
+        else if (arg == "--descriptors")
+            opts.descriptors = value;
+        else if (arg == "--compression")
+            opts.compression = value;
+        else if (arg == "--level")
+            opts.compressionLevel = readValue<int>(arg, value);
+        else if (arg == "--precision")
+            opts.precision = value;
+        else if (arg == "--scale-digits")
+            opts.scaleDigits = readValue<int>(arg, value);
+        else if (arg == "--chunk-rows")
+            opts.chunkRows = readValue<size_t>(arg, value);
+        else if (arg == "--format")
+            opts.format = value;
+        else if (arg == "--output-dir")
+            opts.outputDir = value;
+        else
+            throw std::runtime_error("Unknown option " + arg);
+    }
+
+    if (opts.format != "hdf5" && opts.format != "stream"
+     && opts.format != "binary")
+        throw std::runtime_error("Format must be hdf5, stream or binary");
+
+    if (opts.order != "found" && opts.order != "raster"
+     && opts.order != "morton")
+        throw std::runtime_error("Order must be found, raster or morton");
+
+    if (opts.descriptors != "float" && opts.descriptors != "int8"
+     && opts.descriptors != "binary")
+        throw std::runtime_error("Descriptors must be float, int8 or binary");
+
+    if (opts.descriptors != "float" && opts.format == "binary")
+        throw std::runtime_error("Quantised descriptors need hdf5 or "
+                                 "stream format");
+
+    if (opts.compression != "none" && opts.compression != "deflate"
+     && opts.compression != "lz4" && opts.compression != "zstd")
+        throw std::runtime_error("Compression must be none, deflate, lz4 "
+                                 "or zstd");
+
+    if (opts.precision != "full" && opts.precision != "half"
+     && opts.precision != "scaled")
+        throw std::runtime_error("Precision must be full, half or scaled");
+
+    if ((opts.compression != "none" || opts.precision != "full")
+      && opts.format != "hdf5")
+        throw std::runtime_error("Compression and precision need hdf5 "
+                                 "format");
+
+    if (opts.precision != "full" && opts.descriptors != "float")
+        throw std::runtime_error("Reduced precision needs float "
+                                 "descriptors");
+
+    if (opts.numStreams == 0)
+        throw std::runtime_error("Need at least one stream");
+
+    return opts;
+}
+
+
+std::string outputFilename(const Options& opts, const std::string& input)
+{
+    // Use the last path component, without extension, of the input
+    std::string name = input;
+    while (!name.empty() && name.back() == '/')
+        name.pop_back();
+
+    size_t slash = name.rfind('/');
+    if (slash != std::string::npos)
+        name = name.substr(slash + 1);
+
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && dot > 0)
+        name = name.substr(0, dot);
+
+    const char* extension = ".kps";
+    if (opts.format == "hdf5")
+        extension = ".h5";
+    else if (opts.format == "stream")
+        extension = ".kpstream";
+
+    return opts.outputDir + "/" + name + extension;
+}
+
+
+HDFWriter::Storage storageOptions(const Options& opts)
+{
+    HDFWriter::Storage storage;
+
+    if (opts.compression == "deflate")
+        storage.compression = HDFWriter::Deflate;
+    else if (opts.compression == "lz4")
+        storage.compression = HDFWriter::LZ4;
+    else if (opts.compression == "zstd")
+        storage.compression = HDFWriter::Zstd;
+
+    if (opts.precision == "half")
+        storage.precision = HDFWriter::HalfPrecision;
+    else if (opts.precision == "scaled")
+        storage.precision = HDFWriter::Scaled;
+
+    storage.level = opts.compressionLevel;
+    storage.scaleDigits = opts.scaleDigits;
+    storage.chunkRows = opts.chunkRows;
+
+    return storage;
+}
+
+
+std::unique_ptr<KeypointSink> openSink(const Options& opts,
+                                       const std::string& filename)
+{
+    // Codes are written as bytes
+    HDFWriter::DescriptorFormat format = HDFWriter::Float32;
+    size_t length = descriptorLength;
+
+    if (opts.descriptors == "int8")
+        format = HDFWriter::Int8;
+    else if (opts.descriptors == "binary") {
+        format = HDFWriter::Binary;
+        length = (descriptorLength + 31) / 32 * 4;
+    }
+
+    if (opts.format == "hdf5")
+        return std::unique_ptr<KeypointSink>
+            (new HDFKeypointSink(filename, length, format,
+                                 storageOptions(opts)));
+    else if (opts.format == "stream")
+        return std::unique_ptr<KeypointSink>
+            (new StreamKeypointSink(filename, length, format));
+    else
+        return std::unique_ptr<KeypointSink>
+            (new BinaryKeypointSink(filename, descriptorLength));
+}
+
+
+
+class Stream {
+    // Everything needed to process one input at a time on one device.
+    // The OpenCL objects are recreated whenever the frame size changes.
+
+public:
+    Stream(cl::Context& context, const cl::Device& device,
+           const Options& opts)
+     : context_(context), device_(device),
+       maxNumKeypoints_(opts.maxNumKeypoints),
+       gridSettings_ {opts.gridCellSize, opts.gridMaxPerCell,
+                      opts.gridRadius},
+       order_(opts.order),
+       targetKeypoints_(opts.targetKeypoints),
+       descriptors_(opts.descriptors),
+       cq_(context, device),
+       imageToImageBuffer_(context, {device})
+    {}
+
+    Stats process(FrameSource& source, KeypointSink& sink);
+
+private:
+    void resize(size_t width, size_t height);
+
+    cl::Context context_;
+    cl::Device device_;
+    size_t maxNumKeypoints_;
+    GridSelect::Settings gridSettings_;
+    std::string order_;
+    size_t targetKeypoints_;
+    std::string descriptors_;
+
+    cl::CommandQueue cq_;
+    ImageToImageBuffer imageToImageBuffer_;
+
+    size_t width_ = 0, height_ = 0;
+    cl::Image2D imageGreyscale_;
+    ImageBuffer<cl_float> bufferGreyscale_;
+    std::unique_ptr<Calculator> calculator_;
+
+    std::vector<cl_float> locations_, descriptorFloats_;
+    std::vector<unsigned char> descriptorCodes_;
+};
+
+
+void Stream::resize(size_t width, size_t height)
+{
+    if (calculator_ && width == width_ && height == height_)
+        return;
+
+    width_ = width;
+    height_ = height;
+
+    imageGreyscale_ = cl::Image2D(context_, CL_MEM_READ_WRITE,
+                                  cl::ImageFormat(CL_LUMINANCE, CL_UNORM_INT8),
+                                  width, height);
+    bufferGreyscale_ = ImageBuffer<cl_float>(context_, CL_MEM_READ_WRITE,
+                                             width, height, 16, 32);
+    calculator_.reset(new Calculator(context_, device_, width, height,
+                                     maxNumKeypoints_));
+
+    if (gridSettings_.cellSize > 0.f)
+        calculator_->setGridSelection(gridSettings_);
+
+    if (targetKeypoints_ > 0)
+        calculator_->setAdaptiveThreshold({targetKeypoints_, false, 0.3f,
+                                           1e-4f, 1e4f});
+
+    if (order_ == "raster")
+        calculator_->setKeypointOrder(SortKeypoints::RowMajor);
+    else if (order_ == "morton")
+        calculator_->setKeypointOrder(SortKeypoints::Morton);
+
+    if (descriptors_ == "int8")
+        calculator_->setDescriptorQuantisation(DescriptorQuantiser::Int8);
+    else if (descriptors_ == "binary")
+        calculator_->setDescriptorQuantisation(DescriptorQuantiser::Binary);
+}
+
+
+Stats Stream::process(FrameSource& source, KeypointSink& sink)
+{
+    Stats stats;
+
+    resize(source.width(), source.height());
+
+    GreyscaleFrame frame;
+
+    while (true) {
+
+        // Decode
+        auto t0 = std::chrono::steady_clock::now();
+        if (!source.nextFrame(&frame))
+            break;
+
+        // Upload, transform and find keypoints
+        auto t1 = std::chrono::steady_clock::now();
+
+        cl::Event uploaded, converted;
+        cq_.enqueueWriteImage(imageGreyscale_, CL_FALSE,
+                              makeCLSizeT<3>({0, 0, 0}),
+                              makeCLSizeT<3>({width_, height_, 1}),
+                              0, 0, &frame.data[0],
+                              nullptr, &uploaded);
+
+        imageToImageBuffer_(cq_, imageGreyscale_, bufferGreyscale_,
+                            {uploaded}, &converted);
+
+        (*calculator_)(bufferGreyscale_, {converted});
+
+        // The total is the last of the cumulative counts
+        cl::Buffer cumCounts = calculator_->keypointCumCounts();
+        std::vector<cl::Event> locationsDone
+            = calculator_->keypointLocationEvents();
+
+        cl_uint numKPs;
+        cq_.enqueueReadBuffer(cumCounts, CL_TRUE,
+                              cumCounts.getInfo<CL_MEM_SIZE>()
+                                - sizeof(cl_uint),
+                              sizeof(cl_uint), &numKPs,
+                              &locationsDone);
+
+        // Read the results back
+        auto t2 = std::chrono::steady_clock::now();
+
+        // Only the codes need reading when quantising
+        const bool quantised = calculator_->descriptorQuantisation();
+
+        locations_.resize(4 * numKPs);
+        if (quantised)
+            descriptorCodes_.resize(calculator_->numBytesPerDescriptorCode()
+                                    * numKPs);
+        else
+            descriptorFloats_.resize(descriptorLength * numKPs);
+
+        if (numKPs > 0) {
+            cq_.enqueueReadBuffer(calculator_->keypointLocations(), CL_FALSE,
+                                  0, sizeof(cl_float) * locations_.size(),
+                                  &locations_[0], &locationsDone);
+
+            if (quantised) {
+                std::vector<cl::Event> codesDone
+                    = calculator_->keypointDescriptorCodeEvents();
+
+                cq_.enqueueReadBuffer(calculator_->keypointDescriptorCodes(),
+                                      CL_FALSE,
+                                      0, descriptorCodes_.size(),
+                                      &descriptorCodes_[0], &codesDone);
+            } else {
+                std::vector<cl::Event> descriptorsDone
+                    = calculator_->keypointDescriptorEvents();
+
+                cq_.enqueueReadBuffer(calculator_->keypointDescriptors(),
+                                      CL_FALSE, 0,
+                                      sizeof(cl_float)
+                                        * descriptorFloats_.size(),
+                                      &descriptorFloats_[0],
+                                      &descriptorsDone);
+            }
+        }
+        cq_.finish();
+
+        // Write
+        auto t3 = std::chrono::steady_clock::now();
+
+        sink.append(numKPs, locations_.data(),
+                    quantised? static_cast<const void*>
+                                   (descriptorCodes_.data())
+                             : descriptorFloats_.data());
+
+        auto t4 = std::chrono::steady_clock::now();
+
+        stats.decode += t1 - t0;
+        stats.compute += t2 - t1;
+        stats.readback += t3 - t2;
+        stats.write += t4 - t3;
+        stats.addFrame(numKPs);
+    }
+
+    return stats;
+}
+
+
+
+void printStats(std::ostream& os, const std::string& name,
+                const Stats& stats, DurationMilliseconds wallTime)
+{
+    double n = std::max<size_t>(stats.numFrames, 1);
+
+    os << name << ": " << stats.numFrames << " frames in "
+       << std::fixed << std::setprecision(1)
+       << wallTime.count() / 1000.0 << "s ("
+       << stats.numFrames / (wallTime.count() / 1000.0) << " fps)\n"
+       << "  per frame: decode " << std::setprecision(2)
+       << stats.decode.count() / n << "ms, compute "
+       << stats.compute.count() / n << "ms, readback "
+       << stats.readback.count() / n << "ms, write "
+       << stats.write.count() / n << "ms\n"
+       << "  keypoints: " << stats.numKeypoints << " total, "
+       << std::setprecision(1) << stats.numKeypoints / n << " mean, "
+       << (stats.numFrames? stats.minKeypoints : 0) << " min, "
+       << stats.maxKeypoints << " max\n";
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    try {
+        opts = parseOptions(argc, argv);
+    } catch (std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    if (opts.inputs.empty()) {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+#ifdef BATCH_WITH_FFMPEG
+    AV::registerAll();
+#endif
+
+    try {
+
+        // Set up OpenCL, with no need to share with OpenGL
+        std::vector<cl::Platform> platforms;
+        cl::Platform::get(&platforms);
+
+        if (platforms.size() == 0)
+            throw std::runtime_error("No platforms!");
+
+        std::vector<cl::Device> devices;
+        platforms[0].getDevices(CL_DEVICE_TYPE_ALL, &devices);
+
+        if (opts.numDevices > 0 && opts.numDevices < devices.size())
+            devices.resize(opts.numDevices);
+
+        cl::Context context(devices);
+
+        std::cerr << "Using " << devices.size() << " device(s), "
+                  << opts.numStreams << " stream(s)" << std::endl;
+
+        // Inputs are handed out to whichever stream is free next
+        std::queue<std::string> jobs;
+        for (auto& i: opts.inputs)
+            jobs.push(i);
+
+        std::mutex jobsMutex, reportMutex;
+        Stats totals;
+        bool failed = false;
+
+        auto startTime = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> workers;
+        for (size_t s = 0; s < opts.numStreams; ++s) {
+
+            const cl::Device& device = devices[s % devices.size()];
+
+            workers.emplace_back([&, device] () {
+
+                // Building the kernels can fail (the builders print their
+                // logs); an exception escaping the thread would terminate
+                std::unique_ptr<Stream> stream;
+                try {
+                    stream.reset(new Stream(context, device, opts));
+                } catch (cl::Error& err) {
+                    std::lock_guard<std::mutex> lock(reportMutex);
+                    std::cerr << "Setting up a stream: " << err.what()
+                              << " (" << err.err() << ")" << std::endl;
+                    failed = true;
+                    return;
+                } catch (std::exception& err) {
+                    std::lock_guard<std::mutex> lock(reportMutex);
+                    std::cerr << "Setting up a stream: " << err.what()
+                              << std::endl;
+                    failed = true;
+                    return;
+                }
+
+                while (true) {
+
+                    std::string input;
+                    {
+                        std::lock_guard<std::mutex> lock(jobsMutex);
+                        if (jobs.empty())
+                            return;
+                        input = jobs.front();
+                        jobs.pop();
+                    }
+
+                    try {
+                        auto inputStart = std::chrono::steady_clock::now();
+
+                        std::unique_ptr<FrameSource> source
+                            = openFrameSource(input);
+                        std::unique_ptr<KeypointSink> sink
+                            = openSink(opts, outputFilename(opts, input));
+
+                        Stats stats = stream->process(*source, *sink);
+                        sink->close();
+
+                        DurationMilliseconds inputTime
+                            = std::chrono::steady_clock::now() - inputStart;
+
+                        std::lock_guard<std::mutex> lock(reportMutex);
+                        printStats(std::cout, input, stats, inputTime);
+                        totals += stats;
+
+                    } catch (cl::Error& err) {
+                        std::lock_guard<std::mutex> lock(reportMutex);
+                        std::cerr << input << ": " << err.what() << " ("
+                                  << err.err() << ")" << std::endl;
+                        failed = true;
+                    } catch (std::exception& err) {
+                        std::lock_guard<std::mutex> lock(reportMutex);
+                        std::cerr << input << ": " << err.what() << std::endl;
+                        failed = true;
+                    }
+                }
+            });
+        }
+
+        for (auto& w: workers)
+            w.join();
+
+        DurationMilliseconds totalTime
+            = std::chrono::steady_clock::now() - startTime;
+
+        if (opts.inputs.size() > 1)
+            printStats(std::cout, "Total", totals, totalTime);
+
+        return failed? 1 : 0;
+
+    } catch (cl::Error& err) {
+        std::cerr << err.what() << " (" << err.err() << ")" << std::endl;
+        return -1;
+    }
+}
+
@@ -0,0 +1,241 @@
+// Copyright (C) 2013 Timothy Gale
+#include "frameSource.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cctype>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef BATCH_WITH_FFMPEG
+#include "avmm/avmm.h"
+#endif
+
+
+
+ImageSequenceFrameSource::ImageSequenceFrameSource
+    (const std::vector<std::string>& filenames)
+ : filenames_(filenames)
+{
+    if (filenames_.empty())
+        throw std::runtime_error("No images in sequence");
+
+    // Take the frame size from the first image
+    cv::Mat first = cv::imread(filenames_[0], 0);
+    if (first.empty())
+        throw std::runtime_error("Could not read " + filenames_[0]);
+
+    width_ = first.cols;
+    height_ = first.rows;
+}
+
+
+size_t ImageSequenceFrameSource::width() const
+{
+    return width_;
+}
+
+
+size_t ImageSequenceFrameSource::height() const
+{
+    return height_;
+}
+
+
+bool ImageSequenceFrameSource::nextFrame(GreyscaleFrame* frame)
+{
+    if (nextIdx_ >= filenames_.size())
+        return false;
+
+    const std::string& filename = filenames_[nextIdx_++];
+
+    // Load as greyscale
+    cv::Mat image = cv::imread(filename, 0);
+    if (image.empty())
+        throw std::runtime_error("Could not read " + filename);
+
+    if (size_t(image.cols) != width_ || size_t(image.rows) != height_)
+        throw std::runtime_error("Image size changed in sequence at "
+                                 + filename);
+
+    frame->width = width_;
+    frame->height = height_;
+    frame->data.resize(width_ * height_);
+
+    // Copy row by row, since the Mat may have padding
+    for (size_t y = 0; y < height_; ++y)
+        std::memcpy(&frame->data[y * width_], image.ptr<uint8_t>(y), width_);
+
+    return true;
+}
+
+
+
+#ifdef BATCH_WITH_FFMPEG
+
+struct VideoFrameSource::Impl {
+    AV::FormatContext formatContext;
+    AV::CodecContext codecContext;
+    SWS::Context swsContext;
+    int stream;
+    bool eof = false;
+    bool drained = false;   // Decoder has given up its last frame
+};
+
+
+VideoFrameSource::VideoFrameSource(const std::string& filename)
+ : impl_(new Impl)
+{
+    impl_->formatContext = AV::FormatContext {filename};
+    impl_->formatContext.findStreamInfo();
+
+    // Get which stream to read and the codec
+    AVCodec* codec;
+    impl_->stream = impl_->formatContext.findBestStream(AVMEDIA_TYPE_VIDEO,
+                                                        -1, -1,
+                                                        &codec);
+
+    // Open a decoding context with the codec
+    impl_->codecContext
+        = impl_->formatContext.getStreamCodecContext(impl_->stream);
+    impl_->codecContext.open(codec);
+
+    // Only luminance is used, so convert straight to greyscale
+    impl_->swsContext = SWS::Context {
+        impl_->codecContext.width(), impl_->codecContext.height(),
+        impl_->codecContext.pixelFormat(),
+        impl_->codecContext.width(), impl_->codecContext.height(),
+        PIX_FMT_GRAY8,
+        SWS_POINT
+    };
+}
+
+
+VideoFrameSource::~VideoFrameSource() = default;
+
+
+size_t VideoFrameSource::width() const
+{
+    return impl_->codecContext.width();
+}
+
+
+size_t VideoFrameSource::height() const
+{
+    return impl_->codecContext.height();
+}
+
+
+bool VideoFrameSource::nextFrame(GreyscaleFrame* frame)
+{
+    while (!impl_->drained) {
+
+        AV::Packet packet;
+
+        // At the end of the file, keep feeding empty packets to flush out
+        // the frames still held by the decoder (B-frames, frame threads)
+        if (!impl_->eof && impl_->formatContext.readFrame(&packet))
+            impl_->eof = true;
+
+        if (!impl_->eof && packet.streamIndex() != impl_->stream)
+            continue;
+
+        AV::Frame decoded;
+        if (!impl_->codecContext.decodeVideo(&decoded, packet)) {
+            if (impl_->eof)
+                impl_->drained = true;
+            continue;
+        }
+
+        AV::Frame grey {int(width()), int(height()), PIX_FMT_GRAY8};
+        impl_->swsContext.scale(&grey, decoded);
+
+        frame->width = width();
+        frame->height = height();
+        frame->data.resize(frame->width * frame->height);
+
+        // Remove the line padding
+        for (size_t y = 0; y < frame->height; ++y)
+            std::memcpy(&frame->data[y * frame->width],
+                        grey.getData() + y * grey.getLinesize(),
+                        frame->width);
+
+        return true;
+    }
+
+    return false;
+}
+
+#endif
+
+
+
+bool isDirectory(const std::string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    return S_ISDIR(info.st_mode);
+}
+
+
+static bool hasImageExtension(const std::string& filename)
+{
+    const std::vector<std::string> extensions = {
+        ".png", ".jpg", ".jpeg", ".bmp", ".pgm", ".ppm", ".tif", ".tiff"
+    };
+
+    size_t dot = filename.rfind('.');
+    if (dot == std::string::npos)
+        return false;
+
+    std::string ext = filename.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return std::find(extensions.begin(), extensions.end(), ext)
+            != extensions.end();
+}
+
+
+std::vector<std::string> listImageFiles(const std::string& directory)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr)
+        throw std::runtime_error("Could not open directory " + directory);
+
+    std::vector<std::string> filenames;
+
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (hasImageExtension(name))
+            filenames.push_back(directory + "/" + name);
+    }
+
+    closedir(dir);
+
+    // Frame order is given by the names
+    std::sort(filenames.begin(), filenames.end());
+
+    return filenames;
+}
+
+
+std::unique_ptr<FrameSource> openFrameSource(const std::string& path)
+{
+    if (isDirectory(path))
+        return std::unique_ptr<FrameSource>
+            (new ImageSequenceFrameSource(listImageFiles(path)));
+
+#ifdef BATCH_WITH_FFMPEG
+    return std::unique_ptr<FrameSource>(new VideoFrameSource(path));
+#else
+    throw std::runtime_error("Built without FFmpeg, so can only read "
+                             "directories of images: " + path);
+#endif
+}
+
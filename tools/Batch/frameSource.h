@@ -0,0 +1,90 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+
+struct GreyscaleFrame {
+    // An 8-bit greyscale frame, tightly packed (stride == width)
+    size_t width = 0, height = 0;
+    std::vector<uint8_t> data;
+};
+
+
+class FrameSource {
+    // Something that produces a sequence of greyscale frames, all of the
+    // same size, without needing a window or an OpenGL context.
+
+public:
+    virtual ~FrameSource() = default;
+
+    virtual size_t width() const = 0;
+    virtual size_t height() const = 0;
+    // Dimensions of every frame that will be produced
+
+    virtual bool nextFrame(GreyscaleFrame* frame) = 0;
+    // Fill frame with the next one in the sequence.  Returns false once
+    // there are no more frames.
+};
+
+
+class ImageSequenceFrameSource : public FrameSource {
+    // Reads a list of still images, in order, as if they were frames of
+    // a video.  The first image fixes the size; any later image of a
+    // different size causes a std::runtime_error.
+
+public:
+    ImageSequenceFrameSource(const std::vector<std::string>& filenames);
+
+    size_t width() const;
+    size_t height() const;
+
+    bool nextFrame(GreyscaleFrame* frame);
+
+private:
+    std::vector<std::string> filenames_;
+    size_t nextIdx_ = 0;
+
+    size_t width_ = 0, height_ = 0;
+};
+
+
+#ifdef BATCH_WITH_FFMPEG
+class VideoFrameSource : public FrameSource {
+    // Decodes the best video stream of a file through avmm, converting
+    // each frame to greyscale.
+
+public:
+    VideoFrameSource(const std::string& filename);
+    ~VideoFrameSource();
+
+    size_t width() const;
+    size_t height() const;
+
+    bool nextFrame(GreyscaleFrame* frame);
+
+private:
+    // Hide avmm (and so the FFmpeg headers) from users of this header
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+#endif
+
+
+std::vector<std::string> listImageFiles(const std::string& directory);
+// Returns the image files (by extension) in directory, sorted by name
+
+bool isDirectory(const std::string& path);
+
+std::unique_ptr<FrameSource> openFrameSource(const std::string& path);
+// Opens a directory as an image sequence, and anything else as a video
+// (if FFmpeg support was compiled in).  Throws std::runtime_error if the
+// input can't be opened.
+
+
+#endif
+
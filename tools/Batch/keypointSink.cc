@@ -0,0 +1,76 @@
+// Copyright (C) 2013 Timothy Gale
+#include "keypointSink.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+
+HDFKeypointSink::HDFKeypointSink(const std::string& filename,
+                                 size_t descriptorLength,
+                                 HDFWriter::DescriptorFormat format,
+                                 const HDFWriter::Storage& storage)
+ : writer_(filename, descriptorLength, format, storage)
+{
+}
+
+
+void HDFKeypointSink::append(size_t numKeypoints, const float* keypoints,
+                             const void* descriptors)
+{
+    writer_.append(numKeypoints, keypoints, descriptors);
+}
+
+
+void HDFKeypointSink::close()
+{
+    writer_.close();
+}
+
+
+
+StreamKeypointSink::StreamKeypointSink(const std::string& filename,
+                                       size_t descriptorLength,
+                                       HDFWriter::DescriptorFormat format)
+ : writer_(filename, descriptorLength, format)
+{
+}
+
+
+void StreamKeypointSink::append(size_t numKeypoints, const float* keypoints,
+                                const void* descriptors)
+{
+    writer_.append(numKeypoints, keypoints, descriptors);
+}
+
+
+
+BinaryKeypointSink::BinaryKeypointSink(const std::string& filename,
+                                       size_t descriptorLength)
+ : file_(filename, std::ios::binary | std::ios::trunc),
+   descriptorLength_(descriptorLength)
+{
+    if (!file_)
+        throw std::runtime_error("Could not open " + filename);
+
+    uint64_t header = descriptorLength;
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+
+void BinaryKeypointSink::append(size_t numKeypoints, const float* keypoints,
+                                const void* descriptors)
+{
+    uint64_t count = numKeypoints;
+    file_.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    if (numKeypoints > 0) {
+        file_.write(reinterpret_cast<const char*>(keypoints),
+                    sizeof(float) * 4 * numKeypoints);
+        file_.write(static_cast<const char*>(descriptors),
+                    sizeof(float) * descriptorLength_ * numKeypoints);
+    }
+
+    if (!file_)
+        throw std::runtime_error("Failed writing keypoint stream");
+}
+
@@ -0,0 +1,88 @@
+// Copyright (C) 2013 Timothy Gale
+#ifndef KEYPOINTSINK_H
+#define KEYPOINTSINK_H
+
+#include <string>
+#include <fstream>
+
+#include "hdf5/bufferedHDFWriter.h"
+#include "KeypointStream/keypointStream.h"
+
+
+class KeypointSink {
+    // Destination for the keypoints and descriptors of successive frames.
+    // Each input stream owns one sink, so implementations need not be
+    // thread safe with respect to themselves.
+
+public:
+    virtual ~KeypointSink() = default;
+
+    virtual void append(size_t numKeypoints, const float* keypoints,
+                        const void* descriptors) = 0;
+    // Add a frame.  keypoints holds four floats per keypoint; descriptors
+    // holds descriptorLength elements per keypoint (floats, or bytes for
+    // quantised codes).
+
+    virtual void close() {}
+    // Finish writing.  Sinks that write in the background may only report
+    // errors here.
+};
+
+
+class HDFKeypointSink : public KeypointSink {
+    // Writes using BufferedHDFWriter, so the output has the same layout as
+    // from displayVideoDTCWT, but frames are written in batches from a
+    // background thread.  Its writes (from any instance) are serialised
+    // on hdfMutex().
+
+public:
+    HDFKeypointSink(const std::string& filename, size_t descriptorLength,
+                    HDFWriter::DescriptorFormat format = HDFWriter::Float32,
+                    const HDFWriter::Storage& storage = HDFWriter::Storage());
+
+    void append(size_t numKeypoints, const float* keypoints,
+                const void* descriptors);
+    void close();
+
+private:
+    BufferedHDFWriter writer_;
+};
+
+
+class StreamKeypointSink : public KeypointSink {
+    // Writes a keypoint stream (see KeypointStreamWriter), which other
+    // processes can read while it is being written
+
+public:
+    StreamKeypointSink(const std::string& filename, size_t descriptorLength,
+                       HDFWriter::DescriptorFormat format
+                           = HDFWriter::Float32);
+
+    void append(size_t numKeypoints, const float* keypoints,
+                const void* descriptors);
+
+private:
+    KeypointStreamWriter writer_;
+};
+
+
+class BinaryKeypointSink : public KeypointSink {
+    // Writes a raw stream: a header of the descriptor length as a uint64,
+    // then for each frame a uint64 keypoint count followed by the keypoint
+    // floats then the descriptor floats (native endianness).  Only float
+    // descriptors can be written.
+
+public:
+    BinaryKeypointSink(const std::string& filename, size_t descriptorLength);
+
+    void append(size_t numKeypoints, const float* keypoints,
+                const void* descriptors);
+
+private:
+    std::ofstream file_;
+    size_t descriptorLength_;
+};
+
+
+#endif
+
@@ -467,6 +467,22 @@ namespace AV {
     }
 
 
+    Frame Frame::clone() const
+    {
+        Frame copy {getWidth(), getHeight(), pixelFormat()};
+
+        av_picture_copy(reinterpret_cast<AVPicture*>(copy.frame_),
+                        reinterpret_cast<const AVPicture*>(frame_),
+                        pixelFormat(), getWidth(), getHeight());
+
+        copy.frame_->pts = frame_->pts;
+        copy.frame_->pkt_pos = frame_->pkt_pos;
+        copy.frame_->best_effort_timestamp = frame_->best_effort_timestamp;
+
+        return copy;
+    }
+
+
     void Frame::writePPM() const
     {
         std::ofstream out("test.ppm");
@@ -81,6 +81,12 @@ namespace AV {
         void deinterlace();
         // Deinterlace the picture
 
+        Frame clone() const;
+        // Deep copy into a newly allocated buffer owned by the returned
+        // frame.  Decoded frames point into the decoder's own buffers,
+        // which are reused by the next decode, so this is needed before
+        // handing one to another thread.
+
         // Temporary debugging output to tmp.ppm
         void writePPM() const;
 
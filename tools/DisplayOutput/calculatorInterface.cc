@@ -13,8 +13,10 @@
 
 CalculatorInterface::CalculatorInterface(cl::Context& context,
                                          const cl::Device& device,
-                                         int width, int height)
+                                         int width, int height,
+                                 LumaToImageBuffer::Deinterlace deinterlace)
  : width_(width), height_(height),
+   context_(context), device_(device),
    calculator_(context, device, width, height),
    cq_(context, device, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE),
    greyscaleToRGBA_(context, {device}),
@@ -25,6 +27,7 @@ CalculatorInterface::CalculatorInterface(cl::Context& context,
    imageGreyscale_(context, CL_MEM_READ_WRITE, 
                    cl::ImageFormat(CL_LUMINANCE, CL_UNORM_INT8),
                    width, height),
+   deinterlace_(deinterlace),
    bufferGreyscale_(context, CL_MEM_READ_WRITE,
                     width, height, 16, 32),
    imageToImageBuffer_(context, {device}),
@@ -55,6 +58,9 @@ CalculatorInterface::CalculatorInterface(cl::Context& context,
 
     }
 
+    // The energy map is displayed, so it has to actually be calculated
+    calculator_.setFusedDetection(false);
+
     // Set up for the energy map texture
     energyMapTexture_ = GLTexture(GL_RGBA8, 
         calculator_.getEnergyMapLevel2().getImageInfo<CL_IMAGE_WIDTH>(),
@@ -97,6 +103,59 @@ void CalculatorInterface::processImage(const void* data, size_t length)
     imageToImageBuffer_(cq_, imageGreyscale_, bufferGreyscale_,
                         {imageGreyscaleDone_}, &bufferGreyscaleDone_);
 
+    processBuffer();
+}
+
+
+void CalculatorInterface::processLuma(const void* data, size_t stride,
+                                      int bitDepth, bool interlaced,
+                                      CalculatorInterface* previous)
+{
+    LumaToImageBuffer& toImageBuffer
+        = interlaced? lumaToImageBuffer_ : progressiveLumaToImageBuffer_;
+
+    // Compile for the sample size when first needed
+    if (toImageBuffer.bitDepth() != bitDepth)
+        toImageBuffer = LumaToImageBuffer(context_, {device_}, bitDepth,
+                                          interlaced? deinterlace_
+                                                    : LumaToImageBuffer::None);
+
+    const size_t length = stride * height_ * toImageBuffer.bytesPerSample();
+
+    if (lumaBuffer_() == nullptr 
+            || lumaBuffer_.getInfo<CL_MEM_SIZE>() < length)
+        lumaBuffer_ = cl::Buffer(context_, CL_MEM_READ_ONLY, length);
+
+    // Upload the plane as it is, stride and all.  As for processImage,
+    // this doesn't block, so the data must stay valid until done.
+    cq_.enqueueWriteBuffer(lumaBuffer_, CL_FALSE, 0, length, data,
+                           &lumaBufferReaders_, &lumaBufferDone_);
+    lumaBufferReaders_.clear();
+
+    // Convert to float, filling the padding (and deinterlacing).  Compare
+    // against the previous frame if there is a usable one.
+    if (previous != nullptr && previous != this
+            && previous->lumaBuffer_() != nullptr
+            && previous->lumaBuffer_.getInfo<CL_MEM_SIZE>() >= length) {
+
+        toImageBuffer(cq_, lumaBuffer_, previous->lumaBuffer_,
+                      stride, bufferGreyscale_, 1.0f,
+                      {lumaBufferDone_, previous->lumaBufferDone_},
+                      &bufferGreyscaleDone_);
+
+        // Make sure previous doesn't overwrite its frame while we use it
+        previous->lumaBufferReaders_.push_back(bufferGreyscaleDone_);
+
+    } else
+        toImageBuffer(cq_, lumaBuffer_, stride, bufferGreyscale_, 1.0f,
+                      {lumaBufferDone_}, &bufferGreyscaleDone_);
+
+    processBuffer();
+}
+
+
+void CalculatorInterface::processBuffer()
+{
     calculator_(bufferGreyscale_, {bufferGreyscaleDone_});
 
     // Go over to using the OpenGL objects.  glFinish should already have
@@ -113,8 +172,8 @@ void CalculatorInterface::processImage(const void* data, size_t length)
     cq_.enqueueAcquireGLObjects(&glTransferObjs, nullptr, &glObjsAcquired);
 
     // Convert the input image to RGBA for display
-    greyscaleToRGBA_(cq_, imageGreyscale_, imageTextureCL_, 1.0f,
-                     {imageGreyscaleDone_, glObjsAcquired}, 
+    greyscaleToRGBA_(cq_, bufferGreyscale_, imageTextureCL_, 1.0f,
+                     {bufferGreyscaleDone_, glObjsAcquired}, 
                      &imageTextureCLDone_);
 
     auto levels = calculator_.levelOutputs();
@@ -270,7 +329,7 @@ size_t CalculatorInterface::getNumKeypointLocations()
 size_t CalculatorInterface::getNumFloatsPerKeypointLocation()
 {
     // For the list of keypoint locations, returns how many floating points
-    // each keypoint entry contains.  The format is (x, y, scale), but
+    // each keypoint entry contains.  The format is (x, y, scale, strength), but
     // might then be padded out.  x and y are relative to the centre of the
     // image; scale is the radius of the keypoint.
 
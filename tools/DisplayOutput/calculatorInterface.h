@@ -12,6 +12,7 @@
 #include <array>
 
 #include "Filter/ImageToImageBuffer/imageToImageBuffer.h"
+#include "Filter/LumaToImageBuffer/lumaToImageBuffer.h"
 
 // HACK: Ubuntu always claims to be 1.2 irrespective of what driver supports.
 //#if defined(CL_VERSION_1_2)
@@ -29,6 +30,9 @@ class CalculatorInterface {
 private:
     unsigned int width_, height_;
 
+    cl::Context context_;
+    cl::Device device_;
+
     Calculator calculator_;
 
     // For interop OpenGL/OpenCL
@@ -64,6 +68,20 @@ private:
     // To convert above into below:
     ImageToImageBuffer imageToImageBuffer_;
 
+    // Alternatively, a raw luma plane goes straight into a buffer
+    cl::Buffer lumaBuffer_;
+    cl::Event lumaBufferDone_;
+
+    // Other interfaces may be reading lumaBuffer_ as their previous frame;
+    // these need to finish before it's overwritten
+    std::vector<cl::Event> lumaBufferReaders_;
+
+    LumaToImageBuffer::Deinterlace deinterlace_;
+
+    // and is converted by one of these, for interlaced and progressive
+    // frames:
+    LumaToImageBuffer lumaToImageBuffer_, progressiveLumaToImageBuffer_;
+
     // And also copied into a buffer for the DTCWT input
     ImageBuffer<cl_float> bufferGreyscale_;
     cl::Event bufferGreyscaleDone_;
@@ -85,9 +103,22 @@ public:
 
     CalculatorInterface(cl::Context& context,
                         const cl::Device& device,
-                        int width, int height);
+                        int width, int height,
+                        LumaToImageBuffer::Deinterlace deinterlace
+                            = LumaToImageBuffer::None);
+    // deinterlace applies to processLuma's interlaced frames only
 
     void processImage(const void* data, size_t length);
+    // Process an 8-bit greyscale image, width by height, tightly packed
+
+    void processLuma(const void* data, size_t stride, int bitDepth = 8,
+                     bool interlaced = false,
+                     CalculatorInterface* previous = nullptr);
+    // Process a decoder's luma plane directly.  stride is in samples;
+    // samples of more than 8 bits are stored in 16.  Only interlaced
+    // frames are deinterlaced.  previous is the interface given the
+    // preceding frame, for motion-adaptive deinterlacing to compare
+    // against.
 
     bool isDone();
     void waitUntilDone();
@@ -105,6 +136,11 @@ public:
 
     Calculator& getCalculator();
 
+private:
+
+    void processBuffer();
+    // Run the calculator on bufferGreyscale_, and convert for display
+
 };
 
 
@@ -10,6 +10,8 @@
 #include "avmm/avmm.h"
 
 #include "hdf5/hdfwriter.h"
+#include "util/boundedQueue.h"
+#include "Scheduling/deadlineScheduler.h"
 
 #include <chrono>
 #include <queue>
@@ -18,6 +20,8 @@
 #include <tuple>
 #include <stdexcept>
 #include <memory>
+#include <thread>
+#include <string>
 
 
 std::tuple<cl::Platform, std::vector<cl::Device>, cl::Context> 
@@ -27,40 +31,111 @@ typedef std::chrono::duration<double, std::milli>
     DurationMilliseconds;
 
 
-void writeResults(cl::CommandQueue& cq, Calculator& cal, int numKeypoints,
-                  HDFWriter& output)
+struct KeypointResults {
+    // Everything read back for one frame, waiting to be written
+    size_t numKeypoints;
+    std::vector<cl_float> locations;
+    std::vector<cl_float> descriptors;
+};
+
+
+std::unique_ptr<KeypointResults>
+    readResults(cl::CommandQueue& cq, Calculator& cal, size_t numKeypoints)
 {
+    std::unique_ptr<KeypointResults> results {new KeypointResults};
+    results->numKeypoints = numKeypoints;
+
     // Read the locations
-    std::vector<cl_float> locations(4*numKeypoints);
-    cq.enqueueReadBuffer(cal.keypointLocations(), CL_FALSE, 0, 
-                         sizeof(cl_float) * locations.size(), 
-                         &locations[0]);
-
-    // Read the descriptors
-    std::vector<cl_float> descriptors(2*6*14*numKeypoints);
-    cq.enqueueReadBuffer(cal.keypointDescriptors(), CL_FALSE, 0, 
-                         sizeof(cl_float) * descriptors.size(),
-                         &descriptors[0]);
-
-    // Write them all out, when ready
+    results->locations.resize(4*numKeypoints);
+    results->descriptors.resize(2*6*14*numKeypoints);
+
+    if (numKeypoints > 0) {
+        cq.enqueueReadBuffer(cal.keypointLocations(), CL_FALSE, 0, 
+                             sizeof(cl_float) * results->locations.size(), 
+                             &results->locations[0]);
+
+        // Read the descriptors
+        cq.enqueueReadBuffer(cal.keypointDescriptors(), CL_FALSE, 0, 
+                             sizeof(cl_float) * results->descriptors.size(),
+                             &results->descriptors[0]);
+    }
+
     cq.finish();
 
-    output.append(numKeypoints, &locations[0], &descriptors[0]);
+    return results;
+}
+
+
+int lumaBitDepth(PixelFormat format)
+{
+    // Bits per luma sample, if the format stores luma as its first plane
+    // in a way LumaToImageBuffer can read directly; otherwise zero.
+    switch (format) {
+        case PIX_FMT_GRAY8:
+        case PIX_FMT_YUV420P:
+        case PIX_FMT_YUV422P:
+        case PIX_FMT_YUV444P:
+        case PIX_FMT_YUV440P:
+        case PIX_FMT_YUVJ420P:
+        case PIX_FMT_YUVJ422P:
+        case PIX_FMT_YUVJ444P:
+        case PIX_FMT_YUVJ440P:
+        case PIX_FMT_NV12:
+        case PIX_FMT_NV21:
+            return 8;
+
+        case PIX_FMT_YUV420P10LE:
+        case PIX_FMT_YUV422P10LE:
+        case PIX_FMT_YUV444P10LE:
+            return 10;
+
+        default:
+            return 0;
+    }
+}
+
+
+struct TimedFrame {
+    // A frame, and when it arrived (was decoded), for judging its age
+    std::shared_ptr<AV::Frame> frame;
+    DeadlineScheduler::Clock::time_point arrival;
+    bool interlaced;        // As flagged by the decoder
+};
+
+
+template <typename T>
+void printQueueStats(std::ostream& os, const std::string& name,
+                     const BoundedQueue<T>& queue)
+{
+    auto stats = queue.stats();
+
+    os << name << ": " << stats.numPushed << " items, "
+       << "max depth " << stats.maxDepth << "/" << queue.capacity()
+       << ", producer stalled " << stats.pushStallMs << "ms"
+       << ", consumer stalled " << stats.popStallMs << "ms\n";
 }
 
 
+
 int main(int argc, char* argv[])
 {
     AV::registerAll();
 
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " VideoFilename [OutputFilename.h5]"
+        std::cerr << "Usage: " << argv[0] 
+                  << " VideoFilename [OutputFilename.h5|-] [DeadlineMs]\n"
+                  << "  With a deadline, stale frames are dropped and "
+                  << "quality reduced to keep up"
                   << std::endl;
 
         return -1;
     }
 
-    bool writeOutput = argc == 3;
+    bool writeOutput = argc >= 3 && std::string(argv[2]) != "-";
+
+    // Live mode: keep latency within a deadline
+    bool useScheduler = argc >= 4;
+    DeadlineScheduler scheduler;
 
     // Initialise the video reader
     AV::FormatContext formatContext {argv[1]};
@@ -72,18 +147,28 @@ int main(int argc, char* argv[])
                                               -1, -1, 
                                               &codec);
 
-    // Open a decoding context with the codec
+    // Open a decoding context with the codec, letting it decode several
+    // frames at once on its own threads
     AV::CodecContext codecContext 
         {formatContext.getStreamCodecContext(stream)};
+    codecContext.get()->thread_count = 0;   // Automatic
+    codecContext.get()->thread_type = FF_THREAD_FRAME;
     codecContext.open(codec);
 
-    SWS::Context swsContext {
-        codecContext.width(), codecContext.height(),
-        codecContext.pixelFormat(),
-        codecContext.width(), codecContext.height(),
-        PIX_FMT_YUV422P,
-        SWS_POINT
-    };
+    // Planar YUV can have its luma plane uploaded as it is; anything else
+    // is converted to greyscale on the CPU first
+    const int lumaDepth = lumaBitDepth(codecContext.pixelFormat());
+    const bool convertOnCPU = lumaDepth == 0;
+
+    SWS::Context swsContext;
+    if (convertOnCPU)
+        swsContext = SWS::Context {
+            codecContext.width(), codecContext.height(),
+            codecContext.pixelFormat(),
+            codecContext.width(), codecContext.height(),
+            PIX_FMT_GRAY8,
+            SWS_POINT
+        };
 
     const size_t width = codecContext.width(), 
                  height = codecContext.height();
@@ -100,13 +185,18 @@ int main(int argc, char* argv[])
    
     viewer.initBuffers();
 
-    CalculatorInterface ci1(context, devices[0], width, height);   
-    CalculatorInterface ci2(context, devices[0], width, height);   
-    CalculatorInterface ci3(context, devices[0], width, height);   
+    // Deinterlacing is done on the device, while uploading, for the frames
+    // the decoder flags as interlaced; progressive ones are left alone
+    const auto deinterlace = LumaToImageBuffer::MotionAdaptive;
+    CalculatorInterface ci1(context, devices[0], width, height, deinterlace);
+    CalculatorInterface ci2(context, devices[0], width, height, deinterlace);
+    CalculatorInterface ci3(context, devices[0], width, height, deinterlace);
+
+    // Which was given the last frame
+    CalculatorInterface* previous = nullptr;
 
     std::queue<CalculatorInterface*> ready;
-    std::queue<std::pair<CalculatorInterface*, std::shared_ptr<AV::Frame>>> 
-        processing;
+    std::queue<std::pair<CalculatorInterface*, TimedFrame>> processing;
     ready.push(&ci1);
     ready.push(&ci2);
     ready.push(&ci3);
@@ -114,64 +204,159 @@ int main(int argc, char* argv[])
     // Set up the keypoint transfer format
     viewer.setNumFloatsPerKeypoint(ci1.getNumFloatsPerKeypointLocation());
 
+    if (useScheduler) {
+        Calculator& cal = ci1.getCalculator();
+        scheduler = DeadlineScheduler(
+            DeadlineScheduler::Milliseconds(std::stod(argv[3])),
+            DeadlineScheduler::defaultQualityLevels(
+                cal.numDetectionLevels(), cal.peakThreshold(),
+                cal.keypointLimit())
+        );
+    }
+
     HDFWriter fileOutput;
     
     if (writeOutput) 
         fileOutput = HDFWriter(argv[2], 2*6*14);
 
 
-    auto prevTime = std::chrono::system_clock::now();
-    int n = 0;
+    // The pipeline: decoder thread -> conversion thread -> this thread 
+    // (which owns the GL context, so does the OpenCL work) -> writer
+    // thread.  Each stage blocks when the queue after it is full, so
+    // nothing runs unboundedly ahead.
+    BoundedQueue<TimedFrame> decodedFrames(4), convertedFrames(4);
+    BoundedQueue<std::unique_ptr<KeypointResults>> resultsToWrite(8);
 
-    bool eof = false;
+    std::thread decoder([&] () {
+        try {
+            bool eof = false;
 
-    while (1) {
+            while (true) {
 
+                AV::Packet packet;
 
-        if (!eof && !ready.empty()) {
-            
-            // Acquire the new image
+                // At the end of the file, keep feeding empty packets to
+                // flush out the frames still held by the decoder threads
+                if (!eof && formatContext.readFrame(&packet))
+                    eof = true;
 
-            AV::Packet packet;
+                if (!eof && packet.streamIndex() != stream)
+                    continue;
 
-            // Check for end of file
-            if (formatContext.readFrame(&packet)) {
-                eof = true;
-                continue;
-            }
+                AV::Frame frame;
 
+                if (codecContext.decodeVideo(&frame, packet)) {
 
-            if (packet.get()->stream_index == stream) {
+                    // The decoder reuses the frame's buffer, so take a copy
+                    TimedFrame owned = {
+                        std::shared_ptr<AV::Frame> {
+                            new AV::Frame {frame.clone()}
+                        },
+                        DeadlineScheduler::Clock::now(),
+                        frame.get()->interlaced_frame != 0
+                    };
 
-                AV::Frame frame;
+                    if (!decodedFrames.push(std::move(owned)))
+                        break;
 
-                if (codecContext.decodeVideo(&frame, packet)) {
+                } else if (eof)
+                    break;
+            }
+        } catch (std::exception& err) {
+            std::cerr << "Decoding: " << err.what() << std::endl;
+        }
+
+        decodedFrames.close();
+    });
 
-                    frame.deinterlace();
+    std::thread converter([&] () {
+        try {
+            TimedFrame frame;
 
+            while (decodedFrames.pop(&frame)) {
+
+                if (convertOnCPU) {
                     std::shared_ptr<AV::Frame>
                         formattedFrame {
                             new AV::Frame {
                                 codecContext.width(), 
                                 codecContext.height(),
-                                PIX_FMT_YUV422P
+                                PIX_FMT_GRAY8
                             }
                         };
 
-                    swsContext.scale(&*formattedFrame, frame);
+                    swsContext.scale(&*formattedFrame, *frame.frame);
+                    frame.frame = formattedFrame;
+                }
+
+                if (!convertedFrames.push(std::move(frame)))
+                    break;
+            }
+        } catch (std::exception& err) {
+            std::cerr << "Converting: " << err.what() << std::endl;
+        }
+
+        convertedFrames.close();
+    });
+
+    std::thread writer([&] () {
+        std::unique_ptr<KeypointResults> results;
+
+        while (resultsToWrite.pop(&results))
+            fileOutput.append(results->numKeypoints,
+                              results->locations.data(),
+                              results->descriptors.data());
+    });
+
+
+    auto prevTime = std::chrono::system_clock::now();
+    int n = 0;
+
+    bool eof = false;
 
-                    // Set it being processed
-                    ready.front()->processImage(formattedFrame->getData(),
-                                            formattedFrame->getWidth() 
-                                             * formattedFrame->getHeight());
+    while (1) {
 
-                    // Transfer the calculator to the processing queue
-                    processing.push(std::make_pair(ready.front(), 
-                                                   formattedFrame));
-                    ready.pop();
 
+        if (!eof && !ready.empty()) {
+            
+            // Acquire the new image, if one is waiting
+            TimedFrame formattedFrame;
+
+            if (convertedFrames.tryPop(&formattedFrame)) {
+
+                // Too old to be worth doing?
+                if (useScheduler
+                        && !scheduler.shouldProcess(formattedFrame.arrival))
+                    continue;
+
+                // Use the quality level the scheduler currently allows
+                if (useScheduler) {
+                    const auto& q = scheduler.quality();
+                    Calculator& cal = ready.front()->getCalculator();
+                    cal.setNumDetectionLevels(q.numLevels);
+                    cal.setPeakThreshold(q.threshold);
+                    cal.setKeypointLimit(q.maxNumKeypoints);
                 }
-            }
+
+                // Set it being processed
+                // Only the luma plane is needed
+                const int depth = convertOnCPU? 8 : lumaDepth;
+                const size_t stride = formattedFrame.frame->getLinesize()
+                                        / (depth > 8? 2 : 1);
+
+                ready.front()->processLuma(formattedFrame.frame->getData(),
+                                           stride, depth,
+                                           formattedFrame.interlaced,
+                                           previous);
+                previous = ready.front();
+
+                // Transfer the calculator to the processing queue
+                processing.push(std::make_pair(ready.front(), 
+                                               formattedFrame));
+                ready.pop();
+
+            } else if (convertedFrames.isClosed())
+                eof = true;
 
         }
 
@@ -195,15 +380,24 @@ int main(int argc, char* argv[])
                 viewer.setKeypointLocations(ci->getKeypointLocations(),
                                             numKPs);
 
-                // Write to file
+                // Hand over to be written to file
                 if (writeOutput)
-                    writeResults(cq, ci->getCalculator(), numKPs, fileOutput);
+                    resultsToWrite.push(readResults(cq, ci->getCalculator(),
+                                                    numKPs));
 
                 viewer.update();
 
 
                 // Transfer to the ready queue
                 ready.push(ci);
+
+                if (useScheduler) {
+                    scheduler.frameDone(processing.front().second.arrival);
+
+                    if (n % 100 == 0)
+                        scheduler.writeMetrics(std::cerr);
+                }
+
                 processing.pop();
                 
                 auto newTime = std::chrono::system_clock::now();
@@ -214,7 +408,11 @@ int main(int argc, char* argv[])
                 std::cout << n++ << " " << numKPs 
                                  << " " << 
                         DurationMilliseconds(newTime - prevTime).count()
-                                 << "ms\n";
+                                 << "ms"
+                                 << " queues " << decodedFrames.depth()
+                                 << " " << convertedFrames.depth()
+                                 << " " << resultsToWrite.depth()
+                                 << "\n";
 
                 prevTime = newTime;
 
@@ -228,6 +426,23 @@ int main(int argc, char* argv[])
             break;
     }
 
+    // Stop reading input (in case we're finishing early), but let
+    // everything already read back be written out
+    decodedFrames.cancel();
+    convertedFrames.cancel();
+    resultsToWrite.close();
+
+    decoder.join();
+    converter.join();
+    writer.join();
+
+    printQueueStats(std::cout, "Decoded frames", decodedFrames);
+    printQueueStats(std::cout, "Converted frames", convertedFrames);
+    printQueueStats(std::cout, "Results to write", resultsToWrite);
+
+    if (useScheduler)
+        scheduler.writeMetrics(std::cout);
+
     return 0;
 }
 
@@ -0,0 +1,185 @@
+// Copyright (C) 2013 Timothy Gale
+//
+// Builds or extends an approximate nearest-neighbour index over the
+// descriptors in an HDF5 file written by HDFWriter.  Entry ids are the
+// descriptor's row, which also indexes the keypoints table, and the frames
+// table says which frame it came from.
+//
+// If the index already exists, only the rows after those it holds are
+// added, so running this again as frames are appended keeps it up to date.
+// Only float32 descriptors can be indexed; files of quantised codes are
+// refused.
+
+#include "Index/ivfpqIndex.h"
+#include "hdf5/hdfreader.h"
+
+#include <H5Cpp.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <unistd.h>
+
+
+struct Options {
+    std::string input, index;
+    size_t numLists = 256;
+    size_t numSubquantisers = 21;
+    size_t numIterations = 10;
+    size_t numTrainingSamples = 20000;
+    size_t blockSize = 10000;
+};
+
+
+void printUsage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options] DESCRIPTORS.h5 INDEX\n"
+              << "  Creates INDEX if it doesn't exist, training it on a\n"
+              << "  sample of the descriptors, then adds any descriptors\n"
+              << "  not yet in it.\n\n"
+              << "Options (only used when creating):\n"
+              << "  --lists N          Coarse centroids (256)\n"
+              << "  --subquantisers N  Bytes per descriptor (21)\n"
+              << "  --iterations N     k-means iterations (10)\n"
+              << "  --train N          Descriptors to train on (20000)\n";
+}
+
+
+template <typename T>
+T readValue(const std::string& option, const char* str)
+{
+    std::istringstream ss(str);
+    T val;
+    ss >> val;
+
+    if (ss.fail() || !ss.eof())
+        throw std::runtime_error("Bad value for " + option + ": " + str);
+
+    return val;
+}
+
+
+Options parseOptions(int argc, char* argv[])
+{
+    Options opts;
+    std::vector<std::string> positional;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        if (arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+
+        if (n + 1 >= argc)
+            throw std::runtime_error("Missing value for " + arg);
+        const char* value = argv[++n];
+
+        if (arg == "--lists")
+            opts.numLists = readValue<size_t>(arg, value);
+        else if (arg == "--subquantisers")
+            opts.numSubquantisers = readValue<size_t>(arg, value);
+        else if (arg == "--iterations")
+            opts.numIterations = readValue<size_t>(arg, value);
+        else if (arg == "--train")
+            opts.numTrainingSamples = readValue<size_t>(arg, value);
+        else
+            throw std::runtime_error("Unknown option " + arg);
+    }
+
+    if (positional.size() != 2)
+        throw std::runtime_error("Need a descriptors file and an index");
+
+    opts.input = positional[0];
+    opts.index = positional[1];
+
+    return opts;
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    try {
+        opts = parseOptions(argc, argv);
+    } catch (std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    try {
+
+        HDFReader descriptors(opts.input);
+
+        if (descriptors.format() != HDFWriter::Float32)
+            throw std::runtime_error(opts.input + " holds "
+                    + HDFWriter::formatName(descriptors.format())
+                    + " descriptor codes; only float32 descriptors can "
+                      "be indexed");
+
+        const hsize_t numRows = descriptors.numKeypoints(),
+                      rowLength = descriptors.descriptorLength();
+
+        std::unique_ptr<IVFPQIndex> index;
+
+        if (access(opts.index.c_str(), F_OK) == 0) {
+
+            index.reset(new IVFPQIndex(opts.index));
+
+            if (index->params().dimension != rowLength)
+                throw std::runtime_error("Index is for descriptors of "
+                                         "a different length");
+        } else {
+
+            // Train on rows spread evenly through the file
+            const size_t numSamples = std::min<hsize_t>
+                                        (opts.numTrainingSamples, numRows);
+            std::vector<float> samples(numSamples * rowLength);
+
+            for (size_t n = 0; n < numSamples; ++n)
+                descriptors.readDescriptorRows(n * numRows / numSamples, 1,
+                                               &samples[n * rowLength]);
+
+            IVFPQIndex::Params params = {rowLength, opts.numLists,
+                                         opts.numSubquantisers,
+                                         opts.numIterations};
+
+            std::cout << "Training on " << numSamples << " descriptors"
+                      << std::endl;
+            index.reset(new IVFPQIndex(opts.index, params,
+                                       samples.data(), numSamples));
+        }
+
+        const hsize_t first = index->size();
+        std::vector<float> block(opts.blockSize * rowLength);
+
+        for (hsize_t row = first; row < numRows; row += opts.blockSize) {
+            const hsize_t num = std::min<hsize_t>(opts.blockSize,
+                                                  numRows - row);
+            descriptors.readDescriptorRows(row, num, block.data());
+            index->add(block.data(), num, row);
+        }
+
+        index->flush();
+
+        std::cout << "Added " << (numRows - first) << " descriptors; "
+                  << index->size() << " in " << index->numSegments()
+                  << " segments" << std::endl;
+
+    } catch (H5::Exception& err) {
+        std::cerr << "HDF5 error: " << err.getDetailMsg() << std::endl;
+        return -1;
+    } catch (std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
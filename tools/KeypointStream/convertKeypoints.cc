@@ -0,0 +1,195 @@
+// Copyright (C) 2013 Timothy Gale
+//
+// Converts keypoints and descriptors between the HDF5 layout HDFWriter
+// writes and a keypoint stream (see KeypointStreamWriter), either way.
+// Which way is decided by what the input turns out to be.  Descriptors
+// keep their format; streams can't store reduced precision, so half or
+// scaled HDF5 descriptors come out as full floats.
+//
+// With --follow, a stream being written is followed until no new frames
+// have arrived for that many seconds.
+
+#include "KeypointStream/keypointStream.h"
+#include "hdf5/hdfreader.h"
+#include "hdf5/bufferedHDFWriter.h"
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <chrono>
+#include <memory>
+
+
+struct Options {
+    std::string input, output;
+    size_t blockFrames = 64;
+    double followSeconds = 0.;
+    std::string compression = "none";
+};
+
+
+void printUsage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options] INPUT OUTPUT\n"
+              << "  Converts an HDF5 keypoint file to a keypoint stream,\n"
+              << "  or a keypoint stream to an HDF5 file.\n\n"
+              << "Options:\n"
+              << "  --block N          Frames read at a time (64)\n"
+              << "  --follow SECONDS   Keep reading a stream until it has\n"
+              << "                     been idle this long (0)\n"
+              << "  --compression C    For HDF5 output: none or deflate\n"
+              << "                     (none)\n";
+}
+
+
+template <typename T>
+T readValue(const std::string& option, const char* str)
+{
+    std::istringstream ss(str);
+    T val;
+    ss >> val;
+
+    if (ss.fail() || !ss.eof())
+        throw std::runtime_error("Bad value for " + option + ": " + str);
+
+    return val;
+}
+
+
+Options parseOptions(int argc, char* argv[])
+{
+    Options opts;
+    std::vector<std::string> positional;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        if (arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+
+        if (n + 1 >= argc)
+            throw std::runtime_error("Missing value for " + arg);
+        const char* value = argv[++n];
+
+        if (arg == "--block")
+            opts.blockFrames = readValue<size_t>(arg, value);
+        else if (arg == "--follow")
+            opts.followSeconds = readValue<double>(arg, value);
+        else if (arg == "--compression")
+            opts.compression = value;
+        else
+            throw std::runtime_error("Unknown option " + arg);
+    }
+
+    if (positional.size() != 2)
+        throw std::runtime_error("Need an input and an output");
+
+    if (opts.compression != "none" && opts.compression != "deflate")
+        throw std::runtime_error("Compression must be none or deflate");
+
+    if (opts.blockFrames == 0)
+        throw std::runtime_error("Need at least one frame per block");
+
+    opts.input = positional[0];
+    opts.output = positional[1];
+
+    return opts;
+}
+
+
+size_t streamToHDF(KeypointStreamReader& stream, const Options& opts)
+{
+    HDFWriter::Storage storage;
+    if (opts.compression == "deflate")
+        storage.compression = HDFWriter::Deflate;
+
+    BufferedHDFWriter writer(opts.output, stream.descriptorLength(),
+                             stream.format(), storage);
+
+    const auto idle = std::chrono::milliseconds(
+                         long(opts.followSeconds * 1000.));
+
+    size_t frame = 0;
+    while (true) {
+        for (; frame < stream.numFrames(); ++frame) {
+            KeypointStreamReader::Frame f = stream.frame(frame);
+            writer.append(f.numKeypoints, f.keypoints, f.descriptors);
+        }
+
+        if (opts.followSeconds <= 0.
+         || stream.waitForFrames(frame + 1, idle) <= frame)
+            break;
+    }
+
+    writer.close();
+    return frame;
+}
+
+
+size_t hdfToStream(const Options& opts)
+{
+    HDFReader reader(opts.input);
+    KeypointStreamWriter writer(opts.output, reader.descriptorLength(),
+                                reader.format());
+
+    HDFReader::Stream frames(reader, opts.blockFrames);
+    HDFReader::Frames block;
+
+    while (frames.next(block))
+        for (size_t n = 0; n < block.numFrames(); ++n) {
+            const size_t start = block.keypointStarts[n];
+            writer.append(block.keypointCounts[n],
+                          &block.keypoints[4 * start],
+                          &block.descriptors[reader.descriptorBytes()
+                                              * start]);
+        }
+
+    writer.sync();
+    return writer.numFrames();
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    try {
+        opts = parseOptions(argc, argv);
+    } catch (std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    try {
+
+        // A stream if it opens as one
+        std::unique_ptr<KeypointStreamReader> stream;
+        try {
+            stream.reset(new KeypointStreamReader(opts.input));
+        } catch (std::runtime_error&) {
+        }
+
+        size_t numFrames;
+        if (stream)
+            numFrames = streamToHDF(*stream, opts);
+        else
+            numFrames = hdfToStream(opts);
+
+        std::cout << "Converted " << numFrames << " frames to "
+                  << (stream? "HDF5" : "a keypoint stream") << std::endl;
+
+    } catch (H5::Exception& err) {
+        std::cerr << "HDF5 error: " << err.getDetailMsg() << std::endl;
+        return -1;
+    } catch (std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+